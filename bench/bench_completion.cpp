@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <cz/defer.hpp>
+#include <cz/format.hpp>
+#include <cz/heap.hpp>
+#include <cz/util.hpp>
+#include "bench_runner.hpp"
+#include "core/completion.hpp"
+#include "core/completion_results_channel.hpp"
+#include "custom/config.hpp"
+
+using namespace mag;
+using namespace mag::bench;
+
+/// Generate `count` file paths that look like those in a large repository.
+static void generate_paths(size_t count, cz::String* strings, cz::Vector<size_t>* ends) {
+    const char* directories[] = {"src/", "core/",    "prose/",  "tests/",  "third_party/",
+                                 "lib/", "include/", "render/", "syntax/", "Tokenize/"};
+    const char* names[] = {"completion", "contents", "buffer",  "window", "find_file",
+                           "TokenCache", "render",   "config",  "match",  "diff"};
+    const char* extensions[] = {".cpp", ".hpp", ".c", ".h", ".md", ".txt"};
+
+    Random random;
+    char number[16];
+    ends->reserve_exact(cz::heap_allocator(), count);
+    for (size_t i = 0; i < count; ++i) {
+        size_t depth = 1 + random.below(4);
+        for (size_t d = 0; d < depth; ++d) {
+            cz::Str directory = directories[random.below(10)];
+            strings->reserve(cz::heap_allocator(), directory.len);
+            strings->append(directory);
+        }
+        cz::Str name = names[random.below(10)];
+        cz::Str extension = extensions[random.below(6)];
+        int number_len = snprintf(number, sizeof(number), "%d", (int)random.below(100));
+        strings->reserve(cz::heap_allocator(), name.len + number_len + extension.len);
+        strings->append(name);
+        strings->append({number, (size_t)number_len});
+        strings->append(extension);
+        ends->push(strings->len);
+    }
+}
+
+/// Type `queries` one after another like a user would.
+static void type_queries(Completion_Filter filter,
+                         cz::Str filter_name,
+                         Completion_Engine_Context* engine_context,
+                         const char* const* queries,
+                         size_t queries_len) {
+    Completion_Filter_Context context = {};
+    CZ_DEFER(context.drop());
+
+    char label[64];
+    for (size_t q = 0; q < queries_len; ++q) {
+        engine_context->query.len = 0;
+        engine_context->query.reserve(cz::heap_allocator(), strlen(queries[q]));
+        engine_context->query.append(queries[q]);
+
+        uint64_t start = now_ns();
+        do {
+            filter(/*editor=*/nullptr, &context, engine_context, {}, false);
+        } while (context.incomplete);
+        keep(context.results.len);
+        snprintf(label, sizeof(label), "%.*s \"%s\"", (int)filter_name.len, filter_name.buffer,
+                 queries[q]);
+        report(label, (double)(now_ns() - start) / 1e6, "ms");
+    }
+}
+
+BENCHMARK(fuzzy_completion) {
+    // Measure the whole filter instead of one frame's worth.
+    uint64_t old_budget = custom::completion_filter_budget;
+    custom::completion_filter_budget = 1000000000;
+    CZ_DEFER(custom::completion_filter_budget = old_budget);
+
+    cz::String strings = {};
+    CZ_DEFER(strings.drop(cz::heap_allocator()));
+    cz::Vector<size_t> ends = {};
+    CZ_DEFER(ends.drop(cz::heap_allocator()));
+    generate_paths(1000000, &strings, &ends);
+
+    Completion_Engine_Context engine_context = {};
+    engine_context.init();
+    CZ_DEFER(engine_context.drop());
+    engine_context.results.reserve(ends.len);
+    for (size_t i = 0; i < ends.len; ++i) {
+        size_t start = i == 0 ? 0 : ends[i - 1];
+        engine_context.results.push(strings.slice(start, ends[i]));
+    }
+
+    // The first keystroke checks every result.  Later keystrokes only check previous matches.
+    const char* queries[] = {"", "c", "co", "cor", "core", "core c", "core cm", "core cmp"};
+    const size_t queries_len = sizeof(queries) / sizeof(*queries);
+    type_queries(fuzzy_completion_filter, "fuzzy", &engine_context, queries, queries_len);
+    type_queries(spaces_are_wildcards_completion_filter, "wildcards", &engine_context, queries,
+                 queries_len);
+}
+
+/// Stream `paths` through a channel in chunks like `find_file` does and filter
+/// them each frame.  If `keep_filter_state` then only the new results are checked.
+static void stream_results(cz::Slice<const cz::Str> paths, bool keep_filter_state) {
+    Completion_Results_Channel channel;
+    channel.init();
+    CZ_DEFER(channel.drop());
+
+    std::thread producer([&]() {
+        for (size_t start = 0; start < paths.len; start += 4096) {
+            size_t end = cz::min(paths.len, start + 4096);
+            cz::Vector<cz::Str> chunk = {};
+            chunk.reserve_exact(cz::heap_allocator(), end - start);
+            chunk.append({paths.elems + start, end - start});
+            while (!channel.push(&chunk)) {
+                std::this_thread::yield();
+            }
+        }
+        channel.close();
+    });
+
+    Completion_Engine_Context engine_context = {};
+    engine_context.init();
+    CZ_DEFER(engine_context.drop());
+    engine_context.query = cz::format("co fi");
+
+    Completion_Filter_Context context = {};
+    CZ_DEFER(context.drop());
+
+    uint64_t start = now_ns();
+    uint64_t slowest = 0;
+    size_t frames = 0;
+    while (1) {
+        uint64_t frame_start = now_ns();
+        bool appended = channel.pop_all(&engine_context.results);
+        bool finished = channel.finished();
+        if (appended || context.incomplete) {
+            if (!keep_filter_state) {
+                context.reset();
+            }
+            spaces_are_wildcards_completion_filter(/*editor=*/nullptr, &context, &engine_context,
+                                                   {}, false);
+        }
+        slowest = cz::max(slowest, now_ns() - frame_start);
+        ++frames;
+        if (finished && !context.incomplete) {
+            break;
+        }
+    }
+    producer.join();
+    keep(context.results.len);
+
+    cz::Str mode = keep_filter_state ? "appended" : "refiltered";
+    char label[64];
+    snprintf(label, sizeof(label), "%.*s total", (int)mode.len, mode.buffer);
+    report(label, (double)(now_ns() - start) / 1e6, "ms");
+    snprintf(label, sizeof(label), "%.*s slowest frame", (int)mode.len, mode.buffer);
+    report(label, (double)slowest / 1e6, "ms");
+    snprintf(label, sizeof(label), "%.*s frames", (int)mode.len, mode.buffer);
+    report(label, (double)frames, "frames");
+}
+
+BENCHMARK(completion_streaming) {
+    // Measure the whole filter instead of one frame's worth.
+    uint64_t old_budget = custom::completion_filter_budget;
+    custom::completion_filter_budget = 1000000000;
+    CZ_DEFER(custom::completion_filter_budget = old_budget);
+
+    cz::String strings = {};
+    CZ_DEFER(strings.drop(cz::heap_allocator()));
+    cz::Vector<size_t> ends = {};
+    CZ_DEFER(ends.drop(cz::heap_allocator()));
+    generate_paths(1000000, &strings, &ends);
+
+    cz::Vector<cz::Str> paths = {};
+    CZ_DEFER(paths.drop(cz::heap_allocator()));
+    paths.reserve_exact(cz::heap_allocator(), ends.len);
+    for (size_t i = 0; i < ends.len; ++i) {
+        size_t start = i == 0 ? 0 : ends[i - 1];
+        paths.push(strings.slice(start, ends[i]));
+    }
+
+    stream_results({paths.elems, paths.len}, /*keep_filter_state=*/true);
+    stream_results({paths.elems, paths.len}, /*keep_filter_state=*/false);
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "bench_runner.hpp"
+#include "core/contents.hpp"
+#include "core/movement.hpp"
+
+using namespace mag;
+using namespace mag::bench;
+
+static const size_t sizes_mb[] = {1, 4, 16, 64, 256};
+
+// Compare the backends by running `mag-bench contents` in
+// builds with and without `-DMAG_ROPE_CONTENTS=ON`.
+#ifdef MAG_ROPE_CONTENTS
+static const char backend[] = "rope";
+#else
+static const char backend[] = "vector";
+#endif
+
+/// Fill `contents` with `size` bytes of 64 character lines.
+static void fill_contents(Contents* contents, uint64_t size) {
+    char line[64];
+    for (size_t i = 0; i < sizeof(line) - 1; ++i) {
+        line[i] = 'a' + i % 26;
+    }
+    line[sizeof(line) - 1] = '\n';
+
+    while (contents->len + sizeof(line) <= size) {
+        contents->append({line, sizeof(line)});
+    }
+}
+
+BENCHMARK(contents_lookup) {
+    const size_t lookups = 1000000;
+
+    for (size_t s = 0; s < sizeof(sizes_mb) / sizeof(*sizes_mb); ++s) {
+        Contents contents = {};
+        CZ_DEFER(contents.drop());
+        fill_contents(&contents, sizes_mb[s] << 20);
+
+        char label[64];
+        Random random;
+
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < lookups; ++i) {
+            keep(contents.iterator_at(random.below(contents.len)).index);
+        }
+        snprintf(label, sizeof(label), "%s iterator_at %zuMB", backend, sizes_mb[s]);
+        report(label, (double)(now_ns() - start) / lookups, "ns/op");
+
+        start = now_ns();
+        for (size_t i = 0; i < lookups; ++i) {
+            keep(contents.get_line_number(random.below(contents.len)));
+        }
+        snprintf(label, sizeof(label), "%s get_line_number %zuMB", backend, sizes_mb[s]);
+        report(label, (double)(now_ns() - start) / lookups, "ns/op");
+
+        uint64_t lines = contents.get_line_number(contents.len);
+        start = now_ns();
+        for (size_t i = 0; i < lookups; ++i) {
+            keep(start_of_line_position(contents, 1 + random.below(lines)).position);
+        }
+        snprintf(label, sizeof(label), "%s start_of_line_position %zuMB", backend, sizes_mb[s]);
+        report(label, (double)(now_ns() - start) / lookups, "ns/op");
+
+        start = now_ns();
+        for (size_t i = 0; i < lookups; ++i) {
+            keep((uint8_t)contents.get_once(random.below(contents.len)));
+        }
+        snprintf(label, sizeof(label), "%s get_once %zuMB", backend, sizes_mb[s]);
+        report(label, (double)(now_ns() - start) / lookups, "ns/op");
+    }
+}
+
+BENCHMARK(contents_bulk_edit) {
+    const size_t file_sizes_mb[] = {16, 64, 256};
+    const size_t blob_sizes_mb[] = {1, 16, 100};
+
+    cz::String blob = {};
+    CZ_DEFER(blob.drop(cz::heap_allocator()));
+    blob.reserve_exact(cz::heap_allocator(), 100 << 20);
+    for (size_t i = 0; i < (100 << 20); ++i) {
+        blob.push(i % 64 == 63 ? '\n' : (char)('a' + i % 26));
+    }
+
+    for (size_t f = 0; f < sizeof(file_sizes_mb) / sizeof(*file_sizes_mb); ++f) {
+        Contents contents = {};
+        CZ_DEFER(contents.drop());
+        fill_contents(&contents, file_sizes_mb[f] << 20);
+
+        for (size_t b = 0; b < sizeof(blob_sizes_mb) / sizeof(*blob_sizes_mb); ++b) {
+            uint64_t blob_len = blob_sizes_mb[b] << 20;
+            uint64_t middle = contents.len / 2;
+            char label[64];
+
+            uint64_t start = now_ns();
+            contents.insert(middle, {blob.buffer, blob_len});
+            snprintf(label, sizeof(label), "%s insert %zuMB into %zuMB", backend,
+                     blob_sizes_mb[b], file_sizes_mb[f]);
+            report(label, (double)(now_ns() - start) / 1e6, "ms");
+
+            start = now_ns();
+            contents.remove(middle, blob_len);
+            snprintf(label, sizeof(label), "%s remove %zuMB from %zuMB", backend,
+                     blob_sizes_mb[b], file_sizes_mb[f]);
+            report(label, (double)(now_ns() - start) / 1e6, "ms");
+
+#ifndef MAG_ROPE_CONTENTS
+            // For comparison: shifting the bucket vector once per new bucket
+            // (how `Contents::insert` used to allocate buckets).
+            cz::Vector<cz::Slice<char>> buckets = {};
+            CZ_DEFER(buckets.drop(cz::heap_allocator()));
+            size_t new_buckets = blob_len / 3072;
+            buckets.reserve_exact(cz::heap_allocator(), contents.buckets.len + new_buckets);
+            buckets.insert_slice(0, contents.buckets);
+            start = now_ns();
+            for (size_t i = 0; i < new_buckets; ++i) {
+                buckets.insert(buckets.len / 2, {});
+            }
+            snprintf(label, sizeof(label), "per bucket shift %zuMB into %zuMB", blob_sizes_mb[b],
+                     file_sizes_mb[f]);
+            report(label, (double)(now_ns() - start) / 1e6, "ms");
+#endif
+        }
+    }
+}
+
+BENCHMARK(contents_mid_edit) {
+    const size_t file_sizes_mb[] = {16, 64, 256};
+    const size_t edits = 10000;
+
+    // A paste that overflows its bucket so the buckets after it must be moved.
+    char paste[8192];
+    for (size_t i = 0; i < sizeof(paste); ++i) {
+        paste[i] = i % 64 == 63 ? '\n' : (char)('a' + i % 26);
+    }
+
+    for (size_t f = 0; f < sizeof(file_sizes_mb) / sizeof(*file_sizes_mb); ++f) {
+        Contents contents = {};
+        CZ_DEFER(contents.drop());
+        fill_contents(&contents, file_sizes_mb[f] << 20);
+
+        char label[64];
+        Random random;
+        uint64_t middle = contents.len / 2;
+
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < edits; ++i) {
+            contents.insert(middle + random.below(1 << 20), "x");
+        }
+        snprintf(label, sizeof(label), "%s insert char %zuMB", backend, file_sizes_mb[f]);
+        report(label, (double)(now_ns() - start) / edits, "ns/op");
+
+        start = now_ns();
+        for (size_t i = 0; i < edits; ++i) {
+            contents.insert(middle + random.below(1 << 20), {paste, sizeof(paste)});
+        }
+        snprintf(label, sizeof(label), "%s insert 8KB %zuMB", backend, file_sizes_mb[f]);
+        report(label, (double)(now_ns() - start) / edits, "ns/op");
+
+        start = now_ns();
+        for (size_t i = 0; i < edits; ++i) {
+            contents.remove(middle + random.below(1 << 20), sizeof(paste));
+        }
+        snprintf(label, sizeof(label), "%s remove 8KB %zuMB", backend, file_sizes_mb[f]);
+        report(label, (double)(now_ns() - start) / edits, "ns/op");
+    }
+}
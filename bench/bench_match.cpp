@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "bench_runner.hpp"
+#include "core/contents.hpp"
+#include "core/match.hpp"
+
+using namespace mag;
+using namespace mag::bench;
+
+/// Fill `contents` with `size` bytes of code that never contains the benchmarked queries.
+static void fill_code(Contents* contents, uint64_t size) {
+    cz::Str line = "    int value = compute(123, \"text\");  // A comment.\n";
+    while (contents->len + line.len <= size) {
+        contents->append(line);
+    }
+}
+
+/// Search the entire contents for a query that isn't present.
+static void bench_search(const Contents& contents,
+                         cz::Str label,
+                         cz::Str query,
+                         Case_Handling case_handling,
+                         bool forward) {
+    uint64_t start = now_ns();
+    Contents_Iterator it = forward ? contents.start() : contents.end();
+    bool found = forward ? find_cased(&it, query, case_handling)
+                         : rfind_cased(&it, query, case_handling);
+    double seconds = (double)(now_ns() - start) / 1e9;
+    keep(found + it.position);
+    report(label, (double)contents.len / (1 << 30) / seconds, "GB/s");
+}
+
+BENCHMARK(search) {
+    Contents contents = {};
+    CZ_DEFER(contents.drop());
+    fill_code(&contents, (uint64_t)512 << 20);
+
+    // None of the queries are present so every search scans the entire contents.
+    bench_search(contents, "find 1 char", "#", Case_Handling::CASE_SENSITIVE, true);
+    bench_search(contents, "find", "value(", Case_Handling::CASE_SENSITIVE, true);
+    bench_search(contents, "rfind", "value(", Case_Handling::CASE_SENSITIVE, false);
+    bench_search(contents, "find 1 char cased", "q", Case_Handling::CASE_INSENSITIVE, true);
+    bench_search(contents, "find cased", "Compute(9", Case_Handling::CASE_INSENSITIVE, true);
+    bench_search(contents, "rfind cased", "Compute(9", Case_Handling::CASE_INSENSITIVE, false);
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "bench_runner.hpp"
+#include "core/client.hpp"
+#include "core/command_macros.hpp"
+#include "core/server.hpp"
+#include "render/render.hpp"
+#include "syntax/tokenize_general.hpp"
+
+using namespace mag;
+using namespace mag::bench;
+
+/// Render `frames` frames of a window over a buffer with `cursor_count` cursors.
+static void bench_render_cursors(size_t cursor_count, bool show_marks, size_t frames) {
+    const size_t rows = 100;
+    const size_t cols = 200;
+
+    Server server = {};
+    server.init();
+    CZ_DEFER(server.drop());
+
+    Buffer bench_buffer = create_temp_buffer("bench");
+    bench_buffer.read_only = false;
+    server.editor.create_buffer(bench_buffer);
+
+    Client client = server.make_client();
+    CZ_DEFER(client.drop());
+    server.setup_async_context(&client);
+
+    client.window->total_rows = rows;
+    client.window->total_cols = cols;
+
+    {
+        WITH_SELECTED_BUFFER(&client);
+        buffer->mode.next_token = syntax::general_next_token;
+
+        cz::Str line = "    int value = compute(123, \"text\");  // A comment.\n";
+        for (size_t i = 0; i < cursor_count; ++i) {
+            buffer->contents.append(line);
+        }
+
+        // One cursor per line with a region covering the start of the line.
+        window->cursors.reserve(cz::heap_allocator(), cursor_count);
+        window->cursors.len = 0;
+        for (size_t i = 0; i < cursor_count; ++i) {
+            Cursor cursor = {};
+            cursor.mark = i * line.len + 4;
+            cursor.point = cursor.mark + 5;
+            window->cursors.push(cursor);
+        }
+        window->selected_cursor = cursor_count / 2;
+        window->show_marks = show_marks;
+    }
+
+    render::Cell* cells = cz::heap_allocator().alloc<render::Cell>(rows * cols);
+    CZ_DEFER(cz::heap_allocator().dealloc(cells, rows * cols));
+
+    render::Window_Cache* window_cache = nullptr;
+    CZ_DEFER(render::destroy_window_cache(window_cache));
+    render::Window_Cache* mini_buffer_window_cache = nullptr;
+    CZ_DEFER(render::destroy_window_cache(mini_buffer_window_cache));
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < frames; ++i) {
+        bool any_animated_scrolling = false;
+        render::render_to_cells(cells, /*previous_cells=*/nullptr, &window_cache,
+                                &mini_buffer_window_cache, rows, cols, &server.editor, &client,
+                                &any_animated_scrolling);
+        keep((uint8_t)cells[i % (rows * cols)].code);
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "%zu cursors%s", cursor_count,
+             show_marks ? " with regions" : "");
+    report(label, (double)(now_ns() - start) / 1e6 / frames, "ms/frame");
+}
+
+BENCHMARK(render_cursors) {
+    const size_t cursor_counts[] = {1, 100, 10000};
+    for (size_t c = 0; c < sizeof(cursor_counts) / sizeof(*cursor_counts); ++c) {
+        bench_render_cursors(cursor_counts[c], false, 100);
+        bench_render_cursors(cursor_counts[c], true, 100);
+    }
+}
@@ -0,0 +1,172 @@
+#include "bench_runner.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/string.hpp>
+#include <cz/vector.hpp>
+
+namespace mag {
+namespace bench {
+
+namespace {
+struct Benchmark {
+    const char* name;
+    Benchmark_Function function;
+};
+
+struct Measurement {
+    const char* benchmark;
+    cz::String label;
+    double value;
+    cz::String unit;
+};
+}
+
+static cz::Vector<Benchmark>* benchmarks;
+static const char* current_benchmark;
+static volatile uint64_t sink;
+
+/// Measurements are only recorded when writing them to a JSON file.
+static bool record_measurements;
+static cz::Vector<Measurement> measurements;
+
+Benchmark_Registration::Benchmark_Registration(const char* name, Benchmark_Function function) {
+    // Benchmarks are registered during static initialization so
+    // allocate the registry lazily to avoid initialization order issues.
+    if (!benchmarks) {
+        benchmarks = cz::heap_allocator().alloc<cz::Vector<Benchmark>>();
+        *benchmarks = {};
+    }
+    benchmarks->reserve(cz::heap_allocator(), 1);
+    benchmarks->push({name, function});
+}
+
+uint64_t now_ns() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+void report(cz::Str label, double value, cz::Str unit) {
+    printf("%-40s %-24.*s %14.3f %.*s\n", current_benchmark, (int)label.len, label.buffer, value,
+           (int)unit.len, unit.buffer);
+    fflush(stdout);
+
+    if (record_measurements) {
+        measurements.reserve(cz::heap_allocator(), 1);
+        measurements.push({current_benchmark, label.clone(cz::heap_allocator()), value,
+                           unit.clone(cz::heap_allocator())});
+    }
+}
+
+void keep(uint64_t value) {
+    sink = sink + value;
+}
+
+static void write_json_string(FILE* file, cz::Str str) {
+    putc('"', file);
+    for (size_t i = 0; i < str.len; ++i) {
+        char ch = str[i];
+        if (ch == '"' || ch == '\\') {
+            putc('\\', file);
+            putc(ch, file);
+        } else if ((unsigned char)ch < ' ') {
+            fprintf(file, "\\u%04x", ch);
+        } else {
+            putc(ch, file);
+        }
+    }
+    putc('"', file);
+}
+
+/// Write the measurements as JSON so they can be compared between commits.
+static bool write_json(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    CZ_DEFER(fclose(file));
+
+    fputs("{\n  \"measurements\": [", file);
+    for (size_t i = 0; i < measurements.len; ++i) {
+        const Measurement& measurement = measurements[i];
+        fputs(i == 0 ? "\n    {\"benchmark\": " : ",\n    {\"benchmark\": ", file);
+        write_json_string(file, measurement.benchmark);
+        fputs(", \"label\": ", file);
+        write_json_string(file, measurement.label);
+        fprintf(file, ", \"value\": %.6g, \"unit\": ", measurement.value);
+        write_json_string(file, measurement.unit);
+        putc('}', file);
+    }
+    fputs("\n  ]\n}\n", file);
+    return !ferror(file);
+}
+
+static int run(int argc, char** argv) {
+    if (!benchmarks) {
+        fprintf(stderr, "No benchmarks registered\n");
+        return 1;
+    }
+
+    // `--json PATH` records the measurements to `PATH`.
+    const char* json_path = nullptr;
+    cz::Vector<const char*> filters = {};
+    CZ_DEFER(filters.drop(cz::heap_allocator()));
+    for (int arg = 1; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "--json") == 0 && arg + 1 < argc) {
+            json_path = argv[++arg];
+        } else {
+            filters.reserve(cz::heap_allocator(), 1);
+            filters.push(argv[arg]);
+        }
+    }
+    record_measurements = (json_path != nullptr);
+
+    // Any other arguments are treated as filters on the benchmark names.
+    size_t ran = 0;
+    for (size_t i = 0; i < benchmarks->len; ++i) {
+        Benchmark& benchmark = (*benchmarks)[i];
+        bool matches = filters.len == 0;
+        for (size_t f = 0; f < filters.len; ++f) {
+            if (strstr(benchmark.name, filters[f])) {
+                matches = true;
+                break;
+            }
+        }
+        if (!matches) {
+            continue;
+        }
+
+        current_benchmark = benchmark.name;
+        benchmark.function();
+        ++ran;
+    }
+
+    if (ran == 0) {
+        fprintf(stderr, "No benchmarks matched\n");
+        return 1;
+    }
+
+    if (json_path) {
+        bool written = write_json(json_path);
+        for (size_t i = 0; i < measurements.len; ++i) {
+            measurements[i].label.drop(cz::heap_allocator());
+            measurements[i].unit.drop(cz::heap_allocator());
+        }
+        measurements.drop(cz::heap_allocator());
+        if (!written) {
+            fprintf(stderr, "Failed to write %s\n", json_path);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+}
+}
+
+int main(int argc, char** argv) {
+    return mag::bench::run(argc, argv);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <cz/str.hpp>
+
+namespace mag {
+namespace bench {
+
+typedef void (*Benchmark_Function)();
+
+/// Registers a benchmark to be ran by `mag-bench`.  Use `BENCHMARK` instead of this directly.
+struct Benchmark_Registration {
+    Benchmark_Registration(const char* name, Benchmark_Function function);
+};
+
+#define BENCHMARK_CONCAT2(x, y) x##y
+#define BENCHMARK_CONCAT(x, y) BENCHMARK_CONCAT2(x, y)
+
+/// Define a benchmark.  Usage: `BENCHMARK(contents_iterator_at) { ... }`.
+#define BENCHMARK(NAME)                                                    \
+    static void BENCHMARK_CONCAT(benchmark_, NAME)();                      \
+    static ::mag::bench::Benchmark_Registration BENCHMARK_CONCAT(          \
+        registration_, NAME)(#NAME, BENCHMARK_CONCAT(benchmark_, NAME));   \
+    static void BENCHMARK_CONCAT(benchmark_, NAME)()
+
+/// Monotonic time in nanoseconds.
+uint64_t now_ns();
+
+/// Report a measurement of the current benchmark.  `label` describes the parameters
+/// (ex. `"64MB"`), `value` is the measurement, and `unit` is the unit of `value`.
+void report(cz::Str label, double value, cz::Str unit);
+
+/// Prevent the compiler from optimizing out a computation.
+void keep(uint64_t value);
+
+/// A cheap deterministic random number generator so runs are comparable.
+struct Random {
+    uint64_t state = 0x9E3779B97F4A7C15;
+
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    uint64_t below(uint64_t max) { return max == 0 ? 0 : next() % max; }
+};
+
+}
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "bench_runner.hpp"
+#include "core/buffer.hpp"
+#include "core/transaction.hpp"
+#include "syntax/tokenize_cplusplus.hpp"
+
+using namespace mag;
+using namespace mag::bench;
+
+/// Fill `buffer` with `size` bytes of C++ and syntax highlight all of it.
+static void fill_highlighted_buffer(Buffer* buffer, uint64_t size) {
+    cz::Str line = "    int value = compute(123, \"text\");  // A comment.\n";
+    while (buffer->contents.len + line.len <= size) {
+        buffer->contents.append(line);
+    }
+    buffer->mode.next_token = syntax::cpp_next_token;
+    buffer->token_cache.reset(buffer);
+    buffer->token_cache.generate_check_points_until(buffer, buffer->contents.len);
+}
+
+BENCHMARK(token_cache_update) {
+    const size_t sizes_mb[] = {1, 16, 100};
+    const size_t cursor_counts[] = {100, 1000, 10000};
+
+    for (size_t s = 0; s < sizeof(sizes_mb) / sizeof(*sizes_mb); ++s) {
+        Buffer buffer = {};
+        buffer.type = Buffer::TEMPORARY;
+        buffer.init();
+        CZ_DEFER(buffer.drop());
+        fill_highlighted_buffer(&buffer, sizes_mb[s] << 20);
+
+        cz::Vector<Tokenizer_Check_Point> saved = {};
+        CZ_DEFER(saved.drop(cz::heap_allocator()));
+
+        for (size_t c = 0; c < sizeof(cursor_counts) / sizeof(*cursor_counts); ++c) {
+            size_t cursors = cursor_counts[c];
+            char label[64];
+
+            saved.len = 0;
+            saved.reserve_exact(cz::heap_allocator(), buffer.token_cache.check_points.len);
+            saved.append(buffer.token_cache.check_points);
+
+            // Type a character at every cursor, with the cursors spread evenly over the buffer.
+            Transaction transaction;
+            transaction.init(&buffer);
+            CZ_DEFER(transaction.drop());
+            uint64_t spacing = buffer.contents.len / cursors;
+            for (size_t i = 0; i < cursors; ++i) {
+                Edit edit;
+                edit.value = SSOStr::from_constant("x");
+                edit.position = i * spacing + i;
+                edit.flags = Edit::INSERT;
+                transaction.push(edit);
+            }
+
+            const char* error;
+            uint64_t start = now_ns();
+            if (!transaction.commit(&error)) {
+                fprintf(stderr, "Failed to commit: %s\n", error);
+                return;
+            }
+            snprintf(label, sizeof(label), "commit %zu cursors %zuMB", cursors, sizes_mb[s]);
+            report(label, (double)(now_ns() - start) / 1e6, "ms");
+
+            // Replay just the token cache update against the old check points.
+            buffer.token_cache.check_points.len = 0;
+            buffer.token_cache.check_points.reserve_exact(cz::heap_allocator(), saved.len);
+            buffer.token_cache.check_points.append(saved);
+            buffer.token_cache.change_index = buffer.changes.len - 1;
+            buffer.token_cache.ran_to_end = true;
+
+            start = now_ns();
+            keep(buffer.token_cache.update(&buffer));
+            snprintf(label, sizeof(label), "update %zu cursors %zuMB", cursors, sizes_mb[s]);
+            report(label, (double)(now_ns() - start) / 1e6, "ms");
+
+            buffer.undo();
+            buffer.token_cache.update(&buffer);
+            buffer.token_cache.generate_check_points_until(&buffer, buffer.contents.len);
+        }
+    }
+}
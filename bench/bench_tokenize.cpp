@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <string.h>
+#include <cz/buffer_array.hpp>
+#include <cz/defer.hpp>
+#include <cz/directory.hpp>
+#include <cz/file.hpp>
+#include <cz/heap.hpp>
+#include "bench_runner.hpp"
+#include "core/buffer.hpp"
+#include "core/contents.hpp"
+#include "core/token.hpp"
+#include "syntax/tokenize_buffer_name.hpp"
+#include "syntax/tokenize_build.hpp"
+#include "syntax/tokenize_cmake.hpp"
+#include "syntax/tokenize_color_test.hpp"
+#include "syntax/tokenize_cplusplus.hpp"
+#include "syntax/tokenize_css.hpp"
+#include "syntax/tokenize_ctest.hpp"
+#include "syntax/tokenize_directory.hpp"
+#include "syntax/tokenize_general.hpp"
+#include "syntax/tokenize_general_c_block_comments.hpp"
+#include "syntax/tokenize_general_c_comments.hpp"
+#include "syntax/tokenize_general_c_line_comments.hpp"
+#include "syntax/tokenize_general_hash_comments.hpp"
+#include "syntax/tokenize_go.hpp"
+#include "syntax/tokenize_html.hpp"
+#include "syntax/tokenize_javascript.hpp"
+#include "syntax/tokenize_key_map.hpp"
+#include "syntax/tokenize_markdown.hpp"
+#include "syntax/tokenize_mustache.hpp"
+#include "syntax/tokenize_path.hpp"
+#include "syntax/tokenize_process.hpp"
+#include "syntax/tokenize_protobuf.hpp"
+#include "syntax/tokenize_python.hpp"
+#include "syntax/tokenize_rust.hpp"
+#include "syntax/tokenize_search.hpp"
+#include "syntax/tokenize_shell_script.hpp"
+#include "syntax/tokenize_splash.hpp"
+#include "syntax/tokenize_vim_script.hpp"
+#include "syntax/tokenize_zig.hpp"
+
+using namespace mag;
+using namespace mag::bench;
+
+namespace {
+/// A sample of a language that is repeated to build the synthetic corpus.
+struct Sample {
+    const char* text;
+    /// Suffixes of files in the mag source tree to use as the real corpus.
+    const char* suffixes[3];
+};
+
+struct Tokenizer_Info {
+    const char* name;
+    Tokenizer next_token;
+    const Sample* sample;
+};
+}
+
+static const Sample c_like = {
+    "#include <stdio.h>\n"
+    "/* A block\n   comment. */\n"
+    "struct Point {\n"
+    "    int x, y;  // Coordinates.\n"
+    "};\n"
+    "static int compute(Point* point, const char* name) {\n"
+    "    printf(\"%s: %d\\n\", name, point->x * 123 + point->y);\n"
+    "    return point->x < point->y ? point->x : point->y;\n"
+    "}\n",
+    {".cpp", ".hpp"},
+};
+
+static const Sample rust = {
+    "use std::collections::HashMap;\n"
+    "/// A documented struct.\n"
+    "#[derive(Debug, Clone)]\n"
+    "pub struct Point<'a> { x: i32, y: i32, name: &'a str }\n"
+    "impl<'a> Point<'a> {\n"
+    "    pub fn compute(&self) -> i32 { self.x * 123 + self.y } // Comment.\n"
+    "}\n"
+    "fn main() { let map: HashMap<String, u8> = HashMap::new(); println!(\"{:?}\", map); }\n",
+    {".rs"},
+};
+
+static const Sample go = {
+    "package main\n"
+    "import \"fmt\"\n"
+    "// Point is a point.\n"
+    "type Point struct { X, Y int }\n"
+    "func (p *Point) Compute(name string) int {\n"
+    "    fmt.Printf(\"%s: %d\\n\", name, p.X*123+p.Y)\n"
+    "    return p.X\n"
+    "}\n",
+    {".go"},
+};
+
+static const Sample javascript = {
+    "import { compute } from './compute.js';\n"
+    "// A comment.\n"
+    "class Point extends Base {\n"
+    "    constructor(x, y) { super(); this.x = x; this.y = y; }\n"
+    "    get name() { return `point ${this.x} ${this.y}`; }\n"
+    "}\n"
+    "const re = /ab+c/g; let value = compute(123, 'text') / 2;\n",
+    {".js"},
+};
+
+static const Sample python = {
+    "import os\n"
+    "class Point:\n"
+    "    \"\"\"A documented class.\"\"\"\n"
+    "    def __init__(self, x, y):\n"
+    "        self.x = x  # Coordinates.\n"
+    "        self.y = y\n"
+    "def compute(point, name):\n"
+    "    print(f\"{name}: {point.x * 123 + point.y}\")\n"
+    "    return min(point.x, point.y)\n",
+    {".py"},
+};
+
+static const Sample shell = {
+    "#!/bin/bash\n"
+    "set -e  # Exit on error.\n"
+    "for file in \"$@\"; do\n"
+    "    if [ -f \"$file\" ]; then\n"
+    "        echo \"${file%.*}: $(wc -l < \"$file\")\" | tee -a log.txt\n"
+    "    fi\n"
+    "done\n",
+    {".sh"},
+};
+
+static const Sample markdown = {
+    "# Heading\n"
+    "\n"
+    "Some *emphasized* and **bold** text with `code` in it.\n"
+    "- A list item linking to [a page](https://example.com).\n"
+    "```\n"
+    "int main() { return 0; }\n"
+    "```\n"
+    "\n",
+    {".md"},
+};
+
+static const Sample css = {
+    "/* A comment. */\n"
+    ".class > #id:hover, a[href^=\"http\"] {\n"
+    "    color: #ff00ff;\n"
+    "    margin: 0 auto 12px calc(100% - 3em);\n"
+    "}\n",
+    {".css"},
+};
+
+static const Sample html = {
+    "<!DOCTYPE html>\n"
+    "<html><head><title>Title</title></head>\n"
+    "<!-- A comment. -->\n"
+    "<body class=\"main\"><p id='text'>Some &amp; text</p>\n"
+    "<script>let x = 1 < 2;</script></body></html>\n",
+    {".html"},
+};
+
+static const Sample cmake = {
+    "cmake_minimum_required(VERSION 3.1)\n"
+    "# A comment.\n"
+    "if (CMAKE_BUILD_TYPE STREQUAL \"Tracy\")\n"
+    "  file(GLOB_RECURSE SRCS ${PROJECT_SOURCE_DIR}/src/*.cpp)\n"
+    "  target_link_libraries(${EXECUTABLE} pthread dl z)\n"
+    "endif()\n",
+    {"CMakeLists.txt", ".cmake"},
+};
+
+static const Sample zig = {
+    "const std = @import(\"std\");\n"
+    "/// A documented struct.\n"
+    "pub const Point = struct { x: i32, y: i32 };\n"
+    "pub fn compute(point: *const Point) i32 {\n"
+    "    return point.x * 123 + point.y; // Comment.\n"
+    "}\n",
+    {".zig"},
+};
+
+static const Sample protobuf = {
+    "syntax = \"proto3\";\n"
+    "// A comment.\n"
+    "message Point {\n"
+    "  int32 x = 1;\n"
+    "  repeated string names = 2 [packed = true];\n"
+    "}\n",
+    {".proto"},
+};
+
+static const Sample vim_script = {
+    "\" A comment.\n"
+    "function! Compute(x, y) abort\n"
+    "    let l:value = a:x * 123 + a:y\n"
+    "    echo 'value: ' . l:value\n"
+    "endfunction\n",
+    {".vim"},
+};
+
+static const Sample plain = {
+    "src/core/buffer.cpp:123:45: error: expected ';' after expression\n"
+    "    int value = compute(123, \"text\")\n"
+    "drwxr-xr-x  2 user user 4096 Jan 01 00:00 directory/\n"
+    "Test #1: test_contents ..................   Passed    0.01 sec\n",
+    {},
+};
+
+static const Tokenizer_Info tokenizers[] = {
+    {"buffer_name", syntax::buffer_name_next_token, &plain},
+    {"build", syntax::build_next_token, &plain},
+    {"cmake", syntax::cmake_next_token, &cmake},
+    {"color_test", syntax::color_test_next_token, &plain},
+    {"cpp", syntax::cpp_next_token, &c_like},
+    {"css", syntax::css_next_token, &css},
+    {"ctest", syntax::ctest_next_token, &plain},
+    {"directory", syntax::directory_next_token, &plain},
+    {"general", syntax::general_next_token, &c_like},
+    {"general_c_block", syntax::general_c_block_comments_next_token, &c_like},
+    {"general_c", syntax::general_c_comments_next_token, &c_like},
+    {"general_c_line", syntax::general_c_line_comments_next_token, &c_like},
+    {"general_hash", syntax::general_hash_comments_next_token, &shell},
+    {"go", syntax::go_next_token, &go},
+    {"html", syntax::html_next_token, &html},
+    {"js", syntax::js_next_token, &javascript},
+    {"key_map", syntax::key_map_next_token, &plain},
+    {"md", syntax::md_next_token, &markdown},
+    {"mustache", syntax::mustache_next_token, &html},
+    {"path", syntax::path_next_token, &plain},
+    {"process", syntax::process_next_token, &plain},
+    {"protobuf", syntax::protobuf_next_token, &protobuf},
+    {"python", syntax::python_next_token, &python},
+    {"rust", syntax::rust_next_token, &rust},
+    {"search", syntax::search_next_token, &plain},
+    {"sh", syntax::sh_next_token, &shell},
+    {"splash", syntax::splash_next_token, &plain},
+    {"vim_script", syntax::vim_script_next_token, &vim_script},
+    {"zig", syntax::zig_next_token, &zig},
+};
+
+static void fill_synthetic(Contents* contents, cz::Str text, uint64_t size) {
+    while (contents->len + text.len <= size) {
+        contents->append(text);
+    }
+}
+
+static bool has_suffix(cz::Str file, const Sample* sample) {
+    for (size_t i = 0; i < sizeof(sample->suffixes) / sizeof(*sample->suffixes); ++i) {
+        if (sample->suffixes[i] && file.ends_with(sample->suffixes[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Concatenate the files in `directory` matching `sample`.
+static void append_matching_files(Contents* contents,
+                                  cz::Str directory,
+                                  const Sample* sample,
+                                  bool recurse) {
+    cz::Buffer_Array buffer_array;
+    buffer_array.init();
+    CZ_DEFER(buffer_array.drop());
+
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+    path.reserve_exact(cz::heap_allocator(), directory.len + 1);
+    path.append(directory);
+    path.null_terminate();
+
+    cz::Vector<cz::Str> files = {};
+    CZ_DEFER(files.drop(cz::heap_allocator()));
+    if (!cz::files(cz::heap_allocator(), buffer_array.allocator(), path.buffer, &files)) {
+        return;
+    }
+
+    cz::String file_contents = {};
+    CZ_DEFER(file_contents.drop(cz::heap_allocator()));
+    for (size_t i = 0; i < files.len; ++i) {
+        path.len = 0;
+        path.reserve(cz::heap_allocator(), directory.len + files[i].len + 2);
+        path.append(directory);
+        path.push('/');
+        path.append(files[i]);
+        path.null_terminate();
+
+        if (has_suffix(files[i], sample)) {
+            cz::Input_File file;
+            if (!file.open(path.buffer)) {
+                continue;
+            }
+            CZ_DEFER(file.close());
+            file_contents.len = 0;
+            if (cz::read_to_string(file, cz::heap_allocator(), &file_contents)) {
+                contents->append(file_contents);
+            }
+        } else if (recurse && !files[i].find('.')) {
+            // Probably a directory.  `cz::files` fails if it isn't.
+            append_matching_files(contents, path, sample, recurse);
+        }
+    }
+}
+
+/// Build the real corpus by concatenating the mag source files written in the sample's language.
+static void fill_real(Contents* contents, const Sample* sample) {
+#ifdef MAG_SOURCE_DIR
+    cz::Str root = MAG_SOURCE_DIR;
+    append_matching_files(contents, root, sample, /*recurse=*/false);
+
+    const char* subdirectories[] = {"/src", "/tests", "/bench", "/tutorial"};
+    for (size_t i = 0; i < sizeof(subdirectories) / sizeof(*subdirectories); ++i) {
+        cz::String directory = {};
+        CZ_DEFER(directory.drop(cz::heap_allocator()));
+        directory.reserve_exact(cz::heap_allocator(), root.len + strlen(subdirectories[i]));
+        directory.append(root);
+        directory.append(subdirectories[i]);
+        append_matching_files(contents, directory, sample, /*recurse=*/true);
+    }
+#endif
+}
+
+/// Report the throughput of running `info` over the `contents` labelled `corpus`.
+static void bench_tokenizer(const Tokenizer_Info& info, cz::Str corpus, const Contents& contents) {
+    char label[64];
+
+    uint64_t tokens = 0;
+    uint64_t start = now_ns();
+    {
+        Contents_Iterator iterator = contents.start();
+        Token token;
+        uint64_t state = 0;
+        while (info.next_token(&iterator, &token, &state)) {
+            ++tokens;
+        }
+    }
+    double seconds = (double)(now_ns() - start) / 1e9;
+    keep(tokens);
+
+    snprintf(label, sizeof(label), "%s %.*s", info.name, (int)corpus.len, corpus.buffer);
+    report(label, (double)contents.len / (1 << 20) / seconds, "MB/s");
+    report(label, (double)tokens / seconds, "tokens/s");
+
+    // Check points are what the `Token_Cache` generates when a buffer is first displayed.
+    Buffer buffer = {};
+    buffer.type = Buffer::TEMPORARY;
+    buffer.init();
+    CZ_DEFER(buffer.drop());
+    cz::String string = contents.stringify(cz::heap_allocator());
+    CZ_DEFER(string.drop(cz::heap_allocator()));
+    buffer.contents.append(string);
+    buffer.mode.next_token = info.next_token;
+    buffer.token_cache.reset(&buffer);
+
+    start = now_ns();
+    buffer.token_cache.generate_check_points_until(&buffer, buffer.contents.len);
+    seconds = (double)(now_ns() - start) / 1e9;
+    report(label, (double)buffer.token_cache.check_points.len / seconds, "check points/s");
+}
+
+BENCHMARK(tokenize) {
+    const uint64_t synthetic_size = 8 << 20;
+
+    for (size_t i = 0; i < sizeof(tokenizers) / sizeof(*tokenizers); ++i) {
+        const Tokenizer_Info& info = tokenizers[i];
+
+        Contents synthetic = {};
+        CZ_DEFER(synthetic.drop());
+        fill_synthetic(&synthetic, info.sample->text, synthetic_size);
+        bench_tokenizer(info, "synthetic", synthetic);
+
+        Contents real = {};
+        CZ_DEFER(real.drop());
+        fill_real(&real, info.sample);
+        if (real.len > 0) {
+            bench_tokenizer(info, "mag source", real);
+        }
+    }
+}
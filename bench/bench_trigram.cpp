@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <cz/defer.hpp>
+#include <cz/file.hpp>
+#include <cz/heap.hpp>
+#include "bench_runner.hpp"
+#include "core/file.hpp"
+#include "prose/file_walker.hpp"
+#include "prose/search_engine.hpp"
+#include "prose/trigram_index.hpp"
+
+using namespace mag;
+using namespace mag::bench;
+using namespace mag::prose;
+
+/// Index every file under `root`.  If `old` is given then files whose
+/// times match are reused instead of being read again.
+static size_t build_index(cz::Str root, const Trigram_Index* old, Trigram_Index* index) {
+    Trigram_Index_Builder builder;
+    builder.init(old);
+    CZ_DEFER(builder.drop());
+
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+
+    File_Walker walker;
+    walker.init(root);
+    CZ_DEFER(walker.drop());
+
+    size_t files_read = 0;
+    while (walker.next()) {
+        cz::File_Time file_time;
+        if (!cz::get_file_time(walker.path.buffer, &file_time)) {
+            continue;
+        }
+
+        size_t old_id;
+        if (old && old->find_file(walker.relpath(), &old_id) &&
+            !cz::is_file_time_before(old->files[old_id].file_time, file_time) &&
+            !cz::is_file_time_before(file_time, old->files[old_id].file_time)) {
+            builder.add_unchanged_file(old_id);
+            continue;
+        }
+
+        cz::Slice<char> mapping;
+        cz::Str text = {};
+        if (!load_searchable_file(walker.path.buffer, &contents, &mapping, &text)) {
+            text = {};
+        }
+        builder.add_file(walker.relpath(), file_time, text);
+        if (mapping.elems) {
+            unmap_file(mapping);
+        }
+        ++files_read;
+    }
+
+    builder.finish(index);
+    return files_read;
+}
+
+BENCHMARK(trigram_index) {
+#ifdef MAG_SOURCE_DIR
+    cz::Str root = MAG_SOURCE_DIR;
+    char label[64];
+
+    Trigram_Index index;
+    index.init();
+    CZ_DEFER(index.drop());
+
+    uint64_t start = now_ns();
+    size_t files_read = build_index(root, nullptr, &index);
+    report("build", (double)(now_ns() - start) / 1e6, "ms");
+    report("files", (double)files_read, "files");
+    report("index size", (double)index.byte_size() / 1024, "KB");
+
+    // Nothing changed so every file's trigrams are reused.
+    {
+        Trigram_Index rebuilt;
+        rebuilt.init();
+        CZ_DEFER(rebuilt.drop());
+
+        start = now_ns();
+        files_read = build_index(root, &index, &rebuilt);
+        report("rebuild unchanged", (double)(now_ns() - start) / 1e6, "ms");
+        report("rebuild files read", (double)files_read, "files");
+    }
+
+    cz::String serialized = {};
+    CZ_DEFER(serialized.drop(cz::heap_allocator()));
+    start = now_ns();
+    index.serialize(&serialized);
+    report("serialize", (double)(now_ns() - start) / 1e6, "ms");
+
+    {
+        Trigram_Index loaded;
+        loaded.init();
+        CZ_DEFER(loaded.drop());
+        start = now_ns();
+        keep(loaded.deserialize(serialized));
+        report("deserialize", (double)(now_ns() - start) / 1e6, "ms");
+    }
+
+    const char* queries[] = {"Contents_Iterator", "ZoneScoped", "window_cache", "xyzzy"};
+    cz::Vector<uint32_t> ids = {};
+    CZ_DEFER(ids.drop(cz::heap_allocator()));
+    for (size_t q = 0; q < sizeof(queries) / sizeof(*queries); ++q) {
+        const size_t iterations = 1000;
+        start = now_ns();
+        for (size_t i = 0; i < iterations; ++i) {
+            ids.len = 0;
+            keep(index.find_candidates(queries[q], &ids));
+        }
+        double us = (double)(now_ns() - start) / 1e3 / iterations;
+
+        snprintf(label, sizeof(label), "query %s", queries[q]);
+        report(label, us, "us");
+        snprintf(label, sizeof(label), "candidates %s", queries[q]);
+        report(label, (double)ids.len, "files");
+    }
+#endif
+}
@@ -0,0 +1,410 @@
+/// `mag-bench-render`: render frames of a headless `Server` / `Client` into an in-memory grid.
+///
+/// Each scenario is run with the rendering features enabled one at a time (token iteration,
+/// line numbers, decorations, then overlays) so the cost of each phase is the difference from
+/// the previous run.  Run with `--help` to see the options.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <cz/defer.hpp>
+#include <cz/file.hpp>
+#include <cz/heap.hpp>
+#include <cz/string.hpp>
+#include "core/client.hpp"
+#include "core/command_macros.hpp"
+#include "core/movement.hpp"
+#include "core/server.hpp"
+#include "core/transaction.hpp"
+#include "core/window.hpp"
+#include "render/render.hpp"
+
+using namespace mag;
+
+namespace {
+struct Options {
+    const char* fixture = nullptr;
+    const char* language = "cpp";
+    uint64_t size = 1 << 20;
+    size_t cursors = 1000;
+    size_t rows = 60;
+    size_t cols = 200;
+    size_t vertical_splits = 0;
+    size_t horizontal_splits = 0;
+    size_t frames = 100;
+    const char* scenario = nullptr;
+    double max_ms_per_frame = 0;
+};
+
+enum Scenario {
+    SCROLL,
+    TYPE,
+    CURSORS,
+    SCENARIO_COUNT,
+};
+
+/// Each level enables a phase of rendering on top of the previous levels.
+enum Level {
+    PLAIN,
+    TOKENS,
+    LINE_NUMBERS,
+    DECORATIONS,
+    OVERLAYS,
+    LEVEL_COUNT,
+};
+
+struct Bench {
+    Server server;
+    Client client;
+
+    render::Cell* cells;
+    render::Window_Cache* window_cache;
+    render::Window_Cache* mini_buffer_window_cache;
+
+    /// Rendering features disabled for this level.  Restored before dropping.
+    Tokenizer next_token;
+    cz::Heap_Vector<Decoration> theme_decorations;
+    cz::Heap_Vector<Overlay> theme_overlays;
+    cz::Heap_Vector<Decoration> mode_decorations;
+    cz::Heap_Vector<Overlay> mode_overlays;
+};
+}
+
+static const char* scenario_names[] = {"scroll", "type", "cursors"};
+static const char* level_names[] = {"plain", "+tokens", "+line numbers", "+decorations",
+                                    "+overlays"};
+
+static uint64_t now_ns() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+static bool no_next_token(Contents_Iterator*, Token*, uint64_t*) {
+    return false;
+}
+
+/// Generate `size` bytes of source code in `language`.
+static void generate_fixture(cz::Str language, uint64_t size, cz::String* contents) {
+    static const char* cpp_lines[] = {
+        "#include <stdio.h>\n",
+        "struct Point {\n",
+        "    int x, y;  // Coordinates.\n",
+        "};\n",
+        "static int compute(Point* point, const char* name) {\n",
+        "    printf(\"%s: %d\\n\", name, point->x * 123 + point->y);\n",
+        "    return point->x < point->y ? point->x : point->y;\n",
+        "}\n",
+    };
+    static const char* python_lines[] = {
+        "import os\n",
+        "class Point:\n",
+        "    def __init__(self, x, y):\n",
+        "        self.x = x  # Coordinates.\n",
+        "        self.y = y\n",
+        "def compute(point, name):\n",
+        "    print(f\"{name}: {point.x * 123 + point.y}\")\n",
+        "    return min(point.x, point.y)\n",
+    };
+    static const char* markdown_lines[] = {
+        "# Heading\n",
+        "\n",
+        "Some *emphasized* and **bold** text with `code` in it.\n",
+        "- A list item linking to [a page](https://example.com).\n",
+        "```\n",
+        "int main() { return 0; }\n",
+        "```\n",
+        "\n",
+    };
+
+    const char** lines = cpp_lines;
+    if (language == "python") {
+        lines = python_lines;
+    } else if (language == "markdown" || language == "text") {
+        lines = markdown_lines;
+    }
+
+    contents->reserve_exact(cz::heap_allocator(), size);
+    for (size_t i = 0;; ++i) {
+        cz::Str line = lines[i % 8];
+        if (contents->len + line.len > size) {
+            break;
+        }
+        contents->append(line);
+    }
+}
+
+static cz::Str fixture_name(cz::Str language) {
+    if (language == "python") {
+        return "fixture.py";
+    } else if (language == "markdown") {
+        return "fixture.md";
+    } else if (language == "text") {
+        return "fixture.txt";
+    } else {
+        return "fixture.cpp";
+    }
+}
+
+static void setup(Bench* bench, const Options& options, cz::Str contents, Level level) {
+    *bench = {};
+    bench->server.init();
+
+    Buffer buffer = {};
+    buffer.type = Buffer::FILE;
+    buffer.directory = cz::Str("/tmp/").clone_null_terminate(cz::heap_allocator());
+    buffer.name = fixture_name(options.language).clone(cz::heap_allocator());
+    buffer.contents.append(contents);
+    bench->server.editor.create_buffer(buffer);
+
+    bench->client = bench->server.make_client();
+    bench->server.setup_async_context(&bench->client);
+    bench->client.window->total_rows = options.rows - 1;
+    bench->client.window->total_cols = options.cols;
+
+    Theme& theme = bench->server.editor.theme;
+    bench->theme_decorations = theme.decorations;
+    bench->theme_overlays = theme.overlays;
+    if (level < DECORATIONS) {
+        theme.decorations = {};
+    }
+    if (level < OVERLAYS) {
+        theme.overlays = {};
+    }
+    theme.draw_line_numbers = (level >= LINE_NUMBERS);
+
+    {
+        WITH_SELECTED_BUFFER(&bench->client);
+        bench->next_token = buffer->mode.next_token;
+        bench->mode_decorations = buffer->mode.decorations;
+        bench->mode_overlays = buffer->mode.overlays;
+        if (level < TOKENS) {
+            buffer->mode.next_token = no_next_token;
+        }
+        if (level < DECORATIONS) {
+            buffer->mode.decorations = {};
+        }
+        if (level < OVERLAYS) {
+            buffer->mode.overlays = {};
+        }
+    }
+
+    for (size_t i = 0; i < options.vertical_splits; ++i) {
+        split_window(&bench->client, Window::VERTICAL_SPLIT);
+    }
+    for (size_t i = 0; i < options.horizontal_splits; ++i) {
+        split_window(&bench->client, Window::HORIZONTAL_SPLIT);
+    }
+
+    bench->cells = cz::heap_allocator().alloc<render::Cell>(options.rows * options.cols);
+}
+
+static void teardown(Bench* bench, const Options& options) {
+    render::destroy_window_cache(bench->window_cache);
+    render::destroy_window_cache(bench->mini_buffer_window_cache);
+    cz::heap_allocator().dealloc(bench->cells, options.rows * options.cols);
+
+    Theme& theme = bench->server.editor.theme;
+    theme.decorations = bench->theme_decorations;
+    theme.overlays = bench->theme_overlays;
+    {
+        WITH_SELECTED_BUFFER(&bench->client);
+        buffer->mode.next_token = bench->next_token;
+        buffer->mode.decorations = bench->mode_decorations;
+        buffer->mode.overlays = bench->mode_overlays;
+    }
+
+    bench->client.drop();
+    bench->server.drop();
+}
+
+static void render_frame(Bench* bench, const Options& options) {
+    bool any_animated_scrolling = false;
+    render::render_to_cells(bench->cells, /*previous_cells=*/nullptr, &bench->window_cache,
+                            &bench->mini_buffer_window_cache, options.rows, options.cols,
+                            &bench->server.editor, &bench->client, &any_animated_scrolling);
+}
+
+/// Put a cursor at the start of each of the first `count` lines with a region selecting the line.
+static void setup_cursors(Bench* bench, size_t count) {
+    WITH_SELECTED_BUFFER(&bench->client);
+    window->cursors.len = 0;
+    Contents_Iterator iterator = buffer->contents.start();
+    for (size_t i = 0; i < count && !iterator.at_eob(); ++i) {
+        Cursor cursor = {};
+        cursor.mark = iterator.position;
+        end_of_line(&iterator);
+        cursor.point = iterator.position;
+        window->cursors.reserve(cz::heap_allocator(), 1);
+        window->cursors.push(cursor);
+        forward_char(&iterator);
+    }
+    window->selected_cursor = 0;
+    window->show_marks = true;
+}
+
+/// Make the changes for one frame of `scenario`.
+static void step(Bench* bench, const Options& options, Scenario scenario) {
+    WITH_SELECTED_BUFFER(&bench->client);
+
+    switch (scenario) {
+    case SCROLL: {
+        // Page down, wrapping around at the end of the buffer.
+        Cursor& cursor = window->sel();
+        uint64_t line = buffer->contents.get_line_number(cursor.point) + window->rows();
+        Contents_Iterator iterator = start_of_line_position(buffer->contents, line);
+        if (iterator.at_eob()) {
+            iterator.retreat_to(0);
+        }
+        cursor.point = cursor.mark = iterator.position;
+        break;
+    }
+
+    case TYPE: {
+        Transaction transaction;
+        transaction.init(buffer);
+        CZ_DEFER(transaction.drop());
+
+        Edit edit;
+        edit.value = SSOStr::from_char('x');
+        edit.position = window->sel().point;
+        edit.flags = Edit::INSERT;
+        transaction.push(edit);
+        transaction.commit(&bench->client);
+        break;
+    }
+
+    case CURSORS: {
+        // Shrink every region by one character.
+        for (size_t i = 0; i < window->cursors.len; ++i) {
+            Cursor& cursor = window->cursors[i];
+            if (cursor.point > cursor.mark) {
+                --cursor.point;
+            }
+        }
+        break;
+    }
+
+    case SCENARIO_COUNT:
+        break;
+    }
+}
+
+/// Run `scenario` at every level.  Returns the milliseconds per frame with everything enabled.
+static double run_scenario(const Options& options, cz::Str contents, Scenario scenario) {
+    double previous = 0;
+    for (int level = 0; level < LEVEL_COUNT; ++level) {
+        Bench bench;
+        setup(&bench, options, contents, (Level)level);
+
+        if (scenario == CURSORS) {
+            setup_cursors(&bench, options.cursors);
+        }
+
+        // The first frame tokenizes the visible region and fills the window caches.
+        render_frame(&bench, options);
+
+        uint64_t start = now_ns();
+        for (size_t frame = 0; frame < options.frames; ++frame) {
+            step(&bench, options, scenario);
+            render_frame(&bench, options);
+        }
+        double ms = (double)(now_ns() - start) / 1e6 / options.frames;
+
+        teardown(&bench, options);
+
+        printf("%-10s %-16s %10.3f ms/frame %+10.3f ms\n", scenario_names[scenario],
+               level_names[level], ms, level == 0 ? ms : ms - previous);
+        fflush(stdout);
+        previous = ms;
+    }
+    return previous;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "Usage: mag-bench-render [options]\n"
+            "  --fixture PATH          Render the file at PATH instead of generated code.\n"
+            "  --language LANGUAGE     cpp, python, markdown, or text (default cpp).\n"
+            "  --size BYTES            Size of the generated code (default 1MB).\n"
+            "  --cursors N             Cursors in the cursors scenario (default 1000).\n"
+            "  --rows N --cols N       Size of the cell grid (default 60x200).\n"
+            "  --vsplits N --hsplits N Split the window N times (default 0).\n"
+            "  --frames N              Frames rendered per scenario (default 100).\n"
+            "  --scenario NAME         scroll, type, or cursors (default all).\n"
+            "  --max-ms-per-frame MS   Fail if a scenario takes longer than this.\n");
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    for (int i = 1; i < argc; ++i) {
+        cz::Str arg = argv[i];
+        if (arg == "--help" || i + 1 == argc) {
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (arg == "--fixture") {
+            options->fixture = value;
+        } else if (arg == "--language") {
+            options->language = value;
+        } else if (arg == "--size") {
+            options->size = strtoull(value, nullptr, 10);
+        } else if (arg == "--cursors") {
+            options->cursors = strtoull(value, nullptr, 10);
+        } else if (arg == "--rows") {
+            options->rows = strtoull(value, nullptr, 10);
+        } else if (arg == "--cols") {
+            options->cols = strtoull(value, nullptr, 10);
+        } else if (arg == "--vsplits") {
+            options->vertical_splits = strtoull(value, nullptr, 10);
+        } else if (arg == "--hsplits") {
+            options->horizontal_splits = strtoull(value, nullptr, 10);
+        } else if (arg == "--frames") {
+            options->frames = strtoull(value, nullptr, 10);
+        } else if (arg == "--scenario") {
+            options->scenario = value;
+        } else if (arg == "--max-ms-per-frame") {
+            options->max_ms_per_frame = strtod(value, nullptr);
+        } else {
+            return false;
+        }
+    }
+    return options->rows > 0 && options->cols > 0 && options->frames > 0;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 2;
+    }
+
+    cz::String contents = {};
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    if (options.fixture) {
+        cz::Input_File file;
+        if (!file.open(options.fixture)) {
+            fprintf(stderr, "Failed to open fixture %s\n", options.fixture);
+            return 2;
+        }
+        CZ_DEFER(file.close());
+        cz::read_to_string(file, cz::heap_allocator(), &contents);
+    } else {
+        generate_fixture(options.language, options.size, &contents);
+    }
+
+    int result = 0;
+    for (int scenario = 0; scenario < SCENARIO_COUNT; ++scenario) {
+        if (options.scenario && cz::Str(options.scenario) != scenario_names[scenario]) {
+            continue;
+        }
+
+        double ms = run_scenario(options, contents, (Scenario)scenario);
+        if (options.max_ms_per_frame > 0 && ms > options.max_ms_per_frame) {
+            fprintf(stderr, "%s: %.3f ms/frame exceeds the limit of %.3f ms/frame\n",
+                    scenario_names[scenario], ms, options.max_ms_per_frame);
+            result = 1;
+        }
+    }
+    return result;
+}
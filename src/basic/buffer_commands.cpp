@@ -444,6 +444,7 @@ static void command_rename_buffer_callback(Editor* editor,
     cz::swap(buffer->name, name_clone);
     cz::swap(buffer->directory, directory_clone);
     buffer->type = type;
+    editor->file_watcher.rename_buffer(buffer, handle);
 
     reset_mode(editor, buffer, handle);
 }
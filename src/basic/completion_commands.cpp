@@ -390,69 +390,55 @@ void command_complete_at_point_nearest_matching_before_after(Editor* editor,
 // command_complete_at_point_prompt_identifiers
 ///////////////////////////////////////////////////////////////////////////////
 
+/// Test if `it` is at the start of an identifier that is longer than `len`.
+static bool starts_longer_identifier(Contents_Iterator it, uint64_t len) {
+    // If character before is an identifier character then
+    // `it` is not at the start of an identifier.
+    if (!it.at_bob()) {
+        Contents_Iterator temp = it;
+        temp.retreat();
+        char before = temp.get();
+        if (cz::is_alnum(before) || before == '_')
+            return false;
+    }
+
+    // Check character after region is an identifier.
+    it.advance(len);
+    if (it.at_eob())
+        return false;
+    char after = it.get();
+    return cz::is_alnum(after) || after == '_';
+}
+
 /// Look in the bucket for an identifier that starts with `query` and is longer than `query`.
-static bool list_all_in(cz::Slice<char> bucket,
+/// `out` is at the start of `bucket`.
+static void list_all_in(cz::Slice<char> bucket,
                         Contents_Iterator out,
                         cz::Str query,
                         cz::Allocator result_allocator,
                         cz::Heap_Vector<cz::Str>* results) {
     ZoneScoped;
-    const cz::Str str = {bucket.elems, bucket.len};
-    const char first = query[0];
-    Contents_Iterator test_start = out;
-    size_t index = 0;
-    bool first_iteration = true;
-    while (1) {
-        // Find the start of the test identifier.
-        const char* fst = str.slice_start(index).find(first);
-        if (!fst)
-            break;
-
-        size_t old_index = index;
-        index = fst - str.buffer;
-
-        ++index;
-        if (first_iteration) {
-            first_iteration = false;
-        } else {
-            test_start.advance();
-        }
-
-        test_start.advance(fst - (str.buffer + old_index));
+    if (bucket.len == 0)
+        return;
 
-        // If character before is an identifier character then
-        // `test_start` is not at the start of an identifier.
-        if (!test_start.at_bob()) {
-            Contents_Iterator temp = test_start;
-            temp.retreat();
-            char before = temp.get();
-            if (cz::is_alnum(before) || before == '_')
-                continue;
+    // Candidates are found with the vectorized bucket search.
+    Contents_Iterator test_start = out;
+    while (find_bucket(&test_start, query)) {
+        if (starts_longer_identifier(test_start, query.len)) {
+            Contents_Iterator test_end = test_start;
+            forward_through_identifier(&test_end);
+            cz::String result = {};
+            test_start.contents->slice_into(result_allocator, test_start, test_end.position,
+                                            &result);
+
+            results->reserve(1);
+            results->push(result);
         }
 
-        // Check character after region is an identifier.
-        if (test_start.position + query.len >= test_start.contents->len)
-            continue;
-        Contents_Iterator test_middle = test_start;
-        test_middle.advance(query.len);
-        CZ_DEBUG_ASSERT(test_middle.position < test_middle.contents->len);
-        char after = test_middle.get();
-        if (!cz::is_alnum(after) && after != '_')
-            continue;
-
-        // Check prefix matches.
-        if (!looking_at(test_start, query))
-            continue;
-
-        Contents_Iterator test_end = test_start;
-        forward_through_identifier(&test_end);
-        cz::String result = {};
-        test_start.contents->slice_into(result_allocator, test_start, test_end.position, &result);
-
-        results->reserve(1);
-        results->push(result);
+        test_start.advance();
+        if (test_start.bucket != out.bucket)
+            break;
     }
-    return false;
 }
 
 void all_identifiers_starting_with(const Contents& contents,
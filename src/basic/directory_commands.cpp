@@ -486,6 +486,7 @@ static void command_directory_rename_path_callback(Editor* editor,
         buffer->name.len = 0;
         buffer->name.reserve(cz::heap_allocator(), name.len);
         buffer->name.append(name);
+        editor->file_watcher.rename_buffer(buffer, handle);
 
         reset_mode(editor, buffer, handle);
     }
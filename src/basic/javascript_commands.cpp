@@ -124,6 +124,7 @@ static Asynchronous_Job job_jq_handle_result(const Job_Jq& state) {
     job.tick = do_tick;
     job.kill = do_kill;
     job.data = data;
+    job.buffer = job_buffer_key(data->buffer);
     return job;
 }
 
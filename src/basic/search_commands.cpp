@@ -464,76 +464,67 @@ void command_search_forward_expanding(Editor* editor, Command_Source source) {
 // search_{backward/forward}_identifier implementation
 ///////////////////////////////////////////////////////////////////////////////
 
-/// Find identifier in bucket.
+/// Test if the `len` characters at `it` are an entire identifier.
+static bool is_whole_identifier(Contents_Iterator it, uint64_t len) {
+    // If character before is an identifier character then
+    // `it` is not at the start of an identifier.
+    if (!it.at_bob()) {
+        Contents_Iterator temp = it;
+        temp.retreat();
+        char before = temp.get();
+        if (cz::is_alnum(before) || before == '_')
+            return false;
+    }
+
+    // Check character after region is not an identifier.
+    it.advance(len);
+    if (!it.at_eob()) {
+        char after = it.get();
+        if (cz::is_alnum(after) || after == '_')
+            return false;
+    }
+
+    return true;
+}
+
+/// Find identifier in bucket.  `out` is at the start of `bucket`.
 static bool look_in(cz::Slice<char> bucket,
                     cz::Str identifier,
                     Contents_Iterator* out,
                     bool forward) {
     ZoneScoped;
-    const cz::Str str = {bucket.elems, bucket.len};
-    const char first = identifier[0];
+    if (bucket.len == 0)
+        return false;
+
+    // Candidates are found with the vectorized bucket searches.
     Contents_Iterator test_start = *out;
+    size_t bucket_index = test_start.bucket;
     if (!forward)
-        test_start.advance(str.len);
-    size_t index = forward ? 0 : str.len;
-    bool first_iteration = true;
+        test_start.advance(bucket.len);
     while (1) {
-        // Find the start of the test identifier.
-        const char* fst;
-        if (forward)
-            fst = str.slice_start(index).find(first);
-        else
-            fst = str.slice_end(index).rfind(first);
-        if (!fst)
-            break;
-
-        size_t old_index = index;
-        index = fst - str.buffer;
         if (forward) {
-            ++index;
-            if (first_iteration) {
-                first_iteration = false;
-            } else {
-                test_start.advance();
-            }
+            if (!find_bucket(&test_start, identifier))
+                return false;
+        } else {
+            if (!rfind_bucket(&test_start, identifier))
+                return false;
         }
 
-        if (forward)
-            test_start.advance(fst - (str.buffer + old_index));
-        else
-            test_start.retreat((str.buffer + old_index) - fst);
-
-        // If character before is an identifier character then
-        // `test_start` is not at the start of an identifier.
-        if (!test_start.at_bob()) {
-            Contents_Iterator temp = test_start;
-            temp.retreat();
-            char before = temp.get();
-            if (cz::is_alnum(before) || before == '_')
-                continue;
+        if (is_whole_identifier(test_start, identifier.len)) {
+            *out = test_start;
+            return true;
         }
 
-        // Check character after region is not an identifier.
-        if (test_start.position + identifier.len >= test_start.contents->len) {
-            if (test_start.position + identifier.len > test_start.contents->len)
-                continue;
+        if (forward) {
+            test_start.advance();
+            if (test_start.bucket != bucket_index)
+                return false;
         } else {
-            Contents_Iterator test_end = test_start;
-            test_end.advance(identifier.len);
-            CZ_DEBUG_ASSERT(test_end.position < test_end.contents->len);
-            char after = test_end.get();
-            if (cz::is_alnum(after) || after == '_')
-                continue;
+            // Prevent going into previous bucket.
+            if (test_start.index == 0)
+                return false;
         }
-
-        // Check matches.
-        if (!looking_at(test_start, identifier))
-            continue;
-
-        *out = test_start;
-        return true;
     }
-    return false;
 }
 
 bool rfind_identifier(Contents_Iterator* iterator, cz::Str query) {
@@ -283,6 +283,7 @@ static Asynchronous_Job job_clang_format(size_t change_index,
     job.tick = clang_format_job_tick;
     job.kill = clang_format_job_kill;
     job.data = data;
+    job.buffer = job_buffer_key(buffer_handle);
     return job;
 }
 
@@ -11,6 +11,7 @@
 #include <cz/file.hpp>
 #include <cz/format.hpp>
 #include <cz/heap.hpp>
+#include <string.h>
 #include <thread>
 #include <tracy/Tracy.hpp>
 #include "core/client.hpp"
@@ -22,6 +23,7 @@
 #include "custom/config.hpp"
 #include "render/cell.hpp"
 #include "render/render.hpp"
+#include "render/render_generation.hpp"
 #include "render/window_cache.hpp"
 
 using namespace mag::render;
@@ -181,11 +183,141 @@ static size_t get_color_pair_or_assign(NcursesColorPair* color_pairs,
     return i;
 }
 
+static uint64_t hash_face_color(uint64_t hash, Face_Color color) {
+    uint32_t value = color.is_themed
+                         ? (uint32_t)(uint16_t)color.x.theme_index
+                         : (1 << 24) | (color.x.color.r << 16) | (color.x.color.g << 8) |
+                               color.x.color.b;
+    return (hash ^ value) * 0x100000001b3;
+}
+
+static uint64_t hash_row(const Cell* row, int cols) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (int x = 0; x < cols; ++x) {
+        hash = (hash ^ (uint8_t)row[x].code) * 0x100000001b3;
+        hash = (hash ^ row[x].face.flags) * 0x100000001b3;
+        hash = hash_face_color(hash, row[x].face.foreground);
+        hash = hash_face_color(hash, row[x].face.background);
+    }
+    return hash;
+}
+
+/// If a block of rows moved vertically between the previous and current frames then scroll that
+/// region of the terminal so only the newly exposed rows have to be drawn.  `cellss[0]` is
+/// updated to reflect the new contents of the terminal so the normal diff fixes up the rest.
+/// Returns `true` if the terminal was scrolled and thus needs to be refreshed.
+static bool scroll_moved_rows(Cell** cellss, int rows, int cols) {
+    ZoneScoped;
+
+    cz::Vector<uint64_t> hashes = {};
+    CZ_DEFER(hashes.drop(cz::heap_allocator()));
+    hashes.reserve_exact(cz::heap_allocator(), rows * 2);
+    hashes.len = rows * 2;
+    uint64_t* old_hashes = hashes.elems;
+    uint64_t* new_hashes = hashes.elems + rows;
+
+    int changed_rows = 0;
+    for (int y = 0; y < rows; ++y) {
+        old_hashes[y] = hash_row(cellss[0] + y * cols, cols);
+        new_hashes[y] = hash_row(cellss[1] + y * cols, cols);
+        changed_rows += (old_hashes[y] != new_hashes[y]);
+    }
+
+    // Scrolling a few lines isn't worth the extra escape sequences.
+    const int min_rows = 3;
+    if (changed_rows < min_rows) {
+        return false;
+    }
+
+    // Find the shift that reuses the most changed rows in one contiguous block
+    // where each new row `y` in `[best_start, best_end)` was old row `y + best_shift`.
+    int best_shift = 0, best_start = 0, best_end = 0, best_score = 0;
+    for (int shift = 1 - rows; shift < rows; ++shift) {
+        if (shift == 0) {
+            continue;
+        }
+
+        int start = std::max(0, -shift);
+        int end = std::min(rows, rows - shift);
+        int run_start = start;
+        int score = 0;
+        for (int y = start; y <= end; ++y) {
+            if (y < end && new_hashes[y] == old_hashes[y + shift]) {
+                score += (new_hashes[y] != old_hashes[y]);
+                continue;
+            }
+
+            if (score > best_score) {
+                best_shift = shift;
+                best_start = run_start;
+                best_end = y;
+                best_score = score;
+            }
+            run_start = y + 1;
+            score = 0;
+        }
+    }
+
+    if (best_score < min_rows) {
+        return false;
+    }
+
+    // Scroll the region containing both the old and new positions of the block.
+    int top = std::min(best_start, best_start + best_shift);
+    int bottom = std::max(best_end, best_end + best_shift) - 1;
+    setscrreg(top, bottom);
+    scrollok(stdscr, TRUE);
+    wscrl(stdscr, best_shift);
+    scrollok(stdscr, FALSE);
+    setscrreg(0, rows - 1);
+
+    // Mirror the scroll in the previous frame.  Rows scrolled in are blank.
+    Cell* old_cells = cellss[0];
+    if (best_shift > 0) {
+        memmove(old_cells + top * cols, old_cells + (top + best_shift) * cols,
+                (bottom + 1 - top - best_shift) * cols * sizeof(Cell));
+        for (int i = (bottom + 1 - best_shift) * cols; i < (bottom + 1) * cols; ++i) {
+            old_cells[i] = {{}, ' '};
+        }
+    } else {
+        memmove(old_cells + (top - best_shift) * cols, old_cells + top * cols,
+                (bottom + 1 - top + best_shift) * cols * sizeof(Cell));
+        for (int i = top * cols; i < (top - best_shift) * cols; ++i) {
+            old_cells[i] = {{}, ' '};
+        }
+    }
+    return true;
+}
+
+/// Compute the ncurses attributes and color pair used to draw `face`.
+static void face_attributes(NcursesColorPair* color_pairs,
+                            size_t* num_allocated_colors,
+                            const Face& face,
+                            int* attrs,
+                            size_t* color_pair) {
+    *attrs = A_NORMAL;
+    if (face.flags & Face::UNDERSCORE) {
+        *attrs |= A_UNDERLINE;
+    }
+    if (face.flags & Face::BOLD) {
+        *attrs |= A_BOLD;
+    }
+    if (face.flags & Face::REVERSE) {
+        *attrs |= A_REVERSE;
+    }
+    if (face.flags & Face::ITALICS) {
+        *attrs |= A_UNDERLINE;
+    }
+
+    *color_pair = get_color_pair_or_assign(color_pairs, num_allocated_colors, face, attrs);
+}
+
 static void render(int* total_rows,
                    int* total_cols,
                    Cell** cellss,
                    Window_Cache** window_cache,
                    Window_Cache** mini_buffer_window_cache,
+                   uint64_t* previous_generation,
                    Editor* editor,
                    Client* client,
                    NcursesColorPair* color_pairs,
@@ -222,42 +354,75 @@ static void render(int* total_rows,
         }
     }
 
+    // Skip the frame if nothing observable changed since the last one.
+    uint64_t generation = render_generation(editor, client, rows, cols);
+    if (generation != 0 && generation == *previous_generation) {
+        FrameMark;
+        return;
+    }
+
     bool any_animated_scrolling = false;
-    render_to_cells(cellss[1], window_cache, mini_buffer_window_cache, rows, cols, editor, client,
-                    &any_animated_scrolling);
+    render_to_cells(cellss[1], cellss[0], window_cache, mini_buffer_window_cache, rows, cols,
+                    editor, client, &any_animated_scrolling);
+
+    // Rendering can update the state (ie scrolling to the cursor) so use the
+    // state after rendering.  Keep rendering while animations are running.
+    *previous_generation = 0;
+    if (!any_animated_scrolling) {
+        *previous_generation = render_generation(editor, client, rows, cols);
+    }
 
     bool any = any_animated_scrolling;
+
+    if (custom::ncurses_scroll_region) {
+        any |= scroll_moved_rows(cellss, rows, cols);
+    }
+
     {
         ZoneScopedN("blit cells");
-        int index = 0;
+
+        // Write runs of changed cells with the same face in one call
+        // and only change the attributes when they actually change.
+        int current_attrs = -1;
+        size_t current_color_pair = -1;
+        char run[256];
+
         for (int y = 0; y < rows; ++y) {
-            for (int x = 0; x < cols; ++x) {
-                Cell* new_cell = &cellss[1][index];
-                if (cellss[0][index] != *new_cell) {
-                    int attrs = A_NORMAL;
-                    if (new_cell->face.flags & Face::UNDERSCORE) {
-                        attrs |= A_UNDERLINE;
-                    }
-                    if (new_cell->face.flags & Face::BOLD) {
-                        attrs |= A_BOLD;
-                    }
-                    if (new_cell->face.flags & Face::REVERSE) {
-                        attrs |= A_REVERSE;
-                    }
-                    if (new_cell->face.flags & Face::ITALICS) {
-                        attrs |= A_UNDERLINE;
-                    }
-
-                    size_t color_pair = get_color_pair_or_assign(color_pairs, num_allocated_colors,
-                                                                 new_cell->face, &attrs);
+            int index = y * cols;
+            for (int x = 0; x < cols;) {
+                if (cellss[0][index + x] == cellss[1][index + x]) {
+                    ++x;
+                    continue;
+                }
 
+                const Face& face = cellss[1][index + x].face;
+                int run_start = x;
+                int run_len = 0;
+                do {
+                    // `mvaddnstr` stops at null terminators.
+                    char code = cellss[1][index + x].code;
+                    run[run_len++] = (code == '\0' ? ' ' : code);
+                    ++x;
+                } while (x < cols && run_len < (int)sizeof(run) &&
+                         cellss[0][index + x] != cellss[1][index + x] &&
+                         cellss[1][index + x].face.foreground == face.foreground &&
+                         cellss[1][index + x].face.background == face.background &&
+                         cellss[1][index + x].face.flags == face.flags);
+
+                int attrs;
+                size_t color_pair;
+                face_attributes(color_pairs, num_allocated_colors, face, &attrs, &color_pair);
+                if (attrs != current_attrs) {
                     attrset(attrs);
+                    current_attrs = attrs;
+                }
+                if (color_pair != current_color_pair) {
                     color_set(color_pair, nullptr);
-
-                    mvaddch(y, x, new_cell->code);
-                    any = true;
+                    current_color_pair = color_pair;
                 }
-                ++index;
+
+                mvaddnstr(y, run_start, run, run_len);
+                any = true;
             }
         }
         move(client->cursor_pos_y, client->cursor_pos_x);
@@ -526,6 +691,10 @@ void run(Server* server, Client* client) {
     raw();
     noecho();
     keypad(stdscr, TRUE);
+    if (custom::ncurses_scroll_region) {
+        // Allow ncurses to use the terminal's insert/delete line features.
+        idlok(stdscr, TRUE);
+    }
     curs_set(0);  // hide cursor
     if (custom::enable_terminal_mouse) {
         mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION, NULL);
@@ -577,6 +746,7 @@ void run(Server* server, Client* client) {
     CZ_DEFER(destroy_window_cache(window_cache));
     Window_Cache* mini_buffer_window_cache = nullptr;
     CZ_DEFER(destroy_window_cache(mini_buffer_window_cache));
+    uint64_t previous_generation = 0;
 
     nodelay(stdscr, TRUE);
 
@@ -592,14 +762,14 @@ void run(Server* server, Client* client) {
         load_mini_buffer_completion_cache(server, client);
 
         render(&total_rows, &total_cols, cellss, &window_cache, &mini_buffer_window_cache,
-               &server->editor, client, color_pairs, &num_allocated_colors);
+               &previous_generation, &server->editor, client, color_pairs, &num_allocated_colors);
 
         bool has_jobs = false;
         has_jobs |= (client->key_chain_offset < client->key_chain.len);
         has_jobs |= server->slurp_jobs();
         has_jobs |= server->run_synchronous_jobs(client);
 
-        process_buffer_external_updates(client, client->window);
+        server->editor.file_watcher.poll(&server->editor);
 
         int ch;
         if (has_jobs) {
@@ -27,6 +27,7 @@
 #include "custom/config.hpp"
 #include "render/cell.hpp"
 #include "render/render.hpp"
+#include "render/render_generation.hpp"
 #include "render/window_cache.hpp"
 
 #ifdef _WIN32
@@ -92,61 +93,130 @@ static SDL_Surface* render_character(TTF_Font* font,
     return rendered_char;
 }
 
-static SDL_Surface* lookup_surface_cache(SDL_Surface**** surface_cache,
-                                         TTF_Font* font,
-                                         uint8_t underscore,
-                                         uint8_t bold,
-                                         uint8_t italics,
-                                         size_t theme_index,
-                                         SDL_Color color,
-                                         unsigned char character) {
-    ZoneScoped;
+/// The alpha mask of a rendered character.  Glyphs aren't cropped to their cell
+/// because italic and wide characters can overhang it to the right and bottom.
+struct Glyph {
+    int width;
+    int height;
+    /// `width * height` bytes.
+    const uint8_t* mask;
+};
+
+/// Every character rendered in one font style.
+struct Glyph_Style {
+    Glyph glyphs[UCHAR_MAX + 1];
+    /// The masks of all the glyphs in one allocation.
+    uint8_t* masks;
+    size_t masks_size;
+};
+
+/// Alpha masks of every character in each font style.  Drawing a cell composites its
+/// mask directly into the window surface instead of blitting a surface.
+struct Glyph_Atlas {
+    /// The size of a cell.
+    int width;
+    int height;
+
+    /// `styles[flags]` is the characters rendered with the style `flags`
+    /// (see `glyph_style`).  Styles are rasterized lazily.
+    Glyph_Style* styles[8];
+
+    /// Background coverage masks indexed by the set of rounded corners (see `corner_mask`).
+    uint8_t* corners;
+
+    size_t mask_size() const { return (size_t)width * height; }
 
-    if (!surface_cache[theme_index]) {
-        surface_cache[theme_index] = cz::heap_allocator().alloc_zeroed<SDL_Surface**>(8);
+    void drop() {
+        for (size_t i = 0; i < 8; ++i) {
+            if (styles[i]) {
+                cz::heap_allocator().dealloc(styles[i]->masks, styles[i]->masks_size);
+                cz::heap_allocator().dealloc(styles[i]);
+                styles[i] = nullptr;
+            }
+        }
+        if (corners) {
+            cz::heap_allocator().dealloc(corners, mask_size() * 16);
+            corners = nullptr;
+        }
     }
-    SDL_Surface*** surface_cache_1 = surface_cache[theme_index];
+};
 
-    uint8_t flags = underscore | (bold << 1) | (italics << 2);
-    if (!surface_cache_1[flags]) {
-        surface_cache_1[flags] =
-            cz::heap_allocator().alloc_zeroed<SDL_Surface*>((size_t)UCHAR_MAX + 1);
+static uint8_t glyph_style(uint8_t underscore, uint8_t bold, uint8_t italics) {
+    return underscore | (bold << 1) | (italics << 2);
+}
+
+/// Copy the alpha channel of `rendered_char` into `mask`.
+static void extract_alpha_mask(SDL_Surface* rendered_char, uint8_t* mask) {
+    SDL_Surface* argb = SDL_ConvertSurfaceFormat(rendered_char, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (!argb) {
+        return;
     }
-    SDL_Surface** surface_cache_2 = surface_cache_1[flags];
+    CZ_DEFER(SDL_FreeSurface(argb));
 
-    if (!surface_cache_2[character]) {
-        surface_cache_2[character] =
-            render_character(font, character, underscore, bold, italics, color);
+    SDL_LockSurface(argb);
+    CZ_DEFER(SDL_UnlockSurface(argb));
+
+    for (int y = 0; y < argb->h; ++y) {
+        const uint32_t* row = (const uint32_t*)((const char*)argb->pixels + y * argb->pitch);
+        for (int x = 0; x < argb->w; ++x) {
+            mask[y * argb->w + x] = (uint8_t)(row[x] >> 24);
+        }
     }
-    return surface_cache_2[character];
 }
 
-void drop_surface_cache(SDL_Surface**** surface_cache) {
+/// Rasterize every character in the style `flags`.
+static Glyph_Style* rasterize_glyph_style(TTF_Font* font, uint8_t flags) {
     ZoneScoped;
 
-    for (size_t theme_index = 0; theme_index < 256; ++theme_index) {
-        if (!surface_cache[theme_index]) {
-            continue;
-        }
+    Glyph_Style* style = cz::heap_allocator().alloc<Glyph_Style>();
+    CZ_ASSERT(style);
+    *style = {};
 
-        for (uint8_t flags = 0; flags < 8; ++flags) {
-            if (!surface_cache[theme_index][flags]) {
-                continue;
+    SDL_Surface* rendered_chars[UCHAR_MAX + 1] = {};
+    CZ_DEFER({
+        for (size_t character = 1; character <= UCHAR_MAX; ++character) {
+            if (rendered_chars[character]) {
+                SDL_FreeSurface(rendered_chars[character]);
             }
+        }
+    });
 
-            for (size_t character = 0; character <= UCHAR_MAX; ++character) {
-                if (!surface_cache[theme_index][flags][character]) {
-                    continue;
-                }
+    SDL_Color white = {0xFF, 0xFF, 0xFF, 0xFF};
+    for (size_t character = 1; character <= UCHAR_MAX; ++character) {
+        SDL_Surface* rendered_char = render_character(font, (char)character, flags & 1,
+                                                      (flags >> 1) & 1, (flags >> 2) & 1, white);
+        if (!rendered_char) {
+            continue;
+        }
+        rendered_chars[character] = rendered_char;
+        style->masks_size += (size_t)rendered_char->w * rendered_char->h;
+    }
 
-                SDL_FreeSurface(surface_cache[theme_index][flags][character]);
-            }
+    style->masks = cz::heap_allocator().alloc_zeroed<uint8_t>(style->masks_size);
+    CZ_ASSERT(style->masks || style->masks_size == 0);
 
-            cz::heap_allocator().dealloc(surface_cache[theme_index][flags], (size_t)UCHAR_MAX + 1);
+    uint8_t* mask = style->masks;
+    for (size_t character = 1; character <= UCHAR_MAX; ++character) {
+        SDL_Surface* rendered_char = rendered_chars[character];
+        if (!rendered_char) {
+            continue;
         }
+        extract_alpha_mask(rendered_char, mask);
+        style->glyphs[character] = {rendered_char->w, rendered_char->h, mask};
+        mask += (size_t)rendered_char->w * rendered_char->h;
+    }
+
+    return style;
+}
 
-        cz::heap_allocator().dealloc(surface_cache[theme_index], 8);
+static const Glyph* lookup_glyph(Glyph_Atlas* atlas,
+                                 TTF_Font* font,
+                                 uint8_t flags,
+                                 unsigned char character) {
+    if (!atlas->styles[flags]) {
+        atlas->styles[flags] = rasterize_glyph_style(font, flags);
     }
+    return &atlas->styles[flags]->glyphs[character];
 }
 
 static Face_Color get_face_color_or(Face_Color fc, int16_t deflt) {
@@ -815,13 +885,8 @@ static void process_scroll(Server* server, Client* client, Scroll_State* scroll,
     }
 }
 
-static void blit_surface(SDL_Surface* surface, SDL_Surface* rendered_char, SDL_Rect* rect) {
-    ZoneScopedN("SDL_BlitSurface");
-    SDL_BlitSurface(rendered_char, nullptr, surface, rect);
-}
-
-static void draw_corner(SDL_Surface* bg,
-                        SDL_Color color,
+static void draw_corner(uint8_t* mask,
+                        int width,
                         int x,
                         int y,
                         int radius,
@@ -839,77 +904,162 @@ static void draw_corner(SDL_Surface* bg,
                 continue;
             }
 
-            char* iter = (char*)bg->pixels;
-            if (y)
-                iter += (y + ry) * bg->pitch;
-            else
-                iter += (radius - ry - 1) * bg->pitch;
-            if (x)
-                iter += (x + rx) * bg->format->BytesPerPixel;
-            else
-                iter += (radius - rx - 1) * bg->format->BytesPerPixel;
+            int row = y ? y + ry : radius - ry - 1;
+            int column = x ? x + rx : radius - rx - 1;
+            uint8_t* iter = &mask[row * width + column];
 
             // Totally Outside
             if (rad >= radiusp12) {
-                *(uint32_t*)iter = 0;
+                *iter = 0;
                 continue;
             }
 
-            uint8_t a = (uint8_t)((color.a * (radiusp12 - rad)) / (radiusp12 - radius2));
-            uint32_t mp = SDL_MapRGBA(bg->format, color.r, color.g, color.b, a);
-            *(uint32_t*)iter = mp;
+            *iter = (uint8_t)((0xFF * (radiusp12 - rad)) / (radiusp12 - radius2));
         }
     }
 }
 
-static void render_background(SDL_Surface* surface,
-                              SDL_Color color,
-                              SDL_Rect rect,
-                              SDL_Color default_background,
-                              bool round_top_left,
-                              bool round_top_right,
-                              bool round_bottom_left,
-                              bool round_bottom_right) {
-    ZoneScoped;
-
-    uint32_t color32 = SDL_MapRGBA(surface->format, color.r, color.g, color.b, color.a);
-    uint32_t default_background32 =
-        SDL_MapRGBA(surface->format, default_background.r, default_background.g,
-                    default_background.b, default_background.a);
+enum {
+    ROUND_TOP_LEFT = 1,
+    ROUND_TOP_RIGHT = 2,
+    ROUND_BOTTOM_LEFT = 4,
+    ROUND_BOTTOM_RIGHT = 8,
+};
 
-    if (color32 == default_background32 ||
-        (!round_top_left && !round_top_right && !round_bottom_left && !round_bottom_right)) {
-        SDL_FillRect(surface, &rect, color32);
-        return;
+/// Get the coverage of a cell's background when the corners in `rounded` are rounded.
+static const uint8_t* corner_mask(Glyph_Atlas* atlas, uint8_t rounded) {
+    size_t mask_size = atlas->mask_size();
+    if (!atlas->corners) {
+        ZoneScopedN("rasterize corners");
+
+        atlas->corners = cz::heap_allocator().alloc<uint8_t>(mask_size * 16);
+        CZ_ASSERT(atlas->corners);
+        memset(atlas->corners, 0xFF, mask_size * 16);
+
+        int w = atlas->width;
+        int h = atlas->height;
+        int radius = (int)((float)w / 2.0f);
+        int radius2 = (radius - 1) * (radius - 1);
+        int radiusp12 = radius * radius;
+        for (uint8_t r = 0; r < 16; ++r) {
+            uint8_t* mask = atlas->corners + mask_size * r;
+            if (r & ROUND_TOP_LEFT) {
+                draw_corner(mask, w, 0, 0, radius, radiusp12, radius2);
+            }
+            if (r & ROUND_TOP_RIGHT) {
+                draw_corner(mask, w, w - radius, 0, radius, radiusp12, radius2);
+            }
+            if (r & ROUND_BOTTOM_LEFT) {
+                draw_corner(mask, w, 0, h - radius, radius, radiusp12, radius2);
+            }
+            if (r & ROUND_BOTTOM_RIGHT) {
+                draw_corner(mask, w, w - radius, h - radius, radius, radiusp12, radius2);
+            }
+        }
     }
+    return atlas->corners + mask_size * rounded;
+}
 
-    SDL_FillRect(surface, &rect, default_background32);
-
-    // TODO cache the surfaces
-    SDL_Surface* bg = SDL_CreateRGBSurfaceWithFormat(0, rect.w, rect.h, 32, SDL_PIXELFORMAT_RGBA32);
-    SDL_SetSurfaceBlendMode(bg, SDL_BLENDMODE_BLEND);
+static uint8_t blend_channel(uint8_t from, uint8_t to, uint8_t alpha) {
+    return (uint8_t)((from * (0xFF - alpha) + to * alpha + 0x7F) / 0xFF);
+}
 
-    SDL_FillRect(bg, nullptr, SDL_MapRGBA(bg->format, color.r, color.g, color.b, color.a));
+/// Cells are composited with plain loops over 32 bit pixels.  Window surfaces in
+/// other formats are drawn through a scratch surface (see `get_draw_surface`).
+static bool is_uncommon_format(const SDL_PixelFormat* format) {
+    return format->BytesPerPixel != 4 || format->Rloss || format->Gloss || format->Bloss;
+}
 
-    int radius = (int)((float)rect.w / 2.0f);
-    int radius2 = (radius - 1) * (radius - 1);
-    int radiusp12 = radius * radius;
-    if (round_top_left) {
-        draw_corner(bg, color, 0, 0, radius, radiusp12, radius2);
+/// Draw the background of a cell directly into `surface`.  The background is `background`
+/// blended over `default_background` by `coverage` (null means fully covered).
+/// `surface` must be locked and use a 32 bit format (see `is_uncommon_format`).
+static void composite_background(SDL_Surface* surface,
+                                 SDL_Rect rect,
+                                 const uint8_t* coverage,
+                                 SDL_Color background,
+                                 SDL_Color default_background) {
+    int w = cz::min(rect.w, surface->w - rect.x);
+    int h = cz::min(rect.h, surface->h - rect.y);
+
+    const SDL_PixelFormat* format = surface->format;
+    if (!coverage) {
+        SDL_FillRect(surface, &rect, SDL_MapRGB(format, background.r, background.g, background.b));
+        return;
     }
-    if (round_top_right) {
-        draw_corner(bg, color, rect.w - radius, 0, radius, radiusp12, radius2);
+
+    // Plain loops over bytes so the compiler can vectorize them.
+    for (int y = 0; y < h; ++y) {
+        uint32_t* row = (uint32_t*)((char*)surface->pixels + (rect.y + y) * surface->pitch);
+        row += rect.x;
+        const uint8_t* coverage_row = coverage + y * rect.w;
+        for (int x = 0; x < w; ++x) {
+            uint8_t c = coverage_row[x];
+            uint32_t r = blend_channel(default_background.r, background.r, c);
+            uint32_t g = blend_channel(default_background.g, background.g, c);
+            uint32_t b = blend_channel(default_background.b, background.b, c);
+            row[x] = (r << format->Rshift) | (g << format->Gshift) | (b << format->Bshift) |
+                     format->Amask;
+        }
     }
-    if (round_bottom_left) {
-        draw_corner(bg, color, 0, rect.h - radius, radius, radiusp12, radius2);
+}
+
+/// Blend `glyph` in `foreground` over `surface` with its top left corner at `(x0, y0)`.  The
+/// glyph is only clipped to the surface so it can overhang its cell.  `surface` must be locked
+/// and use a 32 bit format (see `is_uncommon_format`).
+static void composite_glyph(SDL_Surface* surface,
+                            int x0,
+                            int y0,
+                            const Glyph* glyph,
+                            SDL_Color foreground) {
+    int w = cz::min(glyph->width, surface->w - x0);
+    int h = cz::min(glyph->height, surface->h - y0);
+
+    const SDL_PixelFormat* format = surface->format;
+    // Most of a glyph is transparent so skipping those pixels is
+    // faster than blending every pixel in a loop that vectorizes.
+    for (int y = 0; y < h; ++y) {
+        uint32_t* row = (uint32_t*)((char*)surface->pixels + (y0 + y) * surface->pitch);
+        row += x0;
+        const uint8_t* glyph_row = glyph->mask + y * glyph->width;
+        for (int x = 0; x < w; ++x) {
+            uint8_t a = glyph_row[x];
+            if (a == 0) {
+                continue;
+            }
+            uint32_t pixel = row[x];
+            uint32_t r = blend_channel((uint8_t)(pixel >> format->Rshift), foreground.r, a);
+            uint32_t g = blend_channel((uint8_t)(pixel >> format->Gshift), foreground.g, a);
+            uint32_t b = blend_channel((uint8_t)(pixel >> format->Bshift), foreground.b, a);
+            row[x] = (r << format->Rshift) | (g << format->Gshift) | (b << format->Bshift) |
+                     format->Amask;
+        }
     }
-    if (round_bottom_right) {
-        draw_corner(bg, color, rect.w - radius, rect.h - radius, radius, radiusp12, radius2);
+}
+
+/// Get the surface to draw cells into.  This is the window surface unless it uses an uncommon
+/// format in which case it is `*scratch`, recreated whenever the size of the window changes.
+/// Sets `force_redraw` if the scratch surface was recreated since it starts out empty.
+static SDL_Surface* get_draw_surface(SDL_Surface* window_surface,
+                                     SDL_Surface** scratch,
+                                     bool* force_redraw) {
+    if (!is_uncommon_format(window_surface->format)) {
+        return window_surface;
     }
 
-    blit_surface(surface, bg, &rect);
+    if (*scratch && (*scratch)->w == window_surface->w && (*scratch)->h == window_surface->h) {
+        return *scratch;
+    }
 
-    SDL_FreeSurface(bg);
+    if (*scratch) {
+        SDL_FreeSurface(*scratch);
+    }
+    *scratch = SDL_CreateRGBSurfaceWithFormat(0, window_surface->w, window_surface->h, 32,
+                                              SDL_PIXELFORMAT_ARGB8888);
+    CZ_ASSERT(*scratch);
+    // Copy the pixels as is instead of blending them by their alpha.
+    SDL_SetSurfaceBlendMode(*scratch, SDL_BLENDMODE_NONE);
+    *force_redraw = true;
+    return *scratch;
 }
 
 static Face_Color bg_color_of(const Cell& new_cell) {
@@ -922,9 +1072,47 @@ static Face_Color bg_color_of(const Cell& new_cell) {
     }
 }
 
+/// Add the area of a redrawn cell to the list of areas to upload, merging it
+/// into the previous area if it continues the same run of cells on a row.
+static void add_dirty_rect(cz::Vector<SDL_Rect>* dirty_rects, const SDL_Rect& rect) {
+    if (dirty_rects->len > 0) {
+        SDL_Rect* last = &dirty_rects->last();
+        if (last->y == rect.y && last->h == rect.h && last->x + last->w >= rect.x) {
+            SDL_UnionRect(last, &rect, last);
+            return;
+        }
+    }
+
+    dirty_rects->reserve(cz::heap_allocator(), 1);
+    dirty_rects->push(rect);
+}
+
+/// Merge runs on consecutive rows that span the same columns into one rectangle.
+static void merge_dirty_rects_vertically(cz::Vector<SDL_Rect>* dirty_rects) {
+    ZoneScoped;
+
+    size_t merged = 0;
+    for (size_t i = 0; i < dirty_rects->len; ++i) {
+        const SDL_Rect& rect = (*dirty_rects)[i];
+        size_t j = merged;
+        while (j-- > 0) {
+            SDL_Rect* above = &(*dirty_rects)[j];
+            if (above->x == rect.x && above->w == rect.w && above->y + above->h == rect.y) {
+                above->h += rect.h;
+                break;
+            }
+        }
+        if (j == (size_t)-1) {
+            (*dirty_rects)[merged++] = rect;
+        }
+    }
+    dirty_rects->len = merged;
+}
+
 static void render(SDL_Window* window,
                    TTF_Font* font,
-                   SDL_Surface**** surface_cache,
+                   Glyph_Atlas* atlas,
+                   SDL_Surface** scratch,
                    int* old_width,
                    int* old_height,
                    int* total_rows,
@@ -934,17 +1122,19 @@ static void render(SDL_Window* window,
                    Cell** cellss,
                    Window_Cache** window_cache,
                    Window_Cache** mini_buffer_window_cache,
+                   uint64_t* previous_generation,
                    Editor* editor,
                    Client* client,
                    bool force_redraw,
                    bool* redrew) {
     ZoneScoped;
 
-    SDL_Surface* surface;
+    SDL_Surface* window_surface;
     {
         ZoneScopedN("SDL_GetWindowSurface");
-        surface = SDL_GetWindowSurface(window);
+        window_surface = SDL_GetWindowSurface(window);
     }
+    SDL_Surface* surface = get_draw_surface(window_surface, scratch, &force_redraw);
 
     int rows, cols;
     {
@@ -987,16 +1177,41 @@ static void render(SDL_Window* window,
         }
     }
 
+    // Skip the frame if nothing observable changed since the last one.
+    uint64_t generation = render_generation(editor, client, rows, cols);
+    if (!force_redraw && generation != 0 && generation == *previous_generation) {
+        return;
+    }
+
     bool any_animated_scrolling = false;
-    render_to_cells(cellss[1], window_cache, mini_buffer_window_cache, rows, cols, editor, client,
-                    &any_animated_scrolling);
+    render_to_cells(cellss[1], cellss[0], window_cache, mini_buffer_window_cache, rows, cols,
+                    editor, client, &any_animated_scrolling);
+
+    // Rendering can update the state (ie scrolling to the cursor) so use the
+    // state after rendering.  Keep rendering while animations are running.
+    *previous_generation = 0;
+    if (!any_animated_scrolling) {
+        *previous_generation = render_generation(editor, client, rows, cols);
+    }
 
     bool any_changes = any_animated_scrolling;
     const SDL_Color default_background = make_color(editor->theme.colors, {0});
 
+    // The areas of the surface that were redrawn and thus need to be uploaded.
+    cz::Vector<SDL_Rect> dirty_rects = {};
+    CZ_DEFER(dirty_rects.drop(cz::heap_allocator()));
+    cz::Vector<int> redrawn_cells = {};
+    CZ_DEFER(redrawn_cells.drop(cz::heap_allocator()));
+
     {
         ZoneScopedN("draw cells");
 
+        SDL_LockSurface(surface);
+        CZ_DEFER(SDL_UnlockSurface(surface));
+
+        // Draw the backgrounds first so glyphs overhanging their cell aren't painted over by
+        // the background of the next cell.  A cell is redrawn if any of its neighbors changed
+        // because either could have overhung the other.
         for (int y = 0, index = 0; y < rows; ++y) {
             for (int x = 0; x < cols; ++x, ++index) {
                 Cell* new_cell = &cellss[1][index];
@@ -1009,8 +1224,8 @@ static void render(SDL_Window* window,
                 }
 
                 any_changes = true;
-
-                ZoneScopedN("draw cell background");
+                redrawn_cells.reserve(cz::heap_allocator(), 1);
+                redrawn_cells.push(index);
 
                 Face_Color bg = bg_color_of(*new_cell);
 
@@ -1020,10 +1235,11 @@ static void render(SDL_Window* window,
                 bool match_top    = (y     != 0    && bg_color_of(cellss[1][index - cols]) == bg);
                 bool match_bottom = (y + 1 != rows && bg_color_of(cellss[1][index + cols]) == bg);
 
-                bool round_top_left     = !match_top    && !match_left;
-                bool round_top_right    = !match_top    && !match_right;
-                bool round_bottom_left  = !match_bottom && !match_left;
-                bool round_bottom_right = !match_bottom && !match_right;
+                uint8_t rounded = 0;
+                if (!match_top    && !match_left)  rounded |= ROUND_TOP_LEFT;
+                if (!match_top    && !match_right) rounded |= ROUND_TOP_RIGHT;
+                if (!match_bottom && !match_left)  rounded |= ROUND_BOTTOM_LEFT;
+                if (!match_bottom && !match_right) rounded |= ROUND_BOTTOM_RIGHT;
                 // clang-format on
 
                 SDL_Rect rect;
@@ -1031,62 +1247,51 @@ static void render(SDL_Window* window,
                 rect.y = y * character_height;
                 rect.w = character_width;
                 rect.h = character_height;
+                add_dirty_rect(&dirty_rects, rect);
 
                 SDL_Color bgc = make_color(editor->theme.colors, bg);
 
-                render_background(surface, bgc, rect, default_background, round_top_left,
-                                  round_top_right, round_bottom_left, round_bottom_right);
-                bgc = {};
-            }
-        }
-
-        for (int y = 0, index = 0; y < rows; ++y) {
-            for (int x = 0; x < cols; ++x, ++index) {
-                Cell* new_cell = &cellss[1][index];
-                if (!force_redraw && cellss[0][index] == *new_cell &&
-                    (x == 0 || cellss[0][index - 1] == cellss[1][index - 1]) &&
-                    (x + 1 == cols || cellss[0][index + 1] == cellss[1][index + 1]) &&
-                    (y == 0 || cellss[0][index - cols] == cellss[1][index - cols]) &&
-                    (y + 1 == rows || cellss[0][index + cols] == cellss[1][index + cols])) {
-                    continue;
+                // Backgrounds matching the default background are never rounded.
+                const uint8_t* coverage = nullptr;
+                if (rounded && (bgc.r != default_background.r || bgc.g != default_background.g ||
+                                bgc.b != default_background.b)) {
+                    coverage = corner_mask(atlas, rounded);
                 }
 
-                ZoneScopedN("draw cell foreground");
+                composite_background(surface, rect, coverage, bgc, default_background);
+            }
+        }
 
-                Face_Color fg = (new_cell->face.flags & Face::REVERSE) ? new_cell->face.background
-                                                                       : new_cell->face.foreground;
-                fg = get_face_color_or(fg, (new_cell->face.flags & Face::REVERSE) ? 0 : 7);
+        for (size_t i = 0; i < redrawn_cells.len; ++i) {
+            int index = redrawn_cells[i];
+            Cell* new_cell = &cellss[1][index];
 
-                SDL_Rect rect;
-                rect.x = x * character_width;
-                rect.y = y * character_height;
-                rect.w = character_width;
-                rect.h = character_height;
+            Face_Color fg = (new_cell->face.flags & Face::REVERSE) ? new_cell->face.background
+                                                                   : new_cell->face.foreground;
+            fg = get_face_color_or(fg, (new_cell->face.flags & Face::REVERSE) ? 0 : 7);
+            SDL_Color fgc = make_color(editor->theme.colors, fg);
 
-                SDL_Color fgc = make_color(editor->theme.colors, fg);
-
-                // We only cache themed colors.
-                SDL_Surface* rendered_char;
-                if (fg.is_themed) {
-                    rendered_char = lookup_surface_cache(
-                        surface_cache, font, !!(new_cell->face.flags & Face::UNDERSCORE),
-                        !!(new_cell->face.flags & Face::BOLD),
-                        !!(new_cell->face.flags & Face::ITALICS), fg.x.theme_index, fgc,
-                        new_cell->code);
-                } else {
-                    rendered_char = render_character(font, new_cell->code,
-                                                     !!(new_cell->face.flags & Face::UNDERSCORE),
-                                                     !!(new_cell->face.flags & Face::BOLD),
-                                                     !!(new_cell->face.flags & Face::ITALICS), fgc);
-                }
-
-                if (!rendered_char) {
-                    fprintf(stderr, "Failed to render text '%c': %s\n", new_cell->code,
-                            TTF_GetError());
-                    continue;
-                }
+            uint8_t style = glyph_style(!!(new_cell->face.flags & Face::UNDERSCORE),
+                                        !!(new_cell->face.flags & Face::BOLD),
+                                        !!(new_cell->face.flags & Face::ITALICS));
+            const Glyph* glyph = lookup_glyph(atlas, font, style, new_cell->code);
+            if (!glyph->mask) {
+                continue;
+            }
 
-                blit_surface(surface, rendered_char, &rect);
+            SDL_Rect cell_rect;
+            cell_rect.x = (index % cols) * character_width;
+            cell_rect.y = (index / cols) * character_height;
+            cell_rect.w = character_width;
+            cell_rect.h = character_height;
+            composite_glyph(surface, cell_rect.x, cell_rect.y, glyph, fgc);
+
+            // Upload the part of the glyph overhanging the cell too.
+            SDL_Rect glyph_rect = {cell_rect.x, cell_rect.y, glyph->width, glyph->height};
+            SDL_Rect drawn_rect;
+            SDL_UnionRect(&cell_rect, &glyph_rect, &drawn_rect);
+            if (!SDL_RectEquals(&drawn_rect, &cell_rect)) {
+                add_dirty_rect(&dirty_rects, drawn_rect);
             }
         }
     }
@@ -1094,8 +1299,36 @@ static void render(SDL_Window* window,
     if (any_changes) {
         cz::swap(cellss[0], cellss[1]);
 
-        ZoneScopedN("SDL_UpdateWindowSurface");
-        SDL_UpdateWindowSurface(window);
+        merge_dirty_rects_vertically(&dirty_rects);
+
+        bool upload_all = force_redraw || dirty_rects.len > 256;
+        if (surface != window_surface) {
+            ZoneScopedN("blit scratch surface");
+            if (upload_all) {
+                SDL_BlitSurface(surface, nullptr, window_surface, nullptr);
+            } else {
+                for (size_t i = 0; i < dirty_rects.len; ++i) {
+                    // `SDL_BlitSurface` clips the destination rectangle.
+                    SDL_Rect destination = dirty_rects[i];
+                    SDL_BlitSurface(surface, &dirty_rects[i], window_surface, &destination);
+                }
+            }
+        }
+
+        // Uploading many tiny rectangles is slower than uploading the entire surface.
+        int64_t pixels = 0;
+        if (upload_all) {
+            ZoneScopedN("SDL_UpdateWindowSurface");
+            SDL_UpdateWindowSurface(window);
+            pixels = (int64_t)surface->w * surface->h;
+        } else if (dirty_rects.len > 0) {
+            ZoneScopedN("SDL_UpdateWindowSurfaceRects");
+            SDL_UpdateWindowSurfaceRects(window, dirty_rects.elems, (int)dirty_rects.len);
+            for (size_t i = 0; i < dirty_rects.len; ++i) {
+                pixels += (int64_t)dirty_rects[i].w * dirty_rects[i].h;
+            }
+        }
+        TracyPlot("SDL pixels uploaded", pixels);
 
         *redrew = true;
     }
@@ -1180,7 +1413,7 @@ static bool load_font(Client* client,
                       TTF_Font** font,
                       int* character_width,
                       int* character_height,
-                      SDL_Surface**** surface_cache,
+                      Glyph_Atlas* atlas,
                       cz::Str new_font_file,
                       uint32_t new_font_size,
                       float dpi_scale) {
@@ -1221,8 +1454,9 @@ static bool load_font(Client* client,
     }
     *font = new_font;
 
-    drop_surface_cache(surface_cache);
-    memset(surface_cache, 0, 256 * sizeof(*surface_cache));
+    atlas->drop();
+    atlas->width = *character_width;
+    atlas->height = *character_height;
     return true;
 }
 
@@ -1304,13 +1538,16 @@ void run(Server* server, Client* client) {
     int character_width;
     int character_height;
 
-    // SDL_Surface* surface_cache[fg.theme_index(256)][Face::flags(8)][char(UCHAR_MAX + 1)]
-    SDL_Surface*** surface_cache[256] = {};
-    CZ_DEFER(drop_surface_cache(surface_cache));
+    Glyph_Atlas atlas = {};
+    CZ_DEFER(atlas.drop());
+
+    // Only used if the window surface isn't 32 bit.
+    SDL_Surface* scratch = nullptr;
+    CZ_DEFER(if (scratch) SDL_FreeSurface(scratch));
 
     // Load the font.
     load_font(client, &font_file, &font_size, &font, &character_width, &character_height,
-              surface_cache, server->editor.theme.font_file, server->editor.theme.font_size,
+              &atlas, server->editor.theme.font_file, server->editor.theme.font_size,
               dpi_scale);
 
     int old_width = 0;
@@ -1328,6 +1565,7 @@ void run(Server* server, Client* client) {
     CZ_DEFER(destroy_window_cache(window_cache));
     Window_Cache* mini_buffer_window_cache = nullptr;
     CZ_DEFER(destroy_window_cache(mini_buffer_window_cache));
+    uint64_t previous_generation = 0;
 
     SDL_StartTextInput();
     CZ_DEFER(SDL_StopTextInput());
@@ -1373,7 +1611,7 @@ void run(Server* server, Client* client) {
 
         process_scroll(server, client, &scroll, mod_state);
 
-        process_buffer_external_updates(client, client->window);
+        server->editor.file_watcher.poll(&server->editor);
 
         server->process_key_chain(client, /*in_batch_paste=*/false);
 
@@ -1388,7 +1626,7 @@ void run(Server* server, Client* client) {
             font_file.len = 0;
 
             load_font(client, &font_file, &font_size, &font, &character_width, &character_height,
-                      surface_cache, server->editor.theme.font_file, server->editor.theme.font_size,
+                      &atlas, server->editor.theme.font_file, server->editor.theme.font_size,
                       dpi_scale);
 
             // Redraw the screen with the new font info.
@@ -1406,9 +1644,9 @@ void run(Server* server, Client* client) {
         }
 
         bool redrew_this_time = false;
-        render(window, font, surface_cache, &old_width, &old_height, &total_rows, &total_cols,
+        render(window, font, &atlas, &scratch, &old_width, &old_height, &total_rows, &total_cols,
                character_width, character_height, cellss, &window_cache, &mini_buffer_window_cache,
-               &server->editor, client, force_redraw, &redrew_this_time);
+               &previous_generation, &server->editor, client, force_redraw, &redrew_this_time);
 
         force_redraw = false;
 
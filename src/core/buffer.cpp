@@ -46,6 +46,7 @@ void Buffer::drop() {
     contents.drop();
 
     token_cache.drop();
+    token_index.drop();
 
     mode.drop();
 }
@@ -71,8 +72,91 @@ static bool remove(Contents* contents, uint64_t position, cz::Str str) {
     return true;
 }
 
+/// Commits with at least this many edits (ie one per cursor) are applied in one sweep.
+#define BATCH_EDITS_THRESHOLD 16
+
+/// Apply (or unapply if `undo`) `edits` in one sweep over the buckets.  This only works
+/// if the edits are in ascending order (as edits from multiple cursors are).  Returns `false`
+/// if the edits couldn't be batched and otherwise stores whether they applied in `*result`.
+static bool apply_edits_batched(Buffer* buffer,
+                                cz::Slice<const Edit> edits,
+                                bool undo,
+                                bool* result) {
+    if (edits.len < BATCH_EDITS_THRESHOLD) {
+        return false;
+    }
+
+    ZoneScoped;
+
+    cz::Vector<Contents_Splice> splices = {};
+    CZ_DEFER(splices.drop(cz::heap_allocator()));
+    splices.reserve_exact(cz::heap_allocator(), edits.len);
+
+    // Each edit is in the coordinates after the previous edits have been applied.  When undoing,
+    // the edits are ascending in the current coordinates so no conversion is necessary.
+    uint64_t min_position = 0;
+    uint64_t inserted = 0;
+    uint64_t removed = 0;
+    for (size_t i = 0; i < edits.len; ++i) {
+        const Edit& edit = edits[i];
+        if (edit.position < min_position) {
+            return false;
+        }
+
+        Contents_Splice splice = {};
+        splice.position = (undo ? edit.position : edit.position + removed - inserted);
+        bool insert = (edit.flags & Edit::INSERT_MASK);
+        if (insert != undo) {
+            splice.insert = edit.value.as_str();
+        } else {
+            splice.remove = edit.value.len();
+        }
+        splices.push(splice);
+
+        if (insert) {
+            inserted += edit.value.len();
+            min_position = edit.position + edit.value.len();
+        } else {
+            removed += edit.value.len();
+            min_position = edit.position;
+        }
+    }
+
+    // Validate all the edits before changing anything.
+    const Contents& contents = buffer->contents;
+    if (splices.last().position + splices.last().remove > contents.len) {
+        cz::dbreak();
+        *result = false;
+        return true;
+    }
+
+    Contents_Iterator iterator = contents.start();
+    for (size_t i = 0; i < splices.len; ++i) {
+        if (splices[i].remove == 0) {
+            continue;
+        }
+
+        iterator.advance_to(splices[i].position);
+        const Edit& edit = edits[i];
+        if (!looking_at(iterator, edit.value.as_str())) {
+            cz::dbreak();
+            *result = false;
+            return true;
+        }
+    }
+
+    buffer->contents.splice(splices);
+    *result = true;
+    return true;
+}
+
 static bool unapply_edits(Buffer* buffer, cz::Slice<const Edit> edits);
 static bool apply_edits(Buffer* buffer, cz::Slice<const Edit> edits) {
+    bool result;
+    if (apply_edits_batched(buffer, edits, /*undo=*/false, &result)) {
+        return result;
+    }
+
     for (size_t i = 0; i < edits.len; ++i) {
         bool r;
 
@@ -93,6 +177,11 @@ static bool apply_edits(Buffer* buffer, cz::Slice<const Edit> edits) {
 }
 
 static bool unapply_edits(Buffer* buffer, cz::Slice<const Edit> edits) {
+    bool result;
+    if (apply_edits_batched(buffer, edits, /*undo=*/true, &result)) {
+        return result;
+    }
+
     for (size_t i = edits.len; i-- > 0;) {
         bool r;
 
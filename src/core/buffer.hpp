@@ -13,6 +13,7 @@
 #include "core/mode.hpp"
 #include "core/ssostr.hpp"
 #include "core/token_cache.hpp"
+#include "core/token_index.hpp"
 
 namespace mag {
 struct Client;
@@ -94,6 +95,7 @@ struct Buffer {
     Mode mode;
 
     Token_Cache token_cache;
+    Token_Index token_index;
 
     void init();
 
@@ -0,0 +1,278 @@
+#include "byte_search.hpp"
+
+#include <stdint.h>
+#include <string.h>
+#include <cz/char_type.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BYTE_SEARCH_VECTORIZED 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BYTE_SEARCH_VECTORIZED 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace mag {
+
+#ifdef BYTE_SEARCH_VECTORIZED
+namespace {
+#if defined(__AVX2__)
+typedef __m256i Vector;
+const size_t WIDTH = 32;
+
+Vector splat(char ch) {
+    return _mm256_set1_epi8(ch);
+}
+
+/// Get a bit mask of the bytes at `str` that are either `a` or `b`.
+uint32_t mask_either(const char* str, Vector a, Vector b) {
+    Vector v = _mm256_loadu_si256((const Vector*)str);
+    Vector eq = _mm256_or_si256(_mm256_cmpeq_epi8(v, a), _mm256_cmpeq_epi8(v, b));
+    return (uint32_t)_mm256_movemask_epi8(eq);
+}
+#else
+typedef __m128i Vector;
+const size_t WIDTH = 16;
+
+Vector splat(char ch) {
+    return _mm_set1_epi8(ch);
+}
+
+/// Get a bit mask of the bytes at `str` that are either `a` or `b`.
+uint32_t mask_either(const char* str, Vector a, Vector b) {
+    Vector v = _mm_loadu_si128((const Vector*)str);
+    Vector eq = _mm_or_si128(_mm_cmpeq_epi8(v, a), _mm_cmpeq_epi8(v, b));
+    return (uint32_t)_mm_movemask_epi8(eq);
+}
+#endif
+}
+
+static unsigned lowest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static unsigned highest_bit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return index;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+#endif
+
+const char* find_either(const char* str, size_t len, char a, char b) {
+    size_t i = 0;
+
+#ifdef BYTE_SEARCH_VECTORIZED
+    Vector va = splat(a);
+    Vector vb = splat(b);
+    for (; i + WIDTH <= len; i += WIDTH) {
+        uint32_t mask = mask_either(str + i, va, vb);
+        if (mask) {
+            return str + i + lowest_bit(mask);
+        }
+    }
+#endif
+
+    for (; i < len; ++i) {
+        if (str[i] == a || str[i] == b) {
+            return str + i;
+        }
+    }
+    return nullptr;
+}
+
+const char* rfind_either(const char* str, size_t len, char a, char b) {
+    size_t end = len;
+
+#ifdef BYTE_SEARCH_VECTORIZED
+    Vector va = splat(a);
+    Vector vb = splat(b);
+    for (; end >= WIDTH; end -= WIDTH) {
+        uint32_t mask = mask_either(str + end - WIDTH, va, vb);
+        if (mask) {
+            return str + end - WIDTH + highest_bit(mask);
+        }
+    }
+#endif
+
+    while (end-- > 0) {
+        if (str[end] == a || str[end] == b) {
+            return str + end;
+        }
+    }
+    return nullptr;
+}
+
+namespace {
+/// A query along with the characters its first and last characters can match.
+struct Needle {
+    cz::Str query;
+    Case_Handling case_handling;
+    char first[2];
+    char last[2];
+};
+}
+
+static bool cased_char_match(char test, char query, Case_Handling case_handling) {
+    if (case_handling == Case_Handling::CASE_SENSITIVE ||
+        (case_handling == Case_Handling::UPPERCASE_STICKY && cz::is_upper(query))) {
+        return test == query;
+    }
+    return cz::to_lower(test) == cz::to_lower(query);
+}
+
+static void matching_chars(char ch, Case_Handling case_handling, char out[2]) {
+    if (case_handling == Case_Handling::CASE_SENSITIVE || !cz::is_alpha(ch) ||
+        (case_handling == Case_Handling::UPPERCASE_STICKY && cz::is_upper(ch))) {
+        out[0] = ch;
+        out[1] = ch;
+    } else {
+        out[0] = cz::to_lower(ch);
+        out[1] = cz::to_upper(ch);
+    }
+}
+
+static Needle make_needle(cz::Str query, Case_Handling case_handling) {
+    Needle needle;
+    needle.query = query;
+    needle.case_handling = case_handling;
+    matching_chars(query[0], case_handling, needle.first);
+    matching_chars(query[query.len - 1], case_handling, needle.last);
+    return needle;
+}
+
+static bool needle_matches(const char* str, const Needle& needle) {
+    if (needle.case_handling == Case_Handling::CASE_SENSITIVE) {
+        return memcmp(str, needle.query.buffer, needle.query.len) == 0;
+    }
+
+    for (size_t i = 0; i < needle.query.len; ++i) {
+        if (!cased_char_match(str[i], needle.query[i], needle.case_handling)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_candidate(const char* str, const Needle& needle) {
+    char first = str[0];
+    char last = str[needle.query.len - 1];
+    return (first == needle.first[0] || first == needle.first[1]) &&
+           (last == needle.last[0] || last == needle.last[1]);
+}
+
+/// Candidate positions are filtered by comparing both the first and the last character of the
+/// query at once, which rejects almost every position in real text before comparing the rest.
+static const char* find_needle(const char* str, size_t len, const Needle& needle) {
+    if (len < needle.query.len) {
+        return nullptr;
+    }
+
+    // Number of positions the match can start at.
+    size_t starts = len - needle.query.len + 1;
+    size_t i = 0;
+
+#ifdef BYTE_SEARCH_VECTORIZED
+    size_t last = needle.query.len - 1;
+    Vector first_a = splat(needle.first[0]);
+    Vector first_b = splat(needle.first[1]);
+    Vector last_a = splat(needle.last[0]);
+    Vector last_b = splat(needle.last[1]);
+    for (; i + WIDTH <= starts; i += WIDTH) {
+        uint32_t mask = mask_either(str + i, first_a, first_b) &
+                        mask_either(str + i + last, last_a, last_b);
+        while (mask) {
+            const char* candidate = str + i + lowest_bit(mask);
+            if (needle_matches(candidate, needle)) {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < starts; ++i) {
+        if (is_candidate(str + i, needle) && needle_matches(str + i, needle)) {
+            return str + i;
+        }
+    }
+    return nullptr;
+}
+
+static const char* rfind_needle(const char* str, size_t len, const Needle& needle) {
+    if (len < needle.query.len) {
+        return nullptr;
+    }
+
+    size_t end = len - needle.query.len + 1;
+
+#ifdef BYTE_SEARCH_VECTORIZED
+    size_t last = needle.query.len - 1;
+    Vector first_a = splat(needle.first[0]);
+    Vector first_b = splat(needle.first[1]);
+    Vector last_a = splat(needle.last[0]);
+    Vector last_b = splat(needle.last[1]);
+    for (; end >= WIDTH; end -= WIDTH) {
+        size_t i = end - WIDTH;
+        uint32_t mask = mask_either(str + i, first_a, first_b) &
+                        mask_either(str + i + last, last_a, last_b);
+        while (mask) {
+            unsigned bit = highest_bit(mask);
+            if (needle_matches(str + i + bit, needle)) {
+                return str + i + bit;
+            }
+            mask &= ~((uint32_t)1 << bit);
+        }
+    }
+#endif
+
+    while (end-- > 0) {
+        if (is_candidate(str + end, needle) && needle_matches(str + end, needle)) {
+            return str + end;
+        }
+    }
+    return nullptr;
+}
+
+const char* find_substring(const char* str, size_t len, cz::Str query) {
+    return find_substring_cased(str, len, query, Case_Handling::CASE_SENSITIVE);
+}
+
+const char* rfind_substring(const char* str, size_t len, cz::Str query) {
+    return rfind_substring_cased(str, len, query, Case_Handling::CASE_SENSITIVE);
+}
+
+const char* find_substring_cased(const char* str,
+                                 size_t len,
+                                 cz::Str query,
+                                 Case_Handling case_handling) {
+    if (query.len == 0) {
+        return str;
+    }
+    return find_needle(str, len, make_needle(query, case_handling));
+}
+
+const char* rfind_substring_cased(const char* str,
+                                  size_t len,
+                                  cz::Str query,
+                                  Case_Handling case_handling) {
+    if (query.len == 0) {
+        return str + len;
+    }
+    return rfind_needle(str, len, make_needle(query, case_handling));
+}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <cz/str.hpp>
+#include "core/case.hpp"
+
+namespace mag {
+
+/// Searches over a contiguous range of bytes, such as a bucket of `Contents`.  These are
+/// vectorized with AVX2 or SSE2 when compiled with support for them and are scalar otherwise.
+
+/// Find the first byte in `[str, str + len)` that is either `a` or `b`.
+const char* find_either(const char* str, size_t len, char a, char b);
+/// Find the last byte in `[str, str + len)` that is either `a` or `b`.
+const char* rfind_either(const char* str, size_t len, char a, char b);
+
+/// Find the first occurrence of `query` that is entirely inside `[str, str + len)`.
+const char* find_substring(const char* str, size_t len, cz::Str query);
+/// Find the last occurrence of `query` that is entirely inside `[str, str + len)`.
+const char* rfind_substring(const char* str, size_t len, cz::Str query);
+
+/// Same as the functions above except handles case differences according to `case_handling`.
+/// `SMART_CASE` must be resolved by the caller.
+const char* find_substring_cased(const char* str,
+                                 size_t len,
+                                 cz::Str query,
+                                 Case_Handling case_handling);
+const char* rfind_substring_cased(const char* str,
+                                  size_t len,
+                                  cz::Str query,
+                                  Case_Handling case_handling);
+
+}
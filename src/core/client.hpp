@@ -47,6 +47,10 @@ struct Client {
 
     bool queue_quit;
 
+    /// Incremented every time a command is ran.  Commands can change arbitrary
+    /// state so this is used to force the next frame to be rendered.
+    uint64_t commands_ran;
+
     Copy_Chain* global_copy_chain;
     Jump_Chain jump_chain;
 
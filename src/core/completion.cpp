@@ -1,6 +1,9 @@
 #include "completion.hpp"
 
+#include <string.h>
 #include <algorithm>
+#include <chrono>
+#include <cz/arc.hpp>
 #include <cz/defer.hpp>
 #include <cz/directory.hpp>
 #include <cz/file.hpp>
@@ -13,13 +16,26 @@
 #include <tracy/Tracy.hpp>
 #include "core/buffer.hpp"
 #include "core/command_macros.hpp"
+#include "core/completion_results_channel.hpp"
 #include "core/editor.hpp"
 #include "core/file.hpp"
+#include "core/job.hpp"
 #include "core/program_info.hpp"
 #include "custom/config.hpp"
 
 namespace mag {
 
+void Completion_Filter_Context::reset() {
+    if (cleanup) {
+        cleanup(data);
+    }
+    cleanup = nullptr;
+    data = nullptr;
+    results.len = 0;
+    selected = 0;
+    incomplete = false;
+}
+
 void Completion_Filter_Context::drop() {
     if (cleanup) {
         cleanup(data);
@@ -48,6 +64,7 @@ void Completion_Engine_Context::reset() {
     result_suffix.len = 0;
     results_buffer_array.clear();
     results.len = 0;
+    results_appended = false;
 }
 
 void Completion_Engine_Context::parse_file_line_column_suffix() {
@@ -85,20 +102,276 @@ void Completion_Cache::set_engine(Completion_Engine new_engine) {
     engine_context.reset();
 }
 
+namespace completion_ {
+/// Stored in `Completion_Filter_Context::data` by the filters so that typing more of the
+/// query only checks the results that matched before and so big result lists can be
+/// checked over multiple frames.
+struct Narrowing_State {
+    /// The filter this state belongs to.
+    Completion_Filter filter;
+
+    /// The query `candidates` are being checked against.
+    cz::String query;
+    bool has_query;
+
+    /// The results that could match `query`.  If `all_results`
+    /// then the engine's results are used instead.
+    cz::Vector<cz::Str> candidates;
+    bool all_results;
+    /// The number of candidates that have been checked.
+    size_t checked;
+    /// The number of the engine's results seen so far.  Results the engine
+    /// appends after this are added to `candidates` since they weren't checked.
+    size_t results_len;
+
+    /// The result selected when the query changed.  It is selected
+    /// again when it is found unless the user moves the selection.
+    cz::String selected_result;
+    bool has_selected_result;
+    size_t selected;
+
+    void drop() {
+        query.drop(cz::heap_allocator());
+        candidates.drop(cz::heap_allocator());
+        selected_result.drop(cz::heap_allocator());
+    }
+};
+}
+using namespace completion_;
+
+static void narrowing_state_cleanup(void* data) {
+    Narrowing_State* state = (Narrowing_State*)data;
+    state->drop();
+    cz::heap_allocator().dealloc(state);
+}
+
+/// Candidates are checked in blocks of this many between checks of the time budget.
+static const size_t NARROWING_BLOCK = 1024;
+/// When filtering in parallel, each thread checks this many candidates per round.
+static const size_t NARROWING_PARALLEL_BLOCK = 1 << 16;
+
+static size_t count_completion_filter_threads() {
+    if (custom::completion_filter_threads > 0) {
+        return custom::completion_filter_threads;
+    }
+    return count_parallel_for_threads();
+}
+
+template <class Matches>
+static void filter_candidates(cz::Slice<const cz::Str> candidates,
+                              const Matches& matches,
+                              cz::Vector<cz::Str>* output) {
+    for (size_t i = 0; i < candidates.len; ++i) {
+        if (matches(candidates[i])) {
+            output->reserve(cz::heap_allocator(), 1);
+            output->push(candidates[i]);
+        }
+    }
+}
+
+static void push_result(Completion_Filter_Context* context,
+                        Narrowing_State* state,
+                        cz::Str result) {
+    if (state->has_selected_result && state->selected_result == result) {
+        context->selected = context->results.len;
+        state->has_selected_result = false;
+    }
+    context->results.push(result);
+}
+
+namespace completion_ {
+template <class Matches>
+struct Filter_Candidates_Chunks {
+    cz::Slice<const cz::Str> candidates;
+    size_t per_chunk;
+    const Matches* matches;
+    cz::Vector<cz::Str>* outputs;
+};
+}
+
+template <class Matches>
+static void filter_candidates_chunk(void* _data, size_t index) {
+    Filter_Candidates_Chunks<Matches>* data = (Filter_Candidates_Chunks<Matches>*)_data;
+    size_t start = cz::min(data->candidates.len, index * data->per_chunk);
+    size_t end = cz::min(data->candidates.len, start + data->per_chunk);
+    filter_candidates({data->candidates.elems + start, end - start}, *data->matches,
+                      &data->outputs[index]);
+}
+
+/// Check `candidates` in `num_chunks` chunks using `parallel_for`
+/// and add the matches to `context->results` in order.
+template <class Matches>
+static void filter_candidates_parallel(Completion_Filter_Context* context,
+                                       Narrowing_State* state,
+                                       cz::Slice<const cz::Str> candidates,
+                                       size_t num_chunks,
+                                       const Matches& matches) {
+    ZoneScoped;
+
+    cz::Vector<cz::Vector<cz::Str> > outputs = {};
+    CZ_DEFER({
+        for (size_t i = 0; i < outputs.len; ++i) {
+            outputs[i].drop(cz::heap_allocator());
+        }
+        outputs.drop(cz::heap_allocator());
+    });
+    outputs.reserve_exact(cz::heap_allocator(), num_chunks);
+    outputs.len = num_chunks;
+    memset(outputs.elems, 0, outputs.len * sizeof(outputs[0]));
+
+    Filter_Candidates_Chunks<Matches> chunks;
+    chunks.candidates = candidates;
+    chunks.per_chunk = (candidates.len + num_chunks - 1) / num_chunks;
+    chunks.matches = &matches;
+    chunks.outputs = outputs.elems;
+    parallel_for(num_chunks, filter_candidates_chunk<Matches>, &chunks);
+
+    for (size_t i = 0; i < outputs.len; ++i) {
+        context->results.reserve(outputs[i].len);
+        for (size_t j = 0; j < outputs[i].len; ++j) {
+            push_result(context, state, outputs[i][j]);
+        }
+    }
+}
+
+/// Filter the engine's results by `matches`.  If the query `extends` the previous query then
+/// only the results that matched the previous query are checked.  Checking stops after
+/// `custom::completion_filter_budget` and `context->incomplete` is set so the rest are checked
+/// next frame.  If the query changes before then the remaining results are still narrowed.
+template <class Matches>
+static void narrow_results(Completion_Filter filter,
+                           bool (*extends)(cz::Str previous, cz::Str query),
+                           Completion_Filter_Context* context,
+                           Completion_Engine_Context* engine_context,
+                           cz::Str selected_result,
+                           bool has_selected_result,
+                           const Matches& matches) {
+    ZoneScoped;
+
+    Narrowing_State* state = (Narrowing_State*)context->data;
+    if (!state || context->cleanup != narrowing_state_cleanup || state->filter != filter) {
+        context->reset();
+        state = cz::heap_allocator().alloc<Narrowing_State>();
+        CZ_ASSERT(state);
+        *state = {};
+        state->filter = filter;
+        state->all_results = true;
+        context->data = state;
+        context->cleanup = narrowing_state_cleanup;
+    }
+
+    if (!state->all_results && engine_context->results.len > state->results_len) {
+        size_t appended = engine_context->results.len - state->results_len;
+        state->candidates.reserve(cz::heap_allocator(), appended);
+        state->candidates.append({engine_context->results.elems + state->results_len, appended});
+    }
+    state->results_len = engine_context->results.len;
+
+    cz::Str query = engine_context->query;
+    size_t candidates_len =
+        state->all_results ? engine_context->results.len : state->candidates.len;
+
+    if (state->has_query && query == state->query) {
+        // Continue checking where the last frame left off.
+        if (context->selected != state->selected) {
+            state->has_selected_result = false;
+        }
+    } else {
+        if (state->has_query && extends(state->query, query)) {
+            // The results that don't match the previous query can't match this one.  Results
+            // that weren't checked yet are kept after the ones that matched to keep the order.
+            cz::Vector<cz::Str> candidates = {};
+            size_t remaining = candidates_len - state->checked;
+            candidates.reserve_exact(cz::heap_allocator(), context->results.len + remaining);
+            candidates.append({context->results.elems, context->results.len});
+            if (state->all_results) {
+                candidates.append({engine_context->results.elems + state->checked, remaining});
+            } else {
+                candidates.append({state->candidates.elems + state->checked, remaining});
+            }
+            state->candidates.drop(cz::heap_allocator());
+            state->candidates = candidates;
+            state->all_results = false;
+        } else {
+            state->candidates.len = 0;
+            state->all_results = true;
+        }
+
+        state->checked = 0;
+        state->has_query = true;
+        state->query.len = 0;
+        state->query.reserve(cz::heap_allocator(), query.len);
+        state->query.append(query);
+        state->selected_result.len = 0;
+        state->has_selected_result = has_selected_result;
+        if (has_selected_result) {
+            state->selected_result.reserve(cz::heap_allocator(), selected_result.len);
+            state->selected_result.append(selected_result);
+        }
+
+        context->selected = 0;
+        context->results.len = 0;
+    }
+
+    cz::Slice<const cz::Str> candidates;
+    if (state->all_results) {
+        candidates = {engine_context->results.elems, engine_context->results.len};
+    } else {
+        candidates = {state->candidates.elems, state->candidates.len};
+    }
+
+    context->results.reserve(candidates.len - state->checked);
+
+    size_t num_threads = count_completion_filter_threads();
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::microseconds(custom::completion_filter_budget);
+    while (state->checked < candidates.len) {
+        size_t remaining = candidates.len - state->checked;
+        if (num_threads > 1 && remaining >= custom::completion_filter_parallel_threshold) {
+            size_t count = cz::min(remaining, num_threads * NARROWING_PARALLEL_BLOCK);
+            filter_candidates_parallel(context, state,
+                                       {candidates.elems + state->checked, count},
+                                       num_threads, matches);
+            state->checked += count;
+        } else {
+            size_t end = state->checked + cz::min(remaining, NARROWING_BLOCK);
+            for (; state->checked < end; ++state->checked) {
+                cz::Str result = candidates[state->checked];
+                if (matches(result)) {
+                    push_result(context, state, result);
+                }
+            }
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+    }
+
+    context->incomplete = state->checked < candidates.len;
+    state->selected = context->selected;
+}
+
+static bool prefix_extends(cz::Str previous, cz::Str query) {
+    return query.starts_with(previous);
+}
+
 void prefix_completion_filter(Editor* editor,
                               Completion_Filter_Context* context,
                               Completion_Engine_Context* engine_context,
                               cz::Str selected_result,
                               bool has_selected_result) {
-    for (size_t i = 0; i < engine_context->results.len; ++i) {
-        cz::Str result = engine_context->results[i];
-        if (result.starts_with(engine_context->query)) {
-            if (has_selected_result && selected_result == result) {
-                context->selected = context->results.len;
-            }
-            context->results.push(result);
-        }
-    }
+    ZoneScoped;
+
+    cz::Str query = engine_context->query;
+    narrow_results(prefix_completion_filter, prefix_extends, context, engine_context,
+                   selected_result, has_selected_result,
+                   [query](cz::Str result) { return result.starts_with(query); });
+}
+
+static bool infix_extends(cz::Str previous, cz::Str query) {
+    return query.contains(previous);
 }
 
 void infix_completion_filter(Editor* editor,
@@ -106,15 +379,12 @@ void infix_completion_filter(Editor* editor,
                              Completion_Engine_Context* engine_context,
                              cz::Str selected_result,
                              bool has_selected_result) {
-    for (size_t i = 0; i < engine_context->results.len; ++i) {
-        cz::Str result = engine_context->results[i];
-        if (result.contains(engine_context->query)) {
-            if (has_selected_result && selected_result == result) {
-                context->selected = context->results.len;
-            }
-            context->results.push(result);
-        }
-    }
+    ZoneScoped;
+
+    cz::Str query = engine_context->query;
+    narrow_results(infix_completion_filter, infix_extends, context, engine_context,
+                   selected_result, has_selected_result,
+                   [query](cz::Str result) { return result.contains(query); });
 }
 
 static bool starts_with_uppercase_sticky(cz::Str string, cz::Str query) {
@@ -166,7 +436,7 @@ struct Wildcard_Pattern {
     bool wild_end = true;
     cz::Vector<cz::Str> pieces;
 
-    bool matches(cz::Str string) {
+    bool matches(cz::Str string) const {
         size_t index = 0;
         for (size_t j = 0; j < pieces.len; ++j) {
             cz::Str piece = pieces[j];
@@ -297,6 +567,12 @@ static Wildcard_Pattern parse_spaces_are_wildcards(cz::String& query) {
     return pattern;
 }
 
+/// Typing more of the query only ever makes the pattern stricter unless
+/// it turns a trailing `$` (match at the end) into a literal character.
+static bool spaces_are_wildcards_extends(cz::Str previous, cz::Str query) {
+    return query.starts_with(previous) && !previous.ends_with('$');
+}
+
 void spaces_are_wildcards_completion_filter(Editor* editor,
                                             Completion_Filter_Context* context,
                                             Completion_Engine_Context* engine_context,
@@ -310,17 +586,528 @@ void spaces_are_wildcards_completion_filter(Editor* editor,
     Wildcard_Pattern pattern = parse_spaces_are_wildcards(query);
     CZ_DEFER(pattern.pieces.drop(cz::heap_allocator()));
 
+    narrow_results(spaces_are_wildcards_completion_filter, spaces_are_wildcards_extends, context,
+                   engine_context, selected_result, has_selected_result,
+                   [&pattern](cz::Str result) { return pattern.matches(result); });
+}
+
+/// Bonuses and penalties used to rank fuzzy matches.  These are the values fzf uses.
+static const int32_t FUZZY_SCORE_MATCH = 16;
+static const int32_t FUZZY_SCORE_GAP_START = -3;
+static const int32_t FUZZY_SCORE_GAP_EXTENSION = -1;
+static const int32_t FUZZY_BONUS_BOUNDARY = FUZZY_SCORE_MATCH / 2;
+static const int32_t FUZZY_BONUS_BOUNDARY_WHITE = FUZZY_BONUS_BOUNDARY + 2;
+static const int32_t FUZZY_BONUS_BOUNDARY_DELIMITER = FUZZY_BONUS_BOUNDARY + 1;
+static const int32_t FUZZY_BONUS_CAMEL_123 = FUZZY_BONUS_BOUNDARY + FUZZY_SCORE_GAP_EXTENSION;
+static const int32_t FUZZY_BONUS_CONSECUTIVE = -(FUZZY_SCORE_GAP_START + FUZZY_SCORE_GAP_EXTENSION);
+static const int32_t FUZZY_BONUS_FIRST_CHAR_MULTIPLIER = 2;
+
+namespace Fuzzy_Char_Class_ {
+enum Fuzzy_Char_Class {
+    WHITE,
+    DELIMITER,
+    NON_WORD,
+    LOWER,
+    UPPER,
+    NUMBER,
+};
+}
+using Fuzzy_Char_Class_::Fuzzy_Char_Class;
+
+static Fuzzy_Char_Class fuzzy_char_class(char c) {
+    if (cz::is_lower(c)) {
+        return Fuzzy_Char_Class::LOWER;
+    } else if (cz::is_upper(c)) {
+        return Fuzzy_Char_Class::UPPER;
+    } else if (cz::is_digit(c)) {
+        return Fuzzy_Char_Class::NUMBER;
+    } else if (cz::is_space(c)) {
+        return Fuzzy_Char_Class::WHITE;
+    } else if (c == '/' || c == ',' || c == ':' || c == ';' || c == '|') {
+        return Fuzzy_Char_Class::DELIMITER;
+    } else {
+        return Fuzzy_Char_Class::NON_WORD;
+    }
+}
+
+static int32_t fuzzy_bonus(Fuzzy_Char_Class previous, Fuzzy_Char_Class current) {
+    if (current >= Fuzzy_Char_Class::LOWER) {
+        if (previous == Fuzzy_Char_Class::WHITE) {
+            return FUZZY_BONUS_BOUNDARY_WHITE;
+        } else if (previous == Fuzzy_Char_Class::DELIMITER) {
+            return FUZZY_BONUS_BOUNDARY_DELIMITER;
+        } else if (previous == Fuzzy_Char_Class::NON_WORD) {
+            return FUZZY_BONUS_BOUNDARY;
+        }
+    }
+
+    if ((previous == Fuzzy_Char_Class::LOWER && current == Fuzzy_Char_Class::UPPER) ||
+        (previous != Fuzzy_Char_Class::NUMBER && current == Fuzzy_Char_Class::NUMBER)) {
+        return FUZZY_BONUS_CAMEL_123;
+    }
+
+    if (current == Fuzzy_Char_Class::WHITE) {
+        return FUZZY_BONUS_BOUNDARY_WHITE;
+    } else if (current == Fuzzy_Char_Class::DELIMITER || current == Fuzzy_Char_Class::NON_WORD) {
+        return FUZZY_BONUS_BOUNDARY;
+    }
+    return 0;
+}
+
+/// Uppercase characters in the query only match themselves.  Lowercase match either case.
+static bool fuzzy_char_matches(char text, char query) {
+    if (cz::is_upper(query)) {
+        return text == query;
+    }
+    return cz::to_lower(text) == query;
+}
+
+/// Find the first character in `text` that matches `query`.  Uses `memchr`
+/// since it is vectorized; lowercase characters look for both cases.
+static const char* fuzzy_find_char(cz::Str text, char query) {
+    const char* found = (const char*)memchr(text.buffer, query, text.len);
+    if (cz::is_lower(query)) {
+        size_t len = found ? found - text.buffer : text.len;
+        const char* upper = (const char*)memchr(text.buffer, cz::to_upper(query), len);
+        if (upper) {
+            found = upper;
+        }
+    }
+    return found;
+}
+
+/// Score `text` against `term` where the characters of `term` must appear in order.
+/// Uses fzf's v1 algorithm: find the first match, shrink it from the end, then score it.
+/// Returns `false` if there is no match.
+static bool fuzzy_score_term(cz::Str text, cz::Str term, int32_t* score) {
+    // Find where the first match ends.
+    size_t end = 0;
+    for (size_t t = 0; t < term.len; ++t) {
+        const char* found = fuzzy_find_char(text.slice_start(end), term[t]);
+        if (!found) {
+            return false;
+        }
+        end = found - text.buffer + 1;
+    }
+
+    // Walk backwards to find the shortest match ending there.
+    size_t start = end;
+    size_t t = term.len;
+    while (t > 0) {
+        --start;
+        if (fuzzy_char_matches(text[start], term[t - 1])) {
+            --t;
+        }
+    }
+
+    int32_t total = 0;
+    int32_t first_bonus = 0;
+    size_t consecutive = 0;
+    bool in_gap = false;
+    Fuzzy_Char_Class previous =
+        start > 0 ? fuzzy_char_class(text[start - 1]) : Fuzzy_Char_Class::WHITE;
+    for (size_t i = start; i < end; ++i) {
+        Fuzzy_Char_Class current = fuzzy_char_class(text[i]);
+        if (t < term.len && fuzzy_char_matches(text[i], term[t])) {
+            int32_t bonus = fuzzy_bonus(previous, current);
+            if (consecutive == 0) {
+                first_bonus = bonus;
+            } else {
+                // Break consecutive chunks at boundaries.
+                if (bonus >= FUZZY_BONUS_BOUNDARY && bonus > first_bonus) {
+                    first_bonus = bonus;
+                }
+                bonus = cz::max(cz::max(bonus, first_bonus), FUZZY_BONUS_CONSECUTIVE);
+            }
+
+            total += FUZZY_SCORE_MATCH;
+            total += t == 0 ? bonus * FUZZY_BONUS_FIRST_CHAR_MULTIPLIER : bonus;
+            in_gap = false;
+            ++consecutive;
+            ++t;
+        } else {
+            total += in_gap ? FUZZY_SCORE_GAP_EXTENSION : FUZZY_SCORE_GAP_START;
+            in_gap = true;
+            consecutive = 0;
+            first_bonus = 0;
+        }
+        previous = current;
+    }
+
+    *score = total;
+    return true;
+}
+
+/// Each character sets one bit so a result can only match if it has all the query's bits.
+static uint64_t fuzzy_char_bit(char c) {
+    c = cz::to_lower(c);
+    if (cz::is_lower(c)) {
+        return (uint64_t)1 << (c - 'a');
+    } else if (cz::is_digit(c)) {
+        return (uint64_t)1 << (26 + c - '0');
+    } else {
+        return (uint64_t)1 << (36 + (uint8_t)c % 27);
+    }
+}
+
+namespace completion_ {
+struct Fuzzy_Char_Bits {
+    uint64_t bits[256];
+
+    Fuzzy_Char_Bits() {
+        for (size_t i = 0; i < 256; ++i) {
+            bits[i] = fuzzy_char_bit((char)i);
+        }
+    }
+};
+}
+
+static const Fuzzy_Char_Bits fuzzy_char_bits;
+
+/// Set on every computed mask so `0` means it hasn't been computed.
+static const uint64_t FUZZY_MASK_COMPUTED = (uint64_t)1 << 63;
+
+static uint64_t fuzzy_mask(cz::Str string) {
+    uint64_t mask = FUZZY_MASK_COMPUTED;
+    for (size_t i = 0; i < string.len; ++i) {
+        mask |= fuzzy_char_bits.bits[(uint8_t)string[i]];
+    }
+    return mask;
+}
+
+namespace completion_ {
+struct Fuzzy_Match {
+    int32_t score;
+    uint32_t len;
+    uint32_t index;
+};
+
+/// Higher scores first, then shorter results, then the engine's order.
+static bool fuzzy_match_is_better(const Fuzzy_Match& left, const Fuzzy_Match& right) {
+    if (left.score != right.score) {
+        return left.score > right.score;
+    }
+    if (left.len != right.len) {
+        return left.len < right.len;
+    }
+    return left.index < right.index;
+}
+
+struct Fuzzy_Match_Worse_First {
+    bool operator()(const Fuzzy_Match& left, const Fuzzy_Match& right) const {
+        return fuzzy_match_is_better(left, right);
+    }
+};
+
+/// Keep the best `max` matches in a heap with the worst match at the front.
+static void push_top_matches(cz::Vector<Fuzzy_Match>* heap, size_t max, Fuzzy_Match match) {
+    if (heap->len < max) {
+        heap->reserve(cz::heap_allocator(), 1);
+        heap->push(match);
+        std::push_heap(heap->elems, heap->elems + heap->len, Fuzzy_Match_Worse_First{});
+    } else if (max > 0 && fuzzy_match_is_better(match, (*heap)[0])) {
+        std::pop_heap(heap->elems, heap->elems + heap->len, Fuzzy_Match_Worse_First{});
+        heap->last() = match;
+        std::push_heap(heap->elems, heap->elems + heap->len, Fuzzy_Match_Worse_First{});
+    }
+}
+
+struct Fuzzy_Query {
+    cz::Vector<cz::Str> terms;
+    uint64_t mask;
+
+    bool score(cz::Str result, uint64_t result_mask, int32_t* score) const {
+        if ((mask & ~result_mask) != 0) {
+            return false;
+        }
+
+        int32_t total = 0;
+        for (size_t i = 0; i < terms.len; ++i) {
+            int32_t term_score;
+            if (!fuzzy_score_term(result, terms[i], &term_score)) {
+                return false;
+            }
+            total += term_score;
+        }
+        *score = total;
+        return true;
+    }
+};
+
+/// Stored in `Completion_Filter_Context::data` by `fuzzy_completion_filter`.
+struct Fuzzy_State {
+    /// `fuzzy_mask` of each of the engine's results or `0` if it hasn't been computed yet.
+    /// Grows when the engine appends results.
+    cz::Vector<uint64_t> masks;
+
+    cz::String query;
+    bool has_query;
+
+    /// Indices of the results that could match `query`.  If
+    /// `all_results` then all of the engine's results are used.
+    cz::Vector<uint32_t> candidates;
+    bool all_results;
+    size_t checked;
+
+    /// The candidates that matched so they can be narrowed when the query gets longer.
+    cz::Vector<uint32_t> matched;
+    /// The best matches so far.
+    cz::Vector<Fuzzy_Match> top;
+
+    void drop() {
+        masks.drop(cz::heap_allocator());
+        query.drop(cz::heap_allocator());
+        candidates.drop(cz::heap_allocator());
+        matched.drop(cz::heap_allocator());
+        top.drop(cz::heap_allocator());
+    }
+};
+
+struct Fuzzy_Chunk_Output {
+    cz::Vector<uint32_t> matched;
+    cz::Vector<Fuzzy_Match> top;
+};
+
+struct Fuzzy_Score_Chunks {
+    Fuzzy_State* state;
+    const Fuzzy_Query* query;
+    cz::Slice<const cz::Str> results;
+    size_t start;
+    size_t end;
+    size_t per_chunk;
+    size_t max_results;
+    Fuzzy_Chunk_Output* outputs;
+};
+}
+
+static void fuzzy_state_cleanup(void* data) {
+    Fuzzy_State* state = (Fuzzy_State*)data;
+    state->drop();
+    cz::heap_allocator().dealloc(state);
+}
+
+static void parse_fuzzy_query(cz::Str query, Fuzzy_Query* parsed) {
+    parsed->mask = 0;
+    while (1) {
+        while (query.len > 0 && query[0] == ' ') {
+            query = query.slice_start(1);
+        }
+        if (query.len == 0) {
+            break;
+        }
+
+        const char* space = query.find(' ');
+        cz::Str term = query.slice_end(space ? space : query.end());
+        query = query.slice_start(term.len);
+
+        parsed->terms.reserve(cz::heap_allocator(), 1);
+        parsed->terms.push(term);
+        parsed->mask |= fuzzy_mask(term) & ~FUZZY_MASK_COMPUTED;
+    }
+}
+
+/// Score the candidates in `[start, end)`.  Different threads may
+/// run this on different ranges since they write different masks.
+static void fuzzy_score_candidates(Fuzzy_State* state,
+                                   const Fuzzy_Query& query,
+                                   cz::Slice<const cz::Str> results,
+                                   size_t start,
+                                   size_t end,
+                                   size_t max_results,
+                                   cz::Vector<uint32_t>* matched,
+                                   cz::Vector<Fuzzy_Match>* top) {
+    // With no query every result matches so keep the first ones in order.
+    bool ignore_len = query.terms.len == 0;
+    for (size_t c = start; c < end; ++c) {
+        uint32_t index = state->all_results ? (uint32_t)c : state->candidates[c];
+        cz::Str result = results[index];
+
+        uint64_t mask = state->masks[index];
+        if (mask == 0 && query.mask != 0) {
+            mask = fuzzy_mask(result);
+            state->masks[index] = mask;
+        }
+
+        int32_t score;
+        if (!query.score(result, mask, &score)) {
+            continue;
+        }
+
+        matched->reserve(cz::heap_allocator(), 1);
+        matched->push(index);
+        uint32_t len = ignore_len ? 0 : (uint32_t)result.len;
+        push_top_matches(top, max_results, {score, len, index});
+    }
+}
+
+static void fuzzy_score_chunk(void* _data, size_t index) {
+    Fuzzy_Score_Chunks* data = (Fuzzy_Score_Chunks*)_data;
+    size_t start = cz::min(data->end, data->start + index * data->per_chunk);
+    size_t end = cz::min(data->end, start + data->per_chunk);
+    fuzzy_score_candidates(data->state, *data->query, data->results, start, end,
+                           data->max_results, &data->outputs[index].matched,
+                           &data->outputs[index].top);
+}
+
+/// Score the next `count` candidates in `num_chunks` chunks using `parallel_for`.
+static void fuzzy_score_candidates_parallel(Fuzzy_State* state,
+                                            const Fuzzy_Query& query,
+                                            cz::Slice<const cz::Str> results,
+                                            size_t count,
+                                            size_t num_chunks,
+                                            size_t max_results) {
+    ZoneScoped;
+
+    cz::Vector<Fuzzy_Chunk_Output> outputs = {};
+    CZ_DEFER({
+        for (size_t i = 0; i < outputs.len; ++i) {
+            outputs[i].matched.drop(cz::heap_allocator());
+            outputs[i].top.drop(cz::heap_allocator());
+        }
+        outputs.drop(cz::heap_allocator());
+    });
+    outputs.reserve_exact(cz::heap_allocator(), num_chunks);
+    outputs.len = num_chunks;
+    memset(outputs.elems, 0, outputs.len * sizeof(outputs[0]));
+
+    Fuzzy_Score_Chunks chunks;
+    chunks.state = state;
+    chunks.query = &query;
+    chunks.results = results;
+    chunks.start = state->checked;
+    chunks.end = state->checked + count;
+    chunks.per_chunk = (count + num_chunks - 1) / num_chunks;
+    chunks.max_results = max_results;
+    chunks.outputs = outputs.elems;
+    parallel_for(num_chunks, fuzzy_score_chunk, &chunks);
+
+    for (size_t i = 0; i < outputs.len; ++i) {
+        state->matched.reserve(cz::heap_allocator(), outputs[i].matched.len);
+        state->matched.append(outputs[i].matched);
+        for (size_t j = 0; j < outputs[i].top.len; ++j) {
+            push_top_matches(&state->top, max_results, outputs[i].top[j]);
+        }
+    }
+}
+
+/// Typing more of the query only adds characters that must be matched.
+static bool fuzzy_extends(cz::Str previous, cz::Str query) {
+    return query.starts_with(previous);
+}
+
+void fuzzy_completion_filter(Editor* editor,
+                             Completion_Filter_Context* context,
+                             Completion_Engine_Context* engine_context,
+                             cz::Str selected_result,
+                             bool has_selected_result) {
+    ZoneScoped;
+
+    Fuzzy_State* state = (Fuzzy_State*)context->data;
+    if (!state || context->cleanup != fuzzy_state_cleanup) {
+        context->reset();
+        state = cz::heap_allocator().alloc<Fuzzy_State>();
+        CZ_ASSERT(state);
+        *state = {};
+        state->all_results = true;
+        context->data = state;
+        context->cleanup = fuzzy_state_cleanup;
+    }
+
+    cz::Slice<const cz::Str> results = {engine_context->results.elems,
+                                        engine_context->results.len};
+    if (!state->all_results) {
+        // The engine appended results after `masks` was sized so they still need to be checked.
+        state->candidates.reserve(cz::heap_allocator(), results.len - state->masks.len);
+        for (size_t i = state->masks.len; i < results.len; ++i) {
+            state->candidates.push((uint32_t)i);
+        }
+    }
+    if (state->masks.len != results.len) {
+        state->masks.reserve(cz::heap_allocator(), results.len - state->masks.len);
+        memset(state->masks.elems + state->masks.len, 0,
+               (results.len - state->masks.len) * sizeof(uint64_t));
+        state->masks.len = results.len;
+    }
+
+    cz::Str query = engine_context->query;
+    size_t candidates_len = state->all_results ? results.len : state->candidates.len;
+
+    if (!state->has_query || query != state->query) {
+        if (state->has_query && fuzzy_extends(state->query, query)) {
+            // Results that didn't match the previous query can't match this one.
+            cz::Vector<uint32_t> candidates = {};
+            size_t remaining = candidates_len - state->checked;
+            candidates.reserve_exact(cz::heap_allocator(), state->matched.len + remaining);
+            candidates.append(state->matched);
+            for (size_t c = state->checked; c < candidates_len; ++c) {
+                candidates.push(state->all_results ? (uint32_t)c : state->candidates[c]);
+            }
+            state->candidates.drop(cz::heap_allocator());
+            state->candidates = candidates;
+            state->all_results = false;
+        } else {
+            state->candidates.len = 0;
+            state->all_results = true;
+        }
+
+        state->checked = 0;
+        state->matched.len = 0;
+        state->top.len = 0;
+        state->has_query = true;
+        state->query.len = 0;
+        state->query.reserve(cz::heap_allocator(), query.len);
+        state->query.append(query);
+        candidates_len = state->all_results ? results.len : state->candidates.len;
+    }
+
+    Fuzzy_Query parsed = {};
+    CZ_DEFER(parsed.terms.drop(cz::heap_allocator()));
+    parse_fuzzy_query(query, &parsed);
+
+    size_t max_results = custom::fuzzy_completion_max_results;
+    size_t num_threads = count_completion_filter_threads();
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::microseconds(custom::completion_filter_budget);
+    while (state->checked < candidates_len) {
+        size_t remaining = candidates_len - state->checked;
+        if (num_threads > 1 && remaining >= custom::completion_filter_parallel_threshold) {
+            size_t count = cz::min(remaining, num_threads * NARROWING_PARALLEL_BLOCK);
+            fuzzy_score_candidates_parallel(state, parsed, results, count, num_threads,
+                                            max_results);
+            state->checked += count;
+        } else {
+            size_t end = state->checked + cz::min(remaining, NARROWING_BLOCK);
+            fuzzy_score_candidates(state, parsed, results, state->checked, end, max_results,
+                                   &state->matched, &state->top);
+            state->checked = end;
+        }
+
+        if (std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+    }
+
+    context->incomplete = state->checked < candidates_len;
+
+    // Only the best matches are shown.  With no query that is the first results in order.
+    cz::Vector<Fuzzy_Match> sorted = {};
+    CZ_DEFER(sorted.drop(cz::heap_allocator()));
+    sorted.reserve_exact(cz::heap_allocator(), state->top.len);
+    sorted.append(state->top);
+    cz::sort(sorted, [](Fuzzy_Match* left, Fuzzy_Match* right) {
+        return fuzzy_match_is_better(*left, *right);
+    });
+
     context->selected = 0;
     context->results.len = 0;
-    context->results.reserve(engine_context->results.len);
-    for (size_t i = 0; i < engine_context->results.len; ++i) {
-        cz::Str result = engine_context->results[i];
-        if (pattern.matches(result)) {
-            if (has_selected_result && selected_result == result) {
-                context->selected = context->results.len;
-            }
-            context->results.push(result);
+    context->results.reserve(sorted.len);
+    for (size_t i = 0; i < sorted.len; ++i) {
+        cz::Str result = results[sorted[i].index];
+        if (has_selected_result && selected_result == result) {
+            context->selected = context->results.len;
         }
+        context->results.push(result);
     }
 }
 
@@ -487,93 +1274,186 @@ bool no_completion_engine(Editor*, Completion_Engine_Context*, bool) {
     return false;
 }
 
-struct Run_Command_For_Completion_Results_Data {
+namespace completion_ {
+/// Shared by `Run_Command_For_Completion_Results` and the job reading the command's output.
+struct Run_Command_Shared_Data {
+    Completion_Results_Channel channel;
+    /// The results point into this.  Only the job allocates from it.
+    cz::Buffer_Array buffer_array;
+
+    void drop() {
+        channel.drop();
+        buffer_array.drop();
+    }
+};
+
+struct Run_Command_Job_Data {
+    cz::Arc_Weak<Run_Command_Shared_Data> shared;
     cz::Process process;
     cz::Input_File stdout_read;
-    cz::String result;
     cz::Carriage_Return_Carry carry;
+    /// The line being read.
+    cz::String result;
+    /// Lines that haven't been pushed to the channel yet.
+    cz::Vector<cz::Str> chunk;
+    bool done;
+};
+
+struct Run_Command_For_Completion_Results_Data {
+    cz::Arc<Run_Command_Shared_Data> shared;
+    bool finished;
 };
+}
+
+static void run_command_job_kill(void* _data) {
+    Run_Command_Job_Data* data = (Run_Command_Job_Data*)_data;
+    data->stdout_read.close();
+    data->process.kill();
+    data->chunk.drop(cz::heap_allocator());
+    data->shared.drop();
+    cz::heap_allocator().dealloc(data);
+}
+
+static Job_Tick_Result run_command_job_tick(Asynchronous_Job_Handler*, void* _data) {
+    ZoneScoped;
+
+    Run_Command_Job_Data* data = (Run_Command_Job_Data*)_data;
+
+    // If the engine has been dropped then the results are no longer needed.
+    cz::Arc<Run_Command_Shared_Data> shared;
+    if (!data->shared.upgrade(&shared)) {
+        run_command_job_kill(data);
+        return Job_Tick_Result::FINISHED;
+    }
+    CZ_DEFER(shared.drop());
+
+    bool made_progress = false;
+    char buffer[4096];
+    for (int reads = 0; !data->done && reads < 128; ++reads) {
+        int64_t len = data->stdout_read.read_text(buffer, sizeof(buffer), &data->carry);
+        if (len < 0) {
+            // Nothing to read right now.
+            break;
+        }
+        if (len == 0) {
+            data->done = true;
+            break;
+        }
+
+        made_progress = true;
+        cz::Str remaining = {buffer, (size_t)len};
+        while (1) {
+            cz::Str queued = remaining;
+            bool split = remaining.split_excluding('\n', &queued, &remaining);
+
+            data->result.reserve(shared->buffer_array.allocator(), queued.len);
+            data->result.append(queued);
+
+            if (!split) {
+                break;
+            }
+
+            data->chunk.reserve(cz::heap_allocator(), 1);
+            data->chunk.push(data->result);
+            data->result = {};
+        }
+    }
+
+    // If the channel is full then keep adding to the chunk until the engine catches up.
+    if (data->chunk.len > 0 && shared->channel.push(&data->chunk)) {
+        made_progress = true;
+    }
+
+    if (data->done && data->chunk.len == 0) {
+        data->stdout_read.close();
+        data->process.join();
+        shared->channel.close();
+        data->chunk.drop(cz::heap_allocator());
+        data->shared.drop();
+        cz::heap_allocator().dealloc(data);
+        return Job_Tick_Result::FINISHED;
+    }
+
+    return made_progress ? Job_Tick_Result::MADE_PROGRESS : Job_Tick_Result::STALLED;
+}
 
 void Run_Command_For_Completion_Results::drop() {
     if (!pimpl) {
         return;
     }
 
+    // The job kills the process once it notices.
     Run_Command_For_Completion_Results_Data* data = (Run_Command_For_Completion_Results_Data*)pimpl;
-    data->stdout_read.close();
-    data->process.kill();
+    data->shared.drop();
     cz::heap_allocator().dealloc(data);
+    pimpl = nullptr;
 }
 
-bool Run_Command_For_Completion_Results::iterate(Completion_Engine_Context* context,
+bool Run_Command_For_Completion_Results::iterate(Editor* editor,
+                                                 Completion_Engine_Context* context,
                                                  cz::Slice<cz::Str> args,
                                                  cz::Process_Options options,
                                                  bool force_reload) {
     ZoneScoped;
 
-    if (!force_reload && context->results.len > 0 && !pimpl) {
-        return false;
-    }
-
     Run_Command_For_Completion_Results_Data* data = (Run_Command_For_Completion_Results_Data*)pimpl;
-    if (!pimpl) {
-        data = cz::heap_allocator().alloc<Run_Command_For_Completion_Results_Data>();
-        *data = {};
-
-        if (!create_process_output_pipe(&options.std_out, &data->stdout_read)) {
-            cz::heap_allocator().dealloc(data);
+    if (data && !force_reload) {
+        if (data->finished) {
             return false;
         }
-        CZ_DEFER(options.std_out.close());
-        data->stdout_read.set_non_blocking();
 
-        if (!data->process.launch_program(args, options)) {
-            data->stdout_read.close();
-            cz::heap_allocator().dealloc(data);
-            return false;
-        }
+        bool appended = data->shared->channel.pop_all(&context->results);
 
-        pimpl = data;
+        // The lines are shown as they are read and are sorted once the command finishes.
+        if (data->shared->channel.finished()) {
+            data->finished = true;
+            cz::sort(context->results);
+            context->results_appended = false;
+            return true;
+        }
 
-        context->results_buffer_array.clear();
-        context->results.len = 0;
+        context->results_appended = appended;
+        return appended;
     }
 
-    char buffer[4096];
-    bool done = false;
-    while (1) {
-        int64_t len = data->stdout_read.read_text(buffer, sizeof(buffer), &data->carry);
-        if (len > 0) {
-            cz::Str remaining = {buffer, (size_t)len};
-            while (1) {
-                cz::Str queued = remaining;
-                bool split = remaining.split_excluding('\n', &queued, &remaining);
-
-                data->result.reserve(context->results_buffer_array.allocator(), queued.len);
-                data->result.append(queued);
-
-                if (!split) {
-                    break;
-                }
+    Run_Command_Job_Data* job_data = cz::heap_allocator().alloc<Run_Command_Job_Data>();
+    CZ_ASSERT(job_data);
+    *job_data = {};
 
-                context->results.reserve(1);
-                context->results.push(data->result);
-                data->result = {};
-            }
-        } else {
-            done = len == 0;
-            break;
-        }
+    if (!create_process_output_pipe(&options.std_out, &job_data->stdout_read)) {
+        cz::heap_allocator().dealloc(job_data);
+        return false;
     }
+    CZ_DEFER(options.std_out.close());
+    job_data->stdout_read.set_non_blocking();
 
-    if (done) {
-        data->stdout_read.close();
-        data->process.join();
-        cz::heap_allocator().dealloc(data);
-        pimpl = nullptr;
+    if (!job_data->process.launch_program(args, options)) {
+        job_data->stdout_read.close();
+        cz::heap_allocator().dealloc(job_data);
+        return false;
     }
 
-    cz::sort(context->results);
+    // The results of the last run point into its data so clear them first.
+    context->results_buffer_array.clear();
+    context->results.len = 0;
+    context->results_appended = false;
+    drop();
+
+    data = cz::heap_allocator().alloc<Run_Command_For_Completion_Results_Data>();
+    CZ_ASSERT(data);
+    *data = {};
+    data->shared.init_emplace();
+    data->shared->channel.init();
+    data->shared->buffer_array.init();
+    pimpl = data;
+
+    job_data->shared = data->shared.clone_downgrade();
+
+    Asynchronous_Job job;
+    job.tick = run_command_job_tick;
+    job.kill = run_command_job_kill;
+    job.data = job_data;
+    editor->add_asynchronous_job(job);
     return true;
 }
 
@@ -15,9 +15,14 @@ struct Completion_Filter_Context {
     cz::Heap_Vector<cz::Str> results;
     size_t selected;
 
+    /// Set by the filter if it ran out of time before checking every result.
+    /// The filter is called again next frame to continue.
+    bool incomplete;
+
     void* data;
     void (*cleanup)(void* data);
 
+    /// Delete the results and cleanup `data`.
     void reset();
     void drop();
 };
@@ -35,6 +40,11 @@ struct Completion_Engine_Context {
     cz::Buffer_Array results_buffer_array;
     cz::Heap_Vector<cz::Str> results;
 
+    /// Set by an engine that only appended to `results` (ex. while streaming them from a
+    /// `Completion_Results_Channel`).  The filter then keeps its state and only checks the
+    /// new results.  Cleared after the results are filtered.
+    bool results_appended;
+
     void* data;
     void (*cleanup)(void* data);
 
@@ -55,6 +65,9 @@ bool file_completion_engine(Editor*, Completion_Engine_Context*, bool);
 bool buffer_completion_engine(Editor*, Completion_Engine_Context*, bool);
 bool no_completion_engine(Editor*, Completion_Engine_Context*, bool);
 
+/// Filter `engine_context->results` into `context->results`.  `context` is only reset when the
+/// engine's results change so the filter can reuse the previous results (see `data`).  It isn't
+/// reset if the results were only appended to (see `results_appended`).
 typedef void (*Completion_Filter)(Editor* editor,
                                   Completion_Filter_Context* context,
                                   Completion_Engine_Context* engine_context,
@@ -75,12 +88,21 @@ void spaces_are_wildcards_completion_filter(Editor* editor,
                                             Completion_Engine_Context* engine_context,
                                             cz::Str selected_result,
                                             bool has_selected_result);
+/// Rank the results by how well they fuzzy match the query (like fzf) and keep only the best
+/// `custom::fuzzy_completion_max_results`.  Spaces separate terms that must all match.
+void fuzzy_completion_filter(Editor* editor,
+                             Completion_Filter_Context* context,
+                             Completion_Engine_Context* engine_context,
+                             cz::Str selected_result,
+                             bool has_selected_result);
 
-/// Runs a command and loads each line as a result.
+/// Runs a command and loads each line as a result.  The output is read by an
+/// `Asynchronous_Job` and the lines are appended to the results as they are read.
 struct Run_Command_For_Completion_Results {
     void* pimpl;
 
-    bool iterate(Completion_Engine_Context* context,
+    bool iterate(Editor* editor,
+                 Completion_Engine_Context* context,
                  cz::Slice<cz::Str> args,
                  cz::Process_Options options,
                  bool force_reload = false);
@@ -0,0 +1,74 @@
+#include "completion_results_channel.hpp"
+
+#include <cz/heap.hpp>
+#include <tracy/Tracy.hpp>
+
+namespace mag {
+
+void Completion_Results_Channel::init() {
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        chunks[i] = {};
+    }
+    head.store(0);
+    tail.store(0);
+    closed.store(false);
+}
+
+void Completion_Results_Channel::drop() {
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        chunks[i].drop(cz::heap_allocator());
+    }
+}
+
+bool Completion_Results_Channel::push(cz::Vector<cz::Str>* chunk) {
+    size_t end = tail.load(std::memory_order_relaxed);
+    if (end - head.load(std::memory_order_acquire) == CAPACITY) {
+        return false;
+    }
+
+    // The consumer dropped the chunk that used to be in this slot.
+    chunks[end & (CAPACITY - 1)] = *chunk;
+    *chunk = {};
+    tail.store(end + 1, std::memory_order_release);
+    return true;
+}
+
+void Completion_Results_Channel::close() {
+    closed.store(true, std::memory_order_release);
+}
+
+bool Completion_Results_Channel::pop_all(cz::Heap_Vector<cz::Str>* results) {
+    ZoneScoped;
+
+    size_t start = head.load(std::memory_order_relaxed);
+    size_t end = tail.load(std::memory_order_acquire);
+    if (start == end) {
+        return false;
+    }
+
+    size_t total = 0;
+    for (size_t i = start; i < end; ++i) {
+        total += chunks[i & (CAPACITY - 1)].len;
+    }
+    results->reserve(total);
+
+    for (size_t i = start; i < end; ++i) {
+        cz::Vector<cz::Str>* chunk = &chunks[i & (CAPACITY - 1)];
+        results->append(*chunk);
+        chunk->drop(cz::heap_allocator());
+        *chunk = {};
+    }
+
+    head.store(end, std::memory_order_release);
+    return total > 0;
+}
+
+bool Completion_Results_Channel::finished() const {
+    // Check `closed` first so every chunk pushed before closing is visible.
+    if (!closed.load(std::memory_order_acquire)) {
+        return false;
+    }
+    return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <cz/heap_vector.hpp>
+#include <cz/str.hpp>
+#include <cz/vector.hpp>
+
+namespace mag {
+
+/// Passes results from a thread producing them (usually an `Asynchronous_Job`) to a completion
+/// engine without locking.  The producer pushes chunks of results and each frame the engine
+/// appends the chunks that are ready so large result sets show up progressively.  Only the
+/// `cz::Str`s are passed so the producer must keep the strings alive as long as they are used.
+///
+/// There must be exactly one producer thread and one consumer thread.
+struct Completion_Results_Channel {
+    /// The maximum number of chunks waiting to be taken.  Must be a power of two.
+    static const size_t CAPACITY = 64;
+
+    cz::Vector<cz::Str> chunks[CAPACITY];
+    /// The number of chunks taken.  Only written by the consumer.
+    std::atomic_size_t head;
+    /// The number of chunks pushed.  Only written by the producer.
+    std::atomic_size_t tail;
+    /// Set by the producer after the last chunk is pushed.
+    std::atomic_bool closed;
+
+    void init();
+    void drop();
+
+    /// Take ownership of `chunk` and set it to empty.  Returns `false` if the
+    /// channel is full in which case `chunk` is kept and should be pushed later.
+    bool push(cz::Vector<cz::Str>* chunk);
+
+    /// Mark that no more chunks will be pushed.
+    void close();
+
+    /// Append the results of every chunk pushed so far to `results`.
+    /// Returns `true` if any results were appended.
+    bool pop_all(cz::Heap_Vector<cz::Str>* results);
+
+    /// Returns `true` if the channel was closed and every chunk has been taken.
+    bool finished() const;
+};
+
+}
@@ -1,23 +1,36 @@
 #include "contents.hpp"
 
 #include <string.h>
+#include <cz/defer.hpp>
 #include <cz/heap.hpp>
 #include <cz/util.hpp>
 #include <tracy/Tracy.hpp>
+#include "core/file.hpp"
 #include "core/movement.hpp"
 #include "core/ssostr.hpp"
 
+// See `contents_rope.cpp` for the rope used if `MAG_ROPE_CONTENTS` is defined.
+#ifndef MAG_ROPE_CONTENTS
+
 namespace mag {
 
 #define CONTENTS_BUCKET_MAX_SIZE 4096
 #define CONTENTS_BUCKET_DESIRED_LEN (CONTENTS_BUCKET_MAX_SIZE * 3 / 4)
+#define CONTENTS_INDEX_JUMP_THRESHOLD (CONTENTS_BUCKET_MAX_SIZE * 16)
+
+static void bucket_dealloc(Contents* contents, size_t bucket);
 
 void Contents::drop() {
     for (size_t i = 0; i < buckets.len; ++i) {
-        cz::heap_allocator().dealloc(buckets[i].elems, CONTENTS_BUCKET_MAX_SIZE);
+        bucket_dealloc(this, i);
+    }
+    if (mapping.len > 0) {
+        unmap_file(mapping);
     }
     buckets.drop(cz::heap_allocator());
     bucket_lfs.drop(cz::heap_allocator());
+    bucket_len_index.drop(cz::heap_allocator());
+    bucket_lfs_index.drop(cz::heap_allocator());
 }
 
 static cz::Slice<char> bucket_alloc() {
@@ -25,6 +38,26 @@ static cz::Slice<char> bucket_alloc() {
     return {buffer, 0};
 }
 
+static void bucket_dealloc(Contents* contents, size_t bucket) {
+    if (!contents->is_bucket_mapped(bucket)) {
+        cz::heap_allocator().dealloc(contents->buckets[bucket].elems, CONTENTS_BUCKET_MAX_SIZE);
+    }
+}
+
+/// Copy a mapped bucket to the heap so it can be edited.
+static void bucket_materialize(Contents* contents, size_t bucket) {
+    if (!contents->is_bucket_mapped(bucket)) {
+        return;
+    }
+
+    ZoneScoped;
+
+    cz::Slice<char> copy = bucket_alloc();
+    memcpy(copy.elems, contents->buckets[bucket].elems, contents->buckets[bucket].len);
+    copy.len = contents->buckets[bucket].len;
+    contents->buckets[bucket] = copy;
+}
+
 static uint64_t count_lines(cz::Str str) {
     ZoneScoped;
     return str.count('\n');
@@ -70,47 +103,152 @@ static void bucket_append(cz::Slice<char>* bucket, uint64_t* lines, cz::Str str)
     bucket->len += str.len;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Bucket index
+//
+// `bucket_len_index` and `bucket_lfs_index` are Fenwick trees stored 0-indexed.
+// Entry `k - 1` holds the sum of the `k & -k` values ending at (and including) value `k - 1`.
+///////////////////////////////////////////////////////////////////////////////
+
+static size_t lowest_bit(size_t k) {
+    return k & (~k + 1);
+}
+
+static void index_add(cz::Vector<uint64_t>* tree, size_t i, uint64_t delta) {
+    // Note: `delta` may be a negative number that has been wrapped.
+    for (size_t k = i + 1; k <= tree->len; k += lowest_bit(k)) {
+        (*tree)[k - 1] += delta;
+    }
+}
+
+/// Sum of the first `k` values.
+static uint64_t index_prefix(const cz::Vector<uint64_t>& tree, size_t k) {
+    uint64_t sum = 0;
+    for (; k > 0; k -= lowest_bit(k)) {
+        sum += tree[k - 1];
+    }
+    return sum;
+}
+
+/// Push a value onto the end of the tree in `O(log(n))`.
+static void index_push(cz::Vector<uint64_t>* tree, uint64_t value) {
+    size_t k = tree->len + 1;
+    uint64_t sum = value + index_prefix(*tree, k - 1) - index_prefix(*tree, k - lowest_bit(k));
+    tree->reserve(cz::heap_allocator(), 1);
+    tree->push(sum);
+}
+
+/// Find the largest `k` such that the sum of the first `k` values is `<= *value`
+/// (or `< *value` if `strict`).  Subtracts said sum from `*value`.
+static size_t index_search(const cz::Vector<uint64_t>& tree, uint64_t* value, bool strict) {
+    size_t step = 1;
+    while (step * 2 <= tree.len) {
+        step *= 2;
+    }
+
+    size_t k = 0;
+    for (; step > 0; step /= 2) {
+        if (k + step <= tree.len) {
+            uint64_t sum = tree[k + step - 1];
+            if (strict ? sum < *value : sum <= *value) {
+                k += step;
+                *value -= sum;
+            }
+        }
+    }
+    return k;
+}
+
+static void index_update(Contents* contents, size_t bucket, uint64_t old_len, uint64_t old_lfs) {
+    index_add(&contents->bucket_len_index, bucket, contents->buckets[bucket].len - old_len);
+    index_add(&contents->bucket_lfs_index, bucket, contents->bucket_lfs[bucket] - old_lfs);
+}
+
+/// Recalculate the index after buckets have been inserted or removed at or after `first`.
+static void index_rebuild_from(Contents* contents, size_t first) {
+    ZoneScoped;
+
+    size_t n = contents->buckets.len;
+    cz::Vector<uint64_t>* len_tree = &contents->bucket_len_index;
+    cz::Vector<uint64_t>* lfs_tree = &contents->bucket_lfs_index;
+
+    first = cz::min(first, cz::min(len_tree->len, n));
+
+    // Entries before `first` only depend on buckets before `first` so they can be
+    // kept.  Pushing is `O(log(n))` per bucket so for big changes rebuild in `O(n)`.
+    if (n - first <= n / 8) {
+        len_tree->len = first;
+        lfs_tree->len = first;
+        for (size_t i = first; i < n; ++i) {
+            index_push(len_tree, contents->buckets[i].len);
+            index_push(lfs_tree, contents->bucket_lfs[i]);
+        }
+        return;
+    }
+
+    len_tree->len = 0;
+    lfs_tree->len = 0;
+    len_tree->reserve_exact(cz::heap_allocator(), n);
+    lfs_tree->reserve_exact(cz::heap_allocator(), n);
+    for (size_t i = 0; i < n; ++i) {
+        len_tree->push(contents->buckets[i].len);
+        lfs_tree->push(contents->bucket_lfs[i]);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        size_t parent = i + lowest_bit(i + 1);
+        if (parent < n) {
+            (*len_tree)[parent] += (*len_tree)[i];
+            (*lfs_tree)[parent] += (*lfs_tree)[i];
+        }
+    }
+}
+
 void Contents::remove(uint64_t start, uint64_t len) {
     ZoneScoped;
     CZ_DEBUG_ASSERT(start + len <= this->len);
+    if (len == 0) {
+        return;
+    }
+
     this->len -= len;
 
-    for (size_t v = 0; v < buckets.len;) {
-        if (start < buckets[v].len) {
-            if (start + len <= buckets[v].len) {
-                bucket_remove(&buckets[v], &bucket_lfs[v], start, len);
+    Contents_Iterator iterator = iterator_at(start);
+    start = iterator.index;
 
-                // Remove empty buckets.
-                if (buckets[v].len == 0) {
-                    cz::heap_allocator().dealloc(buckets[v].elems, CONTENTS_BUCKET_MAX_SIZE);
-                    buckets.remove(v);
-                    bucket_lfs.remove(v);
-                }
+    // Buckets in the range [empty_start, empty_end) have been emptied.
+    size_t empty_start = buckets.len;
+    size_t empty_end = buckets.len;
 
-                return;
-            } else {
-                bucket_lfs[v] -= count_lines({buckets[v].elems + start, buckets[v].len - start});
-
-                len -= buckets[v].len - start;
-                buckets[v].len = start;
-                start = 0;
-
-                // Remove empty buckets.
-                if (buckets[v].len == 0) {
-                    cz::heap_allocator().dealloc(buckets[v].elems, CONTENTS_BUCKET_MAX_SIZE);
-                    buckets.remove(v);
-                    bucket_lfs.remove(v);
-                } else {
-                    ++v;
-                }
+    for (size_t v = iterator.bucket; len > 0; ++v) {
+        CZ_DEBUG_ASSERT(v < buckets.len);
+
+        uint64_t old_len = buckets[v].len;
+        uint64_t old_lfs = bucket_lfs[v];
+        uint64_t count = cz::min(len, old_len - start);
+        if (count < old_len) {
+            bucket_materialize(this, v);
+        }
+        bucket_remove(&buckets[v], &bucket_lfs[v], start, count);
+        len -= count;
+        start = 0;
+
+        if (buckets[v].len == 0) {
+            bucket_dealloc(this, v);
+            if (empty_start == buckets.len) {
+                empty_start = v;
             }
+            empty_end = v + 1;
         } else {
-            start -= buckets[v].len;
-            ++v;
+            index_update(this, v, old_len, old_lfs);
         }
     }
 
-    CZ_DEBUG_ASSERT(len == 0);
+    // Remove empty buckets.
+    if (empty_start < empty_end) {
+        buckets.remove_range(empty_start, empty_end);
+        bucket_lfs.remove_range(empty_start, empty_end);
+        index_rebuild_from(this, empty_start);
+    }
 }
 
 static void insert_empty(Contents* contents, cz::Str str) {
@@ -120,6 +258,7 @@ static void insert_empty(Contents* contents, cz::Str str) {
 
     contents->len += str.len;
 
+    size_t first_bucket = contents->buckets.len;
     size_t num_buckets = (str.len + CONTENTS_BUCKET_MAX_SIZE - 1) / CONTENTS_BUCKET_MAX_SIZE;
     contents->buckets.reserve(cz::heap_allocator(), num_buckets);
     contents->bucket_lfs.reserve(cz::heap_allocator(), num_buckets);
@@ -136,6 +275,30 @@ static void insert_empty(Contents* contents, cz::Str str) {
         contents->buckets.push(bucket);
         contents->bucket_lfs.push(count_lines({bucket.elems, bucket.len}));
     } while (str.len > 0);
+
+    index_rebuild_from(contents, first_bucket);
+}
+
+/// Insert `count` empty buckets at `index`.  The buckets after `index` are shifted
+/// once instead of once per bucket so inserting large strings stays linear.
+static void insert_empty_buckets(Contents* contents, size_t index, size_t count) {
+    ZoneScoped;
+
+    cz::Vector<cz::Slice<char>> new_buckets = {};
+    CZ_DEFER(new_buckets.drop(cz::heap_allocator()));
+    cz::Vector<uint64_t> new_lfs = {};
+    CZ_DEFER(new_lfs.drop(cz::heap_allocator()));
+    new_buckets.reserve_exact(cz::heap_allocator(), count);
+    new_lfs.reserve_exact(cz::heap_allocator(), count);
+    for (size_t i = 0; i < count; ++i) {
+        new_buckets.push(bucket_alloc());
+        new_lfs.push(0);
+    }
+
+    contents->buckets.reserve(cz::heap_allocator(), count);
+    contents->bucket_lfs.reserve(cz::heap_allocator(), count);
+    contents->buckets.insert_slice(index, new_buckets);
+    contents->bucket_lfs.insert_slice(index, new_lfs);
 }
 
 static void insert_at(Contents* contents, Contents_Iterator iterator, cz::Str str) {
@@ -153,19 +316,19 @@ static void insert_at(Contents* contents, Contents_Iterator iterator, cz::Str st
 
     contents->len += str.len;
 
+    bucket_materialize(contents, b);
+
     // If we can fit in the current bucket then we just insert into it.
     if (contents->buckets[b].len + str.len <= CONTENTS_BUCKET_MAX_SIZE) {
+        uint64_t old_len = contents->buckets[b].len;
+        uint64_t old_lfs = contents->bucket_lfs[b];
         bucket_insert(&contents->buckets[b], &contents->bucket_lfs[b], iterator.index, str);
+        index_update(contents, b, old_len, old_lfs);
     } else {
         // Overflowing one buffer into multiple buffers.
         size_t extra_buffers =
             (contents->buckets[b].len + str.len - 1) / CONTENTS_BUCKET_DESIRED_LEN;
-        contents->buckets.reserve(cz::heap_allocator(), extra_buffers);
-        contents->bucket_lfs.reserve(cz::heap_allocator(), extra_buffers);
-        for (size_t i = 0; i < extra_buffers; ++i) {
-            contents->buckets.insert(b + i + 1, bucket_alloc());
-            contents->bucket_lfs.insert(b + i + 1, 0);
-        }
+        insert_empty_buckets(contents, b + 1, extra_buffers);
 
         // Characters after the start point are saved for later
         char overflow[CONTENTS_BUCKET_MAX_SIZE];
@@ -200,9 +363,9 @@ static void insert_at(Contents* contents, Contents_Iterator iterator, cz::Str st
                 size_t len = str.len - str_index;
                 bucket_append(&contents->buckets[bucket_index], &contents->bucket_lfs[bucket_index],
                               {str.buffer + str_index, len});
-                overflow_index = offset - len;
                 bucket_append(&contents->buckets[bucket_index], &contents->bucket_lfs[bucket_index],
-                              {overflow, overflow_index});
+                              {overflow + overflow_index, offset - len});
+                overflow_index += offset - len;
                 str_index = str.len;
             } else {
                 bucket_append(&contents->buckets[bucket_index], &contents->bucket_lfs[bucket_index],
@@ -218,6 +381,8 @@ static void insert_at(Contents* contents, Contents_Iterator iterator, cz::Str st
         bucket_append(&contents->buckets[b + extra_buffers],
                       &contents->bucket_lfs[b + extra_buffers],
                       {overflow + overflow_index, overflow_len - overflow_index});
+
+        index_rebuild_from(contents, b);
     }
 }
 
@@ -239,6 +404,210 @@ void Contents::append(cz::Str str) {
     insert(len, str);
 }
 
+/// Push `str` as new buckets of at most `CONTENTS_BUCKET_DESIRED_LEN`
+/// characters (or one bucket if it fits).  Reuses `bucket` if possible.
+static void push_spliced_buckets(Contents* contents,
+                                 cz::Vector<cz::Slice<char>>* new_buckets,
+                                 cz::Vector<uint64_t>* new_lfs,
+                                 size_t bucket,
+                                 cz::Str str) {
+    size_t count = 1;
+    if (str.len > CONTENTS_BUCKET_MAX_SIZE) {
+        count = (str.len + CONTENTS_BUCKET_DESIRED_LEN - 1) / CONTENTS_BUCKET_DESIRED_LEN;
+    }
+
+    new_buckets->reserve(cz::heap_allocator(), count);
+    new_lfs->reserve(cz::heap_allocator(), count);
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = cz::min(str.len, (size_t)(count == 1 ? CONTENTS_BUCKET_MAX_SIZE
+                                                           : CONTENTS_BUCKET_DESIRED_LEN));
+        cz::Slice<char> new_bucket;
+        if (i == 0 && !contents->is_bucket_mapped(bucket)) {
+            new_bucket = {contents->buckets[bucket].elems, 0};
+        } else {
+            new_bucket = bucket_alloc();
+        }
+        bucket_append(&new_bucket, str.slice_end(len));
+        new_buckets->push(new_bucket);
+        new_lfs->push(count_lines(str.slice_end(len)));
+        str = str.slice_start(len);
+    }
+}
+
+void Contents::splice(cz::Slice<const Contents_Splice> splices) {
+    ZoneScoped;
+
+    if (splices.len == 0) {
+        return;
+    }
+
+    if (buckets.len == 0) {
+        uint64_t position = 0;
+        for (size_t s = 0; s < splices.len; ++s) {
+            CZ_DEBUG_ASSERT(splices[s].position == 0);
+            CZ_DEBUG_ASSERT(splices[s].remove == 0);
+            insert(position, splices[s].insert);
+            position += splices[s].insert.len;
+        }
+        return;
+    }
+
+    cz::Vector<cz::Slice<char>> new_buckets = {};
+    cz::Vector<uint64_t> new_lfs = {};
+    new_buckets.reserve_exact(cz::heap_allocator(), buckets.len + 1);
+    new_lfs.reserve_exact(cz::heap_allocator(), buckets.len + 1);
+
+    cz::String scratch = {};
+    CZ_DEFER(scratch.drop(cz::heap_allocator()));
+
+    size_t s = 0;
+    uint64_t removing = 0;  // Characters left to remove from a splice in a previous bucket.
+    uint64_t bucket_start = 0;
+    uint64_t new_len = len;
+    for (size_t b = 0; b < buckets.len; ++b) {
+        cz::Str old = buckets[b];
+        uint64_t bucket_end = bucket_start + old.len;
+        bool last = (b + 1 == buckets.len);
+
+        // Splices at the end of a bucket are applied at the start of the next bucket.
+        if (removing == 0 && (s == splices.len || (splices[s].position >= bucket_end && !last))) {
+            new_buckets.reserve(cz::heap_allocator(), 1);
+            new_lfs.reserve(cz::heap_allocator(), 1);
+            new_buckets.push(buckets[b]);
+            new_lfs.push(bucket_lfs[b]);
+            bucket_start = bucket_end;
+            continue;
+        }
+
+        scratch.len = 0;
+        uint64_t cursor = cz::min(removing, (uint64_t)old.len);
+        removing -= cursor;
+
+        while (removing == 0 && s < splices.len && (splices[s].position < bucket_end || last)) {
+            const Contents_Splice& splice = splices[s];
+            uint64_t offset = splice.position - bucket_start;
+            CZ_DEBUG_ASSERT(offset >= cursor);
+            CZ_DEBUG_ASSERT(offset <= old.len);
+
+            scratch.reserve(cz::heap_allocator(), offset - cursor + splice.insert.len);
+            scratch.append(old.slice(cursor, offset));
+            scratch.append(splice.insert);
+
+            uint64_t count = cz::min(splice.remove, old.len - offset);
+            cursor = offset + count;
+            removing = splice.remove - count;
+            new_len += splice.insert.len;
+            new_len -= splice.remove;
+            ++s;
+        }
+
+        scratch.reserve(cz::heap_allocator(), old.len - cursor);
+        scratch.append(old.slice_start(cursor));
+
+        if (scratch.len > 0) {
+            push_spliced_buckets(this, &new_buckets, &new_lfs, b, scratch);
+        } else {
+            bucket_dealloc(this, b);
+        }
+
+        bucket_start = bucket_end;
+    }
+
+    CZ_DEBUG_ASSERT(removing == 0);
+    CZ_DEBUG_ASSERT(s == splices.len);
+
+    buckets.drop(cz::heap_allocator());
+    bucket_lfs.drop(cz::heap_allocator());
+    buckets = new_buckets;
+    bucket_lfs = new_lfs;
+    len = new_len;
+    index_rebuild_from(this, 0);
+}
+
+void Contents::set_mapping(cz::Slice<char> new_mapping) {
+    CZ_ASSERT(mapping.len == 0);
+    mapping = new_mapping;
+}
+
+void Contents::append_mapped(cz::Str str) {
+    ZoneScoped;
+
+    CZ_DEBUG_ASSERT(str.buffer >= mapping.elems);
+    CZ_DEBUG_ASSERT(str.buffer + str.len <= mapping.elems + mapping.len);
+
+    len += str.len;
+
+    size_t num_buckets = (str.len + CONTENTS_BUCKET_MAX_SIZE - 1) / CONTENTS_BUCKET_MAX_SIZE;
+    buckets.reserve(cz::heap_allocator(), num_buckets);
+    bucket_lfs.reserve(cz::heap_allocator(), num_buckets);
+    while (str.len > 0) {
+        cz::Str chunk = str.slice_end(cz::min(str.len, (size_t)CONTENTS_BUCKET_MAX_SIZE));
+        str = str.slice_start(chunk.len);
+
+        // Point directly into the mapping.
+        buckets.push({(char*)chunk.buffer, chunk.len});
+        bucket_lfs.push(count_lines(chunk));
+        index_push(&bucket_len_index, chunk.len);
+        index_push(&bucket_lfs_index, bucket_lfs.last());
+    }
+}
+
+void Contents::unmap() {
+    ZoneScoped;
+
+    if (mapping.len == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < buckets.len; ++i) {
+        bucket_materialize(this, i);
+    }
+    unmap_file(mapping);
+    mapping = {};
+}
+
+void Contents::unmap_changed(uint64_t file_len) {
+    ZoneScoped;
+
+    if (mapping.len == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < buckets.len; ++i) {
+        if (!is_bucket_mapped(i)) {
+            continue;
+        }
+
+        cz::Slice<char> bucket = buckets[i];
+        uint64_t offset = bucket.elems - mapping.elems;
+        uint64_t readable = 0;
+        if (offset < file_len) {
+            readable = cz::min((uint64_t)bucket.len, file_len - offset);
+        }
+
+        cz::Slice<char> copy = bucket_alloc();
+        memcpy(copy.elems, bucket.elems, readable);
+        memset(copy.elems + readable, 0, bucket.len - readable);
+        copy.len = bucket.len;
+        buckets[i] = copy;
+        bucket_lfs[i] = count_lines({copy.elems, copy.len});
+    }
+
+    unmap_file(mapping);
+    mapping = {};
+    index_rebuild_from(this, 0);
+}
+
+bool Contents::is_bucket_mapped(size_t bucket) const {
+    const char* elems = buckets[bucket].elems;
+    return mapping.len > 0 && elems >= mapping.elems && elems < mapping.elems + mapping.len;
+}
+
+uint64_t Contents::bucket_line_feeds(size_t bucket) const {
+    return bucket_lfs[bucket];
+}
+
 static void slice_impl(char* buffer,
                        cz::Slice<const cz::Slice<char>> buckets,
                        Contents_Iterator start,
@@ -323,35 +692,35 @@ cz::Str Contents::slice_str(cz::Allocator allocator,
 char Contents::get_once(uint64_t pos) const {
     ZoneScoped;
 
-    for (size_t i = 0; i < buckets.len; ++i) {
-        if (pos < buckets[i].len) {
-            return buckets[i][pos];
-        }
-        pos -= buckets[i].len;
-    }
-
-    CZ_PANIC("Out of bounds");
+    CZ_ASSERT(pos < len);
+    return iterator_at(pos).get();
 }
 
 uint64_t Contents::get_line_number(uint64_t pos) const {
     ZoneScoped;
 
-    uint64_t line = 1;
-    for (size_t i = 0; i < buckets.len; ++i) {
-        if (pos < buckets[i].len) {
-            return line + count_lines({buckets[i].elems, pos});
-        }
+    CZ_ASSERT(pos <= len);
 
-        line += bucket_lfs[i];
-        pos -= buckets[i].len;
+    size_t bucket = index_search(bucket_len_index, &pos, /*strict=*/false);
+    uint64_t line = 1 + index_prefix(bucket_lfs_index, bucket);
+    if (bucket < buckets.len) {
+        line += count_lines({buckets[bucket].elems, pos});
     }
+    return line;
+}
 
-    // Handle eof.
-    if (pos == 0) {
-        return line;
-    }
+size_t Contents::find_bucket_by_lines(uint64_t* lines, uint64_t* position) const {
+    ZoneScoped;
 
-    CZ_PANIC("Out of bounds");
+    size_t bucket = index_search(bucket_lfs_index, lines, /*strict=*/true);
+    *position = index_prefix(bucket_len_index, bucket);
+    return bucket;
+}
+
+Contents_Iterator Contents::iterator_at_bucket_by_lines(uint64_t* lines) const {
+    Contents_Iterator it = start();
+    it.bucket = find_bucket_by_lines(lines, &it.position);
+    return it;
 }
 
 Contents_Iterator Contents::iterator_at(uint64_t pos) const {
@@ -362,20 +731,10 @@ Contents_Iterator Contents::iterator_at(uint64_t pos) const {
     Contents_Iterator it;
     it.contents = this;
     it.position = pos;
+    it.bucket = index_search(bucket_len_index, &pos, /*strict=*/false);
+    it.index = pos;
 
-    for (size_t i = 0; i < buckets.len; ++i) {
-        if (pos < buckets[i].len) {
-            it.bucket = i;
-            it.index = pos;
-            return it;
-        }
-        pos -= buckets[i].len;
-    }
-
-    CZ_DEBUG_ASSERT(pos == 0);
-
-    it.bucket = buckets.len;
-    it.index = 0;
+    CZ_DEBUG_ASSERT(it.bucket < buckets.len || it.index == 0);
     return it;
 }
 
@@ -383,6 +742,13 @@ void Contents_Iterator::retreat(uint64_t offset) {
     ZoneScoped;
 
     CZ_DEBUG_ASSERT(position >= offset);
+
+    // Use the index instead of walking over many buckets.
+    if (offset > CONTENTS_INDEX_JUMP_THRESHOLD) {
+        *this = contents->iterator_at(position - offset);
+        return;
+    }
+
     position -= offset;
     if (offset > index) {
         offset -= index;
@@ -404,6 +770,13 @@ void Contents_Iterator::advance(uint64_t offset) {
     ZoneScoped;
 
     CZ_DEBUG_ASSERT(position + offset <= contents->len);
+
+    // Use the index instead of walking over many buckets.
+    if (offset > CONTENTS_INDEX_JUMP_THRESHOLD) {
+        *this = contents->iterator_at(position + offset);
+        return;
+    }
+
     position += offset;
     index += offset;
     while (1) {
@@ -426,3 +799,5 @@ void Contents_Iterator::advance(uint64_t offset) {
 }
 
 }
+
+#endif
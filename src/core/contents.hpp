@@ -15,17 +15,126 @@ struct SSOStr;
 
 struct Contents_Iterator;
 
+/// One edit applied by `Contents::splice`.  Removes `remove` characters at `position` then
+/// inserts `insert` there.  `position` is relative to the contents before any edits are applied.
+struct Contents_Splice {
+    uint64_t position;
+    uint64_t remove;
+    cz::Str insert;
+};
+
+#ifdef MAG_ROPE_CONTENTS
+/// A bucket of a rope.  The buckets are the nodes of a balanced (AVL) tree in order and each
+/// node stores the totals of its subtree so a position, line or bucket number is resolved
+/// in `O(log(buckets.len))` and buckets are inserted or removed without shifting the others.
+struct Contents_Node {
+    Contents_Node* parent;
+    Contents_Node* left;
+    Contents_Node* right;
+
+    cz::Slice<char> bucket;
+    uint64_t lfs;
+
+    /// Totals of this node and all its descendants.
+    size_t total_buckets;
+    uint64_t total_len;
+    uint64_t total_lfs;
+    int height;
+};
+
+inline const Contents_Node* contents_node_first(const Contents_Node* node) {
+    while (node && node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+inline const Contents_Node* contents_node_last(const Contents_Node* node) {
+    while (node && node->right) {
+        node = node->right;
+    }
+    return node;
+}
+
+/// The bucket after `node` or `nullptr` if it is the last bucket.
+inline const Contents_Node* contents_node_next(const Contents_Node* node) {
+    if (node->right) {
+        return contents_node_first(node->right);
+    }
+    while (node->parent && node->parent->right == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+/// The bucket before `node` or `nullptr` if it is the first bucket.
+inline const Contents_Node* contents_node_prev(const Contents_Node* node) {
+    if (node->left) {
+        return contents_node_last(node->left);
+    }
+    while (node->parent && node->parent->left == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+/// The buckets of a rope.  Indexing is `O(log(len))` so prefer walking
+/// buckets via `Contents_Iterator`, which remembers its node.
+struct Contents_Rope {
+    Contents_Node* root;
+    size_t len;
+
+    const Contents_Node* node_at(size_t bucket) const;
+    cz::Slice<char> operator[](size_t bucket) const { return node_at(bucket)->bucket; }
+};
+#endif
+
 struct Contents {
+#ifdef MAG_ROPE_CONTENTS
+    Contents_Rope buckets;
+    uint64_t len;
+#else
     cz::Vector<cz::Slice<char>> buckets;
     cz::Vector<uint64_t> bucket_lfs;
     uint64_t len;
 
+    /// Fenwick trees (binary indexed trees) over `buckets[i].len` and `bucket_lfs[i]`.
+    /// These allow us to resolve a position or line number to a bucket in `O(log(buckets.len))`
+    /// instead of walking every bucket.  They are maintained by `insert` and `remove`.
+    cz::Vector<uint64_t> bucket_len_index;
+    cz::Vector<uint64_t> bucket_lfs_index;
+#endif
+
+    /// A read only memory mapped file that buckets may point into instead of owning a heap
+    /// allocation.  Mapped buckets are copied to the heap when they are first edited.
+    cz::Slice<char> mapping;
+
     void drop();
 
     void remove(uint64_t start, uint64_t len);
     void insert(uint64_t position, cz::Str str);
     void append(cz::Str str);
 
+    /// Apply many edits in one sweep over the buckets.  The `splices` must be sorted by
+    /// `position` and their removals must not overlap.  Editing each bucket at most once
+    /// makes this much faster than calling `insert` or `remove` once per edit (ie per cursor).
+    void splice(cz::Slice<const Contents_Splice> splices);
+
+    /// Take ownership of a memory mapped file.  It will be unmapped in `drop` or `unmap`.
+    void set_mapping(cz::Slice<char> mapping);
+    /// Append `str`, which must be inside `mapping`, without copying it.
+    void append_mapped(cz::Str str);
+    /// Copy all mapped buckets to the heap and release the mapping.
+    void unmap();
+    /// Like `unmap` but for after another program changed the mapped file in place.  Only the
+    /// first `file_len` bytes of the mapping are read since the pages after the end of a
+    /// truncated file can't be read; they become zeros.  The line counts are recomputed
+    /// since the mapped bytes may no longer be the ones that were counted.
+    void unmap_changed(uint64_t file_len);
+    bool is_bucket_mapped(size_t bucket) const;
+    /// The number of line feeds in the bucket.
+    uint64_t bucket_line_feeds(size_t bucket) const;
+
     cz::String stringify(cz::Allocator allocator) const;
     void stringify_into(cz::Allocator allocator, cz::String* string) const;
     SSOStr slice(cz::Allocator allocator, Contents_Iterator start, uint64_t end) const;
@@ -43,6 +152,14 @@ struct Contents {
     /// Note: lines (and columns) are 1-indexed!
     uint64_t get_line_number(uint64_t position) const;
 
+    /// Find the first bucket such that the line feeds in it and all previous buckets
+    /// is at least `*lines`.  Subtracts the line feeds in previous buckets from `*lines`
+    /// and sets `*position` to the start of the bucket.  Returns `buckets.len` if not found.
+    size_t find_bucket_by_lines(uint64_t* lines, uint64_t* position) const;
+    /// Like `find_bucket_by_lines` but returns an iterator at the start
+    /// of the bucket.  Returns `end()` if the bucket isn't found.
+    Contents_Iterator iterator_at_bucket_by_lines(uint64_t* lines) const;
+
     inline Contents_Iterator start() const;
     inline Contents_Iterator end() const;
 };
@@ -52,11 +169,20 @@ struct Contents_Iterator {
     uint64_t position;
     size_t bucket;
     size_t index;
+#ifdef MAG_ROPE_CONTENTS
+    /// The node of `bucket` or `nullptr` at the end.  Like `bucket` it
+    /// is invalidated by editing the `Contents` without the iterator.
+    const Contents_Node* node;
+#endif
 
     bool at_bob() const { return position == 0; }
     bool at_eob() const { return position == contents->len; }
 
+#ifdef MAG_ROPE_CONTENTS
+    char get() const { return node->bucket[index]; }
+#else
     char get() const { return contents->buckets[bucket][index]; }
+#endif
 
     void retreat(uint64_t offset);
     void advance(uint64_t offset);
@@ -77,7 +203,12 @@ struct Contents_Iterator {
         --position;
         if (index == 0) {
             --bucket;
+#ifdef MAG_ROPE_CONTENTS
+            node = node ? contents_node_prev(node) : contents_node_last(contents->buckets.root);
+            index = node->bucket.len;
+#else
             index = contents->buckets[bucket].len;
+#endif
         }
         --index;
     }
@@ -86,10 +217,18 @@ struct Contents_Iterator {
         CZ_DEBUG_ASSERT(!at_eob());
         ++position;
         ++index;
+#ifdef MAG_ROPE_CONTENTS
+        if (index == node->bucket.len) {
+            node = contents_node_next(node);
+            ++bucket;
+            index = 0;
+        }
+#else
         if (index == contents->buckets[bucket].len) {
             ++bucket;
             index = 0;
         }
+#endif
     }
 
     void retreat_most(uint64_t offset) {
@@ -114,6 +253,9 @@ struct Contents_Iterator {
 inline Contents_Iterator Contents::start() const {
     Contents_Iterator it = {};
     it.contents = this;
+#ifdef MAG_ROPE_CONTENTS
+    it.node = contents_node_first(buckets.root);
+#endif
     return it;
 }
 
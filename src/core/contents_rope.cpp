@@ -0,0 +1,752 @@
+#include "contents.hpp"
+
+// See `contents.cpp` for the vector of buckets used by default.
+#ifdef MAG_ROPE_CONTENTS
+
+#include <string.h>
+#include <cz/heap.hpp>
+#include <cz/util.hpp>
+#include <tracy/Tracy.hpp>
+#include "core/file.hpp"
+#include "core/ssostr.hpp"
+
+namespace mag {
+
+// Buckets are split the same way as in `contents.cpp`.
+#define CONTENTS_BUCKET_MAX_SIZE 4096
+#define CONTENTS_BUCKET_DESIRED_LEN (CONTENTS_BUCKET_MAX_SIZE * 3 / 4)
+#define CONTENTS_INDEX_JUMP_THRESHOLD (CONTENTS_BUCKET_MAX_SIZE * 16)
+
+///////////////////////////////////////////////////////////////////////////////
+// Buckets
+///////////////////////////////////////////////////////////////////////////////
+
+static cz::Slice<char> bucket_alloc() {
+    char* buffer = cz::heap_allocator().alloc<char>(CONTENTS_BUCKET_MAX_SIZE);
+    return {buffer, 0};
+}
+
+static bool is_mapped(const Contents* contents, const Contents_Node* node) {
+    const char* elems = node->bucket.elems;
+    return contents->mapping.len > 0 && elems >= contents->mapping.elems &&
+           elems < contents->mapping.elems + contents->mapping.len;
+}
+
+static void bucket_dealloc(const Contents* contents, Contents_Node* node) {
+    if (!is_mapped(contents, node)) {
+        cz::heap_allocator().dealloc(node->bucket.elems, CONTENTS_BUCKET_MAX_SIZE);
+    }
+}
+
+/// Copy a mapped bucket to the heap so it can be edited.
+static void bucket_materialize(const Contents* contents, Contents_Node* node) {
+    if (!is_mapped(contents, node)) {
+        return;
+    }
+
+    ZoneScoped;
+
+    cz::Slice<char> copy = bucket_alloc();
+    memcpy(copy.elems, node->bucket.elems, node->bucket.len);
+    copy.len = node->bucket.len;
+    node->bucket = copy;
+}
+
+static uint64_t count_lines(cz::Str str) {
+    ZoneScoped;
+    return str.count('\n');
+}
+
+static void bucket_remove(cz::Slice<char>* bucket, uint64_t* lines, uint64_t start, uint64_t len) {
+    ZoneScoped;
+
+    uint64_t count = count_lines({bucket->elems + start, len});
+    CZ_DEBUG_ASSERT(*lines >= count);
+    *lines -= count;
+
+    uint64_t end = start + len;
+    memmove(bucket->elems + start, bucket->elems + end, bucket->len - end);
+    bucket->len -= len;
+}
+
+static void bucket_insert(cz::Slice<char>* bucket,
+                          uint64_t* lines,
+                          uint64_t position,
+                          cz::Str str) {
+    ZoneScoped;
+
+    *lines += count_lines(str);
+
+    memmove(bucket->elems + position + str.len, bucket->elems + position, bucket->len - position);
+    memcpy(bucket->elems + position, str.buffer, str.len);
+    bucket->len += str.len;
+}
+
+static void bucket_append(cz::Slice<char>* bucket, uint64_t* lines, cz::Str str) {
+    ZoneScoped;
+
+    *lines += count_lines(str);
+    memcpy(bucket->elems + bucket->len, str.buffer, str.len);
+    bucket->len += str.len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tree
+///////////////////////////////////////////////////////////////////////////////
+
+static int height(const Contents_Node* node) {
+    return node ? node->height : 0;
+}
+
+/// Recalculate the totals of `node` from its children.
+static void node_update(Contents_Node* node) {
+    node->total_buckets = 1;
+    node->total_len = node->bucket.len;
+    node->total_lfs = node->lfs;
+    node->height = 1;
+    if (node->left) {
+        node->total_buckets += node->left->total_buckets;
+        node->total_len += node->left->total_len;
+        node->total_lfs += node->left->total_lfs;
+        node->height = node->left->height + 1;
+    }
+    if (node->right) {
+        node->total_buckets += node->right->total_buckets;
+        node->total_len += node->right->total_len;
+        node->total_lfs += node->right->total_lfs;
+        node->height = cz::max(node->height, node->right->height + 1);
+    }
+}
+
+/// Recalculate the totals of `node` and its ancestors after its bucket changed.
+static void update_up(Contents_Node* node) {
+    for (; node; node = node->parent) {
+        node_update(node);
+    }
+}
+
+static void update_all(Contents_Node* node) {
+    if (!node) {
+        return;
+    }
+    update_all(node->left);
+    update_all(node->right);
+    node_update(node);
+}
+
+/// Put `replacement` where `node` is in the tree.
+static void replace_child(Contents_Rope* rope, Contents_Node* node, Contents_Node* replacement) {
+    Contents_Node* parent = node->parent;
+    if (!parent) {
+        rope->root = replacement;
+    } else if (parent->left == node) {
+        parent->left = replacement;
+    } else {
+        parent->right = replacement;
+    }
+    if (replacement) {
+        replacement->parent = parent;
+    }
+}
+
+static Contents_Node* rotate_left(Contents_Rope* rope, Contents_Node* node) {
+    Contents_Node* child = node->right;
+    node->right = child->left;
+    if (node->right) {
+        node->right->parent = node;
+    }
+    replace_child(rope, node, child);
+    child->left = node;
+    node->parent = child;
+    node_update(node);
+    node_update(child);
+    return child;
+}
+
+static Contents_Node* rotate_right(Contents_Rope* rope, Contents_Node* node) {
+    Contents_Node* child = node->left;
+    node->left = child->right;
+    if (node->left) {
+        node->left->parent = node;
+    }
+    replace_child(rope, node, child);
+    child->right = node;
+    node->parent = child;
+    node_update(node);
+    node_update(child);
+    return child;
+}
+
+/// Update and rebalance `node` and its ancestors after a child was inserted or removed.
+static void rebalance_up(Contents_Rope* rope, Contents_Node* node) {
+    while (node) {
+        node_update(node);
+        int balance = height(node->left) - height(node->right);
+        if (balance > 1) {
+            if (height(node->left->left) < height(node->left->right)) {
+                rotate_left(rope, node->left);
+            }
+            node = rotate_right(rope, node);
+        } else if (balance < -1) {
+            if (height(node->right->right) < height(node->right->left)) {
+                rotate_right(rope, node->right);
+            }
+            node = rotate_left(rope, node);
+        }
+        node = node->parent;
+    }
+}
+
+/// Insert a new bucket after `node` or at the start if `node` is `nullptr`.
+static Contents_Node* insert_node_after(Contents_Rope* rope,
+                                        Contents_Node* node,
+                                        cz::Slice<char> bucket,
+                                        uint64_t lfs) {
+    Contents_Node* new_node = cz::heap_allocator().alloc<Contents_Node>();
+    CZ_ASSERT(new_node);
+    *new_node = {};
+    new_node->bucket = bucket;
+    new_node->lfs = lfs;
+
+    if (!rope->root) {
+        rope->root = new_node;
+    } else if (!node) {
+        Contents_Node* first = (Contents_Node*)contents_node_first(rope->root);
+        first->left = new_node;
+        new_node->parent = first;
+    } else if (!node->right) {
+        node->right = new_node;
+        new_node->parent = node;
+    } else {
+        Contents_Node* next = (Contents_Node*)contents_node_first(node->right);
+        next->left = new_node;
+        new_node->parent = next;
+    }
+
+    ++rope->len;
+    rebalance_up(rope, new_node);
+    return new_node;
+}
+
+/// Remove `node` from the tree and deallocate it and its bucket.
+static void remove_node(Contents* contents, Contents_Node* node) {
+    Contents_Rope* rope = &contents->buckets;
+    Contents_Node* changed;
+    if (node->left && node->right) {
+        // Move the next node into the place of `node`.
+        Contents_Node* next = (Contents_Node*)contents_node_first(node->right);
+        if (next->parent != node) {
+            changed = next->parent;
+            replace_child(rope, next, next->right);
+            next->right = node->right;
+            next->right->parent = next;
+        } else {
+            changed = next;
+        }
+        replace_child(rope, node, next);
+        next->left = node->left;
+        next->left->parent = next;
+    } else {
+        changed = node->parent;
+        replace_child(rope, node, node->left ? node->left : node->right);
+    }
+
+    --rope->len;
+    rebalance_up(rope, changed);
+
+    bucket_dealloc(contents, node);
+    cz::heap_allocator().dealloc(node);
+}
+
+static void drop_nodes(const Contents* contents, Contents_Node* node) {
+    if (!node) {
+        return;
+    }
+    drop_nodes(contents, node->left);
+    drop_nodes(contents, node->right);
+    bucket_dealloc(contents, node);
+    cz::heap_allocator().dealloc(node);
+}
+
+const Contents_Node* Contents_Rope::node_at(size_t bucket) const {
+    CZ_DEBUG_ASSERT(bucket < len);
+
+    const Contents_Node* node = root;
+    while (1) {
+        size_t left = node->left ? node->left->total_buckets : 0;
+        if (bucket < left) {
+            node = node->left;
+        } else if (bucket == left) {
+            return node;
+        } else {
+            bucket -= left + 1;
+            node = node->right;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Contents
+///////////////////////////////////////////////////////////////////////////////
+
+void Contents::drop() {
+    drop_nodes(this, buckets.root);
+    if (mapping.len > 0) {
+        unmap_file(mapping);
+    }
+    buckets = {};
+}
+
+void Contents::remove(uint64_t start, uint64_t len) {
+    ZoneScoped;
+    CZ_DEBUG_ASSERT(start + len <= this->len);
+    if (len == 0) {
+        return;
+    }
+
+    this->len -= len;
+
+    Contents_Iterator iterator = iterator_at(start);
+    Contents_Node* node = (Contents_Node*)iterator.node;
+    start = iterator.index;
+
+    while (len > 0) {
+        CZ_DEBUG_ASSERT(node);
+        Contents_Node* next = (Contents_Node*)contents_node_next(node);
+
+        uint64_t count = cz::min(len, node->bucket.len - start);
+        if (count == node->bucket.len) {
+            remove_node(this, node);
+        } else {
+            bucket_materialize(this, node);
+            bucket_remove(&node->bucket, &node->lfs, start, count);
+            update_up(node);
+        }
+
+        len -= count;
+        start = 0;
+        node = next;
+    }
+}
+
+/// Fill `bucket` with up to `count` characters from `first` then `second`.
+static void take_pieces(cz::Slice<char>* bucket,
+                        uint64_t* lines,
+                        cz::Str* first,
+                        cz::Str* second,
+                        size_t count) {
+    cz::Str* pieces[] = {first, second};
+    for (size_t i = 0; i < 2; ++i) {
+        size_t len = cz::min(count, pieces[i]->len);
+        if (len == 0) {
+            continue;
+        }
+        bucket_append(bucket, lines, pieces[i]->slice_end(len));
+        *pieces[i] = pieces[i]->slice_start(len);
+        count -= len;
+    }
+}
+
+/// Insert buckets holding `first` then `second` after `node`.  Buckets are filled to
+/// `CONTENTS_BUCKET_DESIRED_LEN` so there is space to insert later without splitting.
+static void insert_buckets_after(Contents_Rope* rope,
+                                 Contents_Node* node,
+                                 cz::Str first,
+                                 cz::Str second) {
+    while (first.len + second.len > 0) {
+        size_t count = first.len + second.len;
+        if (count > CONTENTS_BUCKET_MAX_SIZE) {
+            count = CONTENTS_BUCKET_DESIRED_LEN;
+        }
+
+        cz::Slice<char> bucket = bucket_alloc();
+        uint64_t lfs = 0;
+        take_pieces(&bucket, &lfs, &first, &second, count);
+        node = insert_node_after(rope, node, bucket, lfs);
+    }
+}
+
+void Contents::insert(uint64_t start, cz::Str str) {
+    ZoneScoped;
+
+    if (str.len == 0) {
+        return;
+    }
+
+    if (buckets.len == 0) {
+        CZ_DEBUG_ASSERT(start == 0);
+        CZ_DEBUG_ASSERT(len == 0);
+        len = str.len;
+        insert_buckets_after(&buckets, nullptr, str, {});
+        return;
+    }
+
+    Contents_Iterator iterator = iterator_at(start);
+    if (!iterator.at_bob()) {
+        // Go to the end of the previous bucket if we are at the start of a bucket.
+        iterator.retreat();
+        iterator.index++;
+        iterator.position++;
+    }
+
+    Contents_Node* node = (Contents_Node*)iterator.node;
+    CZ_DEBUG_ASSERT(iterator.index <= node->bucket.len);
+
+    len += str.len;
+
+    bucket_materialize(this, node);
+
+    // If we can fit in the current bucket then we just insert into it.
+    if (node->bucket.len + str.len <= CONTENTS_BUCKET_MAX_SIZE) {
+        bucket_insert(&node->bucket, &node->lfs, iterator.index, str);
+        update_up(node);
+        return;
+    }
+
+    // Characters after the insertion point are saved then put after `str`.
+    char overflow[CONTENTS_BUCKET_MAX_SIZE];
+    cz::Str rest = {overflow, node->bucket.len - iterator.index};
+    memcpy(overflow, node->bucket.elems + iterator.index, rest.len);
+    node->lfs -= count_lines(rest);
+    node->bucket.len = iterator.index;
+
+    if (node->bucket.len < CONTENTS_BUCKET_DESIRED_LEN) {
+        take_pieces(&node->bucket, &node->lfs, &str, &rest,
+                    CONTENTS_BUCKET_DESIRED_LEN - node->bucket.len);
+    }
+    update_up(node);
+
+    insert_buckets_after(&buckets, node, str, rest);
+}
+
+void Contents::append(cz::Str str) {
+    ZoneScoped;
+
+    insert(len, str);
+}
+
+void Contents::splice(cz::Slice<const Contents_Splice> splices) {
+    ZoneScoped;
+
+    // Each edit is `O(log(buckets.len))` so apply them individually.  Going
+    // backwards means the positions of the remaining splices are unchanged.
+    for (size_t s = splices.len; s-- > 0;) {
+        const Contents_Splice& splice = splices[s];
+        CZ_DEBUG_ASSERT(s == 0 || splices[s - 1].position + splices[s - 1].remove <=
+                                      splice.position);
+        remove(splice.position, splice.remove);
+        insert(splice.position, splice.insert);
+    }
+}
+
+void Contents::set_mapping(cz::Slice<char> new_mapping) {
+    CZ_ASSERT(mapping.len == 0);
+    mapping = new_mapping;
+}
+
+void Contents::append_mapped(cz::Str str) {
+    ZoneScoped;
+
+    CZ_DEBUG_ASSERT(str.buffer >= mapping.elems);
+    CZ_DEBUG_ASSERT(str.buffer + str.len <= mapping.elems + mapping.len);
+
+    len += str.len;
+
+    Contents_Node* node = (Contents_Node*)contents_node_last(buckets.root);
+    while (str.len > 0) {
+        cz::Str chunk = str.slice_end(cz::min(str.len, (size_t)CONTENTS_BUCKET_MAX_SIZE));
+        str = str.slice_start(chunk.len);
+
+        // Point directly into the mapping.
+        node = insert_node_after(&buckets, node, {(char*)chunk.buffer, chunk.len},
+                                 count_lines(chunk));
+    }
+}
+
+void Contents::unmap() {
+    ZoneScoped;
+
+    if (mapping.len == 0) {
+        return;
+    }
+
+    for (const Contents_Node* node = contents_node_first(buckets.root); node;
+         node = contents_node_next(node)) {
+        bucket_materialize(this, (Contents_Node*)node);
+    }
+    unmap_file(mapping);
+    mapping = {};
+}
+
+void Contents::unmap_changed(uint64_t file_len) {
+    ZoneScoped;
+
+    if (mapping.len == 0) {
+        return;
+    }
+
+    for (const Contents_Node* it = contents_node_first(buckets.root); it;
+         it = contents_node_next(it)) {
+        Contents_Node* node = (Contents_Node*)it;
+        if (!is_mapped(this, node)) {
+            continue;
+        }
+
+        cz::Slice<char> bucket = node->bucket;
+        uint64_t offset = bucket.elems - mapping.elems;
+        uint64_t readable = 0;
+        if (offset < file_len) {
+            readable = cz::min((uint64_t)bucket.len, file_len - offset);
+        }
+
+        cz::Slice<char> copy = bucket_alloc();
+        memcpy(copy.elems, bucket.elems, readable);
+        memset(copy.elems + readable, 0, bucket.len - readable);
+        copy.len = bucket.len;
+        node->bucket = copy;
+        node->lfs = count_lines({copy.elems, copy.len});
+    }
+
+    unmap_file(mapping);
+    mapping = {};
+    update_all(buckets.root);
+}
+
+bool Contents::is_bucket_mapped(size_t bucket) const {
+    return is_mapped(this, buckets.node_at(bucket));
+}
+
+uint64_t Contents::bucket_line_feeds(size_t bucket) const {
+    return buckets.node_at(bucket)->lfs;
+}
+
+static void slice_impl(char* buffer, Contents_Iterator start, uint64_t len) {
+    uint64_t bucket_index = start.index;
+    for (const Contents_Node* node = start.node; len > 0; node = contents_node_next(node)) {
+        CZ_DEBUG_ASSERT(node);
+        size_t offset = cz::min(len, node->bucket.len - bucket_index);
+        memcpy(buffer, node->bucket.elems + bucket_index, offset);
+        buffer += offset;
+        len -= offset;
+        bucket_index = 0;
+    }
+}
+
+void Contents::stringify_into(cz::Allocator allocator, cz::String* string) const {
+    ZoneScoped;
+    string->reserve(allocator, len);
+    slice_impl(string->end(), start(), len);
+    string->len += len;
+}
+
+cz::String Contents::stringify(cz::Allocator allocator) const {
+    ZoneScoped;
+    cz::String string = {};
+    stringify_into(allocator, &string);
+    return string;
+}
+
+SSOStr Contents::slice(cz::Allocator allocator, Contents_Iterator start, uint64_t end) const {
+    ZoneScoped;
+
+    CZ_DEBUG_ASSERT(start.position <= end);
+    CZ_DEBUG_ASSERT(end <= len);
+
+    SSOStr value;
+    uint64_t len = end - start.position;
+    if (len > SSOStr::MAX_SHORT_LEN) {
+        char* buffer = (char*)allocator.alloc({len, 1});
+        slice_impl(buffer, start, len);
+        value.allocated.init({buffer, len});
+    } else {
+        char buffer[SSOStr::MAX_SHORT_LEN];
+        slice_impl(buffer, start, len);
+        value.short_.init({buffer, len});
+    }
+    return value;
+}
+
+void Contents::slice_into(Contents_Iterator start, uint64_t end, char* string) const {
+    ZoneScoped;
+    slice_impl(string, start, end - start.position);
+}
+
+void Contents::slice_into(Contents_Iterator start, uint64_t end, cz::String* string) const {
+    ZoneScoped;
+    CZ_DEBUG_ASSERT(string->remaining() >= end - start.position);
+    slice_impl(string->end(), start, end - start.position);
+    string->len += end - start.position;
+}
+
+void Contents::slice_into(cz::Allocator allocator,
+                          Contents_Iterator start,
+                          uint64_t end,
+                          cz::String* string) const {
+    ZoneScoped;
+    string->reserve_exact(allocator, end - start.position);
+    slice_into(start, end, string);
+}
+
+cz::Str Contents::slice_str(cz::Allocator allocator,
+                            Contents_Iterator start, uint64_t end) const {
+    cz::String string = {};
+    slice_into(allocator, start, end, &string);
+    return string;
+}
+
+char Contents::get_once(uint64_t pos) const {
+    ZoneScoped;
+
+    CZ_ASSERT(pos < len);
+    return iterator_at(pos).get();
+}
+
+uint64_t Contents::get_line_number(uint64_t pos) const {
+    ZoneScoped;
+
+    CZ_ASSERT(pos <= len);
+
+    uint64_t line = 1;
+    const Contents_Node* node = buckets.root;
+    while (node) {
+        if (node->left && pos < node->left->total_len) {
+            node = node->left;
+            continue;
+        }
+        if (node->left) {
+            pos -= node->left->total_len;
+            line += node->left->total_lfs;
+        }
+
+        if (pos < node->bucket.len) {
+            return line + count_lines({node->bucket.elems, pos});
+        }
+        pos -= node->bucket.len;
+        line += node->lfs;
+        node = node->right;
+    }
+    return line;
+}
+
+size_t Contents::find_bucket_by_lines(uint64_t* lines, uint64_t* position) const {
+    Contents_Iterator it = iterator_at_bucket_by_lines(lines);
+    *position = it.position;
+    return it.bucket;
+}
+
+Contents_Iterator Contents::iterator_at_bucket_by_lines(uint64_t* lines) const {
+    ZoneScoped;
+
+    Contents_Iterator it = {};
+    it.contents = this;
+    it.node = buckets.root;
+    while (it.node) {
+        const Contents_Node* left = it.node->left;
+        if (left && left->total_lfs >= *lines) {
+            it.node = left;
+            continue;
+        }
+        if (left) {
+            *lines -= left->total_lfs;
+            it.position += left->total_len;
+            it.bucket += left->total_buckets;
+        }
+
+        if (it.node->lfs >= *lines) {
+            return it;
+        }
+        *lines -= it.node->lfs;
+        it.position += it.node->bucket.len;
+        ++it.bucket;
+        it.node = it.node->right;
+    }
+    return it;
+}
+
+Contents_Iterator Contents::iterator_at(uint64_t pos) const {
+    ZoneScoped;
+
+    CZ_DEBUG_ASSERT(pos <= len);
+
+    Contents_Iterator it = {};
+    it.contents = this;
+    it.position = pos;
+    it.node = buckets.root;
+    while (it.node) {
+        const Contents_Node* left = it.node->left;
+        if (left && pos < left->total_len) {
+            it.node = left;
+            continue;
+        }
+        if (left) {
+            pos -= left->total_len;
+            it.bucket += left->total_buckets;
+        }
+
+        if (pos < it.node->bucket.len) {
+            break;
+        }
+        pos -= it.node->bucket.len;
+        ++it.bucket;
+        it.node = it.node->right;
+    }
+    it.index = pos;
+
+    CZ_DEBUG_ASSERT(it.node || it.index == 0);
+    return it;
+}
+
+void Contents_Iterator::retreat(uint64_t offset) {
+    ZoneScoped;
+
+    CZ_DEBUG_ASSERT(position >= offset);
+
+    // Use the tree instead of walking over many buckets.
+    if (offset > CONTENTS_INDEX_JUMP_THRESHOLD) {
+        *this = contents->iterator_at(position - offset);
+        return;
+    }
+
+    position -= offset;
+    if (offset > index) {
+        offset -= index;
+        while (1) {
+            CZ_DEBUG_ASSERT(bucket > 0);
+            --bucket;
+            node = node ? contents_node_prev(node) : contents_node_last(contents->buckets.root);
+            if (offset <= node->bucket.len) {
+                break;
+            }
+            offset -= node->bucket.len;
+        }
+        index = node->bucket.len - offset;
+    } else {
+        index -= offset;
+    }
+}
+
+void Contents_Iterator::advance(uint64_t offset) {
+    ZoneScoped;
+
+    CZ_DEBUG_ASSERT(position + offset <= contents->len);
+
+    // Use the tree instead of walking over many buckets.
+    if (offset > CONTENTS_INDEX_JUMP_THRESHOLD) {
+        *this = contents->iterator_at(position + offset);
+        return;
+    }
+
+    position += offset;
+    index += offset;
+    while (node && index >= node->bucket.len) {
+        index -= node->bucket.len;
+        node = contents_node_next(node);
+        ++bucket;
+    }
+
+    CZ_DEBUG_ASSERT(node || index == 0);
+}
+
+}
+
+#endif
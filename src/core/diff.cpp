@@ -3,12 +3,15 @@
 #include <stdio.h>
 #include <cz/char_type.hpp>
 #include <cz/defer.hpp>
+#include <cz/file.hpp>
 #include <cz/heap.hpp>
-#include <cz/process.hpp>
+#include <tracy/Tracy.hpp>
 #include "core/buffer.hpp"
+#include "core/buffer_handle.hpp"
 #include "core/client.hpp"
 #include "core/edit.hpp"
 #include "core/file.hpp"
+#include "core/line_diff.hpp"
 #include "core/transaction.hpp"
 
 namespace mag {
@@ -276,83 +279,283 @@ const char* apply_diff_file(Buffer* buffer, cz::Input_File file) {
     return message;
 }
 
-const char* reload_file(Buffer* buffer) {
+/// Read the file at `path` with carriage returns stripped the same way buffers are loaded.
+static bool read_file_for_reload(const char* path, cz::String* text) {
+    ZoneScoped;
+
+    cz::Input_File file;
+    if (!file.open(path)) {
+        return false;
+    }
+    CZ_DEFER(file.close());
+
+    if (!cz::read_to_string(file, cz::heap_allocator(), text)) {
+        return false;
+    }
+    cz::strip_carriage_returns(text->buffer, &text->len);
+    return true;
+}
+
+/// Apply the hunks of `diff_lines` to the buffer.
+static const char* apply_line_diff(Buffer* buffer, cz::Slice<const Line_Diff_Hunk> hunks) {
+    ZoneScoped;
+
+    Transaction transaction;
+    transaction.init(buffer);
+    CZ_DEFER(transaction.drop());
+
+    // Edit from the end so the positions of earlier hunks stay the same.
+    for (size_t i = hunks.len; i-- > 0;) {
+        const Line_Diff_Hunk& hunk = hunks[i];
+        if (hunk.remove_len > 0) {
+            Edit remove;
+            remove.value = buffer->contents.slice(transaction.value_allocator(),
+                                                  buffer->contents.iterator_at(hunk.position),
+                                                  hunk.position + hunk.remove_len);
+            remove.position = hunk.position;
+            remove.flags = Edit::REMOVE;
+            transaction.push(remove);
+        }
+        if (hunk.insert.len > 0) {
+            Edit insert;
+            insert.value = SSOStr::as_duplicate(transaction.value_allocator(), hunk.insert);
+            insert.position = hunk.position;
+            insert.flags = Edit::INSERT;
+            transaction.push(insert);
+        }
+    }
+
+    const char* message = nullptr;
+    transaction.commit(&message);
+    return message;
+}
+
+/// Replace the contents of the buffer with `text` by only editing the lines that changed.
+static const char* reload_from_text(Buffer* buffer, cz::Str text) {
+    cz::Vector<Line_Diff_Hunk> hunks = {};
+    CZ_DEFER(hunks.drop(cz::heap_allocator()));
+    diff_lines(buffer->contents, text, &hunks);
+
     bool old_read_only = buffer->read_only;
     buffer->read_only = false;
     CZ_DEFER(buffer->read_only = old_read_only);
 
+    const char* error = nullptr;
+    if (hunks.len > 0) {
+        error = apply_line_diff(buffer, hunks);
+    }
+    if (!error) {
+        buffer->mark_saved();
+    }
+    return error;
+}
+
+const char* reload_file(Buffer* buffer) {
+    ZoneScoped;
+
     if (buffer->type == Buffer::TEMPORARY) {
         return "Temp buffers can't be reloaded";
     }
     if (buffer->type == Buffer::DIRECTORY) {
+        bool old_read_only = buffer->read_only;
+        buffer->read_only = false;
+        CZ_DEFER(buffer->read_only = old_read_only);
         if (!reload_directory_buffer(buffer)) {
             return "Couldn't reload directory";
         }
         return nullptr;
     }
 
-    char diff_file[L_tmpnam];
-    char stderr_file[L_tmpnam];
-    {
-        if (!tmpnam(diff_file)) {
-            return "Error: couldn't create a temp file";
-        }
-        if (!tmpnam(stderr_file)) {
-            return "Error: couldn't create a stderr file";
-        }
+    // Diff against what the mapping holds now rather than what it held when it was loaded.
+    unmap_changed_file(buffer);
 
-        cz::Process_Options options;
-#ifdef _WIN32
-        options.hide_window = true;
-#endif
-        if (!save_buffer_to_temp_file(buffer, &options.std_in)) {
-            return "Error saving buffer to temp file";
-        }
-        CZ_DEFER(options.std_in.close());
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+    buffer->get_path(cz::heap_allocator(), &path);
 
-        if (!options.std_out.open(diff_file)) {
-            return "Error creating temp file to store diff in";
-        }
-        CZ_DEFER(options.std_out.close());
+    cz::String text = {};
+    CZ_DEFER(text.drop(cz::heap_allocator()));
+    if (!read_file_for_reload(path.buffer, &text)) {
+        return "Error reading file";
+    }
 
-        if (!options.std_err.open(stderr_file)) {
-            return "Error creating temp file to store diff stderr in";
-        }
-        CZ_DEFER(options.std_err.close());
+    return reload_from_text(buffer, text);
+}
+
+namespace diff_ {
+struct Reload_File_Job_Data {
+    cz::Arc_Weak<Buffer_Handle> handle;
+    cz::String path;
+    cz::File_Time file_time;
 
-        cz::String buffer_path = {};
-        CZ_DEFER(buffer_path.drop(cz::heap_allocator()));
-        buffer->get_path(cz::heap_allocator(), &buffer_path);
+    void drop() {
+        handle.drop();
+        path.drop(cz::heap_allocator());
+    }
+};
+
+struct Commit_Reload_Job_Data {
+    cz::Arc_Weak<Buffer_Handle> handle;
+    /// The new contents of the file.  The hunks point into it.
+    cz::String text;
+    cz::Vector<Line_Diff_Hunk> hunks;
+    /// `Buffer::changes.len` when the buffer was diffed.
+    size_t changes_len;
+    cz::File_Time file_time;
+
+    void drop() {
+        handle.drop();
+        text.drop(cz::heap_allocator());
+        hunks.drop(cz::heap_allocator());
+    }
+};
+}
+using namespace diff_;
+
+static void commit_reload_job_kill(void* _data) {
+    Commit_Reload_Job_Data* data = (Commit_Reload_Job_Data*)_data;
+    data->drop();
+    cz::heap_allocator().dealloc(data);
+}
+
+static Job_Tick_Result commit_reload_job_tick(Editor*, Client* client, void* _data) {
+    ZoneScoped;
+
+    Commit_Reload_Job_Data* data = (Commit_Reload_Job_Data*)_data;
+    CZ_DEFER(commit_reload_job_kill(data));
+
+    cz::Arc<Buffer_Handle> handle;
+    if (!data->handle.upgrade(&handle)) {
+        return Job_Tick_Result::FINISHED;
+    }
+    CZ_DEFER(handle.drop());
+
+    Buffer* buffer = handle->lock_writing();
+    CZ_DEFER(handle->unlock());
 
-        cz::Str args[] = {"diff", "-" /* stdin */, buffer_path};
+    // Don't throw away edits made since the buffer was diffed.
+    if (buffer->changes.len != data->changes_len || !buffer->is_unchanged()) {
+        return Job_Tick_Result::FINISHED;
+    }
 
-        cz::Process process;
-        if (!process.launch_program(args, options)) {
-            return "Error launching diff";
+    const char* message = nullptr;
+    if (buffer->type == Buffer::DIRECTORY) {
+        message = reload_file(buffer);
+    } else if (data->hunks.len > 0) {
+        bool old_read_only = buffer->read_only;
+        buffer->read_only = false;
+        CZ_DEFER(buffer->read_only = old_read_only);
+
+        message = apply_line_diff(buffer, data->hunks);
+        if (!message) {
+            buffer->mark_saved();
         }
-        process.join();
     }
 
-    cz::String std_err = {};
-    CZ_DEFER(std_err.drop(cz::heap_allocator()));
-    if (!cz::read_to_string(stderr_file, cz::heap_allocator(), &std_err)) {
-        return "Error opening stderr file";
+    if (message) {
+        client->show_message(message);
+        return Job_Tick_Result::FINISHED;
     }
-    if (std_err.len != 0) {
-        return "Error: diff stderr was nonempty";  // TODO propagate stderr
+
+    // Use the time from before the file was read so a write
+    // that happened while diffing causes another reload.
+    buffer->has_file_time = true;
+    buffer->file_time = data->file_time;
+    return Job_Tick_Result::FINISHED;
+}
+
+/// Diff the file against the buffer.  Returns `false` if the buffer shouldn't be reloaded.
+static bool prepare_reload(Asynchronous_Job_Handler* handler,
+                           cz::Arc<Buffer_Handle> handle,
+                           const char* path,
+                           Commit_Reload_Job_Data* commit) {
+    // Diff while only reading so the buffer can still be rendered.
+    const Buffer* buffer = handle->lock_reading();
+    CZ_DEFER(handle->unlock());
+
+    // Don't throw away unsaved edits.
+    if (!buffer->is_unchanged()) {
+        return false;
     }
 
-    cz::Input_File file;
-    if (!file.open(diff_file)) {
-        return "Error opening diff file";
+    commit->changes_len = buffer->changes.len;
+
+    // Directories are listed on the main thread.
+    if (buffer->type == Buffer::DIRECTORY) {
+        return true;
     }
-    CZ_DEFER(file.close());
 
-    const char* error = apply_diff_file(buffer, file);
-    if (!error) {
-        buffer->mark_saved();
+    if (!read_file_for_reload(path, &commit->text)) {
+        handler->show_message("Error reading file");
+        return false;
     }
-    return error;
+
+    diff_lines(buffer->contents, commit->text, &commit->hunks);
+    return true;
+}
+
+static Job_Tick_Result reload_file_job_tick(Asynchronous_Job_Handler* handler, void* _data) {
+    ZoneScoped;
+
+    Reload_File_Job_Data* data = (Reload_File_Job_Data*)_data;
+    CZ_DEFER({
+        data->drop();
+        cz::heap_allocator().dealloc(data);
+    });
+
+    cz::File_Time file_time;
+    if (!cz::get_file_time(data->path.buffer, &file_time) ||
+        !cz::is_file_time_before(data->file_time, file_time)) {
+        return Job_Tick_Result::FINISHED;
+    }
+
+    cz::Arc<Buffer_Handle> handle;
+    if (!data->handle.upgrade(&handle)) {
+        return Job_Tick_Result::FINISHED;
+    }
+    CZ_DEFER(handle.drop());
+
+    Commit_Reload_Job_Data* commit = cz::heap_allocator().alloc<Commit_Reload_Job_Data>();
+    CZ_ASSERT(commit);
+    *commit = {};
+    commit->handle = handle.clone_downgrade();
+    commit->file_time = file_time;
+
+    if (!prepare_reload(handler, handle, data->path.buffer, commit)) {
+        commit_reload_job_kill(commit);
+        return Job_Tick_Result::FINISHED;
+    }
+
+    // Commit the edits on the main thread between frames.
+    Synchronous_Job job;
+    job.tick = commit_reload_job_tick;
+    job.kill = commit_reload_job_kill;
+    job.data = commit;
+    handler->add_synchronous_job(job);
+    return Job_Tick_Result::FINISHED;
+}
+
+static void reload_file_job_kill(void* _data) {
+    Reload_File_Job_Data* data = (Reload_File_Job_Data*)_data;
+    data->drop();
+    cz::heap_allocator().dealloc(data);
+}
+
+Asynchronous_Job job_reload_file(cz::Arc_Weak<Buffer_Handle> handle,
+                                 cz::Str path,
+                                 cz::File_Time file_time) {
+    Reload_File_Job_Data* data = cz::heap_allocator().alloc<Reload_File_Job_Data>();
+    CZ_ASSERT(data);
+    data->handle = handle;
+    data->path = path.clone_null_terminate(cz::heap_allocator());
+    data->file_time = file_time;
+
+    Asynchronous_Job job;
+    job.tick = reload_file_job_tick;
+    job.kill = reload_file_job_kill;
+    job.data = data;
+    job.buffer = job_buffer_key(handle);
+    return job;
 }
 
 }
@@ -1,21 +1,35 @@
 #pragma once
 
+#include <cz/arc.hpp>
+#include <cz/str.hpp>
+#include "core/job.hpp"
+
 namespace cz {
 struct Input_File;
+struct File_Time;
 }
 
 namespace mag {
 struct Client;
 struct Buffer;
+struct Buffer_Handle;
 
 /// Apply a diff file to the buffer.
 ///
 /// Returns an error message to show to the user or `nullptr` on success.
 const char* apply_diff_file(Buffer* buffer, cz::Input_File file);
 
-/// Reload the file if it has changed.
+/// Reload the file if it has changed.  Only the lines that changed are edited (see
+/// `diff_lines`) so cursors and marks in the rest of the file stay where they are.
 ///
 /// Returns an error message to show to the user or `nullptr` on success.
 const char* reload_file(Buffer* buffer);
 
+/// Reload the file at `path` into the buffer if it is newer than `file_time`.  The file is
+/// read and diffed on a job thread while the buffer is only locked for reading and the edits
+/// are committed by a `Synchronous_Job`.  Nothing happens if the buffer has unsaved changes.
+Asynchronous_Job job_reload_file(cz::Arc_Weak<Buffer_Handle> handle,
+                                 cz::Str path,
+                                 cz::File_Time file_time);
+
 }
@@ -13,9 +13,12 @@ namespace mag {
 void Editor::create() {
     copy_buffer.init();
     num_uncompleted_async_jobs = 0;
+    file_watcher.init();
 }
 
 void Editor::drop() {
+    file_watcher.drop();
+
     for (size_t i = 0; i < buffers.len; ++i) {
         buffers[i].drop();
     }
@@ -49,6 +52,7 @@ void Editor::add_synchronous_job(Synchronous_Job job) {
 void Editor::kill(Buffer_Handle* buffer) {
     for (size_t i = buffers.len; i-- > 0;) {
         if (buffers[i].get() == buffer) {
+            file_watcher.remove_buffer(buffer);
             buffers[i].drop();
             buffers.remove(i);
             break;
@@ -63,6 +67,7 @@ void Editor::create_buffer(cz::Arc<Buffer_Handle> buffer_handle) {
         WITH_BUFFER_HANDLE(buffer_handle);
         buffer->id = {buffer_counter++};
         custom::buffer_created_callback(this, buffer, buffer_handle);
+        file_watcher.add_buffer(buffer, buffer_handle);
     }
 
     buffers.reserve(cz::heap_allocator(), 1);
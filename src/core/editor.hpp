@@ -8,6 +8,7 @@
 #include <cz/option.hpp>
 #include <cz/vector.hpp>
 #include "core/buffer_handle.hpp"
+#include "core/file_watcher.hpp"
 #include "core/job.hpp"
 #include "core/key_map.hpp"
 #include "core/key_remap.hpp"
@@ -26,6 +27,9 @@ struct Editor {
 
     uint64_t buffer_counter;
 
+    /// Reloads buffers when their files are changed by other programs.
+    File_Watcher file_watcher;
+
     cz::Vector<Asynchronous_Job> pending_jobs;
     cz::Vector<Synchronous_Job> synchronous_jobs;
     std::atomic_size_t num_uncompleted_async_jobs;
@@ -26,6 +26,7 @@
 #include "core/movement.hpp"
 #include "core/program_info.hpp"
 #include "core/server.hpp"
+#include "core/token_cache_file.hpp"
 #include "core/tracy_format.hpp"
 #include "core/visible_region.hpp"
 #include "custom/config.hpp"
@@ -35,6 +36,7 @@
 #else
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -88,6 +90,132 @@ static bool errno_is_noent() {
 #endif
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Memory mapping
+////////////////////////////////////////////////////////////////////////////////
+
+bool map_file(cz::Input_File file, uint64_t min_size, cz::Slice<char>* mapping) {
+    ZoneScoped;
+
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file.handle, &size)) {
+        return false;
+    }
+    if ((uint64_t)size.QuadPart < min_size || size.QuadPart == 0 || size.QuadPart > SIZE_MAX) {
+        return false;
+    }
+
+    HANDLE mapping_handle = CreateFileMappingA(file.handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping_handle) {
+        return false;
+    }
+    // The view keeps the mapping alive.
+    void* data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping_handle);
+    if (!data) {
+        return false;
+    }
+    *mapping = {(char*)data, (size_t)size.QuadPart};
+#else
+    struct stat st;
+    if (fstat(file.handle, &st) < 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    if ((uint64_t)st.st_size < min_size || st.st_size == 0) {
+        return false;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, file.handle, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    *mapping = {(char*)data, (size_t)st.st_size};
+#endif
+
+    return true;
+}
+
+/// Memory map `file` if it is at least `custom::mmap_file_threshold` bytes.  Files with
+/// carriage returns on the first line aren't mapped since they will have to be copied anyway.
+static bool try_map_text_file(cz::Input_File file, cz::Slice<char>* mapping) {
+    ZoneScoped;
+
+    if (custom::mmap_file_threshold == 0) {
+        return false;
+    }
+
+    if (!map_file(file, custom::mmap_file_threshold, mapping)) {
+        return false;
+    }
+
+    cz::Str str = {mapping->elems, mapping->len};
+    const char* newline = str.find('\n');
+    if (newline && newline != str.buffer && newline[-1] == '\r') {
+        unmap_file(*mapping);
+        *mapping = {};
+        return false;
+    }
+
+    return true;
+}
+
+void unmap_file(cz::Slice<char> mapping) {
+#ifdef _WIN32
+    UnmapViewOfFile(mapping.elems);
+#else
+    munmap(mapping.elems, mapping.len);
+#endif
+}
+
+static bool get_file_size(const char* path, uint64_t* size) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+        return false;
+    }
+    *size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        return false;
+    }
+    *size = st.st_size;
+#endif
+    return true;
+}
+
+bool unmap_changed_file(Buffer* buffer) {
+    ZoneScoped;
+
+    if (buffer->contents.mapping.len == 0) {
+        return false;
+    }
+
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+    if (!buffer->get_path(cz::heap_allocator(), &path)) {
+        return false;
+    }
+
+    // If the file was deleted or replaced then the mapping still holds the old file.
+    uint64_t size;
+    cz::File_Time file_time;
+    if (!get_file_size(path.buffer, &size) || !cz::get_file_time(path.buffer, &file_time)) {
+        return false;
+    }
+    if (size == buffer->contents.mapping.len && buffer->has_file_time &&
+        !cz::is_file_time_before(buffer->file_time, file_time)) {
+        return false;
+    }
+
+    buffer->contents.unmap_changed(size);
+
+    // The highlighting was computed from bytes that have since changed without a `Change`.
+    buffer->token_cache.reset(buffer);
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Load text file
 ////////////////////////////////////////////////////////////////////////////////
@@ -137,6 +265,37 @@ static Job_Tick_Result load_text_file_chunk(Buffer* buffer,
     return Job_Tick_Result::MADE_PROGRESS;
 }
 
+/// Load a memory mapped file.  Chunks are referenced by `buffer->contents` directly.  If we find
+/// a carriage return then we fall back to copying (and stripping) the rest of the file.
+static Job_Tick_Result load_mapped_text_file_chunk(Buffer* buffer,
+                                                   uint64_t* offset,
+                                                   cz::Carriage_Return_Carry* carry,
+                                                   bool* copying) {
+    cz::Str mapped = {buffer->contents.mapping.elems, buffer->contents.mapping.len};
+    for (size_t remaining_iterations = 4096; remaining_iterations-- > 0;) {
+        if (*offset == mapped.len) {
+            return Job_Tick_Result::FINISHED;
+        }
+
+        size_t chunk_len = cz::min(mapped.len - *offset, (size_t)4096);
+        cz::Str chunk = mapped.slice(*offset, *offset + chunk_len);
+        *offset += chunk.len;
+
+        if (!*copying && !chunk.find('\r')) {
+            buffer->contents.append_mapped(chunk);
+            continue;
+        }
+
+        *copying = true;
+        char buf[4096];
+        size_t len = chunk.len;
+        memcpy(buf, chunk.buffer, len);
+        cz::strip_carriage_returns(buf, &len, carry);
+        buffer->contents.append({buf, len});
+    }
+    return Job_Tick_Result::MADE_PROGRESS;
+}
+
 static void reset_buffer_mode_job_kill(void* _data) {
     cz::Arc_Weak<Buffer_Handle>* data = (cz::Arc_Weak<Buffer_Handle>*)_data;
     data->drop();
@@ -149,6 +308,9 @@ static Job_Tick_Result reset_buffer_mode_job_tick(Editor* editor, Client* client
         CZ_DEFER(buffer_handle.drop());
         WITH_BUFFER_HANDLE(buffer_handle);
         basic::reset_mode(editor, buffer, buffer_handle);
+
+        // Now that the tokenizer is known, try to skip syntax highlighting.
+        editor->add_asynchronous_job(job_load_token_cache_file(buffer_handle.clone_downgrade()));
     }
     reset_buffer_mode_job_kill(_data);
     return Job_Tick_Result::FINISHED;
@@ -190,6 +352,12 @@ struct Load_Text_File_Job_Data {
     cz::Input_File file;
     cz::Carriage_Return_Carry carry;
     bool first_line;
+
+    /// If `buffer->contents.mapping` is set then we are loading from the mapping instead of `file`.
+    bool mapped;
+    bool mapped_copying;
+    uint64_t mapped_offset;
+
     cz::Vector<Key> unprocessed_keys;
     Synchronous_Job callback;
 };
@@ -211,8 +379,13 @@ static Job_Tick_Result load_text_file_job_tick(Asynchronous_Job_Handler* handler
     CZ_DEFER(buffer_handle.drop());
 
     WITH_BUFFER_HANDLE(buffer_handle);
-    Job_Tick_Result result =
-        load_text_file_chunk(buffer, data->file, &data->carry, &data->first_line);
+    Job_Tick_Result result;
+    if (data->mapped) {
+        result = load_mapped_text_file_chunk(buffer, &data->mapped_offset, &data->carry,
+                                             &data->mapped_copying);
+    } else {
+        result = load_text_file_chunk(buffer, data->file, &data->carry, &data->first_line);
+    }
     if (result == Job_Tick_Result::FINISHED) {
         data->buffer_handle.drop();
         data->file.close();
@@ -226,6 +399,7 @@ static Job_Tick_Result load_text_file_job_tick(Asynchronous_Job_Handler* handler
 static void start_loading_text_file(Editor* editor,
                                     cz::Arc<Buffer_Handle> buffer_handle,
                                     cz::Input_File file,
+                                    bool mapped,
                                     cz::Vector<Key> unprocessed_keys,
                                     Synchronous_Job callback) {
     Load_Text_File_Job_Data* data = cz::heap_allocator().alloc<Load_Text_File_Job_Data>();
@@ -233,6 +407,9 @@ static void start_loading_text_file(Editor* editor,
     data->file = file;
     data->carry = {};
     data->first_line = true;
+    data->mapped = mapped;
+    data->mapped_copying = false;
+    data->mapped_offset = 0;
     data->unprocessed_keys = unprocessed_keys;
     data->callback = callback;
 
@@ -240,6 +417,7 @@ static void start_loading_text_file(Editor* editor,
     job.tick = load_text_file_job_tick;
     job.kill = load_text_file_job_kill;
     job.data = data;
+    job.buffer = buffer_handle.get();
     editor->add_asynchronous_job(job);
 }
 
@@ -467,13 +645,27 @@ static Open_File_Result load_path_in_buffer(Editor* editor,
         file.close();
         file = {};
         process.detach();  // TODO show stderr / exit code
-        start_loading_text_file(editor, buffer_handle, std_out, unprocessed_keys, callback);
+        start_loading_text_file(editor, buffer_handle, std_out, /*mapped=*/false, unprocessed_keys,
+                                callback);
         std_out = {};  // Prevent destroying.
         return Open_File_Result::SUCCESS;
     }
 
+    // Large files are referenced directly from the page cache instead of being copied.  Files
+    // we can write are copied since they are much more likely to be rewritten in place.
+    cz::Slice<char> mapping;
+    if (buffer->read_only && try_map_text_file(file, &mapping)) {
+        buffer->contents.set_mapping(mapping);
+        file.close();
+        file = {};
+        start_loading_text_file(editor, buffer_handle, file, /*mapped=*/true, unprocessed_keys,
+                                callback);
+        return Open_File_Result::SUCCESS;
+    }
+
     (void)file.set_non_blocking();
-    start_loading_text_file(editor, buffer_handle, file, unprocessed_keys, callback);
+    start_loading_text_file(editor, buffer_handle, file, /*mapped=*/false, unprocessed_keys,
+                            callback);
     file = {};  // Prevent destroying.
     return Open_File_Result::SUCCESS;
 }
@@ -948,6 +1140,9 @@ bool save_buffer(Buffer* buffer) {
             return false;
     }
 
+    // Writing to the mapped file would truncate it out from under us.
+    buffer->contents.unmap();
+
     if (!save_buffer_to(buffer, path.buffer)) {
         return false;
     }
@@ -33,6 +33,19 @@ using Load_File_Result_::Open_File_Result;
 
 bool check_out_of_date_and_update_file_time(const char* path, cz::File_Time* file_time);
 
+/// Memory map all of `file` if it is a non-empty regular file of at least `min_size` bytes.
+/// The mapping stays valid after `file` is closed.  Release it with `unmap_file`.
+bool map_file(cz::Input_File file, uint64_t min_size, cz::Slice<char>* mapping);
+
+/// Release a memory mapping created by `map_file`, for example when loading a large
+/// file.  See `Contents::mapping`.
+void unmap_file(cz::Slice<char> mapping);
+
+/// If `buffer` is memory mapped and its file's size or modification time changed then
+/// copy it out of the mapping (see `Contents::unmap_changed`) and reset its token cache.
+/// Returns `true` if the buffer was unmapped.  The buffer should then be reloaded.
+bool unmap_changed_file(Buffer* buffer);
+
 bool reload_directory_buffer(Buffer* buffer);
 
 /// Open the given file in a `Buffer` and replace the current `Window`.
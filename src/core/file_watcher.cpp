@@ -0,0 +1,403 @@
+#include "file_watcher.hpp"
+
+#include <string.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <tracy/Tracy.hpp>
+#include "core/buffer.hpp"
+#include "core/diff.hpp"
+#include "core/editor.hpp"
+#include "core/file.hpp"
+#include "custom/config.hpp"
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace mag {
+
+#ifdef __linux__
+/// Files are replaced (`git checkout`, editors writing a temporary file and renaming it)
+/// as often as they are written in place so watch the directory instead of the file.
+static const uint32_t WATCH_MASK =
+    IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+#endif
+
+/// Get the directory a buffer is watched in and the name of its file in that
+/// directory.  Returns `false` if the buffer isn't backed by a file.
+static bool get_watch_location(const Buffer* buffer, cz::Str* directory, cz::Str* name) {
+    if (buffer->type == Buffer::TEMPORARY || !buffer->directory.as_str().ends_with('/')) {
+        return false;
+    }
+    *directory = buffer->directory;
+    if (buffer->type == Buffer::DIRECTORY) {
+        *name = {};
+    } else {
+        *name = buffer->name;
+    }
+    return true;
+}
+
+/// Find the index of the first directory whose path is not less than `path`.
+static size_t directory_lower_bound(const cz::Vector<File_Watcher::Watched_Directory>& directories,
+                                    cz::Str path) {
+    size_t start = 0;
+    size_t end = directories.len;
+    while (start < end) {
+        size_t mid = (start + end) / 2;
+        if (directories[mid].path.as_str() < path) {
+            start = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return start;
+}
+
+/// Find the index of the first file whose name is not less than `name`.
+static size_t file_lower_bound(const cz::Vector<File_Watcher::Watched_File>& files, cz::Str name) {
+    size_t start = 0;
+    size_t end = files.len;
+    while (start < end) {
+        size_t mid = (start + end) / 2;
+        if (files[mid].name.as_str() < name) {
+            start = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return start;
+}
+
+void File_Watcher::init() {
+    *this = {};
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+    inotify_fd = -1;
+#endif
+    polling = inotify_fd == -1;
+    last_poll = std::chrono::steady_clock::now();
+}
+
+static void drop_files(cz::Vector<File_Watcher::Watched_File>* files) {
+    for (size_t i = 0; i < files->len; ++i) {
+        (*files)[i].name.drop(cz::heap_allocator());
+        (*files)[i].handle.drop();
+    }
+    files->drop(cz::heap_allocator());
+}
+
+void File_Watcher::drop() {
+#ifdef __linux__
+    if (inotify_fd != -1) {
+        close(inotify_fd);
+    }
+#endif
+    for (size_t i = 0; i < directories.len; ++i) {
+        directories[i].path.drop(cz::heap_allocator());
+        drop_files(&directories[i].files);
+    }
+    directories.drop(cz::heap_allocator());
+}
+
+/// Try to start watching `directory`.  Falls back to polling if we're out of watches.
+static void watch_directory(File_Watcher* watcher, File_Watcher::Watched_Directory* directory) {
+    directory->descriptor = -1;
+    if (watcher->polling) {
+        return;
+    }
+
+#ifdef __linux__
+    directory->descriptor =
+        inotify_add_watch(watcher->inotify_fd, directory->path.buffer, WATCH_MASK);
+    if (directory->descriptor == -1 && (errno == ENOSPC || errno == ENOMEM)) {
+        watcher->polling = true;
+    }
+#endif
+}
+
+void File_Watcher::add_buffer(const Buffer* buffer, const cz::Arc<Buffer_Handle>& handle) {
+    ZoneScoped;
+
+    cz::Str directory, name;
+    if (!get_watch_location(buffer, &directory, &name)) {
+        return;
+    }
+
+    size_t d = directory_lower_bound(directories, directory);
+    if (d == directories.len || directories[d].path != directory) {
+        Watched_Directory watch = {};
+        watch.path = directory.clone_null_terminate(cz::heap_allocator());
+        watch_directory(this, &watch);
+        directories.reserve(cz::heap_allocator(), 1);
+        directories.insert(d, watch);
+    }
+
+    cz::Vector<Watched_File>* files = &directories[d].files;
+    Watched_File file = {};
+    file.name = name.clone(cz::heap_allocator());
+    file.key = handle.get();
+    file.handle = handle.clone_downgrade();
+    files->reserve(cz::heap_allocator(), 1);
+    files->insert(file_lower_bound(*files, name), file);
+}
+
+void File_Watcher::remove_buffer(const Buffer_Handle* handle) {
+    ZoneScoped;
+
+    // Only compares pointers so it is fine to look at every file.
+    for (size_t d = 0; d < directories.len; ++d) {
+        Watched_Directory* directory = &directories[d];
+        for (size_t i = 0; i < directory->files.len; ++i) {
+            Watched_File* file = &directory->files[i];
+            if (file->key != handle) {
+                continue;
+            }
+
+            file->name.drop(cz::heap_allocator());
+            file->handle.drop();
+            directory->files.remove(i);
+
+            // Stop watching directories that no longer have any open files.
+            if (directory->files.len == 0) {
+#ifdef __linux__
+                if (directory->descriptor != -1) {
+                    inotify_rm_watch(inotify_fd, directory->descriptor);
+                }
+#endif
+                directory->path.drop(cz::heap_allocator());
+                directory->files.drop(cz::heap_allocator());
+                directories.remove(d);
+            }
+            return;
+        }
+    }
+}
+
+void File_Watcher::rename_buffer(const Buffer* buffer, const cz::Arc<Buffer_Handle>& handle) {
+    remove_buffer(handle.get());
+    add_buffer(buffer, handle);
+}
+
+/// Mark every buffer of the file `name` in `directory` as changed.
+/// Returns `false` if no buffers have that file open.
+static bool mark_changed(File_Watcher::Watched_Directory* directory, cz::Str name) {
+    bool any = false;
+    for (size_t i = file_lower_bound(directory->files, name);
+         i < directory->files.len && directory->files[i].name == name; ++i) {
+        directory->files[i].changed = true;
+        any = true;
+    }
+    return any;
+}
+
+/// Mark every buffer in `directory` as changed.
+static void mark_all_changed(File_Watcher::Watched_Directory* directory) {
+    for (size_t i = 0; i < directory->files.len; ++i) {
+        directory->files[i].changed = true;
+    }
+}
+
+#ifdef __linux__
+/// Read all pending events.  Returns `true` if any open files changed.
+static bool read_events(File_Watcher* watcher) {
+    ZoneScoped;
+
+    bool any_changed = false;
+
+    alignas(struct inotify_event) char buffer[4096];
+    while (1) {
+        ssize_t len = read(watcher->inotify_fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            break;
+        }
+
+        for (char* ptr = buffer; ptr < buffer + len;) {
+            const struct inotify_event* event = (const struct inotify_event*)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                watcher->check_all = true;
+                any_changed = true;
+                continue;
+            }
+
+            size_t index = 0;
+            for (; index < watcher->directories.len; ++index) {
+                if (watcher->directories[index].descriptor == event->wd) {
+                    break;
+                }
+            }
+            if (index == watcher->directories.len) {
+                continue;
+            }
+
+            File_Watcher::Watched_Directory* directory = &watcher->directories[index];
+
+            // The directory was deleted.  Watch it again if it is recreated.
+            if (event->mask & IN_IGNORED) {
+                directory->descriptor = -1;
+                mark_all_changed(directory);
+                any_changed = true;
+                continue;
+            }
+
+            // Entries being added or removed change directory buffers.
+            if (event->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) {
+                any_changed |= mark_changed(directory, {});
+            }
+
+            if (event->len > 0) {
+                any_changed |= mark_changed(directory, {event->name, strlen(event->name)});
+            }
+        }
+    }
+
+    return any_changed;
+}
+#endif
+
+/// Try to watch directories that were deleted again.  Returns `true` if any
+/// were recreated in which case their files are marked as changed.
+static bool rewatch_directories(File_Watcher* watcher) {
+    ZoneScoped;
+
+    bool any_changed = false;
+    for (size_t d = 0; d < watcher->directories.len && !watcher->polling; ++d) {
+        File_Watcher::Watched_Directory* directory = &watcher->directories[d];
+        if (directory->descriptor != -1) {
+            continue;
+        }
+
+        watch_directory(watcher, directory);
+        if (directory->descriptor != -1) {
+            mark_all_changed(directory);
+            any_changed = true;
+        }
+    }
+    return any_changed;
+}
+
+/// Copy the buffers whose memory mapped files changed out of their mappings.  This is done as
+/// soon as the change is seen instead of once the burst of changes ends since the mapping
+/// no longer agrees with the line counts and token cache computed from it.
+static void unmap_changed_buffers(File_Watcher* watcher) {
+    ZoneScoped;
+
+    for (size_t d = 0; d < watcher->directories.len; ++d) {
+        File_Watcher::Watched_Directory* directory = &watcher->directories[d];
+        for (size_t i = 0; i < directory->files.len; ++i) {
+            File_Watcher::Watched_File* file = &directory->files[i];
+            if (!watcher->check_all && !file->changed) {
+                continue;
+            }
+
+            cz::Arc<Buffer_Handle> handle;
+            if (!file->handle.upgrade(&handle)) {
+                continue;
+            }
+            CZ_DEFER(handle.drop());
+
+            const Buffer* buffer = handle->lock_reading();
+            CZ_DEFER(handle->unlock());
+            if (buffer->contents.mapping.len > 0) {
+                unmap_changed_file(handle->increase_reading_to_writing());
+            }
+        }
+    }
+}
+
+/// Start reloading all buffers whose files changed.
+static void reload_changed_buffers(File_Watcher* watcher, Editor* editor) {
+    ZoneScoped;
+
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+
+    // Only the buffers whose files changed are locked.
+    for (size_t d = 0; d < watcher->directories.len; ++d) {
+        File_Watcher::Watched_Directory* directory = &watcher->directories[d];
+        for (size_t i = 0; i < directory->files.len; ++i) {
+            File_Watcher::Watched_File* file = &directory->files[i];
+            if (!watcher->check_all && !file->changed) {
+                continue;
+            }
+            file->changed = false;
+
+            cz::Arc<Buffer_Handle> handle;
+            if (!file->handle.upgrade(&handle)) {
+                continue;
+            }
+            CZ_DEFER(handle.drop());
+
+            const Buffer* buffer = handle->lock_reading();
+            CZ_DEFER(handle->unlock());
+
+            if (!buffer->has_file_time || !buffer->is_unchanged()) {
+                continue;
+            }
+
+            path.len = 0;
+            if (!buffer->get_path(cz::heap_allocator(), &path)) {
+                continue;
+            }
+
+            // The job checks the file time so events caused by saving the buffer are ignored.
+            editor->add_asynchronous_job(
+                job_reload_file(handle.clone_downgrade(), path, buffer->file_time));
+        }
+    }
+
+    watcher->check_all = false;
+    watcher->any_changed = false;
+}
+
+void File_Watcher::poll(Editor* editor) {
+    ZoneScoped;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::milliseconds poll_interval(custom::file_watcher_poll_interval);
+
+    bool changed = false;
+    if (now - last_poll >= poll_interval) {
+        last_poll = now;
+        if (polling) {
+            check_all = true;
+            unmap_changed_buffers(this);
+            reload_changed_buffers(this, editor);
+        } else {
+            changed |= rewatch_directories(this);
+        }
+    }
+
+#ifdef __linux__
+    if (inotify_fd != -1) {
+        changed |= read_events(this);
+    }
+#endif
+
+    if (changed) {
+        unmap_changed_buffers(this);
+        if (!any_changed) {
+            first_change = now;
+        }
+        last_change = now;
+        any_changed = true;
+    }
+
+    if (!any_changed) {
+        return;
+    }
+
+    // Wait for the burst of events to end but don't wait forever on files that never stop
+    // changing (like logs).
+    std::chrono::milliseconds delay(custom::file_watcher_delay);
+    if (now - last_change >= delay || now - first_change >= delay * 10) {
+        reload_changed_buffers(this, editor);
+    }
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <cz/arc.hpp>
+#include <cz/string.hpp>
+#include <cz/vector.hpp>
+
+namespace mag {
+struct Buffer;
+struct Buffer_Handle;
+struct Editor;
+
+/// Watches the files of every buffer and reloads buffers whose files are changed by
+/// other programs.  Reloads are ran as `Asynchronous_Job`s (see `job_reload_file`) so
+/// many buffers are reloaded in parallel and none are reloaded while rendering.
+///
+/// Buffers are registered by the `Editor` when they are created, renamed or killed so
+/// finding the buffers affected by an event doesn't look at any other buffers.
+///
+/// On Linux the directories containing the files are watched via inotify.  Events are
+/// coalesced until no file changes for `custom::file_watcher_delay` milliseconds.  If
+/// inotify can't be used the file times of all buffers are polled instead.  Memory mapped
+/// buffers are copied out of their mappings immediately (see `unmap_changed_file`).
+struct File_Watcher {
+    struct Watched_File {
+        /// Empty for directory buffers, which change when entries are added or removed.
+        cz::String name;
+        /// Used to find the file when the buffer is killed.  Never dereferenced.
+        const Buffer_Handle* key;
+        cz::Arc_Weak<Buffer_Handle> handle;
+        bool changed;
+    };
+
+    struct Watched_Directory {
+        /// `-1` if the directory isn't watched (ie it was deleted or `polling` is set).
+        int descriptor;
+        /// Terminated by a forward slash.
+        cz::String path;
+        /// Sorted by `name`.
+        cz::Vector<Watched_File> files;
+    };
+
+    int inotify_fd;
+    /// Set if inotify isn't available or ran out of watches.
+    bool polling;
+    /// Sorted by `path`.
+    cz::Vector<Watched_Directory> directories;
+
+    /// Check every buffer because events were lost or can't be received.
+    bool check_all;
+    bool any_changed;
+    std::chrono::steady_clock::time_point first_change;
+    std::chrono::steady_clock::time_point last_change;
+    /// The last time unwatched directories were retried (and files were polled if `polling`).
+    std::chrono::steady_clock::time_point last_poll;
+
+    void init();
+    void drop();
+
+    /// Start watching the file of `buffer`.  Does nothing if it isn't backed by a file.
+    void add_buffer(const Buffer* buffer, const cz::Arc<Buffer_Handle>& handle);
+    /// Stop watching the file of the buffer `handle`.
+    void remove_buffer(const Buffer_Handle* handle);
+    /// Watch the new path of a buffer after its name or directory changes.
+    void rename_buffer(const Buffer* buffer, const cz::Arc<Buffer_Handle>& handle);
+
+    /// Read pending events and reload buffers whose files have changed.  Call once per frame.
+    void poll(Editor* editor);
+};
+
+}
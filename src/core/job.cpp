@@ -60,6 +60,15 @@ Asynchronous_Job Asynchronous_Job::do_nothing() {
     return job;
 }
 
+const Buffer_Handle* job_buffer_key(cz::Arc_Weak<Buffer_Handle> handle) {
+    cz::Arc<Buffer_Handle> strong;
+    if (!handle.upgrade(&strong)) {
+        return nullptr;
+    }
+    CZ_DEFER(strong.drop());
+    return strong.get();
+}
+
 Synchronous_Job Synchronous_Job::do_nothing() {
     Synchronous_Job job;
     job.tick = [](Editor*, Client*, void*) { return Job_Tick_Result::FINISHED; };
@@ -174,6 +183,7 @@ Asynchronous_Job job_process_append(cz::Arc_Weak<Buffer_Handle> buffer_handle,
     job.tick = process_append_job_tick;
     job.kill = process_append_job_kill;
     job.data = data;
+    job.buffer = job_buffer_key(buffer_handle);
     return job;
 }
 
@@ -307,7 +317,7 @@ static Job_Tick_Result run_console_command_callback_job_tick(Editor* editor,
     return Job_Tick_Result::FINISHED;
 }
 
-static Synchronous_Job job_run_console_command_callback(cz::Arc_Weak<Buffer_Handle> buffer_handle) {
+Synchronous_Job job_run_console_command_callback(cz::Arc_Weak<Buffer_Handle> buffer_handle) {
     Run_Console_Command_Callback_Job_Data* data =
         cz::heap_allocator().alloc<Run_Console_Command_Callback_Job_Data>();
     CZ_ASSERT(data);
@@ -343,37 +353,53 @@ Run_Console_Command_Result run_console_command(Client* client,
         }
     }
 
+    cz::Arc<Buffer_Handle> handle;
+    bool created = setup_console_command_buffer(client, editor, working_directory.as_str(), script,
+                                                buffer_name, &handle);
+
+    if (handle_out) {
+        *handle_out = handle;
+    }
+
+    if (!run_console_command_in(client, editor, handle, working_directory.buffer, script)) {
+        return Run_Console_Command_Result::FAILED;
+    }
+
+    return created ? Run_Console_Command_Result::SUCCESS_NEW_BUFFER
+                   : Run_Console_Command_Result::SUCCESS_REUSE_BUFFER;
+}
+
+bool setup_console_command_buffer(Client* client,
+                                  Editor* editor,
+                                  cz::Str working_directory,
+                                  cz::Str script,
+                                  cz::Str buffer_name,
+                                  cz::Arc<Buffer_Handle>* handle,
+                                  void (*prepare)(const cz::Arc<Buffer_Handle>&)) {
     {
         WITH_CONST_SELECTED_BUFFER(client);
         push_jump(window, client, buffer);
     }
 
     bool created = false;
-    cz::Arc<Buffer_Handle> handle;
-    if (!find_temp_buffer(editor, client, buffer_name, working_directory.as_str(), &handle)) {
-        handle = editor->create_buffer(create_temp_buffer(buffer_name, working_directory.as_str()));
+    if (!find_temp_buffer(editor, client, buffer_name, working_directory, handle)) {
+        *handle = editor->create_buffer(create_temp_buffer(buffer_name, working_directory));
         created = true;
     }
 
-    if (handle_out) {
-        *handle_out = handle;
+    if (prepare) {
+        prepare(*handle);
     }
 
     {
-        WITH_BUFFER_HANDLE(handle);
+        WITH_BUFFER_HANDLE(*handle);
         buffer->contents.remove(0, buffer->contents.len);
         buffer->contents.append(script);
         buffer->contents.append("\n");
     }
 
-    client->select_window_for_buffer_or_replace_current(handle);
-
-    if (!run_console_command_in(client, editor, handle, working_directory.buffer, script)) {
-        return Run_Console_Command_Result::FAILED;
-    }
-
-    return created ? Run_Console_Command_Result::SUCCESS_NEW_BUFFER
-                   : Run_Console_Command_Result::SUCCESS_REUSE_BUFFER;
+    client->select_window_for_buffer_or_replace_current(*handle);
+    return created;
 }
 
 bool run_console_command_in(Client* client,
@@ -61,7 +61,8 @@ enum Job_Tick_Result {
     FINISHED,
     /// The job has made some progress.  It will be re-scheduled to do more work.
     MADE_PROGRESS,
-    /// The job has not made progress.  If all jobs are stalled the job thread will sleep.
+    /// The job has not made progress.  It won't be ran again until another job finishes or makes
+    /// progress, a job is added, or the main thread releases its state.
     STALLED,
 };
 }
@@ -76,6 +77,16 @@ using Job_Tick_Result_::Job_Tick_Result;
 ///
 /// It is not thread safe to use the `Editor`, `Client`, or any `Window`s.
 ///
+/// Jobs are ran on a pool of threads so different jobs may tick at the same time.  If a job
+/// works on a specific buffer then set `buffer` so that it is never ran at the same time as
+/// other jobs working on the same buffer (see `job_buffer_key`).  The built in jobs are:
+/// * Jobs that edit a buffer (loading files, reloading, process output, formatting with
+///   clang-format or jq, blame, syntax highlighting, and the token cache file) set `buffer`.
+/// * The search, find file, trigram index, and completion jobs share state between each
+///   other and intentionally run in parallel.  They protect that state with a `cz::Mutex`.
+/// * Jobs that only wait on a process and show a message don't share any state.
+/// New jobs that share state with another job must either set `buffer` or lock the state.
+///
 /// To spawn an `Asynchronous_Job` use `Editor::add_asynchronous_job`.
 /// See `job_process_append` for example code.
 struct Asynchronous_Job {
@@ -91,6 +102,9 @@ struct Asynchronous_Job {
 
     void* data;
 
+    /// If set, ticks of jobs with the same `buffer` are never ran in parallel.
+    const Buffer_Handle* buffer = nullptr;
+
     static Asynchronous_Job do_nothing();
 };
 
@@ -114,6 +128,23 @@ struct Synchronous_Job {
     static Synchronous_Job do_nothing();
 };
 
+/// Get the `Asynchronous_Job::buffer` key for a job that works on `handle`.
+const Buffer_Handle* job_buffer_key(cz::Arc_Weak<Buffer_Handle> handle);
+
+/// The default number of threads for background work such as the job threads.
+/// Leaves a core for the main thread but is always at least one.
+size_t count_background_threads();
+
+/// Run `run(data, index)` for every `index` in `[0, count)` and return once they have all
+/// finished.  The job threads are asked to help but the calling thread also runs iterations,
+/// so this never waits on a busy job pool.  Iterations run in parallel and in any order.
+///
+/// This can be called from the main thread or from inside an `Asynchronous_Job`.
+void parallel_for(size_t count, void (*run)(void* data, size_t index), void* data);
+
+/// The number of threads `parallel_for` runs iterations on, including the calling thread.
+size_t count_parallel_for_threads();
+
 Asynchronous_Job job_process_append(cz::Arc_Weak<Buffer_Handle> buffer_handle,
                                     cz::Process process,
                                     cz::Input_File output,
@@ -128,6 +159,9 @@ Asynchronous_Job job_process_show_message_with_file_contents(cz::Process process
                                                              cz::Input_File file,
                                                              cz::Str message_prefix);
 
+/// A job that runs `custom::console_command_finished_callback` on the buffer if it still exists.
+Synchronous_Job job_run_console_command_callback(cz::Arc_Weak<Buffer_Handle> buffer_handle);
+
 namespace Run_Console_Command_Result_ {
 enum Run_Console_Command_Result {
     FAILED,
@@ -152,6 +186,17 @@ Run_Console_Command_Result run_console_command(Client* client,
                                                cz::Str buffer_name,
                                                cz::Arc<Buffer_Handle>* handle_out = nullptr);
 
+/// Set up the buffer `run_console_command` shows the output of `script` in.  Finds or creates
+/// the buffer, pushes a jump, replaces its contents with `script`, and selects it.  `prepare`
+/// is called before the contents are replaced.  Returns `true` if the buffer was created.
+bool setup_console_command_buffer(Client* client,
+                                  Editor* editor,
+                                  cz::Str working_directory,
+                                  cz::Str script,
+                                  cz::Str buffer_name,
+                                  cz::Arc<Buffer_Handle>* handle,
+                                  void (*prepare)(const cz::Arc<Buffer_Handle>&) = nullptr);
+
 bool run_console_command_in(Client* client,
                             Editor* editor,
                             cz::Arc<Buffer_Handle> buffer_id,
@@ -0,0 +1,460 @@
+#include "line_diff.hpp"
+
+#include <string.h>
+#include <cz/buffer_array.hpp>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/string.hpp>
+#include <cz/util.hpp>
+#include <tracy/Tracy.hpp>
+#include "core/contents.hpp"
+
+namespace mag {
+
+/// Lines that occur more often than this in a range aren't used to split it.  This is the
+/// same limit git uses.  It bounds the work done per line in files with many repeated lines.
+static const uint32_t MAX_OCCURRENCES = 64;
+
+/// Ranges without a line to split on are diffed with Myers' algorithm if they differ by at most
+/// this many lines.  Its time is proportional to the size of the range times the number of lines
+/// that differ and its memory to the square of the number of lines that differ.
+static const size_t MAX_MYERS_COST = 1024;
+
+/// Split `contents` into lines (including their trailing newline).
+/// Lines that span buckets are copied into `buffer_array`.
+static void split_contents_lines(const Contents& contents,
+                                 cz::Buffer_Array* buffer_array,
+                                 cz::Vector<cz::Str>* lines) {
+    ZoneScoped;
+
+    cz::String partial = {};
+    CZ_DEFER(partial.drop(cz::heap_allocator()));
+
+    lines->reserve(cz::heap_allocator(), contents.get_line_number(contents.len) + 1);
+
+    for (size_t bucket = 0; bucket < contents.buckets.len; ++bucket) {
+        cz::Str rest = {contents.buckets[bucket].elems, contents.buckets[bucket].len};
+        while (rest.len > 0) {
+            const char* newline = rest.find('\n');
+            if (!newline) {
+                partial.reserve(cz::heap_allocator(), rest.len);
+                partial.append(rest);
+                break;
+            }
+
+            cz::Str line = rest.slice_end(newline + 1);
+            rest = rest.slice_start(newline + 1);
+
+            if (partial.len > 0) {
+                partial.reserve(cz::heap_allocator(), line.len);
+                partial.append(line);
+                line = partial.clone(buffer_array->allocator());
+                partial.len = 0;
+            }
+
+            lines->reserve(cz::heap_allocator(), 1);
+            lines->push(line);
+        }
+    }
+
+    if (partial.len > 0) {
+        lines->reserve(cz::heap_allocator(), 1);
+        lines->push(partial.clone(buffer_array->allocator()));
+    }
+}
+
+static void split_lines(cz::Str text, cz::Vector<cz::Str>* lines) {
+    ZoneScoped;
+
+    while (text.len > 0) {
+        const char* newline = text.find('\n');
+        const char* end = newline ? newline + 1 : text.end();
+        lines->reserve(cz::heap_allocator(), 1);
+        lines->push(text.slice_end(end));
+        text = text.slice_start(end);
+    }
+}
+
+static uint64_t hash_line(cz::Str line) {
+    uint64_t hash = 0x9e3779b97f4a7c15 ^ line.len;
+    size_t i = 0;
+    for (; i + 8 <= line.len; i += 8) {
+        uint64_t word;
+        memcpy(&word, line.buffer + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccd;
+        hash ^= hash >> 32;
+    }
+    uint64_t word = 0;
+    memcpy(&word, line.buffer + i, line.len - i);
+    hash = (hash ^ word) * 0xc4ceb9fe1a85ec53;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+namespace line_diff_ {
+/// Maps each distinct line to a small id so lines can be compared by comparing ids.
+struct Line_Interner {
+    struct Slot {
+        /// The upper half of the hash.  The lower half picks the slot.
+        uint32_t hash;
+        /// The id plus one so `0` means the slot is empty.
+        uint32_t id_plus_one;
+    };
+
+    cz::Vector<Slot> slots;
+    cz::Vector<cz::Str> distinct_lines;
+
+    void init(size_t max_lines) {
+        size_t capacity = 16;
+        while (capacity < max_lines * 2) {
+            capacity *= 2;
+        }
+        slots.reserve_exact(cz::heap_allocator(), capacity);
+        slots.len = capacity;
+        memset(slots.elems, 0, capacity * sizeof(Slot));
+    }
+
+    void drop() {
+        slots.drop(cz::heap_allocator());
+        distinct_lines.drop(cz::heap_allocator());
+    }
+
+    uint32_t intern(cz::Str line) {
+        uint64_t full_hash = hash_line(line);
+        uint32_t hash = (uint32_t)(full_hash >> 32);
+        size_t mask = slots.len - 1;
+        for (size_t index = full_hash & mask;; index = (index + 1) & mask) {
+            Slot& slot = slots[index];
+            if (slot.id_plus_one == 0) {
+                slot.hash = hash;
+                slot.id_plus_one = (uint32_t)distinct_lines.len + 1;
+                distinct_lines.reserve(cz::heap_allocator(), 1);
+                distinct_lines.push(line);
+                return slot.id_plus_one - 1;
+            }
+            if (slot.hash == hash && distinct_lines[slot.id_plus_one - 1] == line) {
+                return slot.id_plus_one - 1;
+            }
+        }
+    }
+};
+
+struct Range {
+    size_t a_start, a_end;
+    size_t b_start, b_end;
+};
+}
+using namespace line_diff_;
+
+/// Append the hunk replacing the lines `a[a_start, a_end)` with `b[b_start, b_end)`.
+static void push_hunk(cz::Slice<const uint64_t> a_starts,
+                      cz::Slice<const uint64_t> b_starts,
+                      cz::Str after,
+                      const Range& lines,
+                      cz::Vector<Line_Diff_Hunk>* hunks) {
+    Line_Diff_Hunk hunk;
+    hunk.position = a_starts[lines.a_start];
+    hunk.remove_len = a_starts[lines.a_end] - a_starts[lines.a_start];
+    hunk.insert = after.slice(b_starts[lines.b_start], b_starts[lines.b_end]);
+    hunks->reserve(cz::heap_allocator(), 1);
+    hunks->push(hunk);
+}
+
+/// Diff `range` with Myers' algorithm and append the hunks.  Used when the range has no line
+/// to split on because every line in common occurs too often.  Returns `false` without
+/// appending anything if more than `MAX_MYERS_COST` lines differ.
+static bool myers_diff(cz::Slice<const uint32_t> a,
+                       cz::Slice<const uint32_t> b,
+                       cz::Slice<const uint64_t> a_starts,
+                       cz::Slice<const uint64_t> b_starts,
+                       cz::Str after,
+                       const Range& range,
+                       cz::Vector<Line_Diff_Hunk>* hunks) {
+    ZoneScoped;
+
+    const int64_t n = range.a_end - range.a_start;
+    const int64_t m = range.b_end - range.b_start;
+    const uint32_t* a_lines = a.elems + range.a_start;
+    const uint32_t* b_lines = b.elems + range.b_start;
+
+    // The furthest x reached on each diagonal `k = x - y` after `d` differences is stored
+    // at `trace[d * d + d + k]` so the path can be recovered once the end is reached.
+    cz::Vector<int64_t> trace = {};
+    CZ_DEFER(trace.drop(cz::heap_allocator()));
+
+    int64_t max_d = cz::min((int64_t)MAX_MYERS_COST, n + m);
+    int64_t d = 0;
+    for (;; ++d) {
+        if (d > max_d) {
+            return false;
+        }
+
+        trace.reserve(cz::heap_allocator(), 2 * d + 1);
+        int64_t* v = trace.elems + d * d;
+        const int64_t* previous = trace.elems + (d - 1) * (d - 1);
+        trace.len += 2 * d + 1;
+
+        bool found = false;
+        for (int64_t k = -d; k <= d; k += 2) {
+            int64_t x;
+            if (d == 0) {
+                x = 0;
+            } else if (k == -d || (k != d && previous[d - 1 + k - 1] < previous[d - 1 + k + 1])) {
+                x = previous[d - 1 + k + 1];
+            } else {
+                x = previous[d - 1 + k - 1] + 1;
+            }
+            int64_t y = x - k;
+            while (x < n && y < m && a_lines[x] == b_lines[y]) {
+                ++x;
+                ++y;
+            }
+            v[d + k] = x;
+            if (x >= n && y >= m) {
+                found = true;
+                break;
+            }
+        }
+        if (found) {
+            break;
+        }
+    }
+
+    // Walk back from the end recording each line removed or inserted, last first.
+    struct Step {
+        int64_t x, y;
+        bool insert;
+    };
+    cz::Vector<Step> steps = {};
+    CZ_DEFER(steps.drop(cz::heap_allocator()));
+    steps.reserve_exact(cz::heap_allocator(), d);
+
+    int64_t x = n;
+    int64_t y = m;
+    for (; d > 0; --d) {
+        const int64_t* previous = trace.elems + (d - 1) * (d - 1);
+        int64_t k = x - y;
+        bool insert = (k == -d || (k != d && previous[d - 1 + k - 1] < previous[d - 1 + k + 1]));
+        int64_t previous_k = insert ? k + 1 : k - 1;
+        int64_t previous_x = previous[d - 1 + previous_k];
+        int64_t previous_y = previous_x - previous_k;
+        steps.push({previous_x, previous_y, insert});
+        x = previous_x;
+        y = previous_y;
+    }
+
+    // Merge adjacent steps into hunks.
+    Range hunk = {};
+    bool has_hunk = false;
+    for (size_t i = steps.len; i-- > 0;) {
+        size_t step_a = range.a_start + steps[i].x;
+        size_t step_b = range.b_start + steps[i].y;
+        if (has_hunk && (hunk.a_end != step_a || hunk.b_end != step_b)) {
+            push_hunk(a_starts, b_starts, after, hunk, hunks);
+            has_hunk = false;
+        }
+        if (!has_hunk) {
+            hunk = {step_a, step_a, step_b, step_b};
+            has_hunk = true;
+        }
+        if (steps[i].insert) {
+            ++hunk.b_end;
+        } else {
+            ++hunk.a_end;
+        }
+    }
+    if (has_hunk) {
+        push_hunk(a_starts, b_starts, after, hunk, hunks);
+    }
+    return true;
+}
+
+void diff_lines(const Contents& before, cz::Str after, cz::Vector<Line_Diff_Hunk>* hunks) {
+    ZoneScoped;
+
+    cz::Buffer_Array buffer_array;
+    buffer_array.init();
+    CZ_DEFER(buffer_array.drop());
+
+    cz::Vector<cz::Str> a_lines = {};
+    cz::Vector<cz::Str> b_lines = {};
+    CZ_DEFER(a_lines.drop(cz::heap_allocator()));
+    CZ_DEFER(b_lines.drop(cz::heap_allocator()));
+    split_contents_lines(before, &buffer_array, &a_lines);
+    split_lines(after, &b_lines);
+
+    // Lines at the start and end that didn't change are skipped before hashing
+    // since usually only a few lines change.  Ids are only set in the middle.
+    size_t prefix = 0;
+    while (prefix < a_lines.len && prefix < b_lines.len && a_lines[prefix] == b_lines[prefix]) {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < a_lines.len - prefix && suffix < b_lines.len - prefix &&
+           a_lines[a_lines.len - suffix - 1] == b_lines[b_lines.len - suffix - 1]) {
+        ++suffix;
+    }
+
+    // Convert the lines to ids and record where each line starts.
+    Line_Interner interner = {};
+    interner.init(a_lines.len + b_lines.len - 2 * (prefix + suffix));
+    CZ_DEFER(interner.drop());
+
+    cz::Vector<uint32_t> a = {};
+    cz::Vector<uint32_t> b = {};
+    cz::Vector<uint64_t> a_starts = {};
+    cz::Vector<uint64_t> b_starts = {};
+    CZ_DEFER(a.drop(cz::heap_allocator()));
+    CZ_DEFER(b.drop(cz::heap_allocator()));
+    CZ_DEFER(a_starts.drop(cz::heap_allocator()));
+    CZ_DEFER(b_starts.drop(cz::heap_allocator()));
+    a.reserve_exact(cz::heap_allocator(), a_lines.len);
+    b.reserve_exact(cz::heap_allocator(), b_lines.len);
+    a.len = a_lines.len;
+    b.len = b_lines.len;
+    a_starts.reserve_exact(cz::heap_allocator(), a_lines.len + 1);
+    b_starts.reserve_exact(cz::heap_allocator(), b_lines.len + 1);
+
+    {
+        ZoneScopedN("intern lines");
+        uint64_t position = 0;
+        for (size_t i = 0; i < a_lines.len; ++i) {
+            if (i >= prefix && i < a_lines.len - suffix) {
+                a[i] = interner.intern(a_lines[i]);
+            }
+            a_starts.push(position);
+            position += a_lines[i].len;
+        }
+        a_starts.push(position);
+
+        position = 0;
+        for (size_t i = 0; i < b_lines.len; ++i) {
+            if (i >= prefix && i < b_lines.len - suffix) {
+                b[i] = interner.intern(b_lines[i]);
+            }
+            b_starts.push(position);
+            position += b_lines[i].len;
+        }
+        b_starts.push(position);
+    }
+
+    // Per line id: the number of times it occurs in the current range
+    // of `a` and the index of its last occurrence in the range.
+    cz::Vector<uint32_t> counts = {};
+    cz::Vector<size_t> last_occurrence = {};
+    // The index of the previous occurrence of the same line in the range or `SIZE_MAX`.
+    cz::Vector<size_t> previous_occurrence = {};
+    CZ_DEFER(counts.drop(cz::heap_allocator()));
+    CZ_DEFER(last_occurrence.drop(cz::heap_allocator()));
+    CZ_DEFER(previous_occurrence.drop(cz::heap_allocator()));
+    counts.reserve_exact(cz::heap_allocator(), interner.distinct_lines.len);
+    counts.len = interner.distinct_lines.len;
+    memset(counts.elems, 0, counts.len * sizeof(uint32_t));
+    last_occurrence.reserve_exact(cz::heap_allocator(), interner.distinct_lines.len);
+    last_occurrence.len = interner.distinct_lines.len;
+    previous_occurrence.reserve_exact(cz::heap_allocator(), a.len);
+    previous_occurrence.len = a.len;
+
+    // Ranges are processed depth first, left before right, so hunks are found in order.
+    cz::Vector<Range> stack = {};
+    CZ_DEFER(stack.drop(cz::heap_allocator()));
+    stack.reserve(cz::heap_allocator(), 1);
+    stack.push({prefix, a.len - suffix, prefix, b.len - suffix});
+
+    while (stack.len > 0) {
+        Range range = stack.pop();
+
+        // Skip common lines at the start and end.
+        while (range.a_start < range.a_end && range.b_start < range.b_end &&
+               a[range.a_start] == b[range.b_start]) {
+            ++range.a_start;
+            ++range.b_start;
+        }
+        while (range.a_start < range.a_end && range.b_start < range.b_end &&
+               a[range.a_end - 1] == b[range.b_end - 1]) {
+            --range.a_end;
+            --range.b_end;
+        }
+
+        if (range.a_start == range.a_end && range.b_start == range.b_end) {
+            continue;
+        }
+
+        // Find the longest common run of lines that occur the fewest times in `a`.
+        size_t best_a_start = 0, best_a_end = 0, best_b_start = 0, best_b_end = 0;
+        uint32_t best_count = MAX_OCCURRENCES;
+
+        if (range.a_start < range.a_end && range.b_start < range.b_end) {
+            for (size_t i = range.a_start; i < range.a_end; ++i) {
+                uint32_t id = a[i];
+                previous_occurrence[i] = counts[id] == 0 ? SIZE_MAX : last_occurrence[id];
+                last_occurrence[id] = i;
+                ++counts[id];
+            }
+
+            for (size_t bi = range.b_start; bi < range.b_end;) {
+                size_t b_next = bi + 1;
+                uint32_t count = counts[b[bi]];
+                if (count == 0 || count > best_count) {
+                    bi = b_next;
+                    continue;
+                }
+
+                for (size_t ai = last_occurrence[b[bi]]; ai != SIZE_MAX;
+                     ai = previous_occurrence[ai]) {
+                    size_t a_start = ai, b_start = bi;
+                    size_t a_end = ai + 1, b_end = bi + 1;
+                    uint32_t region_count = count;
+                    while (a_start > range.a_start && b_start > range.b_start &&
+                           a[a_start - 1] == b[b_start - 1]) {
+                        --a_start;
+                        --b_start;
+                        region_count = cz::min(region_count, counts[a[a_start]]);
+                    }
+                    while (a_end < range.a_end && b_end < range.b_end && a[a_end] == b[b_end]) {
+                        region_count = cz::min(region_count, counts[a[a_end]]);
+                        ++a_end;
+                        ++b_end;
+                    }
+
+                    if (b_next < b_end) {
+                        b_next = b_end;
+                    }
+                    if (a_end - a_start > best_a_end - best_a_start ||
+                        region_count < best_count) {
+                        best_a_start = a_start;
+                        best_a_end = a_end;
+                        best_b_start = b_start;
+                        best_b_end = b_end;
+                        best_count = region_count;
+                    }
+                }
+
+                bi = b_next;
+            }
+
+            for (size_t i = range.a_start; i < range.a_end; ++i) {
+                counts[a[i]] = 0;
+            }
+        }
+
+        if (best_a_start == best_a_end) {
+            // The lines in common are all too common to split on.  Diff them directly.
+            if (range.a_start < range.a_end && range.b_start < range.b_end &&
+                myers_diff(a, b, a_starts, b_starts, after, range, hunks)) {
+                continue;
+            }
+
+            // There are no lines in common (or diffing is too expensive)
+            // so replace the whole range.
+            push_hunk(a_starts, b_starts, after, range, hunks);
+            continue;
+        }
+
+        stack.reserve(cz::heap_allocator(), 2);
+        stack.push({best_a_end, range.a_end, best_b_end, range.b_end});
+        stack.push({range.a_start, best_a_start, range.b_start, best_b_start});
+    }
+}
+
+}
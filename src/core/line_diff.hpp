@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <cz/str.hpp>
+#include <cz/vector.hpp>
+
+namespace mag {
+struct Contents;
+
+/// A run of lines that differ between two versions of a file.
+struct Line_Diff_Hunk {
+    /// The position in the old contents of the first removed line or where the lines are inserted.
+    uint64_t position;
+    /// The number of bytes of the old contents that are removed.
+    uint64_t remove_len;
+    /// The lines that replace them.  Points into the new text.
+    cz::Str insert;
+};
+
+/// Find the lines that differ between `before` and `after` with a histogram diff (the algorithm
+/// `git diff --histogram` uses).  `before` is read in place; lines are only copied if they span
+/// buckets.  The hunks are appended to `hunks` sorted by position and never overlap.
+void diff_lines(const Contents& before, cz::Str after, cz::Vector<Line_Diff_Hunk>* hunks);
+
+}
@@ -1,6 +1,7 @@
 #include "match.hpp"
 
 #include <tracy/Tracy.hpp>
+#include "core/byte_search.hpp"
 #include "core/contents.hpp"
 #include "core/movement.hpp"
 
@@ -43,7 +44,8 @@ static void resolve_smart_case(Contents_Iterator query,
 }
 
 static bool cased_char_match(char test, char query, Case_Handling case_handling) {
-    if (case_handling == Case_Handling::UPPERCASE_STICKY && cz::is_upper(query)) {
+    if (case_handling == Case_Handling::CASE_SENSITIVE ||
+        (case_handling == Case_Handling::UPPERCASE_STICKY && cz::is_upper(query))) {
         return test == query;
     }
 
@@ -201,37 +203,53 @@ bool find(Contents_Iterator* it, char ch) {
     }
 }
 
-bool rfind(Contents_Iterator* it, char ch) {
-    ZoneScoped;
+/// Find either `a` or `b` at or after the point `it` in the current bucket.
+/// On failure puts `it` at the start of the next bucket.
+static bool find_bucket_either(Contents_Iterator* it, char a, char b) {
+    if (it->bucket >= it->contents->buckets.len)
+        return false;
 
-    if (it->bucket == it->contents->buckets.len) {
-        if (it->bucket == 0) {
-            return false;
-        }
+    cz::Slice<char> bucket = it->contents->buckets[it->bucket];
+    const char* start = bucket.elems + it->index;
+    size_t len = bucket.len - it->index;
+    const char* ptr = find_either(start, len, a, b);
+    if (ptr) {
+        it->advance(ptr - start);
+        return true;
+    } else {
+        it->advance(len);
+        return false;
+    }
+}
 
-        --it->bucket;
-        it->index = it->contents->buckets[it->bucket].len;
+/// Find either `a` or `b` before the point `it` in the current bucket.
+/// If `it` is at the start of a bucket then searches in the previous bucket.
+/// On failure puts `it` at the start of the bucket.
+static bool rfind_bucket_either(Contents_Iterator* it, char a, char b) {
+    if (it->at_bob())
+        return false;
+    it->retreat();
+
+    cz::Slice<char> bucket = it->contents->buckets[it->bucket];
+    const char* ptr = rfind_either(bucket.elems, it->index + 1, a, b);
+    if (ptr) {
+        it->retreat(bucket.elems + it->index - ptr);
+        return true;
+    } else {
+        it->retreat(it->index);
+        return false;
     }
+}
 
-    while (1) {
-        auto bucket = it->contents->buckets[it->bucket];
-        cz::Str str = cz::Str{bucket.elems, bucket.len}.slice_end(it->index);
-        const char* ptr = str.rfind(ch);
+bool rfind(Contents_Iterator* it, char ch) {
+    ZoneScoped;
 
-        if (ptr) {
-            it->index = ptr - str.buffer;
-            it->position -= str.end() - ptr;
+    while (1) {
+        if (rfind_bucket_either(it, ch, ch)) {
             return true;
-        } else {
-            if (it->bucket == 0) {
-                it->position -= it->index;
-                it->index = 0;
-                return false;
-            }
-
-            it->position -= str.len;
-            --it->bucket;
-            it->index = it->contents->buckets[it->bucket].len;
+        }
+        if (it->at_bob()) {
+            return false;
         }
     }
 }
@@ -263,31 +281,12 @@ bool find_cased(Contents_Iterator* it, char ch, Case_Handling case_handling) {
 
     char lower = cz::to_lower(ch);
     char upper = cz::to_upper(ch);
-
-    while (1) {
-        if (it->at_eob()) {
-            return false;
-        }
-
-        auto bucket = it->contents->buckets[it->bucket];
-        cz::Str str = cz::Str{bucket.elems, bucket.len}.slice_start(it->index);
-        const char* ptr = str.find(lower);
-        const char* ptr2 = str.find(upper);
-        if (!ptr) {
-            // No lower case result.
-            ptr = ptr2;
-        } else if (ptr2 && ptr > ptr2) {
-            // The upper case result is closer than the lower case result.
-            ptr = ptr2;
-        }
-
-        if (ptr) {
-            it->advance(ptr - str.buffer);
+    while (!it->at_eob()) {
+        if (find_bucket_either(it, lower, upper)) {
             return true;
-        } else {
-            it->advance(str.len);
         }
     }
+    return false;
 }
 
 bool rfind_cased(Contents_Iterator* it, char ch, Case_Handling case_handling) {
@@ -300,43 +299,12 @@ bool rfind_cased(Contents_Iterator* it, char ch, Case_Handling case_handling) {
 
     char lower = cz::to_lower(ch);
     char upper = cz::to_upper(ch);
-
-    // It's valid to have bucket 1 off the end so account
-    // for that so we can access the bucket below.
-    if (it->bucket == it->contents->buckets.len) {
-        if (it->position == 0)
-            return false;
-        it->retreat();
-        it->position++;
-    }
-
     while (1) {
-        auto bucket = it->contents->buckets[it->bucket];
-        cz::Str str = cz::Str{bucket.elems, bucket.len}.slice_end(it->index);
-        const char* ptr = str.rfind(lower);
-        const char* ptr2 = str.rfind(upper);
-        if (!ptr) {
-            // No lower case result.
-            ptr = ptr2;
-        } else if (ptr2 && ptr < ptr2) {
-            // The upper case result is closer than the lower case result.
-            ptr = ptr2;
-        }
-
-        if (ptr) {
-            it->index = ptr - str.buffer;
-            it->position -= str.end() - ptr;
+        if (rfind_bucket_either(it, lower, upper)) {
             return true;
-        } else {
-            if (it->bucket == 0) {
-                it->position -= it->index;
-                it->index = 0;
-                return false;
-            }
-
-            --it->bucket;
-            it->index = it->contents->buckets[it->bucket].len;
-            it->position -= str.len;
+        }
+        if (it->at_bob()) {
+            return false;
         }
     }
 }
@@ -359,22 +327,7 @@ bool find_bucket(Contents_Iterator* it, char ch) {
 }
 
 bool rfind_bucket(Contents_Iterator* it, char ch) {
-    // Search in the previous bucket if at the start of this one.
-    if (it->at_bob())
-        return false;
-    it->retreat();
-
-    cz::Slice<char> bucket = it->contents->buckets[it->bucket];
-    cz::Str str = {bucket.elems, bucket.len};
-    cz::Str slice = str.slice_end(it->index + 1);
-    const char* ptr = slice.rfind(ch);
-    if (ptr) {
-        it->retreat(str.buffer + it->index - ptr);
-        return true;
-    } else {
-        it->retreat(it->index);
-        return false;
-    }
+    return rfind_bucket_either(it, ch, ch);
 }
 
 bool find_bucket_cased(Contents_Iterator* it, char ch, Case_Handling case_handling) {
@@ -383,21 +336,7 @@ bool find_bucket_cased(Contents_Iterator* it, char ch, Case_Handling case_handli
         return find_bucket(it, ch);
     }
 
-    Contents_Iterator test1 = *it;
-    if (find_bucket(&test1, cz::to_lower(ch))) {
-        Contents_Iterator test2 = *it;
-        if (find_bucket(&test2, cz::to_upper(ch))) {
-            if (test2.position < test1.position) {
-                *it = test2;
-                return true;
-            }
-        }
-
-        *it = test1;
-        return true;
-    }
-
-    return find_bucket(it, cz::to_upper(ch));
+    return find_bucket_either(it, cz::to_lower(ch), cz::to_upper(ch));
 }
 
 bool rfind_bucket_cased(Contents_Iterator* it, char ch, Case_Handling case_handling) {
@@ -406,188 +345,135 @@ bool rfind_bucket_cased(Contents_Iterator* it, char ch, Case_Handling case_handl
         return rfind_bucket(it, ch);
     }
 
-    Contents_Iterator test1 = *it;
-    if (rfind_bucket(&test1, cz::to_lower(ch))) {
-        Contents_Iterator test2 = *it;
-        if (rfind_bucket(&test2, cz::to_upper(ch))) {
-            if (test2.position > test1.position) {
-                *it = test2;
-                return true;
-            }
-        }
+    return rfind_bucket_either(it, cz::to_lower(ch), cz::to_upper(ch));
+}
 
-        *it = test1;
+/// Find `query` starting at or after the point `it` in the current bucket.  Matches entirely
+/// inside the bucket are found with `find_substring_cased`.  Matches that continue into the
+/// next bucket can only start in the last `query.len - 1` characters and are checked one by one.
+/// On failure puts `it` at the start of the next bucket.  `case_handling` must be resolved.
+static bool find_bucket_resolved(Contents_Iterator* it,
+                                 cz::Str query,
+                                 Case_Handling case_handling) {
+    if (it->bucket >= it->contents->buckets.len)
+        return false;
+
+    cz::Slice<char> bucket = it->contents->buckets[it->bucket];
+    const char* start = bucket.elems + it->index;
+    size_t len = bucket.len - it->index;
+    const char* match = find_substring_cased(start, len, query, case_handling);
+    if (match) {
+        it->advance(match - start);
         return true;
     }
 
-    return rfind_bucket(it, cz::to_upper(ch));
+    size_t straddling = len >= query.len ? len - query.len + 1 : 0;
+    it->advance(straddling);
+    for (size_t i = straddling; i < len; ++i) {
+        if (cased_char_match(start[i], query[0], case_handling) &&
+            looking_at_cased(*it, query, case_handling)) {
+            return true;
+        }
+        it->advance();
+    }
+    return false;
 }
 
-bool find_bucket(Contents_Iterator* it, cz::Str query) {
-    if (query.len == 0)
-        return true;
-
-    while (1) {
-        if (!find_bucket(it, query[0]))
-            return false;
+/// Find `query` starting before the point `it` in the current bucket (the end may be after
+/// `it`).  If `it` is at the start of a bucket then searches in the previous bucket.  On failure
+/// puts `it` at the start of the bucket.  `case_handling` must be resolved.
+static bool rfind_bucket_resolved(Contents_Iterator* it,
+                                  cz::Str query,
+                                  Case_Handling case_handling) {
+    if (it->at_bob())
+        return false;
+    it->retreat();
 
-        if (looking_at(*it, query))
+    // Matches starting at or after `inside` continue into the next bucket.
+    // Check them first since they start after all the other matches.
+    cz::Slice<char> bucket = it->contents->buckets[it->bucket];
+    size_t inside = bucket.len >= query.len ? bucket.len - query.len + 1 : 0;
+    while (it->index >= inside) {
+        if (cased_char_match(it->get(), query[0], case_handling) &&
+            looking_at_cased(*it, query, case_handling)) {
             return true;
-
-        size_t bucket = it->bucket;
-        it->advance();
-        if (it->bucket != bucket)
+        }
+        if (it->index == 0) {
             return false;
+        }
+        it->retreat();
+    }
+
+    const char* match =
+        rfind_substring_cased(bucket.elems, it->index + query.len, query, case_handling);
+    if (match) {
+        it->retreat(bucket.elems + it->index - match);
+        return true;
+    } else {
+        it->retreat(it->index);
+        return false;
     }
 }
 
-bool rfind_bucket(Contents_Iterator* it, cz::Str query) {
+bool find_bucket(Contents_Iterator* it, cz::Str query) {
     if (query.len == 0)
         return true;
 
-    while (1) {
-        if (!rfind_bucket(it, query[0]))
-            return false;
+    return find_bucket_resolved(it, query, Case_Handling::CASE_SENSITIVE);
+}
 
-        if (looking_at(*it, query))
-            return true;
+bool rfind_bucket(Contents_Iterator* it, cz::Str query) {
+    if (query.len == 0)
+        return true;
 
-        // Prevent going into previous bucket.
-        if (it->index == 0)
-            return false;
-    }
+    return rfind_bucket_resolved(it, query, Case_Handling::CASE_SENSITIVE);
 }
 
 bool find_bucket_cased(Contents_Iterator* it, cz::Str query, Case_Handling case_handling) {
     resolve_smart_case(query, &case_handling);
-    if (case_handling == Case_Handling::CASE_SENSITIVE) {
-        return find_bucket(it, query);
-    }
-
     if (query.len == 0)
         return true;
 
-    while (1) {
-        if (!find_bucket_cased(it, query[0], case_handling))
-            return false;
-
-        if (looking_at_cased(*it, query, case_handling))
-            return true;
-
-        size_t bucket = it->bucket;
-        it->advance();
-        if (it->bucket != bucket)
-            return false;
-    }
+    return find_bucket_resolved(it, query, case_handling);
 }
 
 bool rfind_bucket_cased(Contents_Iterator* it, cz::Str query, Case_Handling case_handling) {
     resolve_smart_case(query, &case_handling);
-    if (case_handling == Case_Handling::CASE_SENSITIVE) {
-        return rfind_bucket(it, query);
-    }
-
     if (query.len == 0)
         return true;
 
-    while (1) {
-        if (!rfind_bucket_cased(it, query[0], case_handling))
-            return false;
-
-        if (looking_at_cased(*it, query, case_handling))
-            return true;
-
-        // Prevent going into previous bucket.
-        if (it->index == 0)
-            return false;
-    }
+    return rfind_bucket_resolved(it, query, case_handling);
 }
 
 bool find(Contents_Iterator* it, cz::Str query) {
-    ZoneScoped;
-
-    if (query.len == 0) {
-        return true;
-    }
-
-    while (1) {
-        if (!find(it, query[0])) {
-            break;
-        }
-
-        if (looking_at(*it, query)) {
-            return true;
-        }
-
-        it->advance();
-    }
-
-    return false;
+    return find_cased(it, query, Case_Handling::CASE_SENSITIVE);
 }
 
 bool find_cased(Contents_Iterator* it, cz::Str query, Case_Handling case_handling) {
-    resolve_smart_case(query, &case_handling);
-    if (case_handling == Case_Handling::CASE_SENSITIVE) {
-        return find(it, query);
-    }
-
     ZoneScoped;
 
+    resolve_smart_case(query, &case_handling);
     if (query.len == 0) {
         return true;
     }
 
-    while (1) {
-        if (!find_cased(it, query[0], case_handling)) {
-            break;
-        }
-
-        if (looking_at_cased(*it, query, case_handling)) {
+    while (!it->at_eob()) {
+        if (find_bucket_resolved(it, query, case_handling)) {
             return true;
         }
-
-        it->advance();
     }
 
     return false;
 }
 
 bool rfind(Contents_Iterator* it, cz::Str query) {
-    ZoneScoped;
-
-    if (query.len > it->contents->len) {
-        *it = it->contents->start();
-        return false;
-    }
-    if (query.len == 0) {
-        return true;
-    }
-
-    if (it->contents->len - query.len < it->position) {
-        it->retreat_to(it->contents->len - query.len + 1);
-    }
-
-    while (1) {
-        if (!rfind(it, query[0])) {
-            break;
-        }
-
-        if (looking_at(*it, query)) {
-            return true;
-        }
-    }
-
-    return false;
+    return rfind_cased(it, query, Case_Handling::CASE_SENSITIVE);
 }
 
 bool rfind_cased(Contents_Iterator* it, cz::Str query, Case_Handling case_handling) {
-    resolve_smart_case(query, &case_handling);
-    if (case_handling == Case_Handling::CASE_SENSITIVE) {
-        return rfind(it, query);
-    }
-
     ZoneScoped;
 
+    resolve_smart_case(query, &case_handling);
     if (query.len > it->contents->len) {
         *it = it->contents->start();
         return false;
@@ -601,16 +487,13 @@ bool rfind_cased(Contents_Iterator* it, cz::Str query, Case_Handling case_handli
     }
 
     while (1) {
-        if (!rfind_cased(it, query[0], case_handling)) {
-            break;
-        }
-
-        if (looking_at_cased(*it, query, case_handling)) {
+        if (rfind_bucket_resolved(it, query, case_handling)) {
             return true;
         }
+        if (it->at_bob()) {
+            return false;
+        }
     }
-
-    return false;
 }
 
 bool find_before(Contents_Iterator* it, uint64_t end, char ch) {
@@ -410,32 +410,18 @@ Contents_Iterator start_of_line_position(const Contents& contents, uint64_t line
         --line;
     }
 
-    Contents_Iterator it;
-    it.contents = &contents;
-    it.index = 0;
-
-    uint64_t pos = 0;
-    for (size_t i = 0; i < contents.buckets.len; ++i) {
-        if (line <= contents.bucket_lfs[i]) {
-            it.position = pos;
-            it.bucket = i;
-
-            while (line > 0) {
-                --line;
-                end_of_line(&it);
-                forward_char(&it);
-            }
-
-            return it;
-        }
+    Contents_Iterator it = contents.iterator_at_bucket_by_lines(&line);
 
-        line -= contents.bucket_lfs[i];
-        pos += contents.buckets[i].len;
+    if (it.bucket == contents.buckets.len) {
+        CZ_DEBUG_ASSERT(it.position == contents.len);
+        return it;
     }
 
-    CZ_DEBUG_ASSERT(pos == contents.len);
-    it.position = pos;
-    it.bucket = contents.buckets.len;
+    while (line > 0) {
+        --line;
+        end_of_line(&it);
+        forward_char(&it);
+    }
 
     return it;
 }
@@ -5,11 +5,12 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cz/arc.hpp>
 #include <cz/char_type.hpp>
+#include <cz/condition_variable.hpp>
 #include <cz/defer.hpp>
 #include <cz/heap.hpp>
 #include <cz/mutex.hpp>
-#include <cz/semaphore.hpp>
 #include <cz/util.hpp>
 #include <tracy/Tracy.hpp>
 #include "basic/commands.hpp"
@@ -30,9 +31,21 @@ struct Async_Context {
 };
 
 struct Run_Jobs_Data {
-    cz::Semaphore added_asynchronous_job_signal;
     cz::Mutex mutex;
+    /// Signalled when jobs are added, when a job finishes, makes progress, or releases
+    /// its `Asynchronous_Job::buffer`, when stalled jobs are retried, or when we are stopping.
+    cz::Condition_Variable signal;
+
+    /// Jobs waiting to be ran.  A job is removed from this list while it is running.
     cz::Vector<Asynchronous_Job> jobs;
+    /// Jobs that didn't make progress the last time they were ran.  They are retried once
+    /// another job finishes or makes progress, or the main thread unlocks its state.
+    cz::Vector<Asynchronous_Job> stalled_jobs;
+    /// The `Asynchronous_Job::buffer`s of the jobs that are currently running.
+    cz::Vector<const Buffer_Handle*> running_buffers;
+    size_t num_running;
+    size_t num_threads;
+
     cz::Vector<Synchronous_Job> pending_jobs;
     cz::String message;
     std::atomic_size_t* num_uncompleted_async_jobs;
@@ -63,11 +76,76 @@ void Asynchronous_Job_Handler::sync_unlock() {
     ctx->mutex.unlock();
 }
 
+static bool is_buffer_running(Run_Jobs_Data* data, const Buffer_Handle* buffer) {
+    for (size_t i = 0; i < data->running_buffers.len; ++i) {
+        if (data->running_buffers[i] == buffer) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Find a job that doesn't conflict with any running jobs and remove it from the queue.
+static bool claim_job(Run_Jobs_Data* data, Asynchronous_Job* job) {
+    for (size_t i = 0; i < data->jobs.len; ++i) {
+        const Buffer_Handle* buffer = data->jobs[i].buffer;
+        if (buffer && is_buffer_running(data, buffer)) {
+            continue;
+        }
+
+        *job = data->jobs[i];
+        data->jobs.remove(i);
+        if (buffer) {
+            data->running_buffers.reserve(cz::heap_allocator(), 1);
+            data->running_buffers.push(buffer);
+        }
+        ++data->num_running;
+        return true;
+    }
+    return false;
+}
+
+static void release_job(Run_Jobs_Data* data, const Asynchronous_Job& job) {
+    --data->num_running;
+    if (job.buffer) {
+        for (size_t i = 0; i < data->running_buffers.len; ++i) {
+            if (data->running_buffers[i] == job.buffer) {
+                data->running_buffers.remove(i);
+                break;
+            }
+        }
+    }
+}
+
+/// Move all the stalled jobs back into the queue so they are retried.
+/// The caller is responsible for signalling the threads to pick them up.
+static bool retry_stalled_jobs(Run_Jobs_Data* data) {
+    if (data->stalled_jobs.len == 0) {
+        return false;
+    }
+    data->jobs.reserve(cz::heap_allocator(), data->stalled_jobs.len);
+    data->jobs.append(data->stalled_jobs);
+    data->stalled_jobs.len = 0;
+    return true;
+}
+
+/// Retry the stalled jobs after state they could be waiting on changes outside of the pool.
+static void wake_stalled_jobs(Run_Jobs_Data* data) {
+    data->mutex.lock();
+    CZ_DEFER(data->mutex.unlock());
+    if (retry_stalled_jobs(data)) {
+        data->signal.signal_all();
+    }
+}
+
 struct Run_Jobs {
     Run_Jobs_Data* data;
+    size_t thread_index;
 
     void operator()() {
-        tracy::SetThreadName("Mag job thread");
+        char thread_name[32];
+        snprintf(thread_name, sizeof(thread_name), "Mag job thread %zu", thread_index);
+        tracy::SetThreadName(thread_name);
 
         Asynchronous_Job_Handler handler = {};
         handler.async_context = &data->async_context;
@@ -92,37 +170,17 @@ struct Run_Jobs {
         cz::String queue_message = {};
         CZ_DEFER(queue_message.drop(cz::heap_allocator()));
 
-        size_t job_index = 0;
-        bool started = false;
-
-        bool remove = false;
-        bool made_progress = false;
+        data->mutex.lock();
         while (1) {
             Asynchronous_Job job;
             {
                 ZoneScopedN("job thread find job");
 
-                data->mutex.lock();
-                CZ_DEFER(data->mutex.unlock());
-
                 if (queue_message.len != 0) {
                     cz::swap(data->message, queue_message);
                     queue_message.len = 0;
                 }
 
-                if (remove) {
-                    --*data->num_uncompleted_async_jobs;
-                    data->jobs.remove(job_index);
-                    remove = false;
-                }
-
-                if (data->stop) {
-                    if (started) {
-                        FrameMarkEnd("job thread");
-                    }
-                    return;
-                }
-
                 // Send synchronous jobs to the Editor.
                 data->pending_jobs.reserve(cz::heap_allocator(),
                                            handler.pending_synchronous_jobs.len);
@@ -130,40 +188,41 @@ struct Run_Jobs {
                 handler.pending_synchronous_jobs.len = 0;
 
                 // Add asynchronous jobs to the list.
-                data->jobs.reserve(cz::heap_allocator(), handler.pending_asynchronous_jobs.len);
-                data->jobs.append(handler.pending_asynchronous_jobs);
-                handler.pending_asynchronous_jobs.len = 0;
-
-                if (data->jobs.len == 0) {
-                    job_index = 0;
-                    made_progress = false;
-                    goto wait_for_more_jobs;
+                if (handler.pending_asynchronous_jobs.len > 0) {
+                    *data->num_uncompleted_async_jobs += handler.pending_asynchronous_jobs.len;
+                    data->jobs.reserve(cz::heap_allocator(),
+                                       handler.pending_asynchronous_jobs.len);
+                    data->jobs.append(handler.pending_asynchronous_jobs);
+                    handler.pending_asynchronous_jobs.len = 0;
+                    retry_stalled_jobs(data);
+                    data->signal.signal_all();
                 }
 
-                if (job_index == data->jobs.len) {
-                    job_index = 0;
-                    if (!made_progress) {
-                        goto sleep;
-                    }
-                    made_progress = false;
+                if (data->stop) {
+                    data->mutex.unlock();
+                    return;
                 }
 
-                job = data->jobs[job_index];
+                if (!claim_job(data, &job)) {
+                    // Either there are no jobs, every job is stalled, or the remaining
+                    // jobs are waiting on a buffer that is being used.  Stalled jobs are
+                    // requeued by whoever changes state they could be waiting on.
+                    ZoneScopedN("job thread sleep");
+                    data->signal.wait(&data->mutex);
+                    continue;
+                }
             }
 
-            if (!started) {
-                FrameMarkStart("job thread");
-                started = true;
-            }
+            data->mutex.unlock();
 
+            bool remove = false;
+            Job_Tick_Result result = Job_Tick_Result::STALLED;
             {
                 ZoneScopedN("job thread run job");
                 try {
-                    Job_Tick_Result result = job.tick(&handler, job.data);
+                    result = job.tick(&handler, job.data);
                     if (result == Job_Tick_Result::FINISHED) {
                         remove = true;
-                    } else if (result == Job_Tick_Result::MADE_PROGRESS) {
-                        made_progress = true;
                     }
                 } catch (std::exception& ex) {
                     cz::Str prefix = "Job failed with message: ";
@@ -173,33 +232,141 @@ struct Run_Jobs {
                     queue_message.append(message);
                     remove = true;
                 }
-
-                // Go to the next job.  If we remove then the next job will
-                // be shifted into our position so there's nothing to do.
-                if (!remove) {
-                    ++job_index;
-                }
             }
 
-            if (false) {
-            wait_for_more_jobs:
-                if (started) {
-                    FrameMarkEnd("job thread");
-                    started = false;
-                }
+            data->mutex.lock();
+            release_job(data, job);
+
+            if (remove) {
+                --*data->num_uncompleted_async_jobs;
+            } else if (result == Job_Tick_Result::MADE_PROGRESS) {
+                // Put the job at the back of the queue for round robin scheduling.
+                data->jobs.reserve(cz::heap_allocator(), 1);
+                data->jobs.push(job);
+            } else {
+                data->stalled_jobs.reserve(cz::heap_allocator(), 1);
+                data->stalled_jobs.push(job);
+            }
 
-                data->added_asynchronous_job_signal.acquire();
+            // Something changed so the stalled jobs may be able to make progress.
+            bool retried = false;
+            if (result != Job_Tick_Result::STALLED) {
+                retried = retry_stalled_jobs(data);
             }
 
-            if (false) {
-            sleep:
-                ZoneScopedN("job thread sleep");
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            // Wake up threads waiting on our buffer, on the stalled jobs, or in `parallel_for`.
+            if (job.buffer || remove || retried || result == Job_Tick_Result::MADE_PROGRESS) {
+                data->signal.signal_all();
             }
         }
     }
 };
 
+/// The pool `parallel_for` adds jobs to.  Set while the `Server` is running.
+static Run_Jobs_Data* parallel_for_pool;
+
+namespace parallel_for_ {
+struct Parallel_For_Shared {
+    void (*run)(void* data, size_t index);
+    void* data;
+    size_t count;
+    /// The next iteration to run.
+    std::atomic_size_t next;
+    /// The number of iterations that have finished.
+    std::atomic_size_t finished;
+
+    void drop() {}
+};
+}
+using namespace parallel_for_;
+
+static void run_parallel_for_iterations(Parallel_For_Shared* shared) {
+    while (1) {
+        size_t index = shared->next.fetch_add(1);
+        if (index >= shared->count) {
+            return;
+        }
+        shared->run(shared->data, index);
+        shared->finished.fetch_add(1, std::memory_order_release);
+    }
+}
+
+static void parallel_for_job_kill(void* data) {
+    cz::Arc<Parallel_For_Shared>* shared = (cz::Arc<Parallel_For_Shared>*)data;
+    shared->drop();
+    cz::heap_allocator().dealloc(shared);
+}
+
+static Job_Tick_Result parallel_for_job_tick(Asynchronous_Job_Handler*, void* data) {
+    ZoneScoped;
+
+    // Once the caller has claimed every iteration this returns immediately.
+    cz::Arc<Parallel_For_Shared>* shared = (cz::Arc<Parallel_For_Shared>*)data;
+    run_parallel_for_iterations(shared->get());
+    parallel_for_job_kill(data);
+    return Job_Tick_Result::FINISHED;
+}
+
+void parallel_for(size_t count, void (*run)(void* data, size_t index), void* data) {
+    ZoneScoped;
+
+    Run_Jobs_Data* pool = parallel_for_pool;
+    if (count <= 1 || !pool || pool->num_threads == 0) {
+        for (size_t i = 0; i < count; ++i) {
+            run(data, i);
+        }
+        return;
+    }
+
+    cz::Arc<Parallel_For_Shared> shared;
+    shared.init_emplace();
+    CZ_DEFER(shared.drop());
+    shared->run = run;
+    shared->data = data;
+    shared->count = count;
+    shared->next.store(0);
+    shared->finished.store(0);
+
+    {
+        pool->mutex.lock();
+        CZ_DEFER(pool->mutex.unlock());
+
+        // Put the helpers at the front of the queue since the caller is waiting on them.
+        size_t helpers = cz::min(count - 1, pool->num_threads);
+        pool->jobs.reserve(cz::heap_allocator(), helpers);
+        for (size_t i = 0; i < helpers; ++i) {
+            cz::Arc<Parallel_For_Shared>* job_data =
+                cz::heap_allocator().alloc<cz::Arc<Parallel_For_Shared> >();
+            CZ_ASSERT(job_data);
+            *job_data = shared.clone();
+
+            Asynchronous_Job job;
+            job.tick = parallel_for_job_tick;
+            job.kill = parallel_for_job_kill;
+            job.data = job_data;
+            pool->jobs.insert(0, job);
+        }
+        *pool->num_uncompleted_async_jobs += helpers;
+        pool->signal.signal_all();
+    }
+
+    run_parallel_for_iterations(shared.get());
+
+    // Wait for the iterations the job threads started.  The helper jobs signal
+    // the pool after they finish so the wake up can't be missed.
+    pool->mutex.lock();
+    CZ_DEFER(pool->mutex.unlock());
+    while (shared->finished.load(std::memory_order_acquire) < count) {
+        ZoneScopedN("parallel_for wait");
+        pool->signal.wait(&pool->mutex);
+    }
+}
+
+size_t count_parallel_for_threads() {
+    Run_Jobs_Data* pool = parallel_for_pool;
+    return 1 + (pool ? pool->num_threads : 0);
+}
+
 void Server::setup_async_context(Client* client) {
     auto data = (Run_Jobs_Data*)job_data_;
     data->async_context.mutex.lock();
@@ -211,10 +378,30 @@ void Server::setup_async_context(Client* client) {
 
 void Server::set_async_locked(bool locked) {
     auto data = (Run_Jobs_Data*)job_data_;
-    data->async_context.mutex.lock();
-    CZ_DEFER(data->async_context.mutex.unlock());
+    {
+        data->async_context.mutex.lock();
+        CZ_DEFER(data->async_context.mutex.unlock());
+
+        data->async_context.permitted = !locked;
+    }
+
+    // Jobs that stalled trying to lock the `Server` can now make progress.
+    if (!locked) {
+        wake_stalled_jobs(data);
+    }
+}
 
-    data->async_context.permitted = !locked;
+size_t count_background_threads() {
+    // Leave a core for the main thread.
+    size_t cores = std::thread::hardware_concurrency();
+    return cz::max(cores, (size_t)2) - 1;
+}
+
+static size_t count_job_threads() {
+    if (custom::job_threads > 0) {
+        return custom::job_threads;
+    }
+    return count_background_threads();
 }
 
 void Server::init() {
@@ -222,15 +409,22 @@ void Server::init() {
     job_data_ = data;
 
     *data = {};
-    data->added_asynchronous_job_signal.init(0);
     data->mutex.init();
+    data->signal.init();
 
     data->num_uncompleted_async_jobs = &editor.num_uncompleted_async_jobs;
 
     data->async_context.mutex.init();
     data->async_context.permitted = false;
 
-    job_thread = new std::thread(Run_Jobs{data});
+    size_t num_threads = count_job_threads();
+    data->num_threads = num_threads;
+    parallel_for_pool = data;
+    job_threads = {};
+    job_threads.reserve_exact(cz::heap_allocator(), num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        job_threads.push(new std::thread(Run_Jobs{data, i}));
+    }
 
     editor.create();
 }
@@ -241,24 +435,30 @@ void Server::drop() {
     {
         data->mutex.lock();
         CZ_DEFER(data->mutex.unlock());
-
         data->stop = true;
     }
 
-    // If the other thread is stalled on the semaphore then release it.
-    data->added_asynchronous_job_signal.release();
-
-    job_thread->join();
-    delete job_thread;
+    // Wake up threads waiting for jobs.
+    data->signal.signal_all();
 
-    data->added_asynchronous_job_signal.drop();
-    data->mutex.drop();
+    for (size_t i = 0; i < job_threads.len; ++i) {
+        job_threads[i]->join();
+        delete job_threads[i];
+    }
+    job_threads.drop(cz::heap_allocator());
+    parallel_for_pool = nullptr;
 
     for (size_t i = 0; i < data->jobs.len; ++i) {
         data->jobs[i].kill(data->jobs[i].data);
     }
     data->jobs.drop(cz::heap_allocator());
 
+    for (size_t i = 0; i < data->stalled_jobs.len; ++i) {
+        data->stalled_jobs[i].kill(data->stalled_jobs[i].data);
+    }
+    data->stalled_jobs.drop(cz::heap_allocator());
+    data->running_buffers.drop(cz::heap_allocator());
+
     for (size_t i = 0; i < data->pending_jobs.len; ++i) {
         data->pending_jobs[i].kill(data->pending_jobs[i].data);
     }
@@ -268,6 +468,8 @@ void Server::drop() {
 
     data->async_context.mutex.drop();
 
+    data->signal.drop();
+    data->mutex.drop();
     cz::heap_allocator().dealloc(data);
 
     pending_message.drop(cz::heap_allocator());
@@ -287,17 +489,23 @@ bool Server::slurp_jobs() {
     data->jobs.append(editor.pending_jobs);
     if (editor.pending_jobs.len > 0) {
         editor.num_uncompleted_async_jobs += editor.pending_jobs.len;
-        data->added_asynchronous_job_signal.release();
+        data->signal.signal_all();
     }
     editor.pending_jobs.len = 0;
 
+    // The main thread has released its buffers since the stalled jobs last ran.  This is
+    // bounded by the frame rate unlike the job threads retrying the stalled jobs themselves.
+    if (retry_stalled_jobs(data)) {
+        data->signal.signal_all();
+    }
+
     editor.synchronous_jobs.reserve(cz::heap_allocator(), data->pending_jobs.len);
     editor.synchronous_jobs.append(data->pending_jobs);
     data->pending_jobs.len = 0;
 
     cz::swap(pending_message, data->message);
 
-    return data->jobs.len > 0;
+    return data->jobs.len + data->stalled_jobs.len + data->num_running > 0;
 }
 
 bool Server::send_pending_asynchronous_jobs() {
@@ -627,6 +835,7 @@ void Server::process_key_chain(Client* client, bool in_batch_paste) {
 
         // Run the command.
         run_command(command, &editor, source);
+        ++client->commands_ran;
     }
 
     if (!client->record_key_presses) {
@@ -18,7 +18,8 @@ struct Server {
     Command previous_command;
     Editor editor;
 
-    std::thread* job_thread;
+    /// Threads that run `Asynchronous_Job`s.  See `custom::job_threads`.
+    cz::Vector<std::thread*> job_threads;
     void* job_data_;
 
     cz::String pending_message;
@@ -1,6 +1,7 @@
 #include "token_cache.hpp"
 
 #include <stdlib.h>
+#include <string.h>
 #include <chrono>
 #include <cz/bit_array.hpp>
 #include <cz/defer.hpp>
@@ -12,8 +13,11 @@
 #include "core/command_macros.hpp"
 #include "core/contents.hpp"
 #include "core/job.hpp"
+#include "core/match.hpp"
 #include "core/token.hpp"
+#include "core/token_cache_file.hpp"
 #include "core/tracy_format.hpp"
+#include "custom/config.hpp"
 
 namespace mag {
 
@@ -51,66 +55,116 @@ Tokenizer_Check_Point Token_Cache::find_check_point(uint64_t position) const {
     }
 }
 
-static bool any_changes_after(cz::Slice<const Change> changes, uint64_t position) {
-    for (size_t c = 0; c < changes.len; ++c) {
-        if (changes[c].is_redo) {
-            for (size_t e = 0; e < changes[c].commit.edits.len; ++e) {
-                auto& edit = changes[c].commit.edits[e];
-                if (edit.position >= position) {
-                    return true;
-                }
-                if (!(edit.flags & Edit::INSERT_MASK) &&
-                    edit.position + edit.value.len() >= position) {
-                    return true;
-                }
-                position_after_edit(edit, &position);
-            }
+/// Tracks the positions of the check points while edits are replayed.  The current position of a
+/// check point is its stored position plus the prefix sum of a Fenwick tree of offsets.  This
+/// lets each edit shift every later check point in O(log^2 n) instead of O(n).  Arithmetic is
+/// modulo 2^64 so stored positions may temporarily wrap around.
+struct Check_Point_Offsets {
+    cz::Slice<Tokenizer_Check_Point> check_points;
+    cz::Vector<uint64_t> tree;
+    bool dirty;
+};
+
+static size_t lowest_bit(size_t i) {
+    return i & (~i + 1);
+}
+
+static void offsets_add(Check_Point_Offsets* offsets, size_t index, uint64_t offset) {
+    offsets->dirty = true;
+    for (size_t i = index + 1; i <= offsets->tree.len; i += lowest_bit(i)) {
+        offsets->tree[i - 1] += offset;
+    }
+}
+
+static uint64_t offsets_prefix(const Check_Point_Offsets& offsets, size_t index) {
+    uint64_t sum = 0;
+    for (size_t i = index + 1; i > 0; i -= lowest_bit(i)) {
+        sum += offsets.tree[i - 1];
+    }
+    return sum;
+}
+
+static uint64_t offsets_position(const Check_Point_Offsets& offsets, size_t index) {
+    return offsets.check_points[index].position + offsets_prefix(offsets, index);
+}
+
+/// Find the first check point at or after `position` (or strictly after if `strict`).
+static size_t offsets_search(const Check_Point_Offsets& offsets, uint64_t position, bool strict) {
+    size_t start = 0;
+    size_t end = offsets.check_points.len;
+    while (start < end) {
+        size_t mid = (start + end) / 2;
+        uint64_t current = offsets_position(offsets, mid);
+        if (strict ? current <= position : current < position) {
+            start = mid + 1;
         } else {
-            for (size_t e = changes[c].commit.edits.len; e-- > 0;) {
-                auto& edit = changes[c].commit.edits[e];
-                if (edit.position >= position) {
-                    return true;
-                }
-                if ((edit.flags & Edit::INSERT_MASK) &&
-                    edit.position + edit.value.len() >= position) {
-                    return true;
-                }
-                position_before_edit(edit, &position);
-            }
+            end = mid;
         }
     }
-    return false;
+    return start;
 }
 
-static bool any_changes_inbetween(cz::Slice<const Change> changes, uint64_t start, uint64_t end) {
-    for (size_t c = 0; c < changes.len; ++c) {
-        if (changes[c].is_redo) {
-            for (size_t e = 0; e < changes[c].commit.edits.len; ++e) {
-                auto& edit = changes[c].commit.edits[e];
-                if (cz::max(edit.position, start) <=
-                    cz::min(
-                        edit.position + (!(edit.flags & Edit::INSERT_MASK) ? edit.value.len() : 0),
-                        end)) {
-                    return true;
-                }
-                position_after_edit(edit, &start);
-                position_after_edit(edit, &end);
-            }
-        } else {
-            for (size_t e = changes[c].commit.edits.len; e-- > 0;) {
-                auto& edit = changes[c].commit.edits[e];
-                if (cz::max(edit.position, start) <=
-                    cz::min(
-                        edit.position + ((edit.flags & Edit::INSERT_MASK) ? edit.value.len() : 0),
-                        end)) {
-                    return true;
-                }
-                position_before_edit(edit, &start);
-                position_before_edit(edit, &end);
-            }
+/// Mark the check points `[start, end]` as changed.
+static void mark_changed(cz::Sized_Bit_Array* changed, size_t count, size_t start, size_t end) {
+    for (size_t i = start; i <= end && i < count; ++i) {
+        changed->set(i);
+    }
+}
+
+/// Replay one edit against the check points.  A check point is changed if the
+/// edit overlaps the range between it and the previous check point (inclusive).
+static void offsets_apply_edit(Check_Point_Offsets* offsets,
+                               cz::Sized_Bit_Array* changed,
+                               uint64_t position,
+                               uint64_t len,
+                               bool insert,
+                               bool after_position) {
+    size_t count = offsets->check_points.len;
+    size_t start = offsets_search(*offsets, position, /*strict=*/false);
+
+    if (insert) {
+        size_t end = offsets_search(*offsets, position, /*strict=*/true);
+        mark_changed(changed, count, start, end);
+
+        size_t shift = (after_position ? end : start);
+        if (shift < count) {
+            offsets_add(offsets, shift, len);
+        }
+    } else {
+        mark_changed(changed, count, start,
+                     offsets_search(*offsets, position + len, /*strict=*/true));
+
+        // Check points inside the removed region collapse to its start.
+        size_t shift = offsets_search(*offsets, position + len, /*strict=*/false);
+        for (size_t i = start; i < shift; ++i) {
+            offsets->check_points[i].position = position - offsets_prefix(*offsets, i);
+        }
+        if (shift < count) {
+            offsets_add(offsets, shift, (uint64_t)0 - len);
         }
     }
-    return false;
+}
+
+/// Write the offsets back into the check points in one sweep.
+static void offsets_flush(Check_Point_Offsets* offsets) {
+    if (!offsets->dirty) {
+        return;
+    }
+
+    // Undo the tree construction to get the offset added at each index.
+    cz::Slice<uint64_t> tree = offsets->tree;
+    for (size_t i = tree.len; i > 0; --i) {
+        size_t parent = i + lowest_bit(i);
+        if (parent <= tree.len) {
+            tree[parent - 1] -= tree[i - 1];
+        }
+    }
+
+    uint64_t offset = 0;
+    for (size_t i = 0; i < tree.len; ++i) {
+        offset += tree[i];
+        offsets->check_points[i].position += offset;
+    }
 }
 
 bool Token_Cache::update(const Buffer* buffer) {
@@ -129,25 +183,34 @@ bool Token_Cache::update(const Buffer* buffer) {
     changed_check_points.init(cz::heap_allocator(), check_points.len);
     CZ_DEFER(changed_check_points.drop(cz::heap_allocator()));
 
-    // Detect check points that changed
-    for (size_t i = 0; i < check_points.len; ++i) {
-        if (any_changes_inbetween(pending_changes, i == 0 ? 0 : check_points[i - 1].position,
-                                  check_points[i].position)) {
-            changed_check_points.set(i);
-        }
-
-        uint64_t pos = check_points[i].position;
-        position_after_changes(pending_changes, &pos);
-
-        if (!any_changes_after(pending_changes, check_points[i].position)) {
-            uint64_t offset = pos - check_points[i].position;
-            for (size_t j = i; j < check_points.len; ++j) {
-                check_points[j].position += offset;
+    // Replay the edits, marking check points that changed and shifting the rest.
+    {
+        Check_Point_Offsets offsets = {};
+        offsets.check_points = check_points;
+        offsets.tree.reserve_exact(cz::heap_allocator(), check_points.len);
+        CZ_DEFER(offsets.tree.drop(cz::heap_allocator()));
+        offsets.tree.len = check_points.len;
+        memset(offsets.tree.elems, 0, check_points.len * sizeof(uint64_t));
+
+        for (size_t c = 0; c < pending_changes.len; ++c) {
+            cz::Slice<const Edit> edits = pending_changes[c].commit.edits;
+            if (pending_changes[c].is_redo) {
+                for (size_t e = 0; e < edits.len; ++e) {
+                    offsets_apply_edit(&offsets, &changed_check_points, edits[e].position,
+                                       edits[e].value.len(), edits[e].flags & Edit::INSERT_MASK,
+                                       edits[e].flags & Edit::AFTER_POSITION_MASK);
+                }
+            } else {
+                // Undo applies the inverse edits in reverse order.
+                for (size_t e = edits.len; e-- > 0;) {
+                    offsets_apply_edit(&offsets, &changed_check_points, edits[e].position,
+                                       edits[e].value.len(), !(edits[e].flags & Edit::INSERT_MASK),
+                                       edits[e].flags & Edit::AFTER_POSITION_MASK);
+                }
             }
-            break;
         }
 
-        check_points[i].position = pos;
+        offsets_flush(&offsets);
     }
     change_index = changes.len;
 
@@ -279,6 +342,216 @@ bool Token_Cache::next_check_point(const Buffer* buffer,
     return false;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Parallel tokenization
+//
+// For big buffers we split the untokenized text into chunks and tokenize them using
+// `parallel_for`, each starting from a guessed state (state `0` after a blank line).  Then we
+// walk through the chunks in order with the real state.  Once the real tokenizer reaches one of
+// the speculative check points with the same state the streams have converged and the rest of
+// the chunk's speculative check points are correct.  Otherwise we tokenize the chunk normally.
+//
+// Every check point is correct (tokenizing from the previous check point reproduces it) but
+// the check points may be at different positions than sequential tokenization would put them.
+////////////////////////////////////////////////////////////////////////////////
+
+static constexpr uint64_t PARALLEL_CHUNK_SIZE = 256 * 1024;
+
+/// The buffer is locked while tokenizing so stop speculatively tokenizing after this long.
+static constexpr std::chrono::milliseconds PARALLEL_TOKENIZE_BUDGET(4);
+
+struct Speculative_Chunk {
+    uint64_t start;
+    uint64_t start_state;
+    /// Stop once the tokenizer reaches this position.
+    uint64_t end;
+    /// Check points strictly before `end`.
+    cz::Vector<Tokenizer_Check_Point> check_points;
+    /// `false` if we ran out of time before reaching `end`.
+    bool complete;
+};
+
+struct Speculative_Chunks {
+    const Buffer* buffer;
+    Speculative_Chunk* chunks;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+/// Guess a position to start tokenizing in state `0`.  We look for a blank line since
+/// those rarely appear inside of tokens (except for comments and strings).
+static uint64_t guess_chunk_start(const Contents* contents, uint64_t position, uint64_t end) {
+    uint64_t limit = cz::min(end, position + 64 * 1024);
+
+    Contents_Iterator iterator = contents->iterator_at(position);
+    if (find_before(&iterator, limit, "\n\n")) {
+        return iterator.position + 2;
+    }
+
+    iterator.retreat_to(position);
+    if (find_before(&iterator, limit, '\n')) {
+        return iterator.position + 1;
+    }
+    return position;
+}
+
+static void tokenize_speculative_chunk(void* _data, size_t index) {
+    ZoneScoped;
+
+    Speculative_Chunks* data = (Speculative_Chunks*)_data;
+    const Buffer* buffer = data->buffer;
+    Speculative_Chunk* chunk = &data->chunks[index];
+
+    Contents_Iterator iterator = buffer->contents.iterator_at(chunk->start);
+    uint64_t state = chunk->start_state;
+    uint64_t last = chunk->start;
+
+    chunk->check_points.reserve(cz::heap_allocator(), 1);
+    chunk->check_points.push({chunk->start, state});
+
+    // Always tokenize some of the first chunk so we make progress.
+    chunk->complete = false;
+    if (index > 0 && std::chrono::steady_clock::now() >= data->deadline) {
+        return;
+    }
+
+    Token token;
+    while (iterator.position < chunk->end) {
+        if (!buffer->mode.next_token(&iterator, &token, &state)) {
+            break;
+        }
+
+        if (iterator.position >= last + TOKENIZATION_DISTANCE && iterator.position < chunk->end) {
+            chunk->check_points.reserve(cz::heap_allocator(), 1);
+            chunk->check_points.push({iterator.position, state});
+            last = iterator.position;
+
+            if (std::chrono::steady_clock::now() >= data->deadline) {
+                return;
+            }
+        }
+    }
+    chunk->complete = true;
+}
+
+static size_t count_tokenization_threads() {
+    if (custom::syntax_highlight_threads > 0) {
+        return custom::syntax_highlight_threads;
+    }
+    return count_parallel_for_threads();
+}
+
+bool Token_Cache::next_check_points_parallel(const Buffer* buffer,
+                                             Contents_Iterator* iterator,
+                                             uint64_t* state) {
+    ZoneScoped;
+
+    const Contents* contents = &buffer->contents;
+    size_t num_chunks = count_tokenization_threads();
+
+    if (check_points.len == 0) {
+        // Put an empty check point at the start.
+        check_points.reserve(cz::heap_allocator(), 1);
+        check_points.push({});
+    }
+    uint64_t region_end =
+        cz::min(contents->len, iterator->position + num_chunks * PARALLEL_CHUNK_SIZE);
+
+    cz::Vector<Speculative_Chunk> chunks = {};
+    CZ_DEFER({
+        for (size_t i = 0; i < chunks.len; ++i) {
+            chunks[i].check_points.drop(cz::heap_allocator());
+        }
+        chunks.drop(cz::heap_allocator());
+    });
+    chunks.reserve_exact(cz::heap_allocator(), num_chunks);
+
+    // The first chunk starts at the real state so it will always converge immediately.
+    chunks.push({iterator->position, *state, region_end, {}, false});
+    for (size_t i = 1; i < num_chunks; ++i) {
+        uint64_t nominal = iterator->position + i * PARALLEL_CHUNK_SIZE;
+        if (nominal >= region_end) {
+            break;
+        }
+        uint64_t start = guess_chunk_start(contents, nominal, region_end);
+        if (start >= region_end) {
+            break;
+        }
+        if (start <= chunks.last().start) {
+            continue;
+        }
+        chunks.last().end = start;
+        chunks.push({start, 0, region_end, {}, false});
+    }
+
+    {
+        ZoneScopedN("tokenize speculatively");
+        Speculative_Chunks data;
+        data.buffer = buffer;
+        data.chunks = chunks.elems;
+        data.deadline = std::chrono::steady_clock::now() + PARALLEL_TOKENIZE_BUDGET;
+        parallel_for(chunks.len, tokenize_speculative_chunk, &data);
+    }
+
+    ZoneScopedN("reconcile speculative check points");
+
+    uint64_t last = check_points.len > 0 ? check_points.last().position : 0;
+    auto push_check_point = [&](Tokenizer_Check_Point check_point) {
+        check_points.reserve(cz::heap_allocator(), 1);
+        check_points.push(check_point);
+        last = check_point.position;
+    };
+
+    Token token;
+    for (size_t c = 0; c < chunks.len; ++c) {
+        cz::Slice<Tokenizer_Check_Point> speculative = chunks[c].check_points;
+        // If the chunk ran out of time then only go as far as it got.
+        uint64_t end = chunks[c].complete ? chunks[c].end : speculative.last().position;
+        size_t s = 0;
+        while (iterator->position < end) {
+            while (s < speculative.len && speculative[s].position < iterator->position) {
+                ++s;
+            }
+
+            if (s < speculative.len && speculative[s].position == iterator->position &&
+                speculative[s].state == *state) {
+                // Converged so the rest of the speculative check points are correct.
+                for (; s < speculative.len; ++s) {
+                    if (speculative[s].position > last) {
+                        push_check_point(speculative[s]);
+                    }
+                }
+                iterator->advance_to(speculative.last().position);
+                *state = speculative.last().state;
+                s = speculative.len;
+                if (iterator->position >= end) {
+                    break;
+                }
+            }
+
+            if (!buffer->mode.next_token(iterator, &token, state)) {
+                ran_to_end = (contents->len > 0);
+                return false;
+            }
+
+            if (iterator->position >= last + TOKENIZATION_DISTANCE) {
+                push_check_point({iterator->position, *state});
+            }
+        }
+
+        if (!chunks[c].complete) {
+            break;
+        }
+    }
+
+    // Resume from the last check point next time.
+    if (check_points.len > 0) {
+        *iterator = contents->iterator_at(check_points.last().position);
+        *state = check_points.last().state;
+    }
+
+    return true;
+}
+
 bool Token_Cache::is_covered(uint64_t position) const {
     // If the tokenizer crashes halfway through then we
     // consider points after the crash to be covered.
@@ -305,7 +578,8 @@ static void job_syntax_highlight_buffer_kill(void* _data) {
     cz::heap_allocator().dealloc(data);
 }
 
-static Job_Tick_Result job_syntax_highlight_buffer_tick(Asynchronous_Job_Handler*, void* _data) {
+static Job_Tick_Result job_syntax_highlight_buffer_tick(Asynchronous_Job_Handler* handler,
+                                                        void* _data) {
     ZoneScoped;
 
     Job_Syntax_Highlight_Buffer_Data* data = (Job_Syntax_Highlight_Buffer_Data*)_data;
@@ -356,15 +630,21 @@ static Job_Tick_Result job_syntax_highlight_buffer_tick(Asynchronous_Job_Handler
             iterator = buffer->contents.start();
         }
 
-        auto time_start = std::chrono::steady_clock::now();
-        while (1) {
-            if (!data->token_cache.next_check_point(buffer, &iterator, &state)) {
-                stop = true;
-                break;
-            }
+        uint64_t threshold = custom::parallel_syntax_highlight_threshold;
+        if (threshold > 0 && buffer->contents.len - iterator.position >= threshold) {
+            stop = !data->token_cache.next_check_points_parallel(buffer, &iterator, &state);
+        } else {
+            auto time_start = std::chrono::steady_clock::now();
+            while (1) {
+                if (!data->token_cache.next_check_point(buffer, &iterator, &state)) {
+                    stop = true;
+                    break;
+                }
 
-            if (std::chrono::steady_clock::now() - time_start > std::chrono::milliseconds(2)) {
-                break;
+                if (std::chrono::steady_clock::now() - time_start >
+                    std::chrono::milliseconds(2)) {
+                    break;
+                }
             }
         }
     }
@@ -388,6 +668,8 @@ static Job_Tick_Result job_syntax_highlight_buffer_tick(Asynchronous_Job_Handler
     }
 
     if (stop) {
+        // Hash and write the file without blocking the buffer.
+        handler->add_asynchronous_job(job_save_token_cache_file(handle.clone_downgrade()));
         job_syntax_highlight_buffer_kill(_data);
     }
     return stop ? Job_Tick_Result::FINISHED : Job_Tick_Result::MADE_PROGRESS;
@@ -405,6 +687,7 @@ Asynchronous_Job job_syntax_highlight_buffer(cz::Arc_Weak<Buffer_Handle> handle)
     job.tick = job_syntax_highlight_buffer_tick;
     job.kill = job_syntax_highlight_buffer_kill;
     job.data = data;
+    job.buffer = job_buffer_key(handle);
     return job;
 }
 
@@ -45,6 +45,13 @@ struct Token_Cache {
 
     /// Add a check point onto the end
     bool next_check_point(const Buffer* buffer, Contents_Iterator* iterator, uint64_t* state);
+
+    /// Add check points for the next region of the buffer by tokenizing chunks of it in
+    /// parallel.  Check points are correct but may be at different positions than the ones
+    /// `next_check_point` would add.  Returns `false` if we reached the end of the buffer.
+    bool next_check_points_parallel(const Buffer* buffer,
+                                    Contents_Iterator* iterator,
+                                    uint64_t* state);
 };
 
 /// Make a job that generates token cache check points
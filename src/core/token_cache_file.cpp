@@ -0,0 +1,407 @@
+#include "token_cache_file.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <cz/defer.hpp>
+#include <cz/file.hpp>
+#include <cz/heap.hpp>
+#include <cz/path.hpp>
+#include <tracy/Tracy.hpp>
+#include "core/buffer.hpp"
+#include "core/buffer_handle.hpp"
+#include "core/contents.hpp"
+#include "core/job.hpp"
+#include "core/program_info.hpp"
+#include "core/token_cache.hpp"
+#include "custom/config.hpp"
+
+namespace mag {
+
+static constexpr uint64_t TOKEN_CACHE_FILE_MAGIC = 0x313048435447414d;  // "MAGTCH01"
+
+/// The file is laid out as this header followed by the
+/// path of the buffer and then the check points.
+struct Token_Cache_File_Header {
+    uint64_t magic;
+    uint64_t tokenizer;
+    uint64_t program_date;
+    uint64_t contents_hash;
+    uint64_t contents_len;
+    uint64_t path_len;
+    uint64_t check_points_len;
+};
+
+static uint64_t hash_bytes(uint64_t hash, cz::Str str) {
+    for (size_t i = 0; i < str.len; ++i) {
+        hash ^= (uint8_t)str[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static uint64_t hash_contents(const Contents& contents) {
+    ZoneScoped;
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < contents.buckets.len; ++i) {
+        hash = hash_bytes(hash, contents.buckets[i]);
+    }
+    return hash;
+}
+
+/// Identify the tokenizer in a way that is stable across runs of the same executable.
+/// Function addresses move with ASLR but their offsets within the executable don't.
+/// Rebuilding mag changes `program_date` which invalidates every cache file.
+static uint64_t tokenizer_identity(const Buffer* buffer) {
+    return (uint64_t)((uintptr_t)buffer->mode.next_token - (uintptr_t)&job_save_token_cache_file);
+}
+
+static uint64_t packed_program_date() {
+    return ((uint64_t)program_date.year << 40) | ((uint64_t)program_date.month << 32) |
+           ((uint64_t)program_date.day_of_month << 24) | ((uint64_t)program_date.hour << 16) |
+           ((uint64_t)program_date.minute << 8) | (uint64_t)program_date.second;
+}
+
+static bool should_cache(const Buffer* buffer) {
+    return custom::token_cache_file_threshold > 0 && buffer->type == Buffer::FILE &&
+           buffer->contents.len >= custom::token_cache_file_threshold && buffer->is_unchanged();
+}
+
+static bool get_cache_directory(cz::String* directory) {
+    cz::Str configured = custom::token_cache_directory;
+    if (configured.len == 0) {
+        return false;
+    }
+
+    if (!cz::path::is_absolute(configured)) {
+        if (!user_home_path) {
+            return false;
+        }
+        cz::Str home = user_home_path;
+        directory->reserve(cz::heap_allocator(), home.len + 1);
+        directory->append(home);
+        if (!home.ends_with('/')) {
+            directory->push('/');
+        }
+    }
+
+    directory->reserve(cz::heap_allocator(), configured.len + 1);
+    directory->append(configured);
+    if (directory->as_str().ends_with('/')) {
+        directory->len--;
+    }
+    directory->null_terminate();
+    return true;
+}
+
+/// Create the directory and all its parents.
+static void create_directories(cz::String* directory) {
+    for (size_t i = 1; i <= directory->len; ++i) {
+        if (i == directory->len || (*directory)[i] == '/') {
+            char saved = directory->buffer[i];
+            directory->buffer[i] = '\0';
+            cz::file::create_directory(directory->buffer);
+            directory->buffer[i] = saved;
+        }
+    }
+}
+
+/// Get the path of the cache file for the file at `path`.
+static bool get_cache_file_path(cz::Str path, bool create, cz::String* cache_path) {
+    if (!get_cache_directory(cache_path)) {
+        return false;
+    }
+
+    if (create) {
+        create_directories(cache_path);
+    }
+
+    char name[18];
+    snprintf(name, sizeof(name), "/%016llx",
+             (unsigned long long)hash_bytes(0xcbf29ce484222325, path));
+    cache_path->reserve(cz::heap_allocator(), sizeof(name) + 4);
+    cache_path->append(name);
+    cache_path->null_terminate();
+    return true;
+}
+
+static bool read_exact(cz::Input_File file, void* data, size_t len) {
+    char* it = (char*)data;
+    while (len > 0) {
+        int64_t result = file.read(it, len);
+        if (result <= 0) {
+            return false;
+        }
+        it += result;
+        len -= result;
+    }
+    return true;
+}
+
+static bool write_exact(cz::Output_File file, const void* data, size_t len) {
+    const char* it = (const char*)data;
+    while (len > 0) {
+        int64_t result = file.write(it, len);
+        if (result <= 0) {
+            return false;
+        }
+        it += result;
+        len -= result;
+    }
+    return true;
+}
+
+/// What is written to the cache file.  Copied from the buffer so it can be written unlocked.
+struct Token_Cache_File_Contents {
+    Token_Cache_File_Header header;
+    cz::String path;
+    cz::Vector<Tokenizer_Check_Point> check_points;
+
+    void drop() {
+        path.drop(cz::heap_allocator());
+        check_points.drop(cz::heap_allocator());
+    }
+};
+
+/// Copy what is needed to save the token cache.  Returns `false` if it shouldn't be saved.
+static bool prepare_token_cache_file(const Buffer* buffer, Token_Cache_File_Contents* file) {
+    ZoneScoped;
+
+    const Token_Cache& token_cache = buffer->token_cache;
+    if (!should_cache(buffer) || !token_cache.ran_to_end ||
+        token_cache.change_index != buffer->changes.len) {
+        return false;
+    }
+
+    if (!buffer->get_path(cz::heap_allocator(), &file->path)) {
+        return false;
+    }
+
+    file->check_points.reserve_exact(cz::heap_allocator(), token_cache.check_points.len);
+    file->check_points.append(token_cache.check_points);
+
+    Token_Cache_File_Header* header = &file->header;
+    header->magic = TOKEN_CACHE_FILE_MAGIC;
+    header->tokenizer = tokenizer_identity(buffer);
+    header->program_date = packed_program_date();
+    header->contents_hash = hash_contents(buffer->contents);
+    header->contents_len = buffer->contents.len;
+    header->path_len = file->path.len;
+    header->check_points_len = file->check_points.len;
+    return true;
+}
+
+static void write_token_cache_file(const Token_Cache_File_Contents& file) {
+    ZoneScoped;
+
+    cz::String cache_path = {};
+    CZ_DEFER(cache_path.drop(cz::heap_allocator()));
+    if (!get_cache_file_path(file.path, /*create=*/true, &cache_path)) {
+        return;
+    }
+
+    // Write to a temporary file and then rename it so a concurrent
+    // reader never sees a partially written cache file.
+    cz::String temp_path = {};
+    CZ_DEFER(temp_path.drop(cz::heap_allocator()));
+    temp_path.reserve_exact(cz::heap_allocator(), cache_path.len + 5);
+    temp_path.append(cache_path);
+    temp_path.append(".tmp");
+    temp_path.null_terminate();
+
+    bool success;
+    {
+        cz::Output_File output;
+        if (!output.open(temp_path.buffer)) {
+            return;
+        }
+        CZ_DEFER(output.close());
+
+        success = write_exact(output, &file.header, sizeof(file.header)) &&
+                  write_exact(output, file.path.buffer, file.path.len) &&
+                  write_exact(output, file.check_points.elems,
+                              file.check_points.len * sizeof(Tokenizer_Check_Point));
+    }
+
+    if (!success || rename(temp_path.buffer, cache_path.buffer) != 0) {
+        remove(temp_path.buffer);
+    }
+}
+
+static void job_save_token_cache_file_kill(void* _data) {
+    cz::Arc_Weak<Buffer_Handle>* data = (cz::Arc_Weak<Buffer_Handle>*)_data;
+    data->drop();
+    cz::heap_allocator().dealloc(data);
+}
+
+static Job_Tick_Result job_save_token_cache_file_tick(Asynchronous_Job_Handler*, void* _data) {
+    ZoneScoped;
+
+    cz::Arc_Weak<Buffer_Handle>* data = (cz::Arc_Weak<Buffer_Handle>*)_data;
+
+    cz::Arc<Buffer_Handle> handle;
+    if (!data->upgrade(&handle)) {
+        job_save_token_cache_file_kill(_data);
+        return Job_Tick_Result::FINISHED;
+    }
+    CZ_DEFER(handle.drop());
+
+    Token_Cache_File_Contents file = {};
+    CZ_DEFER(file.drop());
+    {
+        // Only read so the buffer can still be rendered while hashing.
+        const Buffer* buffer = handle->try_lock_reading();
+        if (!buffer) {
+            return Job_Tick_Result::STALLED;
+        }
+        CZ_DEFER(handle->unlock());
+
+        if (!prepare_token_cache_file(buffer, &file)) {
+            job_save_token_cache_file_kill(_data);
+            return Job_Tick_Result::FINISHED;
+        }
+    }
+
+    write_token_cache_file(file);
+    job_save_token_cache_file_kill(_data);
+    return Job_Tick_Result::FINISHED;
+}
+
+Asynchronous_Job job_save_token_cache_file(cz::Arc_Weak<Buffer_Handle> handle) {
+    cz::Arc_Weak<Buffer_Handle>* data = cz::heap_allocator().clone(handle);
+    CZ_ASSERT(data);
+
+    Asynchronous_Job job;
+    job.tick = job_save_token_cache_file_tick;
+    job.kill = job_save_token_cache_file_kill;
+    job.data = data;
+    job.buffer = job_buffer_key(handle);
+    return job;
+}
+
+static bool load_check_points(const Buffer* buffer,
+                              cz::Vector<Tokenizer_Check_Point>* check_points) {
+    ZoneScoped;
+
+    if (!should_cache(buffer)) {
+        return false;
+    }
+
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+    if (!buffer->get_path(cz::heap_allocator(), &path)) {
+        return false;
+    }
+
+    cz::String cache_path = {};
+    CZ_DEFER(cache_path.drop(cz::heap_allocator()));
+    if (!get_cache_file_path(path, /*create=*/false, &cache_path)) {
+        return false;
+    }
+
+    cz::Input_File file;
+    if (!file.open(cache_path.buffer)) {
+        return false;
+    }
+    CZ_DEFER(file.close());
+
+    Token_Cache_File_Header header;
+    if (!read_exact(file, &header, sizeof(header))) {
+        return false;
+    }
+
+    // Cheap checks first.
+    if (header.magic != TOKEN_CACHE_FILE_MAGIC || header.tokenizer != tokenizer_identity(buffer) ||
+        header.program_date != packed_program_date() ||
+        header.contents_len != buffer->contents.len || header.path_len != path.len ||
+        header.check_points_len == 0 || header.check_points_len > buffer->contents.len + 1) {
+        return false;
+    }
+
+    // Different paths can have the same hash.
+    cz::String cached_path = {};
+    CZ_DEFER(cached_path.drop(cz::heap_allocator()));
+    cached_path.reserve_exact(cz::heap_allocator(), header.path_len);
+    if (!read_exact(file, cached_path.buffer, header.path_len)) {
+        return false;
+    }
+    cached_path.len = header.path_len;
+    if (cached_path.as_str() != path.as_str()) {
+        return false;
+    }
+
+    if (header.contents_hash != hash_contents(buffer->contents)) {
+        return false;
+    }
+
+    check_points->reserve_exact(cz::heap_allocator(), header.check_points_len);
+    if (!read_exact(file, check_points->elems,
+                    header.check_points_len * sizeof(Tokenizer_Check_Point))) {
+        return false;
+    }
+    check_points->len = header.check_points_len;
+
+    // Reject corrupted files.
+    for (size_t i = 1; i < check_points->len; ++i) {
+        if ((*check_points)[i - 1].position >= (*check_points)[i].position) {
+            return false;
+        }
+    }
+    return check_points->last().position <= buffer->contents.len;
+}
+
+static void job_load_token_cache_file_kill(void* _data) {
+    cz::Arc_Weak<Buffer_Handle>* data = (cz::Arc_Weak<Buffer_Handle>*)_data;
+    data->drop();
+    cz::heap_allocator().dealloc(data);
+}
+
+static Job_Tick_Result job_load_token_cache_file_tick(Asynchronous_Job_Handler*, void* _data) {
+    ZoneScoped;
+
+    cz::Arc_Weak<Buffer_Handle>* data = (cz::Arc_Weak<Buffer_Handle>*)_data;
+
+    cz::Arc<Buffer_Handle> handle;
+    if (!data->upgrade(&handle)) {
+        job_load_token_cache_file_kill(_data);
+        return Job_Tick_Result::FINISHED;
+    }
+    CZ_DEFER(handle.drop());
+
+    const Buffer* buffer = handle->try_lock_reading();
+    if (!buffer) {
+        return Job_Tick_Result::STALLED;
+    }
+    CZ_DEFER(handle->unlock());
+
+    size_t changes_len = buffer->changes.len;
+    cz::Vector<Tokenizer_Check_Point> check_points = {};
+    CZ_DEFER(check_points.drop(cz::heap_allocator()));
+    if (load_check_points(buffer, &check_points)) {
+        // The check points are only valid if no one edited the buffer while the lock was upgraded.
+        Buffer* buffer_mut = handle->increase_reading_to_writing();
+        if (buffer_mut->changes.len != changes_len) {
+            job_load_token_cache_file_kill(_data);
+            return Job_Tick_Result::FINISHED;
+        }
+        buffer_mut->token_cache.change_index = buffer_mut->changes.len;
+        cz::swap(buffer_mut->token_cache.check_points, check_points);
+        buffer_mut->token_cache.ran_to_end = true;
+    }
+
+    job_load_token_cache_file_kill(_data);
+    return Job_Tick_Result::FINISHED;
+}
+
+Asynchronous_Job job_load_token_cache_file(cz::Arc_Weak<Buffer_Handle> handle) {
+    cz::Arc_Weak<Buffer_Handle>* data = cz::heap_allocator().clone(handle);
+    CZ_ASSERT(data);
+
+    Asynchronous_Job job;
+    job.tick = job_load_token_cache_file_tick;
+    job.kill = job_load_token_cache_file_kill;
+    job.data = data;
+    job.buffer = job_buffer_key(handle);
+    return job;
+}
+
+}
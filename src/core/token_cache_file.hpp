@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cz/arc.hpp>
+
+namespace mag {
+struct Asynchronous_Job;
+struct Buffer_Handle;
+
+/// Make a job that saves the buffer's token cache check points to disk so that reopening the
+/// file can skip syntax highlighting.  Does nothing unless the buffer is an unmodified file at
+/// least `custom::token_cache_file_threshold` bytes long that has been completely highlighted.
+/// The buffer is only locked for reading while the check points are copied and the contents
+/// are hashed.  The file is written after unlocking.  Takes ownership of the `handle`.
+Asynchronous_Job job_save_token_cache_file(cz::Arc_Weak<Buffer_Handle> handle);
+
+/// Make a job that restores the buffer's token cache from the check points saved by
+/// `job_save_token_cache_file` if the contents and tokenizer still match.  Start this once
+/// the file has finished loading.  Takes ownership of the `handle`.
+Asynchronous_Job job_load_token_cache_file(cz::Arc_Weak<Buffer_Handle> handle);
+
+}
@@ -0,0 +1,224 @@
+#include "token_index.hpp"
+
+#include <cz/heap.hpp>
+#include <tracy/Tracy.hpp>
+#include "core/buffer.hpp"
+#include "core/contents.hpp"
+#include "custom/config.hpp"
+
+namespace mag {
+
+static void push_varint(cz::Vector<uint8_t>* data, uint64_t value) {
+    data->reserve(cz::heap_allocator(), 10);
+    while (value >= 0x80) {
+        data->push((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    data->push((uint8_t)value);
+}
+
+static uint64_t read_varint(const uint8_t** data) {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *(*data)++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+}
+
+bool Token_Index_Cursor::next(Token* token) {
+    if (data == data_end) {
+        return false;
+    }
+
+    token->start = position + read_varint(&data);
+    token->end = token->start + read_varint(&data);
+    token->type = (Token_Type)read_varint(&data);
+    position = token->end + read_varint(&data);
+    return true;
+}
+
+static void drop_blocks(Token_Index* index) {
+    for (size_t i = 0; i < index->blocks.len; ++i) {
+        index->blocks[i].data.drop(cz::heap_allocator());
+    }
+    index->blocks.len = 0;
+    index->total_bytes = 0;
+}
+
+void Token_Index::drop() {
+    drop_blocks(this);
+    blocks.drop(cz::heap_allocator());
+}
+
+bool Token_Index::is_valid(const Buffer* buffer) const {
+    return change_index == buffer->changes.len && contents_len == buffer->contents.len &&
+           tokenizer == buffer->mode.next_token;
+}
+
+/// Find the first block starting at or after `position`.
+static size_t search_blocks(cz::Slice<const Token_Index::Block> blocks, uint64_t position) {
+    size_t start = 0;
+    size_t end = blocks.len;
+    while (start < end) {
+        size_t mid = (start + end) / 2;
+        if (blocks[mid].start < position) {
+            start = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return start;
+}
+
+const Token_Index::Block* Token_Index::find(const Buffer* buffer, uint64_t position) const {
+    if (blocks.len == 0 || !is_valid(buffer)) {
+        return nullptr;
+    }
+
+    size_t index = search_blocks(blocks, position);
+    if (index < blocks.len && blocks[index].start == position) {
+        return &blocks[index];
+    }
+    return nullptr;
+}
+
+/// Find the last check point at or before `position`.
+static size_t search_check_points(cz::Slice<const Tokenizer_Check_Point> check_points,
+                                  uint64_t position) {
+    size_t start = 0;
+    size_t end = check_points.len;
+    while (start < end) {
+        size_t mid = (start + end) / 2;
+        if (check_points[mid].position <= position) {
+            start = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return start == 0 ? 0 : start - 1;
+}
+
+/// Get the end of the block starting at check point `i`.  Returns `false` if
+/// the end isn't known yet (because the rest of the buffer isn't tokenized).
+static bool block_end(const Buffer* buffer, size_t i, uint64_t* end) {
+    const Token_Cache& token_cache = buffer->token_cache;
+    if (i + 1 < token_cache.check_points.len) {
+        *end = token_cache.check_points[i + 1].position;
+        return true;
+    }
+    if (token_cache.ran_to_end) {
+        *end = buffer->contents.len;
+        return true;
+    }
+    return false;
+}
+
+bool Token_Index::is_indexed(const Buffer* buffer, uint64_t start, uint64_t end) const {
+    if (custom::token_index_max_bytes == 0) {
+        return true;
+    }
+
+    cz::Slice<const Tokenizer_Check_Point> check_points = buffer->token_cache.check_points;
+    if (check_points.len == 0) {
+        return true;
+    }
+
+    size_t first = search_check_points(check_points, start);
+    for (size_t i = first; i < check_points.len; ++i) {
+        if (i > first && check_points[i].position >= end) {
+            break;
+        }
+
+        uint64_t unused;
+        if (block_end(buffer, i, &unused) && !find(buffer, check_points[i].position)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Tokenize from `check_point` until `end` into `block`.  Returns `false` if the
+/// tokenizer produces tokens that can't be represented (ie they go backwards).
+static bool tokenize_block(const Buffer* buffer,
+                           Tokenizer_Check_Point check_point,
+                           uint64_t end,
+                           Token_Index::Block* block) {
+    Contents_Iterator iterator = buffer->contents.iterator_at(check_point.position);
+    uint64_t state = check_point.state;
+    uint64_t previous = check_point.position;
+    while (iterator.position < end) {
+        Token token;
+        if (!buffer->mode.next_token(&iterator, &token, &state)) {
+            break;
+        }
+
+        if (token.start < previous || token.end < token.start || iterator.position < token.end) {
+            return false;
+        }
+
+        push_varint(&block->data, token.start - previous);
+        push_varint(&block->data, token.end - token.start);
+        push_varint(&block->data, token.type);
+        push_varint(&block->data, iterator.position - token.end);
+        previous = iterator.position;
+    }
+
+    block->start = check_point.position;
+    block->end = iterator.position;
+    block->end_state = state;
+    return true;
+}
+
+void Token_Index::index_region(const Buffer* buffer, uint64_t start, uint64_t end) {
+    ZoneScoped;
+
+    if (custom::token_index_max_bytes == 0) {
+        return;
+    }
+
+    if (!is_valid(buffer)) {
+        drop_blocks(this);
+        change_index = buffer->changes.len;
+        contents_len = buffer->contents.len;
+        tokenizer = buffer->mode.next_token;
+    }
+
+    cz::Slice<const Tokenizer_Check_Point> check_points = buffer->token_cache.check_points;
+    size_t first = search_check_points(check_points, start);
+    for (size_t i = first; i < check_points.len; ++i) {
+        if (i > first && check_points[i].position >= end) {
+            break;
+        }
+
+        uint64_t block_end_position;
+        if (!block_end(buffer, i, &block_end_position)) {
+            break;
+        }
+
+        size_t index = search_blocks(blocks, check_points[i].position);
+        if (index < blocks.len && blocks[index].start == check_points[i].position) {
+            continue;
+        }
+
+        // Start over instead of growing without bound.
+        if (total_bytes > custom::token_index_max_bytes) {
+            drop_blocks(this);
+            index = 0;
+        }
+
+        Block block = {};
+        if (!tokenize_block(buffer, check_points[i], block_end_position, &block)) {
+            block.data.drop(cz::heap_allocator());
+            continue;
+        }
+
+        total_bytes += block.data.len;
+        blocks.reserve(cz::heap_allocator(), 1);
+        blocks.insert(index, block);
+    }
+}
+
+}
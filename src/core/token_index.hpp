@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <cz/vector.hpp>
+#include "core/token.hpp"
+
+namespace mag {
+struct Buffer;
+
+/// Reads the tokens out of one `Token_Index::Block`.
+struct Token_Index_Cursor {
+    const uint8_t* data;
+    const uint8_t* data_end;
+
+    /// The position of the tokenizer after the last token read.
+    uint64_t position;
+
+    /// Read the next token.  Returns `false` at the end of the block.
+    bool next(Token* token);
+};
+
+/// A compact copy of the tokens between `Token_Cache` check points so that repeated
+/// token queries (rendering, overlays, token movement) over the same region become array lookups
+/// instead of re-running the tokenizer.  Each token is stored as four varints: the gap from the
+/// previous token, the length, the type, and how far past the end the tokenizer stopped.
+///
+/// The index only describes one version of the buffer: it is dropped when the buffer
+/// is edited, appended to, or changes tokenizers.  It is filled in on demand
+/// (see `index_region`) and is dropped when it grows past `custom::token_index_max_bytes`.
+struct Token_Index {
+    struct Block {
+        /// The position and state of the check point the block starts at.
+        uint64_t start;
+        /// The position and state of the next check point (or the end of the buffer).
+        uint64_t end;
+        uint64_t end_state;
+        cz::Vector<uint8_t> data;
+    };
+
+    size_t change_index;
+    uint64_t contents_len;
+    Tokenizer tokenizer;
+    size_t total_bytes;
+    cz::Vector<Block> blocks;
+
+    void drop();
+
+    /// Check if the index describes the current version of the buffer.
+    bool is_valid(const Buffer* buffer) const;
+
+    /// Find the block starting at the check point at `position`.
+    /// Returns `nullptr` if there is none or the index is out of date.
+    const Block* find(const Buffer* buffer, uint64_t position) const;
+
+    /// Check if all check points between `start` and `end` are indexed.
+    bool is_indexed(const Buffer* buffer, uint64_t start, uint64_t end) const;
+
+    /// Index the tokens between the check points covering `start` through `end`.
+    void index_region(const Buffer* buffer, uint64_t start, uint64_t end);
+};
+
+}
@@ -9,6 +9,18 @@ void Forward_Token_Iterator::init_at_check_point(const Buffer* buffer, uint64_t
     Tokenizer_Check_Point check_point = buffer->token_cache.find_check_point(position);
     tokenization_iterator = buffer->contents.iterator_at(check_point.position);
     state = check_point.state;
+
+    buffer_ = buffer;
+    start_indexed_block(check_point.position);
+}
+
+void Forward_Token_Iterator::start_indexed_block(uint64_t position) {
+    indexed_block_ = buffer_->token_index.find(buffer_, position);
+    if (indexed_block_) {
+        indexed_.data = indexed_block_->data.elems;
+        indexed_.data_end = indexed_block_->data.elems + indexed_block_->data.len;
+        indexed_.position = position;
+    }
 }
 
 bool Forward_Token_Iterator::init_at_or_after(const Buffer* buffer, uint64_t position) {
@@ -23,6 +35,23 @@ bool Forward_Token_Iterator::init_after(const Buffer* buffer, uint64_t position)
 }
 
 bool Forward_Token_Iterator::next() {
+    while (indexed_block_) {
+        if (indexed_.next(&token_)) {
+            tokenization_iterator.advance_to(indexed_.position);
+            return true;
+        }
+
+        // Continue after the block.
+        const Token_Index::Block* block = indexed_block_;
+        tokenization_iterator.advance_to(block->end);
+        state = block->end_state;
+        if (block->end > block->start) {
+            start_indexed_block(block->end);
+        } else {
+            indexed_block_ = nullptr;
+        }
+    }
+
     bool found = (*tokenizer)(&tokenization_iterator, &token_, &state);
 #ifdef CZ_DEBUG_ASSERTIONS
     if (found) {
@@ -24,7 +24,15 @@ struct Forward_Token_Iterator {
     Contents_Iterator tokenization_iterator;
 
 private:
+    void start_indexed_block(uint64_t position);
+
     Token token_;
+
+    /// If the tokens after the check point are in the `Buffer::token_index`
+    /// then they are read from there instead of running the tokenizer.
+    const Buffer* buffer_;
+    const Token_Index::Block* indexed_block_;
+    Token_Index_Cursor indexed_;
 };
 
 struct Backward_Token_Iterator {
@@ -153,6 +153,78 @@ CompressionExtensions compression_extensions[] = {
 size_t compression_extensions_len =
     sizeof(compression_extensions) / sizeof(*compression_extensions);
 
+/// Read only files at least this many bytes are memory mapped instead of being copied into the
+/// buffer.  Parts of the file are only copied when they are edited.  This makes opening huge
+/// files (logs, core dumps) near instant and keeps them in the page cache.  If another program
+/// modifies the file in place the file watcher copies the buffer out of the mapping as soon as
+/// it notices and then reloads it.  Set to `0` to disable.
+uint64_t mmap_file_threshold = 64 << 20;
+
+/// Files that are open in buffers are watched for changes by other programs (via inotify on
+/// Linux).  Changes are reloaded once no file has changed for `file_watcher_delay` milliseconds
+/// so a `git rebase` reloads each buffer once.  Where files can't be watched, the file times of
+/// all buffers are checked every `file_watcher_poll_interval` milliseconds instead.  Deleted
+/// directories are watched again once they are recreated, checked at the same interval.
+uint64_t file_watcher_delay = 50;
+uint64_t file_watcher_poll_interval = 1000;
+
+/// The number of threads used to run asynchronous jobs (syntax highlighting, loading
+/// files, reading process output, etc).  Use `0` to use one thread per core minus one.
+size_t job_threads = 0;
+
+/// Project searches (`command_search_in_*`) run in process on the job threads by default.
+/// Set `search_with_ag` to shell out to `ag` instead.  `search_threads` is the number of files
+/// searched in parallel; use `0` to use one per core minus one.
+bool search_with_ag = false;
+size_t search_threads = 0;
+
+/// `find_file` lists directories on `find_file_threads` jobs (`0` means one per core minus one).
+/// The files of the last `find_file_cache_roots` directories are cached so opening `find_file`
+/// again shows them instantly while the directories' modification times are checked in the
+/// background.  Set to `0` to disable the cache.
+size_t find_file_threads = 0;
+size_t find_file_cache_roots = 4;
+
+/// Completion filters spend at most `completion_filter_budget` microseconds per frame checking
+/// results so typing never waits on a huge list; the rest are checked over the next frames.
+/// Typing more of the query only rechecks the results that matched so far.  Once at least
+/// `completion_filter_parallel_threshold` results remain they are checked in
+/// `completion_filter_threads` chunks on the job threads (`0` means one per job thread plus
+/// one for the main thread).
+uint64_t completion_filter_budget = 8000;
+size_t completion_filter_parallel_threshold = 1 << 17;
+size_t completion_filter_threads = 0;
+
+/// `fuzzy_completion_filter` only keeps this many of the best matches.
+size_t fuzzy_completion_max_results = 1000;
+
+/// Keep a trigram index of each version control repository that is searched so later
+/// searches only read the files that can match.  The index is updated in the background
+/// after each search by checking file modification times and is saved at `trigram_index_path`
+/// (relative to the repository root) so it survives restarts.  See
+/// `command_show_trigram_index_stats` for its size and timings.
+bool trigram_index = false;
+cz::Str trigram_index_path = ".git/mag-trigram-index";
+
+/// When at least this many bytes of a buffer still need to be syntax highlighted, the
+/// background syntax highlighter splits the next part of the buffer into
+/// `syntax_highlight_threads` chunks and tokenizes them in parallel on the job threads (`0`
+/// means one per job thread plus one).  Set the threshold to `0` to always tokenize
+/// sequentially.
+uint64_t parallel_syntax_highlight_threshold = 4 << 20;
+size_t syntax_highlight_threads = 0;
+
+/// Once a file at least this many bytes has been fully syntax highlighted, its tokenizer check
+/// points are saved into `token_cache_directory` (relative paths are relative to the home
+/// directory).  Reopening the file unchanged then restores them instead of re-tokenizing
+/// everything.  Entries are keyed by path, content hash, and tokenizer.  Set to `0` to disable.
+uint64_t token_cache_file_threshold = 1 << 20;
+cz::Str token_cache_directory = ".cache/mag/tokens";
+
+/// The maximum number of bytes used to store the tokens of each buffer so rendering, overlays,
+/// and token movement don't re-run the tokenizer over the same text.  Set to `0` to disable.
+size_t token_index_max_bytes = 16 << 20;
+
 /// Controls whether ncurses will configure colors of the terminal.
 /// It doesn't look good on my machine so I disabled it.
 bool enable_terminal_colors = false;
@@ -174,6 +246,12 @@ bool enable_terminal_mouse = false;
 /// 2. Avoid auto-indent features that could create incorrect amounts of indent.
 size_t ncurses_batch_paste_boundary = 6;
 
+/// If enabled then when a block of rows moves vertically (ie scrolling a full width window) the
+/// ncurses client scrolls that region of the terminal instead of redrawing every row.  This
+/// greatly reduces the output over slow connections such as SSH but some terminals render
+/// scroll regions poorly.
+bool ncurses_scroll_region = false;
+
 using namespace basic;
 
 #define BIND(MAP, KEYS, FUNC) ((MAP).bind(KEYS, COMMAND(FUNC)))
@@ -827,6 +905,7 @@ static void create_theme(Theme& theme) {
 
     theme.max_completion_results = 10;
     theme.mini_buffer_max_height = 10;
+    // Use `fuzzy_completion_filter` to rank results like fzf instead.
     theme.mini_buffer_completion_filter = spaces_are_wildcards_completion_filter;
     theme.window_completion_filter = prefix_completion_filter;
 
@@ -1230,6 +1309,7 @@ void buffer_created_callback(Editor* editor,
                     editor->theme.special_faces[Face_Type::SEARCH_MODE_RESULT_HIGHLIGHT],
                     buffer->name.slice(strlen("*ag "), buffer->name.len - 1),
                     Case_Handling::CASE_SENSITIVE, Token_Type::SEARCH_RESULT));
+                BIND(buffer->mode.key_map, "g", prose::command_search_reload);
             }
         } else if (buffer->name.starts_with("*build ") ||
                    buffer->name.starts_with("*clang-tidy ")) {
@@ -71,10 +71,39 @@ struct CompressionExtensions {
 extern CompressionExtensions compression_extensions[];
 extern size_t compression_extensions_len;
 
+extern uint64_t mmap_file_threshold;
+extern uint64_t file_watcher_delay;
+extern uint64_t file_watcher_poll_interval;
+
+extern size_t job_threads;
+
+extern bool search_with_ag;
+extern size_t search_threads;
+
+extern size_t find_file_threads;
+extern size_t find_file_cache_roots;
+
+extern uint64_t completion_filter_budget;
+extern size_t completion_filter_parallel_threshold;
+extern size_t completion_filter_threads;
+extern size_t fuzzy_completion_max_results;
+
+extern bool trigram_index;
+extern cz::Str trigram_index_path;
+
+extern uint64_t parallel_syntax_highlight_threshold;
+extern size_t syntax_highlight_threads;
+
+extern uint64_t token_cache_file_threshold;
+extern cz::Str token_cache_directory;
+
+extern size_t token_index_max_bytes;
+
 extern bool enable_terminal_colors;
 extern bool enable_terminal_mouse;
 
 extern size_t ncurses_batch_paste_boundary;
+extern bool ncurses_scroll_region;
 
 }
 }
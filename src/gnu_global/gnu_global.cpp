@@ -48,7 +48,7 @@ bool completion_engine(Editor* editor, Completion_Engine_Context* context, bool
 #ifdef _WIN32
     options.hide_window = true;
 #endif
-    return data->runner.iterate(context, args, options, is_initial_frame);
+    return data->runner.iterate(editor, context, args, options, is_initial_frame);
 }
 
 const char* lookup_symbol(const char* directory,
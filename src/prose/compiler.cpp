@@ -166,6 +166,7 @@ struct Buffer_State {
     Buffer_Messages messages;
 };
 static cz::Vector<Buffer_State> buffer_states;
+static uint64_t messages_generation;
 
 static void resolve_positions(const Buffer* buffer, File_Messages* file_messages) {
     if (file_messages->resolved_change_index == (size_t)-1) {
@@ -234,6 +235,11 @@ void install_messages(const Buffer* buffer, const cz::Arc<Buffer_Handle>& buffer
     state->buffer_array.clear();
     state->messages = parse_messages(buffer->contents.start(), buffer->directory,
                                      state->buffer_array.allocator());
+    ++messages_generation;
+}
+
+uint64_t installed_messages_generation() {
+    return messages_generation;
 }
 
 }
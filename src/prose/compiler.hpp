@@ -45,5 +45,8 @@ void command_install_compiler_messages(Editor* editor, Command_Source source);
 
 void install_messages(const Buffer* buffer, const cz::Arc<Buffer_Handle>& buffer_handle);
 
+/// Incremented every time messages are installed so renderers know to redraw.
+uint64_t installed_messages_generation();
+
 }
 }
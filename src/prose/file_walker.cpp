@@ -0,0 +1,220 @@
+#include "file_walker.hpp"
+
+#include <cz/defer.hpp>
+#include <cz/directory.hpp>
+#include <cz/file.hpp>
+#include <cz/heap.hpp>
+#include <cz/path.hpp>
+#include <cz/sort.hpp>
+#include <tracy/Tracy.hpp>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace mag {
+namespace prose {
+
+#ifdef __linux__
+/// The layout `getdents64` fills in.  glibc only declares it for newer versions.
+struct Linux_Dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+
+bool read_directory(const char* path,
+                    cz::Allocator name_allocator,
+                    cz::Vector<Directory_Entry>* entries) {
+    ZoneScoped;
+
+#ifdef __linux__
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    CZ_DEFER(close(fd));
+
+    alignas(8) char buffer[32 << 10];
+    while (1) {
+        long count = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (count < 0) {
+            return false;
+        }
+        if (count == 0) {
+            return true;
+        }
+
+        for (long offset = 0; offset < count;) {
+            Linux_Dirent64* dirent = (Linux_Dirent64*)(buffer + offset);
+            offset += dirent->d_reclen;
+
+            cz::Str name = dirent->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            // Some file systems don't fill in the type.
+            bool is_directory = (dirent->d_type == DT_DIR);
+            if (dirent->d_type == DT_UNKNOWN) {
+                struct stat info;
+                is_directory = fstatat(fd, dirent->d_name, &info, AT_SYMLINK_NOFOLLOW) == 0 &&
+                               S_ISDIR(info.st_mode);
+            }
+
+            entries->reserve(cz::heap_allocator(), 1);
+            entries->push({name.clone(name_allocator), is_directory});
+        }
+    }
+#else
+    cz::Vector<cz::Str> names = {};
+    CZ_DEFER(names.drop(cz::heap_allocator()));
+    if (!cz::files(cz::heap_allocator(), name_allocator, path, &names)) {
+        return false;
+    }
+
+    cz::String entry_path = {};
+    CZ_DEFER(entry_path.drop(cz::heap_allocator()));
+    cz::Str directory = path;
+
+    entries->reserve(cz::heap_allocator(), names.len);
+    for (size_t i = 0; i < names.len; ++i) {
+        entry_path.len = 0;
+        entry_path.reserve(cz::heap_allocator(), directory.len + names[i].len + 2);
+        entry_path.append(directory);
+        entry_path.push('/');
+        entry_path.append(names[i]);
+        entry_path.null_terminate();
+        entries->push({names[i], cz::file::is_directory_and_not_symlink(entry_path.buffer)});
+    }
+    return true;
+#endif
+}
+
+static void load_directory(File_Walker* walker) {
+    ZoneScoped;
+
+    cz::Allocator entry_allocator = walker->entries_buffer_array.allocator();
+
+    // Get all files in the directory.
+    File_Walker::Directory directory;
+    directory.save_point = walker->entries_buffer_array.save();
+    directory.entries = {};
+
+    read_directory(walker->path.buffer, entry_allocator, &directory.entries);
+
+    // Then sort it into reverse order because we pop them from the end first.
+    cz::sort(directory.entries, [](Directory_Entry* left, Directory_Entry* right) {
+        return left->name > right->name;
+    });
+    walker->directories.reserve(cz::heap_allocator(), 1);
+    walker->directories.push(directory);
+
+    // Load ignore rules.
+    version_control::Ignore_Rules rules = {};
+    version_control::find_ignore_rules(walker->path.buffer, &rules);
+    walker->ignore_rules_offsets.reserve(cz::heap_allocator(), 1);
+    walker->ignore_rules_rules.reserve(cz::heap_allocator(), 1);
+    walker->ignore_rules_offsets.push(walker->path.len - walker->path_initial_len);
+    walker->ignore_rules_rules.push(rules);
+
+    walker->path.push('/');
+}
+
+void File_Walker::init(cz::Str root) {
+    *this = {};
+    if (root.ends_with('/')) {
+        root.len--;
+    }
+    path = root.clone_null_terminate(cz::heap_allocator());
+    path_initial_len = path.len;
+    entries_buffer_array.init();
+    load_directory(this);
+    directory_len = path.len;
+}
+
+void File_Walker::drop() {
+    for (size_t i = 0; i < ignore_rules_rules.len; ++i) {
+        ignore_rules_rules[i].drop();
+    }
+    ignore_rules_offsets.drop(cz::heap_allocator());
+    ignore_rules_rules.drop(cz::heap_allocator());
+
+    for (size_t i = directories.len; i-- > 0;) {
+        directories[i].entries.drop(cz::heap_allocator());
+    }
+    directories.drop(cz::heap_allocator());
+
+    entries_buffer_array.drop();
+    path.drop(cz::heap_allocator());
+}
+
+bool File_Walker::next() {
+    // Remove the previous file.
+    path.len = directory_len;
+
+    while (1) {
+        // Pop finished directories.
+        while (directories.len > 0 && directories.last().entries.len == 0) {
+            // Pop last name and trailing `/`.  Ex. `/home/abc/` -> `/home/`.
+            path.pop();
+            cz::path::pop_name(&path);
+
+            // Delete the ignore rules for the directory.
+            ignore_rules_offsets.pop();
+            ignore_rules_rules.last().drop();
+            ignore_rules_rules.pop();
+
+            // Cleanup the directory.
+            Directory directory = directories.pop();
+            entries_buffer_array.restore(directory.save_point);
+            directory.entries.drop(cz::heap_allocator());
+        }
+
+        if (directories.len == 0) {
+            directory_len = path.len;
+            return false;
+        }
+
+        const size_t old_len = path.len;
+
+        // Get the absolute path to this entry.
+        Directory_Entry entry = directories.last().entries.pop();
+        path.reserve(cz::heap_allocator(), entry.name.len + 2);
+        path.append(entry.name);
+        path.null_terminate();
+
+        // Skip ignored files.
+        bool ignored = false;
+        for (size_t i = 0; i < ignore_rules_rules.len; ++i) {
+            cz::Str relpath = path.slice_start(path_initial_len + ignore_rules_offsets[i]);
+            if (version_control::file_matches(ignore_rules_rules[i], relpath)) {
+                ignored = true;
+                break;
+            }
+        }
+        if (ignored) {
+            path.len = old_len;
+            continue;
+        }
+
+        // Don't follow symlinks to directories so we can't get stuck in a cycle.
+        if (entry.is_directory) {
+            load_directory(this);
+            continue;
+        }
+
+        directory_len = old_len;
+        return true;
+    }
+}
+
+}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cz/buffer_array.hpp>
+#include <cz/string.hpp>
+#include <cz/vector.hpp>
+#include "version_control/ignore.hpp"
+
+namespace mag {
+namespace prose {
+
+struct Directory_Entry {
+    cz::Str name;
+    /// `false` for symbolic links to directories.
+    bool is_directory;
+};
+
+/// Append the entries in the directory `path` (excluding `.` and `..`) to `entries` in no
+/// particular order.  Names are allocated with `name_allocator`.  On Linux the types of the
+/// entries are read with `getdents64` instead of calling `stat` on each entry.
+bool read_directory(const char* path,
+                    cz::Allocator name_allocator,
+                    cz::Vector<Directory_Entry>* entries);
+
+/// Walks every file in a directory tree depth first.  Each directory's entries are visited
+/// in sorted order.  Files and directories matched by the `version_control::Ignore_Rules` of
+/// any directory above them are skipped.  Symbolic links to directories aren't followed.
+struct File_Walker {
+    struct Directory {
+        cz::Vector<Directory_Entry> entries;
+        cz::Buffer_Array::Save_Point save_point;
+    };
+
+    /// The absolute path to the current file.
+    cz::String path;
+    size_t path_initial_len;
+    size_t directory_len;
+
+    cz::Buffer_Array entries_buffer_array;
+    cz::Vector<Directory> directories;
+
+    cz::Vector<size_t> ignore_rules_offsets;
+    cz::Vector<version_control::Ignore_Rules> ignore_rules_rules;
+
+    /// Start walking the directory `root`.  A trailing `/` is ignored.
+    void init(cz::Str root);
+    void drop();
+
+    /// Go to the next file.  Returns `false` once every file has been visited.
+    bool next();
+
+    /// Get the path of the current file relative to the root.
+    cz::Str relpath() const { return path.slice_start(path_initial_len + 1); }
+};
+
+}
+}
@@ -1,18 +1,23 @@
 #include "find_file.hpp"
 
 #include <cz/arc.hpp>
+#include <cz/buffer_array.hpp>
+#include <cz/date.hpp>
 #include <cz/defer.hpp>
-#include <cz/directory.hpp>
 #include <cz/file.hpp>
 #include <cz/heap.hpp>
 #include <cz/mutex.hpp>
-#include <cz/path.hpp>
 #include <cz/process.hpp>
 #include <cz/sort.hpp>
 #include <cz/util.hpp>
+#include <tracy/Tracy.hpp>
 #include "core/command_macros.hpp"
+#include "core/completion_results_channel.hpp"
 #include "core/file.hpp"
+#include "core/job.hpp"
 #include "core/movement.hpp"
+#include "custom/config.hpp"
+#include "prose/file_walker.hpp"
 #include "prose/helpers.hpp"
 #include "syntax/tokenize_path.hpp"
 #include "version_control/ignore.hpp"
@@ -21,70 +26,164 @@ namespace mag {
 namespace prose {
 
 namespace find_file_ {
+/// The ignore rules of a directory along with the rules of every directory above it.
+struct Ignore_Chain {
+    cz::Arc<Ignore_Chain> parent;
+    /// The length of the relative path to the directory the rules were loaded from.
+    size_t offset;
+    version_control::Ignore_Rules rules;
+
+    void drop() {
+        rules.drop();
+        if (parent.is_not_null()) {
+            parent.drop();
+        }
+    }
+};
+
+struct Pending_Directory {
+    /// The path relative to the root.  Empty for the root and otherwise starts with a `/`.
+    cz::String relpath;
+    /// The rules of the directories above this one.
+    cz::Arc<Ignore_Chain> ignore;
+
+    void drop() {
+        relpath.drop(cz::heap_allocator());
+        if (ignore.is_not_null()) {
+            ignore.drop();
+        }
+    }
+};
+
+/// The files found by walking a directory tree.  Walks are cached
+/// so opening `find_file` again in the same directory is instant.
+struct Walk_Snapshot {
+    struct Directory_Time {
+        cz::Str relpath;
+        cz::File_Time file_time;
+    };
+
+    struct Ignore_File_Time {
+        /// The absolute path to the ignore file.
+        cz::Str path;
+        cz::File_Time file_time;
+    };
+
+    /// The absolute path to the root without a trailing `/`.
+    cz::String root;
+    cz::Vector<cz::Str> files;
+
+    /// Each directory that was listed and its modification time from before it was listed.
+    /// Adding, removing, or renaming an entry changes the time of its directory so
+    /// `files` is up to date as long as every directory still has the same time.
+    cz::Vector<Directory_Time> directories;
+
+    /// Each ignore file that was read and its modification time from before it was read.
+    /// Editing an ignore file in place doesn't change the time of its directory.
+    cz::Vector<Ignore_File_Time> ignore_files;
+
+    /// The strings of the jobs that walked the tree.
+    cz::Vector<cz::Buffer_Array> buffer_arrays;
+
+    void drop() {
+        for (size_t i = 0; i < buffer_arrays.len; ++i) {
+            buffer_arrays[i].drop();
+        }
+        buffer_arrays.drop(cz::heap_allocator());
+        ignore_files.drop(cz::heap_allocator());
+        directories.drop(cz::heap_allocator());
+        files.drop(cz::heap_allocator());
+        root.drop(cz::heap_allocator());
+    }
+};
+
 struct Find_File_Shared_Data {
     cz::Mutex mutex;
 
-    cz::Vector<cz::Vector<cz::Str> > results;
+    /// Each walk job pushes its results to its own channel.  Only used if `stream_results`
+    /// is set.  Set before the jobs start so the engine reads them without locking.
+    cz::Vector<Completion_Results_Channel*> channels;
+    bool stream_results;
+
+    /// Set when a walk that isn't streamed finishes.  The results
+    /// should be replaced with the files in `walk`.
+    bool replaced;
 
     bool finished;
 
-    cz::Buffer_Array results_buffer_array;
+    /// The walk in progress.  Results point into its `buffer_arrays`.
+    cz::Arc<Walk_Snapshot> walk;
+    cz::Vector<Pending_Directory> pending;
+    /// The number of jobs that are listing a directory.
+    size_t busy_jobs;
+    /// The number of jobs that haven't exited.
+    size_t running_jobs;
 
     void drop() {
         mutex.drop();
 
-        for (size_t i = 0; i < results.len; ++i) {
-            results[i].drop(cz::heap_allocator());
+        for (size_t i = 0; i < channels.len; ++i) {
+            channels[i]->drop();
+            cz::heap_allocator().dealloc(channels[i]);
         }
-        results.drop(cz::heap_allocator());
+        channels.drop(cz::heap_allocator());
 
-        results_buffer_array.drop();
-    }
-};
+        for (size_t i = 0; i < pending.len; ++i) {
+            pending[i].drop();
+        }
+        pending.drop(cz::heap_allocator());
 
-struct Directory {
-    cz::Vector<cz::Str> entries;
-    cz::Buffer_Array::Save_Point save_point;
+        if (walk.is_not_null()) {
+            walk.drop();
+        }
+    }
 };
 
-struct Find_File_Job_Data {
-    size_t path_initial_len;
-    cz::String path;
-
-    cz::Buffer_Array entries_buffer_array;
-    cz::Vector<Directory> directories;
+struct Walk_Job_Data {
+    cz::Arc_Weak<Find_File_Shared_Data> shared;
 
-    cz::Buffer_Array results_buffer_array;
+    /// Stores the results.  Moved into the snapshot when the job exits.
+    cz::Buffer_Array buffer_array;
 
-    bool already_started;
-    cz::Vector<size_t> ignore_rules_offsets;
-    cz::Vector<version_control::Ignore_Rules> ignore_rules_rules;
+    /// Where results are streamed to.  Owned by the shared data.
+    Completion_Results_Channel* channel;
+    /// Results that didn't fit in `channel` yet.
+    cz::Vector<cz::Str> unpublished;
 
-    cz::Arc_Weak<Find_File_Shared_Data> shared;
+    cz::String path;
+    cz::Vector<Directory_Entry> entries;
+    cz::Buffer_Array entries_buffer_array;
+    cz::Vector<Pending_Directory> found_directories;
 
     void drop() {
-        Find_File_Job_Data* data = this;
-
-        data->results_buffer_array.drop();
-
-        for (size_t i = 0; i < ignore_rules_rules.len; ++i) {
-            data->ignore_rules_rules[i].drop();
+        for (size_t i = 0; i < found_directories.len; ++i) {
+            found_directories[i].drop();
         }
-        data->ignore_rules_offsets.drop(cz::heap_allocator());
-        data->ignore_rules_rules.drop(cz::heap_allocator());
+        found_directories.drop(cz::heap_allocator());
+        unpublished.drop(cz::heap_allocator());
+        entries_buffer_array.drop();
+        entries.drop(cz::heap_allocator());
+        path.drop(cz::heap_allocator());
+        buffer_array.drop();
+    }
+};
 
-        for (size_t i = data->directories.len; i-- > 0;) {
-            (void)data->directories[i].entries.drop(cz::heap_allocator());
-        }
-        data->directories.drop(cz::heap_allocator());
+struct Validate_Job_Data {
+    cz::Arc_Weak<Find_File_Shared_Data> shared;
+    cz::Arc<Walk_Snapshot> snapshot;
+    size_t index;
+    cz::String path;
 
-        data->entries_buffer_array.drop();
-        data->path.drop(cz::heap_allocator());
+    void drop() {
+        path.drop(cz::heap_allocator());
+        snapshot.drop();
     }
 };
 
 struct Find_File_Completion_Engine_Data {
     cz::Arc<Find_File_Shared_Data> shared;
+    /// The cached walk whose files are shown.
+    cz::Arc<Walk_Snapshot> snapshot;
     cz::String path;
     bool finished;
 
@@ -92,162 +191,332 @@ struct Find_File_Completion_Engine_Data {
         if (shared.is_not_null()) {
             shared.drop();
         }
+        if (snapshot.is_not_null()) {
+            snapshot.drop();
+        }
         path.drop(cz::heap_allocator());
     }
 };
 }
 using namespace find_file_;
 
-static bool load_directory(Find_File_Job_Data* data) {
-    cz::Allocator entry_allocator = data->entries_buffer_array.allocator();
+/// Walks indexed by root.  Only used on the main thread.
+static cz::Vector<cz::Arc<Walk_Snapshot> > walk_cache;
 
-    // Get all files in the directory.
-    Directory directory;
-    directory.save_point = data->entries_buffer_array.save();
-    directory.entries = {};
-
-    cz::files(cz::heap_allocator(), entry_allocator, data->path.buffer, &directory.entries);
+static cz::Arc<Walk_Snapshot>* find_cached_walk(cz::Str root) {
+    for (size_t i = 0; i < walk_cache.len; ++i) {
+        if (walk_cache[i]->root == root) {
+            return &walk_cache[i];
+        }
+    }
+    return nullptr;
+}
 
-    // Then sort it into reverse order because we pop them from the end first.
-    cz::sort(directory.entries, [](cz::Str* left, cz::Str* right) { return *left > *right; });
-    data->directories.push(directory);
+/// Add `snapshot` to the cache, replacing the old walk of the same root.
+static void cache_walk(cz::Arc<Walk_Snapshot> snapshot) {
+    cz::Arc<Walk_Snapshot>* old = find_cached_walk(snapshot->root);
+    if (old) {
+        old->drop();
+        walk_cache.remove(old - walk_cache.elems);
+    }
 
-    // Load ignore rules.
-    version_control::Ignore_Rules rules = {};
-    version_control::find_ignore_rules(data->path.buffer, &rules);
-    data->ignore_rules_offsets.reserve(cz::heap_allocator(), 1);
-    data->ignore_rules_rules.reserve(cz::heap_allocator(), 1);
-    data->ignore_rules_offsets.push(data->path.len - data->path_initial_len);
-    data->ignore_rules_rules.push(rules);
+    walk_cache.reserve(cz::heap_allocator(), 1);
+    walk_cache.push(snapshot);
 
-    data->path.push('/');
+    // Evict the least recently walked roots.
+    while (walk_cache.len > custom::find_file_cache_roots) {
+        walk_cache[0].drop();
+        walk_cache.remove(0);
+    }
+}
 
-    return true;
+static Job_Tick_Result cache_walk_job_tick(Editor* editor, Client* client, void* _data) {
+    cz::Arc<Walk_Snapshot>* snapshot = (cz::Arc<Walk_Snapshot>*)_data;
+    cache_walk(*snapshot);
+    cz::heap_allocator().dealloc(snapshot);
+    return Job_Tick_Result::FINISHED;
 }
 
-static Job_Tick_Result find_file_job_tick(Asynchronous_Job_Handler* handler, void* _data) {
-    Find_File_Job_Data* data = (Find_File_Job_Data*)_data;
+static void cache_walk_job_kill(void* _data) {
+    cz::Arc<Walk_Snapshot>* snapshot = (cz::Arc<Walk_Snapshot>*)_data;
+    snapshot->drop();
+    cz::heap_allocator().dealloc(snapshot);
+}
 
-    // Try to acquire the shared data but don't lock it until later.  If it has
-    // been deleted then our results are no longer needed so we can delete them.
-    cz::Arc<Find_File_Shared_Data> shared;
-    if (!data->shared.upgrade(&shared)) {
-        data->drop();
-        cz::heap_allocator().dealloc(data);
-        return Job_Tick_Result::FINISHED;
+static size_t count_walk_jobs() {
+    if (custom::find_file_threads > 0) {
+        return custom::find_file_threads;
     }
-    CZ_DEFER(shared.drop());
-
-    // First iteration setup.
-    if (!data->already_started) {
-        data->already_started = true;
+    return count_background_threads();
+}
 
-        data->directories.reserve(cz::heap_allocator(), 32);
-        data->entries_buffer_array.init();
+/// List one directory.  Subdirectories are added to `data->found_directories`.
+static void walk_directory(Walk_Job_Data* data,
+                           Walk_Snapshot* walk,
+                           const Pending_Directory& directory,
+                           cz::Vector<cz::Str>* results,
+                           cz::Vector<Walk_Snapshot::Directory_Time>* directory_times,
+                           cz::Vector<Walk_Snapshot::Ignore_File_Time>* ignore_times) {
+    ZoneScoped;
+
+    data->path.len = 0;
+    data->path.reserve(cz::heap_allocator(), walk->root.len + directory.relpath.len + 1);
+    data->path.append(walk->root);
+    data->path.append(directory.relpath);
+    data->path.null_terminate();
+
+    // Get the time first so changes made while listing the directory are noticed.
+    Walk_Snapshot::Directory_Time directory_time;
+    if (!cz::get_file_time(data->path.buffer, &directory_time.file_time)) {
+        return;
+    }
 
-        data->results_buffer_array.init();
+    data->entries.len = 0;
+    data->entries_buffer_array.clear();
+    if (!read_directory(data->path.buffer, data->entries_buffer_array.allocator(),
+                        &data->entries)) {
+        return;
+    }
 
-        // Load first directory.
-        if (!load_directory(data)) {
-            {
-                shared->mutex.lock();
-                CZ_DEFER(shared->mutex.unlock());
+    directory_time.relpath = directory.relpath.clone(data->buffer_array.allocator());
+    directory_times->reserve(cz::heap_allocator(), 1);
+    directory_times->push(directory_time);
 
-                shared->finished = true;
-            }
+    // Get the times of the ignore files before they are read too.
+    for (size_t i = 0; i < data->entries.len; ++i) {
+        const Directory_Entry& entry = data->entries[i];
+        if (entry.is_directory || !version_control::is_ignore_file(entry.name)) {
+            continue;
+        }
 
-            data->drop();
-            cz::heap_allocator().dealloc(data);
-            return Job_Tick_Result::FINISHED;
+        cz::String path = {};
+        path.reserve_exact(data->buffer_array.allocator(), data->path.len + entry.name.len + 2);
+        path.append(data->path);
+        path.push('/');
+        path.append(entry.name);
+        path.null_terminate();
+
+        Walk_Snapshot::Ignore_File_Time ignore_time;
+        ignore_time.path = path;
+        if (cz::get_file_time(path.buffer, &ignore_time.file_time)) {
+            ignore_times->reserve(cz::heap_allocator(), 1);
+            ignore_times->push(ignore_time);
         }
     }
 
-    cz::Vector<cz::Str> results = {};
-    results.reserve(cz::heap_allocator(), 128);
+    cz::Arc<Ignore_Chain> ignore;
+    ignore.init_copy({});
+    CZ_DEFER(ignore.drop());
+    if (directory.ignore.is_not_null()) {
+        ignore->parent = directory.ignore.clone();
+    }
+    ignore->offset = directory.relpath.len;
+    version_control::find_ignore_rules(data->path, &ignore->rules);
 
-    while (results.remaining() > 0) {
-    next_file:
-        // Pop empty entries.
-        while (data->directories.len > 0 && data->directories.last().entries.len == 0) {
-            // Pop last name and trailing `/`.  Ex. `/home/abc/` -> `/home/`.
-            data->path.pop();
-            cz::path::pop_name(&data->path);
+    cz::String relpath = {};
+    CZ_DEFER(relpath.drop(cz::heap_allocator()));
 
-            // Delete the ignore rules for the directory.
-            data->ignore_rules_offsets.pop();
-            data->ignore_rules_rules.last().drop();
-            data->ignore_rules_rules.pop();
+    for (size_t i = 0; i < data->entries.len; ++i) {
+        const Directory_Entry& entry = data->entries[i];
 
-            // Cleanup the directory.
-            Directory directory = data->directories.pop();
-            data->entries_buffer_array.restore(directory.save_point);
-            directory.entries.drop(cz::heap_allocator());
+        relpath.len = 0;
+        relpath.reserve(cz::heap_allocator(), directory.relpath.len + entry.name.len + 1);
+        relpath.append(directory.relpath);
+        relpath.push('/');
+        relpath.append(entry.name);
+
+        // Skip ignored files.
+        bool ignored = false;
+        for (const Ignore_Chain* rules = ignore.get();;) {
+            if (version_control::file_matches(rules->rules, relpath.slice_start(rules->offset))) {
+                ignored = true;
+                break;
+            }
+            if (rules->parent.is_null()) {
+                break;
+            }
+            rules = rules->parent.get();
+        }
+        if (ignored) {
+            continue;
         }
 
-        // Test if we're completely done.
-        if (data->directories.len == 0) {
-            break;
+        // Symlinks aren't followed so they are listed as files.
+        if (entry.is_directory) {
+            Pending_Directory found;
+            found.relpath = relpath.clone(cz::heap_allocator());
+            found.ignore = ignore.clone();
+            data->found_directories.reserve(cz::heap_allocator(), 1);
+            data->found_directories.push(found);
+        } else {
+            results->reserve(cz::heap_allocator(), 1);
+            results->push(relpath.slice_start(1).clone(data->buffer_array.allocator()));
         }
+    }
+}
 
-        const size_t old_len = data->path.len;
+/// Exit a walk job once there are no directories left.
+static void walk_job_exit(Asynchronous_Job_Handler* handler,
+                          Walk_Job_Data* data,
+                          Find_File_Shared_Data* shared) {
+    Walk_Snapshot* walk = shared->walk.get();
 
-        // Get the absolute path to this entry.
-        cz::Str entry = data->directories.last().entries.pop();
-        data->path.reserve(cz::heap_allocator(), entry.len + 2);
-        data->path.append(entry);
-        data->path.null_terminate();
+    bool last;
+    {
+        shared->mutex.lock();
+        CZ_DEFER(shared->mutex.unlock());
 
-        // Skip ignored files.
-        for (size_t i = 0; i < data->ignore_rules_rules.len; ++i) {
-            cz::Str relpath =
-                data->path.slice_start(data->path_initial_len + data->ignore_rules_offsets[i]);
-            if (version_control::file_matches(data->ignore_rules_rules[i], relpath)) {
-                data->path.len = old_len;
-                goto next_file;
-            }
-        }
+        walk->buffer_arrays.reserve(cz::heap_allocator(), 1);
+        walk->buffer_arrays.push(data->buffer_array);
+        data->buffer_array = {};
 
-        // Non-directories are listed literally.  Don't follow symlinks so count them as files.
-        if (!cz::file::is_directory_and_not_symlink(data->path.buffer) ||
-            data->directories.remaining() == 0) {
-            cz::Str result = data->path.slice_start(data->path_initial_len + 1);
-            results.push(result.clone(data->results_buffer_array.allocator()));
-            data->path.len = old_len;
-            continue;
-        }
+        last = (--shared->running_jobs == 0);
+    }
+
+    data->drop();
+    cz::heap_allocator().dealloc(data);
 
-        // Reached a directory entry so load it.
-        // If loading fails we just ignore it and go to the next directory.
-        (void)load_directory(data);
+    if (!last) {
+        return;
+    }
+
+    // The last job to exit publishes the walk.  Nothing else reads
+    // `walk->files` until `finished` is set so sort it without locking.
+    cz::sort(walk->files);
+
+    if (custom::find_file_cache_roots > 0) {
+        cz::Arc<Walk_Snapshot>* snapshot = cz::heap_allocator().alloc<cz::Arc<Walk_Snapshot> >();
+        CZ_ASSERT(snapshot);
+        *snapshot = shared->walk.clone();
+
+        Synchronous_Job job;
+        job.tick = cache_walk_job_tick;
+        job.kill = cache_walk_job_kill;
+        job.data = snapshot;
+        handler->add_synchronous_job(job);
     }
 
     shared->mutex.lock();
     CZ_DEFER(shared->mutex.unlock());
+    shared->finished = true;
+    shared->replaced = !shared->stream_results;
+}
 
-    Job_Tick_Result result = Job_Tick_Result::MADE_PROGRESS;
+static Job_Tick_Result walk_job_tick(Asynchronous_Job_Handler* handler, void* _data) {
+    ZoneScoped;
 
-    // If we stop early then we are done.
-    if (results.remaining() > 0) {
-        shared->finished = true;
-        cz::swap(shared->results_buffer_array, data->results_buffer_array);
+    Walk_Job_Data* data = (Walk_Job_Data*)_data;
+
+    // If the dialog has been closed then the results are no longer needed.
+    cz::Arc<Find_File_Shared_Data> shared;
+    if (!data->shared.upgrade(&shared)) {
         data->drop();
         cz::heap_allocator().dealloc(data);
-        result = Job_Tick_Result::FINISHED;
+        return Job_Tick_Result::FINISHED;
+    }
+    CZ_DEFER(shared.drop());
+
+    // The root and the ownership of the snapshot don't change until the last job exits.
+    Walk_Snapshot* walk = shared->walk.get();
+
+    cz::Vector<cz::Str> results = {};
+    CZ_DEFER(results.drop(cz::heap_allocator()));
+    cz::Vector<Walk_Snapshot::Directory_Time> directory_times = {};
+    CZ_DEFER(directory_times.drop(cz::heap_allocator()));
+    cz::Vector<Walk_Snapshot::Ignore_File_Time> ignore_times = {};
+    CZ_DEFER(ignore_times.drop(cz::heap_allocator()));
+
+    bool busy = false;
+    for (size_t directories = 0; directories < 64 && results.len < 4096; ++directories) {
+        Pending_Directory directory;
+        {
+            shared->mutex.lock();
+            CZ_DEFER(shared->mutex.unlock());
+
+            // Publish the directories found last time so other jobs can start on them.
+            shared->pending.reserve(cz::heap_allocator(), data->found_directories.len);
+            shared->pending.append(data->found_directories);
+            data->found_directories.len = 0;
+
+            if (busy) {
+                --shared->busy_jobs;
+                busy = false;
+            }
+
+            if (shared->pending.len == 0) {
+                break;
+            }
+
+            directory = shared->pending.pop();
+            ++shared->busy_jobs;
+            busy = true;
+        }
+
+        walk_directory(data, walk, directory, &results, &directory_times, &ignore_times);
+        directory.drop();
     }
 
-    // If there are results then push them.
-    if (results.len > 0) {
-        shared->results.reserve(cz::heap_allocator(), 1);
-        shared->results.push(results);
-    } else {
-        results.drop(cz::heap_allocator());
+    bool exit = false;
+    bool waiting = false;
+    bool stream_results;
+    {
+        shared->mutex.lock();
+        CZ_DEFER(shared->mutex.unlock());
+
+        if (busy) {
+            shared->pending.reserve(cz::heap_allocator(), data->found_directories.len);
+            shared->pending.append(data->found_directories);
+            data->found_directories.len = 0;
+            --shared->busy_jobs;
+        }
+
+        walk->directories.reserve(cz::heap_allocator(), directory_times.len);
+        walk->directories.append(directory_times);
+        walk->ignore_files.reserve(cz::heap_allocator(), ignore_times.len);
+        walk->ignore_files.append(ignore_times);
+        walk->files.reserve(cz::heap_allocator(), results.len);
+        walk->files.append(results);
+        stream_results = shared->stream_results;
+
+        if (shared->pending.len == 0) {
+            // Another job is listing a directory that may have subdirectories.
+            if (shared->busy_jobs > 0) {
+                waiting = true;
+            } else {
+                exit = true;
+            }
+        }
     }
 
-    return result;
+    if (stream_results) {
+        if (data->unpublished.len == 0) {
+            data->unpublished = results;
+            results = {};
+        } else {
+            data->unpublished.reserve(cz::heap_allocator(), results.len);
+            data->unpublished.append(results);
+        }
+
+        // If the channel is full then keep the results until the engine catches up.
+        if (data->unpublished.len > 0) {
+            data->channel->push(&data->unpublished);
+        }
+    }
+
+    if (exit) {
+        // Push every result before exiting so the engine has them all once the walk finishes.
+        if (data->unpublished.len > 0) {
+            return Job_Tick_Result::STALLED;
+        }
+        walk_job_exit(handler, data, shared.get());
+        return Job_Tick_Result::FINISHED;
+    }
+
+    return waiting ? Job_Tick_Result::STALLED : Job_Tick_Result::MADE_PROGRESS;
 }
 
-static void find_file_job_kill(void* _data) {
-    Find_File_Job_Data* data = (Find_File_Job_Data*)_data;
+static void walk_job_kill(void* _data) {
+    Walk_Job_Data* data = (Walk_Job_Data*)_data;
 
     // If the shared state is still alive then mark ourselves as done.
     cz::Arc<Find_File_Shared_Data> shared;
@@ -264,6 +533,144 @@ static void find_file_job_kill(void* _data) {
     cz::heap_allocator().dealloc(data);
 }
 
+/// Start walking `root`.  `shared` must be locked if any jobs could be using it.
+static void start_walk(Find_File_Shared_Data* shared,
+                       const cz::Arc<Find_File_Shared_Data>& shared_arc,
+                       cz::Str root,
+                       cz::Vector<Asynchronous_Job>* jobs) {
+    shared->walk.init_copy({});
+    Walk_Snapshot* walk = shared->walk.get();
+    walk->root = root.clone_null_terminate(cz::heap_allocator());
+
+    // Every directory also uses the ignore files in the home directory.
+    cz::Buffer_Array buffer_array;
+    buffer_array.init();
+    cz::Vector<cz::Str> global_ignore_files = {};
+    CZ_DEFER(global_ignore_files.drop(cz::heap_allocator()));
+    version_control::get_global_ignore_files(buffer_array.allocator(), &global_ignore_files);
+    for (size_t i = 0; i < global_ignore_files.len; ++i) {
+        Walk_Snapshot::Ignore_File_Time ignore_time;
+        ignore_time.path = global_ignore_files[i];
+        if (cz::get_file_time(ignore_time.path.buffer, &ignore_time.file_time)) {
+            walk->ignore_files.reserve(cz::heap_allocator(), 1);
+            walk->ignore_files.push(ignore_time);
+        }
+    }
+    walk->buffer_arrays.reserve(cz::heap_allocator(), 1);
+    walk->buffer_arrays.push(buffer_array);
+
+    Pending_Directory directory = {};
+    shared->pending.reserve(cz::heap_allocator(), 1);
+    shared->pending.push(directory);
+
+    size_t count = count_walk_jobs();
+    shared->running_jobs = count;
+    jobs->reserve(cz::heap_allocator(), count);
+    for (size_t i = 0; i < count; ++i) {
+        Walk_Job_Data* data = cz::heap_allocator().alloc<Walk_Job_Data>();
+        CZ_ASSERT(data);
+        *data = {};
+        data->shared = shared_arc.clone_downgrade();
+        data->buffer_array.init();
+        data->entries_buffer_array.init();
+
+        if (shared->stream_results) {
+            Completion_Results_Channel* channel =
+                cz::heap_allocator().alloc<Completion_Results_Channel>();
+            CZ_ASSERT(channel);
+            channel->init();
+            shared->channels.reserve(cz::heap_allocator(), 1);
+            shared->channels.push(channel);
+            data->channel = channel;
+        }
+
+        Asynchronous_Job job;
+        job.tick = walk_job_tick;
+        job.kill = walk_job_kill;
+        job.data = data;
+        jobs->push(job);
+    }
+}
+
+/// Check if the cached walk is out of date and if so walk the tree again.
+static Job_Tick_Result validate_job_tick(Asynchronous_Job_Handler* handler, void* _data) {
+    ZoneScoped;
+
+    Validate_Job_Data* data = (Validate_Job_Data*)_data;
+
+    cz::Arc<Find_File_Shared_Data> shared;
+    if (!data->shared.upgrade(&shared)) {
+        data->drop();
+        cz::heap_allocator().dealloc(data);
+        return Job_Tick_Result::FINISHED;
+    }
+    CZ_DEFER(shared.drop());
+
+    // Check the directories and then the ignore files.
+    const Walk_Snapshot* snapshot = data->snapshot.get();
+    size_t count = snapshot->directories.len + snapshot->ignore_files.len;
+    bool changed = false;
+    for (size_t i = 0; i < 1024 && data->index < count; ++i) {
+        size_t index = data->index++;
+        cz::File_Time expected;
+        data->path.len = 0;
+        if (index < snapshot->directories.len) {
+            const Walk_Snapshot::Directory_Time& directory = snapshot->directories[index];
+            data->path.reserve(cz::heap_allocator(),
+                               snapshot->root.len + directory.relpath.len + 1);
+            data->path.append(snapshot->root);
+            data->path.append(directory.relpath);
+            expected = directory.file_time;
+        } else {
+            const Walk_Snapshot::Ignore_File_Time& ignore_file =
+                snapshot->ignore_files[index - snapshot->directories.len];
+            data->path.reserve(cz::heap_allocator(), ignore_file.path.len + 1);
+            data->path.append(ignore_file.path);
+            expected = ignore_file.file_time;
+        }
+        data->path.null_terminate();
+
+        cz::File_Time file_time;
+        if (!cz::get_file_time(data->path.buffer, &file_time) ||
+            cz::is_file_time_before(file_time, expected) ||
+            cz::is_file_time_before(expected, file_time)) {
+            changed = true;
+            break;
+        }
+    }
+
+    if (!changed && data->index < count) {
+        return Job_Tick_Result::MADE_PROGRESS;
+    }
+
+    cz::Vector<Asynchronous_Job> jobs = {};
+    CZ_DEFER(jobs.drop(cz::heap_allocator()));
+    {
+        shared->mutex.lock();
+        CZ_DEFER(shared->mutex.unlock());
+
+        if (changed) {
+            start_walk(shared.get(), shared, snapshot->root, &jobs);
+        } else {
+            shared->finished = true;
+        }
+    }
+
+    for (size_t i = 0; i < jobs.len; ++i) {
+        handler->add_asynchronous_job(jobs[i]);
+    }
+
+    data->drop();
+    cz::heap_allocator().dealloc(data);
+    return Job_Tick_Result::FINISHED;
+}
+
+static void validate_job_kill(void* _data) {
+    Validate_Job_Data* data = (Validate_Job_Data*)_data;
+    data->drop();
+    cz::heap_allocator().dealloc(data);
+}
+
 static bool find_file_completion_engine(Editor* editor,
                                         Completion_Engine_Context* context,
                                         bool is_initial_frame) {
@@ -275,27 +682,51 @@ static bool find_file_completion_engine(Editor* editor,
         if (data->shared.is_not_null()) {
             data->shared.drop();
         }
+        if (data->snapshot.is_not_null()) {
+            data->snapshot.drop();
+            data->snapshot = {};
+        }
 
         data->shared.init_copy({});
         data->shared->mutex.init();
-        data->shared->results_buffer_array.init();
-
-        Find_File_Job_Data* job_data = cz::heap_allocator().alloc<Find_File_Job_Data>();
-        CZ_ASSERT(job_data);
-        *job_data = {};
-        job_data->path_initial_len = data->path.len;
-        job_data->path = data->path.clone_null_terminate(cz::heap_allocator());
-        job_data->shared = data->shared.clone_downgrade();
-        job_data->entries_buffer_array.init();
-
-        Asynchronous_Job job;
-        job.tick = find_file_job_tick;
-        job.kill = find_file_job_kill;
-        job.data = job_data;
-        editor->add_asynchronous_job(job);
+        data->finished = false;
 
         context->results_buffer_array.clear();
         context->results.len = 0;
+
+        cz::Str root = data->path;
+        if (root.ends_with('/')) {
+            root.len--;
+        }
+
+        cz::Arc<Walk_Snapshot>* cached = find_cached_walk(root);
+        if (cached) {
+            // Show the cached files immediately and then check if they are out of date.
+            data->snapshot = cached->clone();
+            context->results.reserve(data->snapshot->files.len);
+            context->results.append(data->snapshot->files);
+
+            Validate_Job_Data* job_data = cz::heap_allocator().alloc<Validate_Job_Data>();
+            CZ_ASSERT(job_data);
+            *job_data = {};
+            job_data->shared = data->shared.clone_downgrade();
+            job_data->snapshot = cached->clone();
+
+            Asynchronous_Job job;
+            job.tick = validate_job_tick;
+            job.kill = validate_job_kill;
+            job.data = job_data;
+            editor->add_asynchronous_job(job);
+            return true;
+        }
+
+        cz::Vector<Asynchronous_Job> jobs = {};
+        CZ_DEFER(jobs.drop(cz::heap_allocator()));
+        data->shared->stream_results = true;
+        start_walk(data->shared.get(), data->shared, root, &jobs);
+        for (size_t i = 0; i < jobs.len; ++i) {
+            editor->add_asynchronous_job(jobs[i]);
+        }
     }
 
     if (data->finished) {
@@ -306,31 +737,40 @@ static bool find_file_completion_engine(Editor* editor,
     cz::Arc<Find_File_Shared_Data> shared = data->shared.clone();
     CZ_DEFER(shared.drop());
 
-    shared->mutex.lock();
-    CZ_DEFER(shared->mutex.unlock());
-
     bool changes = false;
+    bool finished;
+    {
+        shared->mutex.lock();
+        CZ_DEFER(shared->mutex.unlock());
 
-    cz::Slice<cz::Vector<cz::Str> > results = shared->results;
-    if (results.len > 0) {
-        changes = true;
-
-        size_t total = 0;
-        for (size_t i = 0; i < results.len; ++i) {
-            total += results[i].len;
-        }
+        // The cached files were out of date so show the new ones instead.
+        if (shared->replaced) {
+            changes = true;
+            shared->replaced = false;
 
-        context->results.reserve(total);
+            if (data->snapshot.is_not_null()) {
+                data->snapshot.drop();
+            }
+            data->snapshot = shared->walk.clone();
 
-        for (size_t i = 0; i < results.len; ++i) {
-            context->results.append(results[i]);
-            results[i].drop(cz::heap_allocator());
+            context->results.len = 0;
+            context->results.reserve(data->snapshot->files.len);
+            context->results.append(data->snapshot->files);
         }
 
-        shared->results.len = 0;
+        finished = shared->finished;
+    }
+
+    // Jobs push all their results before exiting so if
+    // the walk is finished then every result is taken here.
+    bool appended = false;
+    for (size_t i = 0; i < shared->channels.len; ++i) {
+        appended |= shared->channels[i]->pop_all(&context->results);
     }
+    context->results_appended = appended && !changes;
+    changes |= appended;
 
-    if (shared->finished) {
+    if (finished) {
         data->finished = true;
     }
 
@@ -418,7 +858,7 @@ static bool diff_master_completion_engine(Editor* editor,
 #ifdef _WIN32
     options.hide_window = true;
 #endif
-    return data->runner.iterate(context, args, options, is_initial_frame);
+    return data->runner.iterate(editor, context, args, options, is_initial_frame);
 }
 
 REGISTER_COMMAND(command_find_file_diff_master);
@@ -4,11 +4,18 @@
 #include <cz/file.hpp>
 #include <cz/heap_string.hpp>
 #include <cz/heap_vector.hpp>
+#include <cz/process.hpp>
+#include "basic/search_buffer_commands.hpp"
 #include "core/command_macros.hpp"
 #include "core/file.hpp"
+#include "core/job.hpp"
+#include "core/jump.hpp"
 #include "core/movement.hpp"
 #include "core/token.hpp"
+#include "core/window.hpp"
+#include "custom/config.hpp"
 #include "prose/helpers.hpp"
+#include "prose/search_engine.hpp"
 
 namespace mag {
 namespace prose {
@@ -16,6 +23,78 @@ namespace prose {
 static char empty_file_path[L_tmpnam];
 static void ensure_has_empty_file();
 
+namespace search_ {
+/// The parameters of a search ran in process so it can be reloaded.
+struct Search_Record {
+    cz::Arc_Weak<Buffer_Handle> buffer_handle;
+    cz::String directory;
+    cz::String query;
+    bool query_word;
+    bool has_file;
+    cz::String file;
+
+    void drop() {
+        buffer_handle.drop();
+        directory.drop(cz::heap_allocator());
+        query.drop(cz::heap_allocator());
+        file.drop(cz::heap_allocator());
+    }
+};
+}
+using namespace search_;
+
+static cz::Vector<Search_Record> search_records;
+
+static Search_Record* find_search_record(const cz::Arc<Buffer_Handle>& handle) {
+    for (size_t i = 0; i < search_records.len; ++i) {
+        if (search_records[i].buffer_handle.ptr_equal(handle)) {
+            return &search_records[i];
+        }
+    }
+    return nullptr;
+}
+
+static void record_search(const cz::Arc<Buffer_Handle>& handle,
+                          cz::Str directory,
+                          cz::Str query,
+                          bool query_word,
+                          const cz::String* file) {
+    // Clean up the records of killed buffers.
+    for (size_t i = search_records.len; i-- > 0;) {
+        if (!search_records[i].buffer_handle.still_alive()) {
+            search_records[i].drop();
+            search_records.remove(i);
+        }
+    }
+
+    Search_Record* record = find_search_record(handle);
+    if (record) {
+        record->drop();
+    } else {
+        search_records.reserve(cz::heap_allocator(), 1);
+        search_records.push({});
+        record = &search_records.last();
+    }
+
+    record->buffer_handle = handle.clone_downgrade();
+    record->directory = directory.clone_null_terminate(cz::heap_allocator());
+    record->query = query.clone(cz::heap_allocator());
+    record->query_word = query_word;
+    record->has_file = file != nullptr;
+    record->file = file ? file->clone(cz::heap_allocator()) : cz::String{};
+}
+
+static void start_recorded_search(Editor* editor,
+                                  const cz::Arc<Buffer_Handle>& handle,
+                                  const Search_Record& record) {
+    cz::Option<cz::Str> file;
+    if (record.has_file) {
+        file = record.file.as_str();
+    }
+    start_search(editor, handle, record.directory, record.query, record.query_word, file,
+                 job_run_console_command_callback(handle.clone_downgrade()));
+}
+
 void run_search(Client* client,
                 Editor* editor,
                 const char* directory,
@@ -53,7 +132,66 @@ void run_search(Client* client,
 
     client->close_fused_paired_windows();
 
-    run_console_command(client, editor, directory, args, buffer_name);
+    if (custom::search_with_ag) {
+        run_console_command(client, editor, directory, args, buffer_name);
+        return;
+    }
+
+    // Search in process but set up the buffer the same way `run_console_command` does.  The
+    // first line is the equivalent `ag` command so the buffer looks the same either way.
+    cz::String working_directory = standardize_path(cz::heap_allocator(), directory);
+    CZ_DEFER(working_directory.drop(cz::heap_allocator()));
+
+    cz::String script = {};
+    CZ_DEFER(script.drop(cz::heap_allocator()));
+    cz::Process::escape_args(args, &script, cz::heap_allocator());
+
+    // Stop the previous search before clearing its results.
+    cz::Arc<Buffer_Handle> handle;
+    setup_console_command_buffer(client, editor, working_directory.as_str(), script, buffer_name,
+                                 &handle, cancel_search);
+
+    record_search(handle, working_directory, query, query_word, file);
+    start_recorded_search(editor, handle, *find_search_record(handle));
+}
+
+REGISTER_COMMAND(command_search_reload);
+void command_search_reload(Editor* editor, Command_Source source) {
+    Window_Unified* window = source.client->selected_window();
+    cz::Arc<Buffer_Handle> handle = window->buffer_handle;
+
+    Search_Record* record = find_search_record(handle);
+
+    // Searches ran with `ag` are reloaded by rerunning the first line.
+    if (!record) {
+        basic::command_search_buffer_reload(editor, source);
+        return;
+    }
+
+    // Stop the previous search before clearing its results.
+    cancel_search(handle);
+
+    {
+        WITH_BUFFER_HANDLE(handle);
+        window->update_cursors(buffer, source.client);
+
+        // Delete everything after the first line.
+        Contents_Iterator end = buffer->contents.start();
+        end_of_line(&end);
+        if (end.at_eob()) {
+            buffer->contents.append("\n");
+        } else {
+            end.advance();
+            buffer->token_cache.reset(buffer);
+            buffer->contents.remove(end.position, buffer->contents.len - end.position);
+        }
+
+        kill_extra_cursors(window, source.client);
+        window->cursors[0].point = window->cursors[0].mark = buffer->contents.len;
+        window->show_marks = false;
+    }
+
+    start_recorded_search(editor, handle, *record);
 }
 
 template <bool copy_directory(Client*, cz::Str, cz::String*), bool query_word>
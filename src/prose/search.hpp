@@ -13,6 +13,10 @@ void run_search(Client* client,
                 bool query_word,
                 const cz::String* file = nullptr);
 
+/// Reload a search buffer.  Searches ran in process are ran again, otherwise
+/// this falls back to `basic::command_search_buffer_reload`.
+void command_search_reload(Editor* editor, Command_Source source);
+
 void command_search_in_current_directory_prompt(Editor* editor, Command_Source source);
 void command_search_in_current_directory_token_at_position(Editor* editor, Command_Source source);
 void command_search_in_current_directory_word_prompt(Editor* editor, Command_Source source);
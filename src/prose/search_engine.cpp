@@ -0,0 +1,706 @@
+#include "search_engine.hpp"
+
+#include <string.h>
+#include <cz/buffer_array.hpp>
+#include <cz/char_type.hpp>
+#include <cz/defer.hpp>
+#include <cz/file.hpp>
+#include <cz/format.hpp>
+#include <cz/heap.hpp>
+#include <cz/mutex.hpp>
+#include <cz/sort.hpp>
+#include <cz/util.hpp>
+#include <tracy/Tracy.hpp>
+#include "core/buffer.hpp"
+#include "core/buffer_handle.hpp"
+#include "core/byte_search.hpp"
+#include "core/editor.hpp"
+#include "core/file.hpp"
+#include "custom/config.hpp"
+#include "prose/file_walker.hpp"
+#include "prose/trigram_index.hpp"
+
+namespace mag {
+namespace prose {
+
+////////////////////////////////////////////////////////////////////////////////
+// Searching text
+////////////////////////////////////////////////////////////////////////////////
+
+static bool is_word_char(char ch) {
+    return cz::is_alnum(ch) || ch == '_';
+}
+
+/// Emulates `\b` around the query in `ag --word-regexp`.
+static bool is_word_match(cz::Str text, const char* match, cz::Str query) {
+    bool before = match > text.buffer && is_word_char(match[-1]);
+    if (before == is_word_char(query[0])) {
+        return false;
+    }
+
+    const char* end = match + query.len;
+    bool after = end < text.end() && is_word_char(*end);
+    if (after == is_word_char(query.last())) {
+        return false;
+    }
+
+    return true;
+}
+
+static size_t count_newlines(const char* start, const char* end) {
+    size_t count = 0;
+    while (1) {
+        start = (const char*)memchr(start, '\n', end - start);
+        if (!start) {
+            return count;
+        }
+        ++count;
+        ++start;
+    }
+}
+
+void search_text(cz::Str relpath,
+                 cz::Str text,
+                 cz::Str query,
+                 bool query_word,
+                 cz::String* output) {
+    ZoneScoped;
+
+    if (query.len == 0) {
+        return;
+    }
+
+    uint64_t line_number = 1;
+    const char* counted = text.buffer;
+    const char* position = text.buffer;
+    while (1) {
+        const char* match = find_substring(position, text.end() - position, query);
+        if (!match) {
+            break;
+        }
+
+        if (query_word && !is_word_match(text, match, query)) {
+            position = match + 1;
+            continue;
+        }
+
+        line_number += count_newlines(counted, match);
+
+        cz::Str before = text.slice_end(match);
+        const char* line_start = before.rfind('\n');
+        line_start = line_start ? line_start + 1 : text.buffer;
+
+        const char* line_end = text.slice_start(match).find('\n');
+        if (!line_end) {
+            line_end = text.end();
+        }
+
+        cz::Str line = text.slice(line_start, line_end);
+        uint64_t column = match - line_start + 1;
+        cz::append(cz::heap_allocator(), output, relpath, ':', line_number, ':', column, ':',
+                   line, '\n');
+
+        // Only report each line once.
+        if (line_end == text.end()) {
+            break;
+        }
+        counted = line_end;
+        position = line_end + 1;
+    }
+}
+
+bool looks_binary(cz::Str text) {
+    return memchr(text.buffer, '\0', cz::min(text.len, (size_t)512)) != nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Shared state
+////////////////////////////////////////////////////////////////////////////////
+
+namespace search_engine_ {
+/// The contents of a buffer with unsaved changes.
+struct Snapshot {
+    cz::String relpath;
+    cz::String contents;
+};
+
+struct Search_Shared {
+    cz::Mutex mutex;
+
+    // These are immutable once the search starts.
+    cz::String directory;
+    cz::String query;
+    bool query_word;
+    cz::Vector<Snapshot> snapshots;
+    cz::Arc_Weak<Buffer_Handle> handle;
+    /// If the trigram index was used then the candidates it found (sorted and queued when the
+    /// search starts) and the files it covers (sorted by path).  The walk only queues the
+    /// other files and the files that changed since the index was built.
+    bool use_index;
+    cz::Vector<cz::Str> candidates;
+    cz::Vector<Trigram_Index::File> indexed_files;
+    cz::Buffer_Array index_buffer_array;
+
+    // These are protected by `mutex`.
+    /// Relative paths of files that still need to be searched.
+    cz::Vector<cz::Str> paths;
+    cz::Buffer_Array paths_buffer_array;
+    bool walk_finished;
+    bool cancelled;
+    size_t running_jobs;
+    Synchronous_Job callback;
+    bool ran_callback;
+
+    void drop() {
+        mutex.drop();
+        directory.drop(cz::heap_allocator());
+        query.drop(cz::heap_allocator());
+        for (size_t i = 0; i < snapshots.len; ++i) {
+            snapshots[i].relpath.drop(cz::heap_allocator());
+            snapshots[i].contents.drop(cz::heap_allocator());
+        }
+        snapshots.drop(cz::heap_allocator());
+        handle.drop();
+        candidates.drop(cz::heap_allocator());
+        indexed_files.drop(cz::heap_allocator());
+        index_buffer_array.drop();
+        paths.drop(cz::heap_allocator());
+        paths_buffer_array.drop();
+        if (!ran_callback) {
+            callback.kill(callback.data);
+        }
+    }
+
+    const Snapshot* find_snapshot(cz::Str relpath) const {
+        for (size_t i = 0; i < snapshots.len; ++i) {
+            if (snapshots[i].relpath == relpath) {
+                return &snapshots[i];
+            }
+        }
+        return nullptr;
+    }
+
+    /// Returns `true` if `relpath` was queued as a candidate or if the index
+    /// knows it doesn't contain the query.  `path` is its absolute path.
+    bool covered_by_index(cz::Str relpath, const char* path) const {
+        size_t start = 0;
+        size_t end = candidates.len;
+        while (start < end) {
+            size_t mid = (start + end) / 2;
+            if (candidates[mid] < relpath) {
+                start = mid + 1;
+            } else {
+                end = mid;
+            }
+        }
+        if (start < candidates.len && candidates[start] == relpath) {
+            return true;
+        }
+
+        start = 0;
+        end = indexed_files.len;
+        while (start < end) {
+            size_t mid = (start + end) / 2;
+            if (indexed_files[mid].path < relpath) {
+                start = mid + 1;
+            } else {
+                end = mid;
+            }
+        }
+        if (start == indexed_files.len || indexed_files[start].path != relpath) {
+            return false;
+        }
+
+        cz::File_Time file_time;
+        return cz::get_file_time(path, &file_time) &&
+               file_times_equal(indexed_files[start].file_time, file_time);
+    }
+};
+
+struct Running_Search {
+    const Buffer_Handle* key;
+    cz::Arc_Weak<Search_Shared> shared;
+};
+}
+using namespace search_engine_;
+
+/// Searches that may still be running.  Only accessed on the main thread.
+static cz::Vector<Running_Search> running_searches;
+
+static bool is_cancelled(Search_Shared* shared) {
+    shared->mutex.lock();
+    CZ_DEFER(shared->mutex.unlock());
+    return shared->cancelled;
+}
+
+/// Called when a job exits.  The last job to exit runs the callback.
+static void finish_job(Search_Shared* shared, Asynchronous_Job_Handler* handler) {
+    shared->mutex.lock();
+    CZ_DEFER(shared->mutex.unlock());
+
+    --shared->running_jobs;
+    if (shared->running_jobs == 0 && handler && !shared->cancelled) {
+        shared->ran_callback = true;
+        handler->add_synchronous_job(shared->callback);
+    }
+}
+
+/// Append `output` to the end of the buffer.  Returns `false` if the search should stop.
+static bool flush_output(Search_Shared* shared, cz::String* output) {
+    if (output->len == 0) {
+        return !is_cancelled(shared);
+    }
+
+    cz::Arc<Buffer_Handle> handle;
+    if (!shared->handle.upgrade(&handle)) {
+        shared->mutex.lock();
+        shared->cancelled = true;
+        shared->mutex.unlock();
+        return false;
+    }
+    CZ_DEFER(handle.drop());
+
+    Buffer* buffer = handle->lock_writing();
+    CZ_DEFER(handle->unlock());
+
+    // Check while holding the buffer lock so we never append after the search has been
+    // cancelled and the buffer has been cleared for another search.
+    if (is_cancelled(shared)) {
+        return false;
+    }
+
+    buffer->contents.append(*output);
+    output->len = 0;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Walk job
+////////////////////////////////////////////////////////////////////////////////
+
+namespace search_engine_ {
+struct Walk_Job_Data {
+    cz::Arc<Search_Shared> shared;
+    File_Walker walker;
+
+    /// Paths found in the current tick.  The walker reuses the memory of
+    /// its paths so they are copied here before being queued.
+    cz::Buffer_Array found_buffer_array;
+
+    void drop() {
+        walker.drop();
+        found_buffer_array.drop();
+        shared.drop();
+    }
+};
+}
+
+static void walk_job_kill(void* _data) {
+    Walk_Job_Data* data = (Walk_Job_Data*)_data;
+    finish_job(data->shared.get(), nullptr);
+    data->drop();
+    cz::heap_allocator().dealloc(data);
+}
+
+static Job_Tick_Result walk_job_tick(Asynchronous_Job_Handler* handler, void* _data) {
+    ZoneScoped;
+
+    Walk_Job_Data* data = (Walk_Job_Data*)_data;
+    Search_Shared* shared = data->shared.get();
+
+    cz::Vector<cz::Str> found = {};
+    CZ_DEFER(found.drop(cz::heap_allocator()));
+    found.reserve_exact(cz::heap_allocator(), 256);
+    data->found_buffer_array.clear();
+
+    bool finished = false;
+    while (found.remaining() > 0) {
+        if (!data->walker.next()) {
+            finished = true;
+            break;
+        }
+
+        // Unsaved buffers are queued when the search starts.
+        cz::Str relpath = data->walker.relpath();
+        if (shared->find_snapshot(relpath)) {
+            continue;
+        }
+        if (shared->use_index && shared->covered_by_index(relpath, data->walker.path.buffer)) {
+            continue;
+        }
+        found.push(relpath.clone(data->found_buffer_array.allocator()));
+    }
+
+    {
+        shared->mutex.lock();
+        CZ_DEFER(shared->mutex.unlock());
+
+        if (shared->cancelled) {
+            finished = true;
+        } else {
+            // Copy the paths because the next tick will reuse their memory.
+            shared->paths.reserve(cz::heap_allocator(), found.len);
+            for (size_t i = 0; i < found.len; ++i) {
+                shared->paths.push(found[i].clone(shared->paths_buffer_array.allocator()));
+            }
+        }
+
+        if (finished) {
+            shared->walk_finished = true;
+        }
+    }
+
+    if (finished) {
+        finish_job(shared, handler);
+        data->drop();
+        cz::heap_allocator().dealloc(data);
+        return Job_Tick_Result::FINISHED;
+    }
+
+    return Job_Tick_Result::MADE_PROGRESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Search job
+////////////////////////////////////////////////////////////////////////////////
+
+namespace search_engine_ {
+struct Search_Job_Data {
+    cz::Arc<Search_Shared> shared;
+
+    /// The relative path of the file being searched.
+    cz::String relpath;
+    /// The absolute path of the file being searched.
+    cz::String path;
+    /// The contents of small files.  Large files are memory mapped.
+    cz::String contents;
+    /// Results that haven't been appended to the buffer yet.
+    cz::String output;
+
+    void drop() {
+        relpath.drop(cz::heap_allocator());
+        path.drop(cz::heap_allocator());
+        contents.drop(cz::heap_allocator());
+        output.drop(cz::heap_allocator());
+        shared.drop();
+    }
+};
+}
+
+/// Files at least this big are memory mapped instead of being read.
+static const uint64_t SEARCH_MAP_THRESHOLD = 64 << 10;
+
+bool load_searchable_file(const char* path,
+                          cz::String* contents,
+                          cz::Slice<char>* mapping,
+                          cz::Str* text) {
+    ZoneScoped;
+
+    *mapping = {};
+
+    cz::Input_File file;
+    if (!file.open(path)) {
+        return false;
+    }
+    CZ_DEFER(file.close());
+
+    if (map_file(file, SEARCH_MAP_THRESHOLD, mapping)) {
+        *text = {mapping->elems, mapping->len};
+    } else {
+        *mapping = {};
+        contents->len = 0;
+        (void)cz::read_to_string(file, cz::heap_allocator(), contents);
+        *text = *contents;
+    }
+
+    if (looks_binary(*text)) {
+        if (mapping->elems) {
+            unmap_file(*mapping);
+            *mapping = {};
+        }
+        return false;
+    }
+
+    return true;
+}
+
+static void search_file(Search_Job_Data* data) {
+    ZoneScoped;
+
+    Search_Shared* shared = data->shared.get();
+
+    const Snapshot* snapshot = shared->find_snapshot(data->relpath);
+    if (snapshot) {
+        search_text(data->relpath, snapshot->contents, shared->query, shared->query_word,
+                    &data->output);
+        return;
+    }
+
+    data->path.len = 0;
+    data->path.reserve(cz::heap_allocator(), shared->directory.len + data->relpath.len + 1);
+    data->path.append(shared->directory);
+    data->path.append(data->relpath);
+    data->path.null_terminate();
+
+    cz::Slice<char> mapping;
+    cz::Str text;
+    if (!load_searchable_file(data->path.buffer, &data->contents, &mapping, &text)) {
+        return;
+    }
+    CZ_DEFER({
+        if (mapping.elems) {
+            unmap_file(mapping);
+        }
+    });
+
+    search_text(data->relpath, text, shared->query, shared->query_word, &data->output);
+}
+
+static void search_job_kill(void* _data) {
+    Search_Job_Data* data = (Search_Job_Data*)_data;
+    finish_job(data->shared.get(), nullptr);
+    data->drop();
+    cz::heap_allocator().dealloc(data);
+}
+
+static Job_Tick_Result search_job_tick(Asynchronous_Job_Handler* handler, void* _data) {
+    ZoneScoped;
+
+    Search_Job_Data* data = (Search_Job_Data*)_data;
+    Search_Shared* shared = data->shared.get();
+
+    bool finished = false;
+    bool stalled = true;
+
+    // Search a batch of files and then append all their results at once.
+    for (size_t searched = 0; searched < 64 && data->output.len < (64 << 10); ++searched) {
+        {
+            shared->mutex.lock();
+            CZ_DEFER(shared->mutex.unlock());
+
+            if (shared->cancelled) {
+                finished = true;
+                break;
+            }
+
+            if (shared->paths.len == 0) {
+                finished = shared->walk_finished;
+                break;
+            }
+
+            cz::Str relpath = shared->paths.pop();
+            data->relpath.len = 0;
+            data->relpath.reserve(cz::heap_allocator(), relpath.len + 1);
+            data->relpath.append(relpath);
+            data->relpath.null_terminate();
+
+            // Reuse the memory once every queued path has been taken.
+            if (shared->paths.len == 0) {
+                shared->paths_buffer_array.clear();
+            }
+        }
+
+        stalled = false;
+        search_file(data);
+    }
+
+    if (!flush_output(shared, &data->output)) {
+        finished = true;
+    }
+
+    if (finished) {
+        finish_job(shared, handler);
+        data->drop();
+        cz::heap_allocator().dealloc(data);
+        return Job_Tick_Result::FINISHED;
+    }
+
+    return stalled ? Job_Tick_Result::STALLED : Job_Tick_Result::MADE_PROGRESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Starting searches
+////////////////////////////////////////////////////////////////////////////////
+
+static size_t count_search_jobs() {
+    if (custom::search_threads > 0) {
+        return custom::search_threads;
+    }
+    return count_background_threads();
+}
+
+/// Copy the contents of buffers with unsaved changes since they won't match the files on disk.
+/// If `open_files` isn't `nullptr` then the paths of the other open files are added to it.
+static void collect_open_files(Editor* editor,
+                               Search_Shared* shared,
+                               cz::Option<cz::Str> file,
+                               cz::Vector<cz::Str>* open_files) {
+    ZoneScoped;
+
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+
+    for (size_t i = 0; i < editor->buffers.len; ++i) {
+        cz::Arc<Buffer_Handle> handle = editor->buffers[i];
+        const Buffer* buffer = handle->lock_reading();
+        CZ_DEFER(handle->unlock());
+
+        if (buffer->type != Buffer::FILE) {
+            continue;
+        }
+
+        path.len = 0;
+        if (!buffer->get_path(cz::heap_allocator(), &path) ||
+            !path.starts_with(shared->directory)) {
+            continue;
+        }
+
+        cz::Str relpath = path.slice_start(shared->directory.len);
+        if (file.is_present && relpath != file.value) {
+            continue;
+        }
+
+        if (buffer->is_unchanged()) {
+            if (open_files) {
+                open_files->reserve(cz::heap_allocator(), 1);
+                open_files->push(relpath.clone(shared->index_buffer_array.allocator()));
+            }
+            continue;
+        }
+
+        Snapshot snapshot;
+        snapshot.relpath = relpath.clone_null_terminate(cz::heap_allocator());
+        snapshot.contents = buffer->contents.stringify(cz::heap_allocator());
+        shared->snapshots.reserve(cz::heap_allocator(), 1);
+        shared->snapshots.push(snapshot);
+    }
+}
+
+void cancel_search(const cz::Arc<Buffer_Handle>& handle) {
+    const Buffer_Handle* key = handle.get();
+    for (size_t i = running_searches.len; i-- > 0;) {
+        cz::Arc<Search_Shared> shared;
+        bool alive = running_searches[i].shared.upgrade(&shared);
+        if (alive) {
+            if (running_searches[i].key != key) {
+                shared.drop();
+                continue;
+            }
+
+            shared->mutex.lock();
+            shared->cancelled = true;
+            shared->mutex.unlock();
+            shared.drop();
+        }
+
+        // Forget about searches that are done or cancelled.
+        running_searches[i].shared.drop();
+        running_searches.remove(i);
+    }
+}
+
+void start_search(Editor* editor,
+                  const cz::Arc<Buffer_Handle>& handle,
+                  cz::Str directory,
+                  cz::Str query,
+                  bool query_word,
+                  cz::Option<cz::Str> file,
+                  Synchronous_Job callback) {
+    ZoneScoped;
+
+    cancel_search(handle);
+
+    cz::Arc<Search_Shared> shared;
+    shared.init_copy({});
+    CZ_DEFER(shared.drop());
+    shared->mutex.init();
+    shared->paths_buffer_array.init();
+    shared->index_buffer_array.init();
+    shared->callback = callback;
+
+    shared->directory.reserve_exact(cz::heap_allocator(), directory.len + 2);
+    shared->directory.append(directory);
+    if (!shared->directory.ends_with('/')) {
+        shared->directory.push('/');
+    }
+    shared->directory.null_terminate();
+
+    shared->query = query.clone(cz::heap_allocator());
+    shared->query_word = query_word;
+    shared->handle = handle.clone_downgrade();
+
+    // Narrow down the files to search using the trigram index if there is one.  The index may
+    // be out of date so the directory is still walked to find new and changed files.
+    cz::Vector<cz::Str>& candidates = shared->candidates;
+    bool walk = !file.is_present;
+    shared->use_index =
+        walk && find_trigram_index_candidates(editor, shared->directory, query,
+                                              shared->index_buffer_array.allocator(),
+                                              &candidates, &shared->indexed_files);
+
+    // Also search every open file since the index doesn't know about unsaved changes.
+    bool use_candidates = shared->use_index;
+    collect_open_files(editor, shared.get(), file, use_candidates ? &candidates : nullptr);
+
+    // Queue the unsaved buffers and the file if there is one.
+    shared->paths.reserve(cz::heap_allocator(), shared->snapshots.len + 1);
+    for (size_t i = 0; i < shared->snapshots.len; ++i) {
+        shared->paths.push(shared->snapshots[i].relpath);
+    }
+    if (file.is_present && !shared->find_snapshot(file.value)) {
+        shared->paths.push(file.value.clone(shared->paths_buffer_array.allocator()));
+    }
+
+    if (use_candidates) {
+        cz::sort(candidates);
+        shared->paths.reserve(cz::heap_allocator(), candidates.len);
+        for (size_t i = 0; i < candidates.len; ++i) {
+            if (i > 0 && candidates[i - 1] == candidates[i]) {
+                continue;
+            }
+            if (!shared->find_snapshot(candidates[i])) {
+                shared->paths.push(candidates[i]);
+            }
+        }
+    }
+
+    size_t num_jobs = count_search_jobs();
+    shared->running_jobs = num_jobs + walk;
+    shared->walk_finished = !walk;
+
+    running_searches.reserve(cz::heap_allocator(), 1);
+    running_searches.push({handle.get(), shared.clone_downgrade()});
+
+    if (walk) {
+        Walk_Job_Data* data = cz::heap_allocator().alloc<Walk_Job_Data>();
+        CZ_ASSERT(data);
+        *data = {};
+        data->shared = shared.clone();
+        data->walker.init(shared->directory);
+        data->found_buffer_array.init();
+
+        Asynchronous_Job job;
+        job.tick = walk_job_tick;
+        job.kill = walk_job_kill;
+        job.data = data;
+        editor->add_asynchronous_job(job);
+    }
+
+    // Don't set `job.buffer` so the jobs can run in parallel.  They
+    // lock the buffer themselves when they append their results.
+    for (size_t i = 0; i < num_jobs; ++i) {
+        Search_Job_Data* data = cz::heap_allocator().alloc<Search_Job_Data>();
+        CZ_ASSERT(data);
+        *data = {};
+        data->shared = shared.clone();
+
+        Asynchronous_Job job;
+        job.tick = search_job_tick;
+        job.kill = search_job_kill;
+        job.data = data;
+        editor->add_asynchronous_job(job);
+    }
+}
+
+}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cz/arc.hpp>
+#include <cz/option.hpp>
+#include <cz/slice.hpp>
+#include <cz/string.hpp>
+#include "core/job.hpp"
+
+namespace mag {
+struct Buffer_Handle;
+struct Editor;
+
+namespace prose {
+
+/// Search for `query` in every file under `directory` (or only in `file`, a path relative to
+/// `directory`) on the job threads.  Files matched by `version_control::Ignore_Rules` and binary
+/// files are skipped.  Files with unsaved changes are searched as they appear in the editor.
+/// If there is a trigram index (see `custom::trigram_index`) only the files it says could
+/// match and the files open in the editor are read.
+///
+/// Results are appended to the end of `handle` as they are found, one line per matching line
+/// formatted as `relpath:line:column:text` (the same format as `ag --column`).  The order of
+/// results across files is not deterministic.  If `query_word` is `true` then matches must
+/// start and end on word boundaries (the same as `ag --word-regexp`).
+///
+/// `callback` is ran once the search finishes.  Starting another search in `handle`
+/// cancels the previous one without running its `callback`.
+void start_search(Editor* editor,
+                  const cz::Arc<Buffer_Handle>& handle,
+                  cz::Str directory,
+                  cz::Str query,
+                  bool query_word,
+                  cz::Option<cz::Str> file,
+                  Synchronous_Job callback);
+
+/// Cancel the search running in `handle`, if there is one.
+void cancel_search(const cz::Arc<Buffer_Handle>& handle);
+
+/// Append the lines in `text` matching `query` to `output` in the format described above.
+void search_text(cz::Str relpath,
+                 cz::Str text,
+                 cz::Str query,
+                 bool query_word,
+                 cz::String* output);
+
+/// Approximates the check `ag` uses to skip binary files.
+bool looks_binary(cz::Str text);
+
+/// Load the file at `path` to be searched.  Large files are memory mapped into `mapping`
+/// (release it with `unmap_file`) and other files are read into `contents`.  Returns `false`
+/// if the file can't be read or is binary.  Otherwise `text` is set to the file's contents.
+bool load_searchable_file(const char* path,
+                          cz::String* contents,
+                          cz::Slice<char>* mapping,
+                          cz::Str* text);
+
+}
+}
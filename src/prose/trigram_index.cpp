@@ -0,0 +1,859 @@
+#include "trigram_index.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <cz/arc.hpp>
+#include <cz/defer.hpp>
+#include <cz/file.hpp>
+#include <cz/heap.hpp>
+#include <cz/mutex.hpp>
+#include <cz/sort.hpp>
+#include <tracy/Tracy.hpp>
+#include "core/command_macros.hpp"
+#include "core/editor.hpp"
+#include "core/file.hpp"
+#include "core/job.hpp"
+#include "custom/config.hpp"
+#include "prose/file_walker.hpp"
+#include "prose/helpers.hpp"
+#include "prose/search_engine.hpp"
+#include "version_control/version_control.hpp"
+
+namespace mag {
+namespace prose {
+
+static uint32_t trigram_at(const char* str) {
+    return ((uint32_t)(uint8_t)str[0] << 16) | ((uint32_t)(uint8_t)str[1] << 8) |
+           (uint32_t)(uint8_t)str[2];
+}
+
+bool file_times_equal(const cz::File_Time& left, const cz::File_Time& right) {
+    return !cz::is_file_time_before(left, right) && !cz::is_file_time_before(right, left);
+}
+
+/// Find the first index in `[start, end)` where `array[index] >= value`.
+static size_t lower_bound(const cz::Vector<uint32_t>& array,
+                          size_t start,
+                          size_t end,
+                          uint32_t value) {
+    while (start < end) {
+        size_t mid = start + (end - start) / 2;
+        if (array[mid] < value) {
+            start = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return start;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Trigram_Index
+////////////////////////////////////////////////////////////////////////////////
+
+void Trigram_Index::init() {
+    *this = {};
+    paths_buffer_array.init();
+}
+
+void Trigram_Index::drop() {
+    files.drop(cz::heap_allocator());
+    paths_buffer_array.drop();
+    trigrams.drop(cz::heap_allocator());
+    offsets.drop(cz::heap_allocator());
+    postings.drop(cz::heap_allocator());
+}
+
+bool Trigram_Index::find_file(cz::Str path, size_t* id) const {
+    size_t start = 0;
+    size_t end = files.len;
+    while (start < end) {
+        size_t mid = start + (end - start) / 2;
+        if (files[mid].path < path) {
+            start = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+
+    if (start < files.len && files[start].path == path) {
+        *id = start;
+        return true;
+    }
+    return false;
+}
+
+bool Trigram_Index::find_candidates(cz::Str query, cz::Vector<uint32_t>* ids) const {
+    ZoneScoped;
+
+    ids->len = 0;
+    if (query.len < 3) {
+        return false;
+    }
+
+    struct Range {
+        uint32_t start;
+        uint32_t end;
+    };
+
+    cz::Vector<Range> ranges = {};
+    CZ_DEFER(ranges.drop(cz::heap_allocator()));
+    ranges.reserve_exact(cz::heap_allocator(), query.len - 2);
+
+    for (size_t i = 0; i + 3 <= query.len; ++i) {
+        uint32_t trigram = trigram_at(query.buffer + i);
+        size_t index = lower_bound(trigrams, 0, trigrams.len, trigram);
+        if (index == trigrams.len || trigrams[index] != trigram) {
+            // No file contains this trigram.
+            return true;
+        }
+        ranges.push({offsets[index], offsets[index + 1]});
+    }
+
+    // Start with the rarest trigram so the intersections stay small.
+    cz::sort(ranges, [](Range* left, Range* right) {
+        return left->end - left->start < right->end - right->start;
+    });
+
+    ids->reserve_exact(cz::heap_allocator(), ranges[0].end - ranges[0].start);
+    for (size_t i = ranges[0].start; i < ranges[0].end; ++i) {
+        ids->push(postings[i]);
+    }
+
+    for (size_t r = 1; r < ranges.len && ids->len > 0; ++r) {
+        size_t position = ranges[r].start;
+        size_t kept = 0;
+        for (size_t i = 0; i < ids->len; ++i) {
+            uint32_t id = (*ids)[i];
+            position = lower_bound(postings, position, ranges[r].end, id);
+            if (position == ranges[r].end) {
+                break;
+            }
+            if (postings[position] == id) {
+                (*ids)[kept++] = id;
+            }
+        }
+        ids->len = kept;
+    }
+
+    return true;
+}
+
+size_t Trigram_Index::byte_size() const {
+    size_t size = files.len * sizeof(File);
+    for (size_t i = 0; i < files.len; ++i) {
+        size += files[i].path.len;
+    }
+    size += (trigrams.len + offsets.len + postings.len) * sizeof(uint32_t);
+    return size;
+}
+
+static constexpr uint64_t TRIGRAM_INDEX_MAGIC = 0x313049525447414d;  // "MAGTRI01"
+
+/// The file is laid out as this header followed by the file times, the path lengths (as
+/// `uint32_t`s), the paths, the trigrams, the offsets (`trigrams_len + 1` of them) and the
+/// postings.  Everything is in native byte order since the index is never shared.
+struct Trigram_Index_Header {
+    uint64_t magic;
+    uint64_t file_time_size;
+    uint64_t files_len;
+    uint64_t paths_len;
+    uint64_t trigrams_len;
+    uint64_t postings_len;
+};
+
+static void append_bytes(cz::String* output, const void* data, size_t len) {
+    output->reserve(cz::heap_allocator(), len);
+    output->append({(const char*)data, len});
+}
+
+void Trigram_Index::serialize(cz::String* output) const {
+    ZoneScoped;
+
+    Trigram_Index_Header header;
+    header.magic = TRIGRAM_INDEX_MAGIC;
+    header.file_time_size = sizeof(cz::File_Time);
+    header.files_len = files.len;
+    header.paths_len = 0;
+    for (size_t i = 0; i < files.len; ++i) {
+        header.paths_len += files[i].path.len;
+    }
+    header.trigrams_len = trigrams.len;
+    header.postings_len = postings.len;
+
+    output->reserve_exact(cz::heap_allocator(),
+                          sizeof(header) + files.len * (sizeof(cz::File_Time) + 4) +
+                              header.paths_len + (trigrams.len * 2 + 1 + postings.len) * 4);
+
+    append_bytes(output, &header, sizeof(header));
+    for (size_t i = 0; i < files.len; ++i) {
+        append_bytes(output, &files[i].file_time, sizeof(cz::File_Time));
+    }
+    for (size_t i = 0; i < files.len; ++i) {
+        uint32_t len = (uint32_t)files[i].path.len;
+        append_bytes(output, &len, sizeof(len));
+    }
+    for (size_t i = 0; i < files.len; ++i) {
+        append_bytes(output, files[i].path.buffer, files[i].path.len);
+    }
+    append_bytes(output, trigrams.elems, trigrams.len * sizeof(uint32_t));
+    if (offsets.len == 0) {
+        uint32_t zero = 0;
+        append_bytes(output, &zero, sizeof(zero));
+    } else {
+        append_bytes(output, offsets.elems, offsets.len * sizeof(uint32_t));
+    }
+    append_bytes(output, postings.elems, postings.len * sizeof(uint32_t));
+}
+
+static bool read_bytes(cz::Str* data, void* output, size_t len) {
+    if (data->len < len) {
+        return false;
+    }
+    memcpy(output, data->buffer, len);
+    *data = data->slice_start(len);
+    return true;
+}
+
+static bool read_array(cz::Str* data, cz::Vector<uint32_t>* array, size_t len) {
+    if (data->len / sizeof(uint32_t) < len) {
+        return false;
+    }
+    array->reserve_exact(cz::heap_allocator(), len);
+    array->len = len;
+    return read_bytes(data, array->elems, len * sizeof(uint32_t));
+}
+
+static bool deserialize_index(Trigram_Index* index, cz::Str data) {
+    Trigram_Index_Header header;
+    if (!read_bytes(&data, &header, sizeof(header))) {
+        return false;
+    }
+
+    // Reject corrupted lengths before allocating anything.
+    if (header.magic != TRIGRAM_INDEX_MAGIC || header.file_time_size != sizeof(cz::File_Time) ||
+        header.files_len > data.len || header.paths_len > data.len ||
+        header.trigrams_len > data.len || header.postings_len > data.len) {
+        return false;
+    }
+
+    index->files.reserve_exact(cz::heap_allocator(), header.files_len);
+    for (size_t i = 0; i < header.files_len; ++i) {
+        Trigram_Index::File file = {};
+        if (!read_bytes(&data, &file.file_time, sizeof(cz::File_Time))) {
+            return false;
+        }
+        index->files.push(file);
+    }
+
+    cz::Vector<uint32_t> path_lengths = {};
+    CZ_DEFER(path_lengths.drop(cz::heap_allocator()));
+    if (!read_array(&data, &path_lengths, header.files_len)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < index->files.len; ++i) {
+        if (data.len < path_lengths[i]) {
+            return false;
+        }
+        cz::Str path = data.slice_end(path_lengths[i]);
+        index->files[i].path = path.clone(index->paths_buffer_array.allocator());
+        data = data.slice_start(path_lengths[i]);
+
+        // `find_file` requires the paths to be sorted.
+        if (i > 0 && !(index->files[i - 1].path < index->files[i].path)) {
+            return false;
+        }
+    }
+
+    if (!read_array(&data, &index->trigrams, header.trigrams_len) ||
+        !read_array(&data, &index->offsets, header.trigrams_len + 1) ||
+        !read_array(&data, &index->postings, header.postings_len) || data.len != 0) {
+        return false;
+    }
+
+    if (index->offsets[0] != 0 || index->offsets.last() != index->postings.len) {
+        return false;
+    }
+    for (size_t i = 0; i < index->trigrams.len; ++i) {
+        if ((i > 0 && index->trigrams[i - 1] >= index->trigrams[i]) ||
+            index->offsets[i] > index->offsets[i + 1]) {
+            return false;
+        }
+        for (size_t p = index->offsets[i]; p < index->offsets[i + 1]; ++p) {
+            if (index->postings[p] >= index->files.len ||
+                (p > index->offsets[i] && index->postings[p - 1] >= index->postings[p])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Trigram_Index::deserialize(cz::Str data) {
+    ZoneScoped;
+
+    if (deserialize_index(this, data)) {
+        return true;
+    }
+
+    drop();
+    init();
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Trigram_Index_Builder
+////////////////////////////////////////////////////////////////////////////////
+
+static const size_t TRIGRAM_COUNT = (size_t)1 << 24;
+
+void Trigram_Index_Builder::init(const Trigram_Index* old_index) {
+    *this = {};
+    old = old_index;
+    paths_buffer_array.init();
+    seen.reserve_exact(cz::heap_allocator(), TRIGRAM_COUNT / 64);
+    seen.len = TRIGRAM_COUNT / 64;
+    memset(seen.elems, 0, seen.len * sizeof(uint64_t));
+}
+
+void Trigram_Index_Builder::drop() {
+    files.drop(cz::heap_allocator());
+    paths_buffer_array.drop();
+    pending.drop(cz::heap_allocator());
+    seen.drop(cz::heap_allocator());
+}
+
+void Trigram_Index_Builder::add_unchanged_file(size_t old_id) {
+    // `old` outlives the builder so there is no need to copy the path.
+    const Trigram_Index::File& file = old->files[old_id];
+    files.reserve(cz::heap_allocator(), 1);
+    files.push({file.path, file.file_time, old_id});
+}
+
+void Trigram_Index_Builder::add_file(cz::Str path, cz::File_Time file_time, cz::Str contents) {
+    ZoneScoped;
+
+    uint64_t index = files.len;
+    files.reserve(cz::heap_allocator(), 1);
+    files.push({path.clone(paths_buffer_array.allocator()), file_time, SIZE_MAX});
+
+    size_t start = pending.len;
+    uint32_t trigram = 0;
+    for (size_t i = 0; i < contents.len; ++i) {
+        trigram = ((trigram << 8) | (uint8_t)contents[i]) & (TRIGRAM_COUNT - 1);
+        if (i < 2) {
+            continue;
+        }
+
+        uint64_t bit = (uint64_t)1 << (trigram & 63);
+        if (seen[trigram >> 6] & bit) {
+            continue;
+        }
+        seen[trigram >> 6] |= bit;
+
+        pending.reserve(cz::heap_allocator(), 1);
+        pending.push(((uint64_t)trigram << 32) | index);
+    }
+
+    // Clear the bit set for the next file.
+    for (size_t i = start; i < pending.len; ++i) {
+        uint32_t added = (uint32_t)(pending[i] >> 32);
+        seen[added >> 6] &= ~((uint64_t)1 << (added & 63));
+    }
+}
+
+void Trigram_Index_Builder::finish(Trigram_Index* index) {
+    ZoneScoped;
+
+    // Sort the files by path.  A file's id in the new index is its position in this order.
+    cz::Vector<uint32_t> order = {};
+    CZ_DEFER(order.drop(cz::heap_allocator()));
+    order.reserve_exact(cz::heap_allocator(), files.len);
+    for (size_t i = 0; i < files.len; ++i) {
+        order.push((uint32_t)i);
+    }
+    cz::sort(order, [&](uint32_t* left, uint32_t* right) {
+        return files[*left].path < files[*right].path;
+    });
+
+    cz::Vector<uint32_t> new_ids = {};
+    CZ_DEFER(new_ids.drop(cz::heap_allocator()));
+    new_ids.reserve_exact(cz::heap_allocator(), files.len);
+    new_ids.len = files.len;
+
+    // Files that were deleted or read again map to `UINT32_MAX`.
+    size_t old_files_len = old ? old->files.len : 0;
+    cz::Vector<uint32_t> old_to_new = {};
+    CZ_DEFER(old_to_new.drop(cz::heap_allocator()));
+    old_to_new.reserve_exact(cz::heap_allocator(), old_files_len);
+    old_to_new.len = old_files_len;
+    memset(old_to_new.elems, 0xff, old_to_new.len * sizeof(uint32_t));
+
+    index->files.reserve_exact(cz::heap_allocator(), files.len);
+    for (size_t i = 0; i < order.len; ++i) {
+        const File& file = files[order[i]];
+        new_ids[order[i]] = (uint32_t)i;
+        if (file.old_id != SIZE_MAX) {
+            old_to_new[file.old_id] = (uint32_t)i;
+        }
+        index->files.push({file.path.clone(index->paths_buffer_array.allocator()), file.file_time});
+    }
+
+    // Switch the files that were read to their new ids and then sort them into postings order.
+    for (size_t i = 0; i < pending.len; ++i) {
+        uint64_t trigram = pending[i] >> 32;
+        pending[i] = (trigram << 32) | new_ids[(uint32_t)pending[i]];
+    }
+    cz::sort(pending);
+
+    // Merge the old postings of the unchanged files with the postings of the files that were
+    // read.  Both are already sorted by id since unchanged files keep their relative order.
+    size_t old_trigrams_len = old ? old->trigrams.len : 0;
+    size_t t = 0;
+    size_t p = 0;
+    while (t < old_trigrams_len || p < pending.len) {
+        uint32_t trigram;
+        if (t < old_trigrams_len &&
+            (p == pending.len || old->trigrams[t] <= (uint32_t)(pending[p] >> 32))) {
+            trigram = old->trigrams[t];
+        } else {
+            trigram = (uint32_t)(pending[p] >> 32);
+        }
+
+        size_t o = 0;
+        size_t o_end = 0;
+        if (t < old_trigrams_len && old->trigrams[t] == trigram) {
+            o = old->offsets[t];
+            o_end = old->offsets[t + 1];
+            ++t;
+        }
+
+        size_t start = index->postings.len;
+        while (1) {
+            while (o < o_end && old_to_new[old->postings[o]] == UINT32_MAX) {
+                ++o;
+            }
+
+            bool has_old = o < o_end;
+            bool has_pending = p < pending.len && (uint32_t)(pending[p] >> 32) == trigram;
+            if (!has_old && !has_pending) {
+                break;
+            }
+
+            uint32_t id;
+            if (has_old && (!has_pending || old_to_new[old->postings[o]] < (uint32_t)pending[p])) {
+                id = old_to_new[old->postings[o++]];
+            } else {
+                id = (uint32_t)pending[p++];
+            }
+
+            index->postings.reserve(cz::heap_allocator(), 1);
+            index->postings.push(id);
+        }
+
+        // Drop trigrams whose files have all been deleted.
+        if (index->postings.len > start) {
+            index->trigrams.reserve(cz::heap_allocator(), 1);
+            index->offsets.reserve(cz::heap_allocator(), 1);
+            index->trigrams.push(trigram);
+            index->offsets.push((uint32_t)start);
+        }
+    }
+
+    index->offsets.reserve(cz::heap_allocator(), 1);
+    index->offsets.push((uint32_t)index->postings.len);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Background updates
+////////////////////////////////////////////////////////////////////////////////
+
+namespace trigram_index_ {
+struct Index_State {
+    cz::Mutex mutex;
+
+    /// The root directory of the repository.  Ends in a `/`.  Immutable.
+    cz::String root;
+
+    // These are protected by `mutex`.
+    Trigram_Index index;
+    bool ready;
+    bool updating;
+
+    // Statistics for `command_show_trigram_index_stats`.
+    uint64_t update_ms;
+    size_t files_read;
+    uint64_t query_us;
+    size_t query_candidates;
+
+    void drop() {
+        mutex.drop();
+        root.drop(cz::heap_allocator());
+        index.drop();
+    }
+};
+
+struct Update_Job_Data {
+    cz::Arc<Index_State> state;
+
+    bool started;
+    std::chrono::steady_clock::time_point start_time;
+    size_t files_read;
+
+    File_Walker walker;
+    Trigram_Index_Builder builder;
+    cz::String contents;
+
+    void drop() {
+        if (started) {
+            walker.drop();
+            builder.drop();
+        }
+        contents.drop(cz::heap_allocator());
+        state.drop();
+    }
+};
+}
+using namespace trigram_index_;
+
+/// The repositories that have been indexed.  Only accessed on the main thread.
+static cz::Vector<cz::Arc<Index_State> > index_states;
+
+static void get_index_path(cz::Str root, cz::String* path) {
+    path->reserve_exact(cz::heap_allocator(), root.len + custom::trigram_index_path.len + 1);
+    path->append(root);
+    path->append(custom::trigram_index_path);
+    path->null_terminate();
+}
+
+static bool load_index(cz::Str root, Trigram_Index* index) {
+    ZoneScoped;
+
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+    get_index_path(root, &path);
+
+    cz::Input_File file;
+    if (!file.open(path.buffer)) {
+        return false;
+    }
+    CZ_DEFER(file.close());
+
+    cz::String data = {};
+    CZ_DEFER(data.drop(cz::heap_allocator()));
+    (void)cz::read_to_string(file, cz::heap_allocator(), &data);
+
+    return index->deserialize(data);
+}
+
+static bool write_exact(cz::Output_File file, const void* data, size_t len) {
+    const char* it = (const char*)data;
+    while (len > 0) {
+        int64_t result = file.write(it, len);
+        if (result <= 0) {
+            return false;
+        }
+        it += result;
+        len -= result;
+    }
+    return true;
+}
+
+static void save_index(cz::Str root, const Trigram_Index& index) {
+    ZoneScoped;
+
+    cz::String path = {};
+    CZ_DEFER(path.drop(cz::heap_allocator()));
+    get_index_path(root, &path);
+
+    cz::String data = {};
+    CZ_DEFER(data.drop(cz::heap_allocator()));
+    index.serialize(&data);
+
+    // Write to a temporary file and then rename it so a concurrent
+    // reader never sees a partially written index.
+    cz::String temp_path = {};
+    CZ_DEFER(temp_path.drop(cz::heap_allocator()));
+    temp_path.reserve_exact(cz::heap_allocator(), path.len + 5);
+    temp_path.append(path);
+    temp_path.append(".tmp");
+    temp_path.null_terminate();
+
+    bool success;
+    {
+        cz::Output_File file;
+        if (!file.open(temp_path.buffer)) {
+            return;
+        }
+        CZ_DEFER(file.close());
+        success = write_exact(file, data.buffer, data.len);
+    }
+
+    if (!success || rename(temp_path.buffer, path.buffer) != 0) {
+        remove(temp_path.buffer);
+    }
+}
+
+static void update_job_kill(void* _data) {
+    Update_Job_Data* data = (Update_Job_Data*)_data;
+    {
+        Index_State* state = data->state.get();
+        state->mutex.lock();
+        CZ_DEFER(state->mutex.unlock());
+        state->updating = false;
+    }
+    data->drop();
+    cz::heap_allocator().dealloc(data);
+}
+
+static void finish_update(Update_Job_Data* data) {
+    ZoneScoped;
+
+    Index_State* state = data->state.get();
+
+    Trigram_Index index;
+    index.init();
+    CZ_DEFER(index.drop());
+    data->builder.finish(&index);
+
+    save_index(state->root, index);
+
+    auto elapsed = std::chrono::steady_clock::now() - data->start_time;
+
+    state->mutex.lock();
+    CZ_DEFER(state->mutex.unlock());
+    cz::swap(state->index, index);
+    state->ready = true;
+    state->updating = false;
+    state->update_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+    state->files_read = data->files_read;
+}
+
+static Job_Tick_Result update_job_tick(Asynchronous_Job_Handler*, void* _data) {
+    ZoneScoped;
+
+    Update_Job_Data* data = (Update_Job_Data*)_data;
+    Index_State* state = data->state.get();
+
+    if (!data->started) {
+        data->started = true;
+        data->start_time = std::chrono::steady_clock::now();
+
+        bool ready;
+        {
+            state->mutex.lock();
+            CZ_DEFER(state->mutex.unlock());
+            ready = state->ready;
+        }
+
+        // Load the index saved by a previous session so searches can use it immediately.
+        if (!ready) {
+            Trigram_Index index;
+            index.init();
+            CZ_DEFER(index.drop());
+            if (load_index(state->root, &index)) {
+                state->mutex.lock();
+                CZ_DEFER(state->mutex.unlock());
+                cz::swap(state->index, index);
+                state->ready = true;
+            }
+        }
+
+        // Only this job replaces `state->index` so it can be read without locking.
+        data->walker.init(state->root);
+        data->builder.init(&state->index);
+        return Job_Tick_Result::MADE_PROGRESS;
+    }
+
+    const Trigram_Index& old = state->index;
+    size_t bytes_read = 0;
+    for (size_t i = 0; i < 256 && bytes_read < (8 << 20); ++i) {
+        if (!data->walker.next()) {
+            finish_update(data);
+            data->drop();
+            cz::heap_allocator().dealloc(data);
+            return Job_Tick_Result::FINISHED;
+        }
+
+        cz::File_Time file_time;
+        if (!cz::get_file_time(data->walker.path.buffer, &file_time)) {
+            continue;
+        }
+
+        cz::Str relpath = data->walker.relpath();
+        size_t old_id;
+        if (old.find_file(relpath, &old_id) &&
+            file_times_equal(old.files[old_id].file_time, file_time)) {
+            data->builder.add_unchanged_file(old_id);
+            continue;
+        }
+
+        // Binary files are recorded without any trigrams so they aren't read again.
+        cz::Slice<char> mapping;
+        cz::Str text = {};
+        if (!load_searchable_file(data->walker.path.buffer, &data->contents, &mapping, &text)) {
+            text = {};
+        }
+        data->builder.add_file(relpath, file_time, text);
+        if (mapping.elems) {
+            unmap_file(mapping);
+        }
+
+        bytes_read += text.len;
+        ++data->files_read;
+    }
+
+    return Job_Tick_Result::MADE_PROGRESS;
+}
+
+static cz::Arc<Index_State>* find_index_state(cz::Str root) {
+    for (size_t i = 0; i < index_states.len; ++i) {
+        if (index_states[i]->root.as_str() == root) {
+            return &index_states[i];
+        }
+    }
+    return nullptr;
+}
+
+static bool get_repository_root(cz::Str directory, cz::String* root) {
+    if (!version_control::get_root_directory(directory, cz::heap_allocator(), root)) {
+        return false;
+    }
+    root->reserve(cz::heap_allocator(), 2);
+    if (!root->ends_with('/')) {
+        root->push('/');
+    }
+    root->null_terminate();
+    return true;
+}
+
+bool find_trigram_index_candidates(Editor* editor,
+                                   cz::Str directory,
+                                   cz::Str query,
+                                   cz::Allocator path_allocator,
+                                   cz::Vector<cz::Str>* paths,
+                                   cz::Vector<Trigram_Index::File>* indexed_files) {
+    ZoneScoped;
+
+    if (!custom::trigram_index) {
+        return false;
+    }
+
+    cz::String root = {};
+    CZ_DEFER(root.drop(cz::heap_allocator()));
+    if (!get_repository_root(directory, &root) || !directory.starts_with(root)) {
+        return false;
+    }
+
+    cz::Arc<Index_State>* arc = find_index_state(root);
+    if (!arc) {
+        cz::Arc<Index_State> created;
+        created.init_copy({});
+        created->mutex.init();
+        created->root = root.clone_null_terminate(cz::heap_allocator());
+        created->index.init();
+        index_states.reserve(cz::heap_allocator(), 1);
+        index_states.push(created);
+        arc = &index_states.last();
+    }
+    Index_State* state = arc->get();
+
+    bool start_update;
+    bool found = false;
+    {
+        state->mutex.lock();
+        CZ_DEFER(state->mutex.unlock());
+
+        start_update = !state->updating;
+        state->updating = true;
+
+        cz::Vector<uint32_t> ids = {};
+        CZ_DEFER(ids.drop(cz::heap_allocator()));
+
+        auto start = std::chrono::steady_clock::now();
+        if (state->ready && state->index.find_candidates(query, &ids)) {
+            found = true;
+
+            // Only keep files in `directory`.
+            cz::Str prefix = directory.slice_start(root.len);
+            paths->reserve(cz::heap_allocator(), ids.len);
+            for (size_t i = 0; i < ids.len; ++i) {
+                cz::Str path = state->index.files[ids[i]].path;
+                if (path.starts_with(prefix)) {
+                    paths->push(path.slice_start(prefix.len).clone(path_allocator));
+                }
+            }
+
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            state->query_us =
+                std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+            state->query_candidates = ids.len;
+
+            // Files are sorted by path so the ones in `directory` are contiguous.
+            for (size_t i = 0; i < state->index.files.len; ++i) {
+                const Trigram_Index::File& file = state->index.files[i];
+                if (file.path.starts_with(prefix)) {
+                    indexed_files->reserve(cz::heap_allocator(), 1);
+                    indexed_files->push({file.path.slice_start(prefix.len).clone(path_allocator),
+                                         file.file_time});
+                } else if (indexed_files->len > 0) {
+                    break;
+                }
+            }
+        }
+    }
+
+    if (start_update) {
+        Update_Job_Data* data = cz::heap_allocator().alloc<Update_Job_Data>();
+        CZ_ASSERT(data);
+        *data = {};
+        data->state = arc->clone();
+
+        Asynchronous_Job job;
+        job.tick = update_job_tick;
+        job.kill = update_job_kill;
+        job.data = data;
+        editor->add_asynchronous_job(job);
+    }
+
+    return found;
+}
+
+REGISTER_COMMAND(command_show_trigram_index_stats);
+void command_show_trigram_index_stats(Editor* editor, Command_Source source) {
+    cz::String root = {};
+    CZ_DEFER(root.drop(cz::heap_allocator()));
+    {
+        WITH_CONST_SELECTED_BUFFER(source.client);
+        if (!copy_version_control_directory(source.client, buffer->directory, &root)) {
+            return;
+        }
+    }
+
+    cz::Arc<Index_State>* arc = find_index_state(root);
+    if (!arc) {
+        source.client->show_message("This repository hasn't been indexed");
+        return;
+    }
+    Index_State* state = arc->get();
+
+    state->mutex.lock();
+    CZ_DEFER(state->mutex.unlock());
+
+    if (!state->ready) {
+        source.client->show_message("The trigram index is still being built");
+        return;
+    }
+
+    source.client->show_message_format(
+        "Trigram index: ", state->index.files.len, " files, ", state->index.trigrams.len,
+        " trigrams, ", state->index.byte_size() >> 10, " KB; last update took ", state->update_ms,
+        " ms reading ", state->files_read, " files; last query took ", state->query_us,
+        " us finding ", state->query_candidates, " candidates");
+}
+
+}
+}
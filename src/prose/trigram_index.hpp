@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <cz/buffer_array.hpp>
+#include <cz/date.hpp>
+#include <cz/string.hpp>
+#include <cz/vector.hpp>
+#include "core/command.hpp"
+
+namespace mag {
+struct Editor;
+
+namespace prose {
+
+/// Records which files contain each sequence of three bytes (a trigram).  A file can only
+/// contain a query if it contains every trigram in the query so intersecting the files of
+/// the query's trigrams narrows a search down to a few candidate files.
+struct Trigram_Index {
+    struct File {
+        /// The path relative to the root of the index.
+        cz::Str path;
+        cz::File_Time file_time;
+    };
+
+    /// Sorted by path.  The id of a file is its index in this array.
+    cz::Vector<File> files;
+    cz::Buffer_Array paths_buffer_array;
+
+    /// The sorted trigrams.  The sorted ids of the files containing `trigrams[i]`
+    /// are `postings[offsets[i]]` through `postings[offsets[i + 1] - 1]`.
+    cz::Vector<uint32_t> trigrams;
+    cz::Vector<uint32_t> offsets;
+    cz::Vector<uint32_t> postings;
+
+    void init();
+    void drop();
+
+    /// Find the id of the file at `path`.
+    bool find_file(cz::Str path, size_t* id) const;
+
+    /// Find the ids of the files containing every trigram in `query`.
+    /// Returns `false` if `query` is too short to narrow down the files.
+    bool find_candidates(cz::Str query, cz::Vector<uint32_t>* ids) const;
+
+    /// The number of bytes used to store the index.
+    size_t byte_size() const;
+
+    void serialize(cz::String* output) const;
+    /// Load an index made by `serialize`.  Returns `false` if `data` is corrupt.
+    /// The index must be initialized and empty.
+    bool deserialize(cz::Str data);
+};
+
+/// Builds a `Trigram_Index` while reusing the trigrams of unchanged files in an old index.
+struct Trigram_Index_Builder {
+    struct File {
+        cz::Str path;
+        cz::File_Time file_time;
+        /// The id of the file in `old` or `SIZE_MAX` if it was read.
+        size_t old_id;
+    };
+
+    const Trigram_Index* old;
+
+    cz::Vector<File> files;
+    cz::Buffer_Array paths_buffer_array;
+
+    /// `(trigram << 32) | index into files` for each unique trigram of each file that was read.
+    cz::Vector<uint64_t> pending;
+
+    /// A bit set of the trigrams in the current file.
+    cz::Vector<uint64_t> seen;
+
+    /// `old` must stay alive and unchanged until `finish` is called.  It may be `nullptr`.
+    void init(const Trigram_Index* old);
+    void drop();
+
+    /// Add a file that hasn't changed since `old` was built.
+    void add_unchanged_file(size_t old_id);
+    /// Add a new or changed file.
+    void add_file(cz::Str path, cz::File_Time file_time, cz::Str contents);
+
+    /// Build the index out of the files that were added.  `index` must be initialized and empty.
+    void finish(Trigram_Index* index);
+};
+
+bool file_times_equal(const cz::File_Time& left, const cz::File_Time& right);
+
+/// If `custom::trigram_index` is enabled and the version control repository containing
+/// `directory` has been indexed then append the paths relative to `directory` of the files
+/// that may contain `query` to `paths` and return `true`.  Otherwise returns `false`.
+///
+/// Either way this starts updating the index in the background.  The index may be out of
+/// date so every file in `directory` that the index covers is appended to `indexed_files`
+/// (relative to `directory` and sorted by path).  The caller should also check files that
+/// are missing from it, that have a different file time, or that are open.
+bool find_trigram_index_candidates(Editor* editor,
+                                   cz::Str directory,
+                                   cz::Str query,
+                                   cz::Allocator path_allocator,
+                                   cz::Vector<cz::Str>* paths,
+                                   cz::Vector<Trigram_Index::File>* indexed_files);
+
+void command_show_trigram_index_stats(Editor* editor, Command_Source source);
+
+}
+}
@@ -2,6 +2,7 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <string.h>
 #include <cz/char_type.hpp>
 #include <cz/format.hpp>
 #include <cz/sort.hpp>
@@ -18,6 +19,7 @@
 #include "core/token_iterator.hpp"
 #include "core/tracy_format.hpp"
 #include "core/visible_region.hpp"
+#include "render_generation.hpp"
 #include "custom/config.hpp"
 #include "version_control/version_control.hpp"
 
@@ -250,6 +252,15 @@ static void animate_scrolling(bool allow_animated_scrolling,
     }
 }
 
+/// Get an upper bound on the last position that can be rendered in the window.  At most
+/// `rows` lines are drawn so this is the start of the line after the last possible line.
+static uint64_t visible_end_position(const Window_Unified* window,
+                                     const Buffer* buffer,
+                                     uint64_t start) {
+    uint64_t line = buffer->contents.get_line_number(start);
+    return start_of_line_position(buffer->contents, line + window->rows()).position;
+}
+
 static Contents_Iterator update_cursors_and_run_animated_scrolling(Editor* editor,
                                                                    Client* client,
                                                                    Window_Unified* window,
@@ -505,6 +516,14 @@ static Contents_Iterator update_cursors_and_run_animated_scrolling(Editor* edito
         handle->reduce_writing_to_reading();
     }
 
+    // Index the tokens on the screen so the renderer and overlays don't each re-run the tokenizer.
+    uint64_t visible_end = visible_end_position(window, buffer, iterator.position);
+    if (!buffer->token_index.is_indexed(buffer, iterator.position, visible_end)) {
+        Buffer* buffer_mut = handle->increase_reading_to_writing();
+        buffer_mut->token_index.index_region(buffer, iterator.position, visible_end);
+        handle->reduce_writing_to_reading();
+    }
+
     return iterator;
 }
 
@@ -562,6 +581,158 @@ Face calculate_face(Editor* editor,
     return face;
 }
 
+namespace {
+/// A cursor or the boundary of a region that is inside the visible region.
+struct Cursor_Event {
+    enum Type : uint8_t {
+        POINT,
+        REGION_START,
+        REGION_END,
+    };
+
+    uint64_t position;
+    Type type;
+    bool selected;
+};
+}
+
+/// Count the elements of the sorted `positions` that are less than `position`.
+static size_t count_positions_before(cz::Slice<const uint64_t> positions, uint64_t position) {
+    size_t first = 0;
+    size_t last = positions.len;
+    while (first < last) {
+        size_t mid = (first + last) / 2;
+        if (positions[mid] < position) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+static void build_region_index(const Window_Unified* window,
+                               Window_Unified_Cache::Region_Index* index) {
+    ZoneScoped;
+
+    index->starts.len = 0;
+    index->ends.len = 0;
+    index->starts.reserve(cz::heap_allocator(), window->cursors.len);
+    index->ends.reserve(cz::heap_allocator(), window->cursors.len);
+
+    // Empty regions start and end at the same position so they never contribute.
+    for (size_t c = 0; c < window->cursors.len; ++c) {
+        const Cursor& cursor = window->cursors[c];
+        if (cursor.point != cursor.mark) {
+            index->starts.push(cursor.start());
+            index->ends.push(cursor.end());
+        }
+    }
+
+    cz::sort(index->starts);
+    cz::sort(index->ends);
+}
+
+/// Find the cursors and region boundaries between `start` and `end` (inclusive) sorted by
+/// position.  The cursors are sorted by point so they are found via binary search.  Marks can be
+/// anywhere so regions can nest or overlap each other; their boundaries are found via binary
+/// search in `region_index`, which is rebuilt if it wasn't built from `cursors_version` (`0` if
+/// unknown).  `mark_depth` and `selected_mark_depth` are set to the number of regions
+/// containing `start`.
+static void find_cursor_events(const Window_Unified* window,
+                               Window_Unified_Cache::Region_Index* region_index,
+                               uint64_t cursors_version,
+                               uint64_t start,
+                               uint64_t end,
+                               cz::Vector<Cursor_Event>* events,
+                               int* mark_depth,
+                               int* selected_mark_depth) {
+    ZoneScoped;
+
+    cz::Slice<const Cursor> cursors = window->cursors;
+
+    // Find the cursors with points in [start, end].
+    size_t first = 0;
+    size_t last = cursors.len;
+    while (first < last) {
+        size_t mid = (first + last) / 2;
+        if (cursors[mid].point < start) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    for (size_t c = first; c < cursors.len && cursors[c].point <= end; ++c) {
+        events->reserve(cz::heap_allocator(), 1);
+        events->push({cursors[c].point, Cursor_Event::POINT, c == window->selected_cursor});
+    }
+
+    if (!window->show_marks) {
+        return;
+    }
+
+    if (cursors_version == 0 || region_index->cursors_version != cursors_version) {
+        build_region_index(window, region_index);
+        region_index->cursors_version = cursors_version;
+    }
+
+    cz::Slice<const uint64_t> starts = region_index->starts;
+    cz::Slice<const uint64_t> ends = region_index->ends;
+
+    // Every region ending at or before `start` also starts before it so the
+    // difference is the number of regions starting before and ending after `start`.
+    size_t first_start = count_positions_before(starts, start);
+    size_t first_end = count_positions_before(ends, start + 1);
+    *mark_depth = (int)(first_start - first_end);
+
+    // The boundaries don't say which region they belong to.  Flag one boundary at each
+    // end of the selected region; regions sharing a boundary are indistinguishable.
+    const Cursor& selected = window->sel();
+    bool selected_region = (selected.point != selected.mark);
+    if (selected_region && selected.start() < start && selected.end() > start) {
+        ++*selected_mark_depth;
+    }
+
+    bool flagged_start = !selected_region;
+    for (size_t i = first_start; i < starts.len && starts[i] <= end; ++i) {
+        bool flag = (!flagged_start && starts[i] == selected.start());
+        flagged_start |= flag;
+        events->reserve(cz::heap_allocator(), 1);
+        events->push({starts[i], Cursor_Event::REGION_START, flag});
+    }
+
+    bool flagged_end = !selected_region;
+    for (size_t i = first_end; i < ends.len && ends[i] <= end; ++i) {
+        bool flag = (!flagged_end && ends[i] == selected.end());
+        flagged_end |= flag;
+        events->reserve(cz::heap_allocator(), 1);
+        events->push({ends[i], Cursor_Event::REGION_END, flag});
+    }
+
+    cz::sort(*events, [](const Cursor_Event* left, const Cursor_Event* right) {
+        return left->position < right->position;
+    });
+}
+
+/// Apply the region boundaries before `position` and skip the cursors.
+static void skip_cursor_events(cz::Slice<const Cursor_Event> events,
+                               size_t* next_event,
+                               uint64_t position,
+                               int* mark_depth,
+                               int* selected_mark_depth) {
+    for (; *next_event < events.len && events[*next_event].position < position; ++*next_event) {
+        const Cursor_Event& event = events[*next_event];
+        if (event.type == Cursor_Event::POINT) {
+            continue;
+        }
+        int delta = (event.type == Cursor_Event::REGION_START ? 1 : -1);
+        *mark_depth += delta;
+        if (event.selected) {
+            *selected_mark_depth += delta;
+        }
+    }
+}
+
 static void draw_buffer_contents(const DrawingContext& drawing_context,
                                  Window_Cache* window_cache,
                                  Editor* editor,
@@ -587,19 +758,29 @@ static void draw_buffer_contents(const DrawingContext& drawing_context,
 
     cz::Slice<Cursor> cursors = window->cursors;
 
+    // Find the cursors and regions on the screen so each character
+    // doesn't need to be compared against every single cursor.
     int mark_depth = 0;
     int selected_mark_depth = 0;
-    // Initialize show_mark to number of regions at start of visible region.
-    if (window->show_marks) {
-        for (size_t c = 0; c < cursors.len; ++c) {
-            if (iterator.position > cursors[c].start() && iterator.position < cursors[c].end()) {
-                ++mark_depth;
-                if (c == window->selected_cursor) {
-                    ++selected_mark_depth;
-                }
-            }
+    cz::Vector<Cursor_Event> cursor_events = {};
+    CZ_DEFER(cursor_events.drop(cz::heap_allocator()));
+    Window_Unified_Cache::Region_Index temporary_region_index = {};
+    CZ_DEFER(temporary_region_index.drop());
+    Window_Unified_Cache::Region_Index* region_index = &temporary_region_index;
+    uint64_t version = 0;
+    if (window_cache) {
+        // Only trust the version if drawing hasn't moved or killed any cursors.
+        Window_Unified_Cache* cache = &window_cache->v.unified;
+        region_index = &cache->region_index;
+        if (cache->cursors_change_index == window->change_index &&
+            cache->cursors_len == window->cursors.len) {
+            version = cache->cursors_version;
         }
     }
+    find_cursor_events(window, region_index, version, iterator.position,
+                       visible_end_position(window, buffer, iterator.position), &cursor_events,
+                       &mark_depth, &selected_mark_depth);
+    size_t next_cursor_event = 0;
 
     CZ_DEFER({
         for (size_t i = 0; i < editor->theme.overlays.len; ++i) {
@@ -642,33 +823,28 @@ static void draw_buffer_contents(const DrawingContext& drawing_context,
     while (!iterator.at_eob()) {
         token_it.find_at_or_after(iterator.position);
 
-        if (window->show_marks) {
-            for (size_t c = 0; c < cursors.len; ++c) {
-                if (iterator.position == cursors[c].start()) {
-                    ++mark_depth;
-                    if (c == window->selected_cursor) {
-                        ++selected_mark_depth;
-                    }
-                }
-                if (iterator.position == cursors[c].end()) {
-                    --mark_depth;
-                    if (c == window->selected_cursor) {
-                        --selected_mark_depth;
-                    }
-                }
-            }
-        }
+        skip_cursor_events(cursor_events, &next_cursor_event, iterator.position, &mark_depth,
+                           &selected_mark_depth);
 
         bool has_selected_cursor = false;
         bool has_cursor = false;
-        for (size_t c = 0; c < cursors.len; ++c) {
-            if (iterator.position == cursors[c].point) {
+        for (; next_cursor_event < cursor_events.len &&
+               cursor_events[next_cursor_event].position == iterator.position;
+             ++next_cursor_event) {
+            const Cursor_Event& event = cursor_events[next_cursor_event];
+            if (event.type == Cursor_Event::POINT) {
                 has_cursor = true;
-                if (c == window->selected_cursor) {
+                if (event.selected) {
                     has_selected_cursor = true;
                     *cursor_pos_y = y;
                     *cursor_pos_x = x;
                 }
+            } else {
+                int delta = (event.type == Cursor_Event::REGION_START ? 1 : -1);
+                mark_depth += delta;
+                if (event.selected) {
+                    selected_mark_depth += delta;
+                }
             }
         }
 
@@ -789,23 +965,8 @@ static void draw_buffer_contents(const DrawingContext& drawing_context,
 
             token_it.init_at_or_after(buffer, eol.position);
 
-            if (window->show_marks) {
-                for (size_t c = 0; c < cursors.len; ++c) {
-                    if (cursors[c].start() > iterator.position &&
-                        cursors[c].start() < eol.position) {
-                        ++mark_depth;
-                        if (c == window->selected_cursor) {
-                            ++selected_mark_depth;
-                        }
-                    }
-                    if (cursors[c].end() > iterator.position && cursors[c].end() < eol.position) {
-                        --mark_depth;
-                        if (c == window->selected_cursor) {
-                            --selected_mark_depth;
-                        }
-                    }
-                }
-            }
+            skip_cursor_events(cursor_events, &next_cursor_event, eol.position, &mark_depth,
+                               &selected_mark_depth);
 
             iterator = eol;
         } else {
@@ -1103,11 +1264,28 @@ static void setup_unified_window_cache(Editor* editor,
         destroy_window_cache_children(*window_cache);
         cache_window_unified_create(editor, *window_cache, window, buffer);
     } else if ((*window_cache)->v.unified.window_id != window->id) {
+        destroy_window_cache_children(*window_cache);
         cache_window_unified_create(editor, *window_cache, window, buffer);
     }
 }
 
+/// Copy the cells of a window from the previous frame.
+static void copy_window_cells(Cell* cells,
+                              const Cell* previous_cells,
+                              size_t total_cols,
+                              const Window* window,
+                              size_t start_row,
+                              size_t start_col) {
+    ZoneScoped;
+
+    for (size_t y = 0; y < window->total_rows; ++y) {
+        size_t index = (start_row + y) * total_cols + start_col;
+        memcpy(cells + index, previous_cells + index, window->total_cols * sizeof(Cell));
+    }
+}
+
 static void draw_window(Cell* cells,
+                        const Cell* previous_cells,
                         Window_Cache** window_cache,
                         size_t total_cols,
                         Editor* editor,
@@ -1127,8 +1305,34 @@ static void draw_window(Cell* cells,
 
         setup_unified_window_cache(editor, window, buffer, window_cache);
 
-        draw_buffer(cells, *window_cache, total_cols, editor, client, any_animated_scrolling,
+        // Reuse the previous frame if nothing observable changed.
+        Window_Unified_Cache* cache = &(*window_cache)->v.unified;
+        cache->cursors_version = cursors_version(window);
+        cache->cursors_change_index = window->change_index;
+        cache->cursors_len = window->cursors.len;
+        uint64_t version =
+            window_render_version(editor, client, window, buffer, cache->cursors_version);
+        if (previous_cells && version != 0 && version == cache->render_version) {
+            copy_window_cells(cells, previous_cells, total_cols, window, start_row, start_col);
+            client->cursor_pos_y = cache->cursor_pos_y;
+            client->cursor_pos_x = cache->cursor_pos_x;
+            break;
+        }
+
+        bool animated_scrolling = false;
+        draw_buffer(cells, *window_cache, total_cols, editor, client, &animated_scrolling,
                     window, buffer, window == selected_window, start_row, start_col);
+        *any_animated_scrolling |= animated_scrolling;
+
+        // Drawing can update the window (ie to keep the cursor on screen)
+        // so compute the version of the state that was actually drawn.
+        cache->render_version = 0;
+        if (!animated_scrolling) {
+            cache->render_version =
+                window_render_version(editor, client, window, buffer, cursors_version(window));
+        }
+        cache->cursor_pos_y = client->cursor_pos_y;
+        cache->cursor_pos_x = client->cursor_pos_x;
         break;
     }
 
@@ -1148,8 +1352,8 @@ static void draw_window(Cell* cells,
         }
 
         if (window->tag == Window::VERTICAL_SPLIT) {
-            draw_window(cells, &(*window_cache)->v.split.first, total_cols, editor, client,
-                        any_animated_scrolling, window->first, selected_window, start_row,
+            draw_window(cells, previous_cells, &(*window_cache)->v.split.first, total_cols, editor,
+                        client, any_animated_scrolling, window->first, selected_window, start_row,
                         start_col);
 
             {
@@ -1160,18 +1364,18 @@ static void draw_window(Cell* cells,
                 }
             }
 
-            draw_window(cells, &(*window_cache)->v.split.second, total_cols, editor, client,
-                        any_animated_scrolling, window->second, selected_window, start_row,
+            draw_window(cells, previous_cells, &(*window_cache)->v.split.second, total_cols, editor,
+                        client, any_animated_scrolling, window->second, selected_window, start_row,
                         start_col + window->total_cols - window->second->total_cols);
         } else {
-            draw_window(cells, &(*window_cache)->v.split.first, total_cols, editor, client,
-                        any_animated_scrolling, window->first, selected_window, start_row,
+            draw_window(cells, previous_cells, &(*window_cache)->v.split.first, total_cols, editor,
+                        client, any_animated_scrolling, window->first, selected_window, start_row,
                         start_col);
 
             // No separator as the window title acts as it.
 
-            draw_window(cells, &(*window_cache)->v.split.second, total_cols, editor, client,
-                        any_animated_scrolling, window->second, selected_window,
+            draw_window(cells, previous_cells, &(*window_cache)->v.split.second, total_cols, editor,
+                        client, any_animated_scrolling, window->second, selected_window,
                         start_row + window->total_rows - window->second->total_rows, start_col);
         }
         break;
@@ -1260,58 +1464,23 @@ static bool load_completion_cache(Editor* editor,
                                      completion_cache->state == Completion_Cache::INITIAL);
     }
 
-    if (completion_cache->state != Completion_Cache::LOADED || engine_change) {
-        completion_cache->filter_context.selected = 0;
-        completion_cache->filter_context.results.len = 0;
-        completion_cache->filter_context.results.reserve(
-            completion_cache->engine_context.results.len);
+    // Results that were only appended to are filtered without starting over.
+    if (completion_cache->state == Completion_Cache::INITIAL ||
+        (engine_change && !completion_cache->engine_context.results_appended)) {
+        completion_cache->filter_context.reset();
+    }
+
+    if (completion_cache->state != Completion_Cache::LOADED || engine_change ||
+        completion_cache->filter_context.incomplete) {
         completion_filter(editor, &completion_cache->filter_context,
                           &completion_cache->engine_context, selected_result, has_selected_result);
     }
+    completion_cache->engine_context.results_appended = false;
 
     completion_cache->state = Completion_Cache::LOADED;
     return true;
 }
 
-void process_buffer_external_updates(Client* client, Window* window) {
-    ZoneScoped;
-
-    switch (window->tag) {
-    case Window::UNIFIED: {
-        Window_Unified* w = (Window_Unified*)window;
-        WITH_CONST_WINDOW_BUFFER(w, client);
-
-        if (!buffer->is_unchanged() || !buffer->has_file_time) {
-            return;
-        }
-
-        cz::String path = {};
-        CZ_DEFER(path.drop(cz::heap_allocator()));
-        if (!buffer->get_path(cz::heap_allocator(), &path)) {
-            return;
-        }
-
-        cz::File_Time file_time = buffer->file_time;
-        if (check_out_of_date_and_update_file_time(path.buffer, &file_time)) {
-            Buffer* buffer_mut = handle->increase_reading_to_writing();
-            buffer_mut->file_time = file_time;
-            const char* message = reload_file(buffer_mut);
-            if (message)
-                client->show_message(message);
-        }
-
-        break;
-    }
-
-    default: {
-        auto w = (Window_Split*)window;
-        process_buffer_external_updates(client, w->first);
-        process_buffer_external_updates(client, w->second);
-        break;
-    }
-    }
-}
-
 static void draw_mini_buffer_buffer(Cell* cells,
                                     Window_Cache** mini_buffer_window_cache,
                                     size_t total_rows,
@@ -1538,6 +1707,7 @@ static size_t draw_mini_buffer(Cell* cells,
 }
 
 void render_to_cells(Cell* cells,
+                     const Cell* previous_cells,
                      Window_Cache** window_cache,
                      Window_Cache** mini_buffer_window_cache,
                      size_t total_rows,
@@ -1555,8 +1725,8 @@ void render_to_cells(Cell* cells,
     }
 
     client->window->set_size(total_rows, total_cols);
-    draw_window(cells, window_cache, total_cols, editor, client, any_animated_scrolling,
-                client->window, client->selected_normal_window, 0, 0);
+    draw_window(cells, previous_cells, window_cache, total_cols, editor, client,
+                any_animated_scrolling, client->window, client->selected_normal_window, 0, 0);
     recalculate_mouse(editor->theme, client);
 }
 
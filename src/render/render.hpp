@@ -15,9 +15,10 @@ namespace render {
 
 bool load_mini_buffer_completion_cache(Server* server, Client* client);
 
-void process_buffer_external_updates(Client* client, Window* window);
-
+/// Render the editor to `cells`.  If `previous_cells` is not null then it must be the previous
+/// frame's result at the same size; unchanged windows are then copied from it instead of redrawn.
 void render_to_cells(Cell* cells,
+                     const Cell* previous_cells,
                      Window_Cache** window_cache,
                      Window_Cache** mini_buffer_window_cache,
                      size_t total_rows,
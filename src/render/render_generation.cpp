@@ -0,0 +1,262 @@
+#include "render_generation.hpp"
+
+#include <chrono>
+#include <cz/defer.hpp>
+#include <tracy/Tracy.hpp>
+#include "core/buffer_handle.hpp"
+#include "core/decoration.hpp"
+#include "core/overlay.hpp"
+#include "prose/compiler.hpp"
+
+namespace mag {
+namespace render {
+
+namespace {
+struct Hasher {
+    uint64_t hash = 0xcbf29ce484222325;
+
+    void bytes(const void* data, size_t len) {
+        for (size_t i = 0; i < len; ++i) {
+            hash ^= ((const uint8_t*)data)[i];
+            hash *= 0x100000001b3;
+        }
+    }
+
+    template <class T>
+    void value(const T& t) {
+        bytes(&t, sizeof(t));
+    }
+
+    /// Never return `0` since it means the state is unknown.
+    uint64_t finish() const { return hash | 1; }
+};
+}
+
+static void hash_face_color(Hasher* hasher, Face_Color color) {
+    hasher->value(color.is_themed);
+    if (color.is_themed) {
+        hasher->value(color.x.theme_index);
+    } else {
+        hasher->value(color.x.color.r);
+        hasher->value(color.x.color.g);
+        hasher->value(color.x.color.b);
+    }
+}
+
+static void hash_face(Hasher* hasher, const Face& face) {
+    hash_face_color(hasher, face.foreground);
+    hash_face_color(hasher, face.background);
+    hasher->value(face.flags);
+}
+
+/// Decorations and overlays are opaque.  Their state is changed by
+/// commands which are accounted for via `Client::commands_ran`.
+static void hash_decorations_and_overlays(Hasher* hasher,
+                                          cz::Slice<const Decoration> decorations,
+                                          cz::Slice<const Overlay> overlays) {
+    hasher->value(decorations.len);
+    for (size_t i = 0; i < decorations.len; ++i) {
+        hasher->value(decorations[i].vtable);
+        hasher->value(decorations[i].data);
+    }
+    hasher->value(overlays.len);
+    for (size_t i = 0; i < overlays.len; ++i) {
+        hasher->value(overlays[i].vtable);
+        hasher->value(overlays[i].data);
+    }
+}
+
+/// Hash the settings of `mode` that affect rendering.
+static void hash_mode(Hasher* hasher, const Mode& mode) {
+    hasher->value(mode.next_token);
+    hash_decorations_and_overlays(hasher, mode.decorations, mode.overlays);
+    hasher->value(mode.indent_width);
+    hasher->value(mode.tab_width);
+    hasher->value(mode.use_tabs);
+    hasher->value(mode.preferred_column);
+    hasher->value(mode.wrap_long_lines);
+    hasher->value(mode.render_bucket_boundaries);
+}
+
+/// Hash the settings of `theme` that affect rendering.
+static void hash_theme(Hasher* hasher, const Theme& theme) {
+    hasher->value(theme.colors);
+    if (theme.colors) {
+        hasher->bytes(theme.colors, 256 * sizeof(*theme.colors));
+    }
+    for (size_t i = 0; i < Face_Type::length; ++i) {
+        hash_face(hasher, theme.special_faces[i]);
+    }
+    for (size_t i = 0; i < Token_Type::length; ++i) {
+        hash_face(hasher, theme.token_faces[i]);
+    }
+    hash_decorations_and_overlays(hasher, theme.decorations, theme.overlays);
+    hasher->value(theme.max_completion_results);
+    hasher->value(theme.mini_buffer_max_height);
+    hasher->value(theme.draw_line_numbers);
+    hasher->value(theme.allow_animated_scrolling);
+    hasher->value(theme.scroll_outside_visual_rows);
+    hasher->value(theme.scroll_jump_half_page_when_outside_visible_region);
+    hasher->value(theme.scroll_outside_visual_columns);
+}
+
+static void hash_buffer(Hasher* hasher, const Buffer* buffer) {
+    hasher->value(buffer);
+    hasher->value(buffer->contents.len);
+    hasher->value(buffer->changes.len);
+    hasher->value(buffer->commit_index);
+    hasher->value(buffer->saved_commit_id.is_present);
+    if (buffer->saved_commit_id.is_present) {
+        hasher->value(buffer->saved_commit_id.value);
+    }
+    hasher->value(buffer->read_only);
+    hasher->value(buffer->type);
+    hasher->value(buffer->use_carriage_returns);
+    hasher->bytes(buffer->name.buffer, buffer->name.len);
+    hasher->bytes(buffer->directory.buffer, buffer->directory.len);
+
+    // Syntax highlighting progresses asynchronously without changing the `Buffer`.
+    hasher->value(buffer->token_cache.change_index);
+    hasher->value(buffer->token_cache.check_points.len);
+    hasher->value(buffer->token_cache.ran_to_end);
+
+    hash_mode(hasher, buffer->mode);
+}
+
+uint64_t cursors_version(const Window_Unified* window) {
+    Hasher hasher;
+    hasher.value(window->cursors.len);
+    for (size_t i = 0; i < window->cursors.len; ++i) {
+        hasher.value(window->cursors[i].point);
+        hasher.value(window->cursors[i].mark);
+    }
+    return hasher.finish();
+}
+
+static void hash_window(Hasher* hasher, const Window_Unified* window, uint64_t cursors_version) {
+    hasher->value(window);
+    hasher->value(window->id);
+    hasher->value(window->total_rows);
+    hasher->value(window->total_cols);
+    hasher->value(window->start_position);
+    hasher->value(window->column_offset);
+    hasher->value(window->change_index);
+    hasher->value(window->selected_cursor);
+    hasher->value(window->show_marks);
+    hasher->value(window->completing);
+    hasher->value(window->pinned);
+    hasher->value(cursors_version);
+}
+
+/// Hash the state shared between all windows.
+static void hash_shared(Hasher* hasher, const Editor* editor, const Client* client) {
+    hash_theme(hasher, editor->theme);
+    // Commands can change state that isn't hashed such as overlays' settings.
+    hasher->value(client->commands_ran);
+    hasher->value(prose::installed_messages_generation());
+    hasher->value(editor->synchronous_jobs.len);
+    hasher->value(editor->num_uncompleted_async_jobs.load());
+    hasher->value(client->selected_normal_window);
+    hasher->value(client->_select_mini_buffer);
+    hasher->value(client->_message.tag);
+}
+
+uint64_t window_render_version(const Editor* editor,
+                               const Client* client,
+                               const Window_Unified* window,
+                               const Buffer* buffer,
+                               uint64_t cursors_version) {
+    // Always redraw windows with completion popups or while prompting
+    // since overlays such as search highlighting look at the prompt.
+    if (window->completing || client->_message.tag == Message::RESPOND) {
+        return 0;
+    }
+
+    Hasher hasher;
+    hash_shared(&hasher, editor, client);
+    hash_window(&hasher, window, cursors_version);
+    hash_buffer(&hasher, buffer);
+    return hasher.finish();
+}
+
+static bool hash_window_tree(Hasher* hasher, const Client* client, const Window* w) {
+    hasher->value(w->tag);
+    hasher->value(w->total_rows);
+    hasher->value(w->total_cols);
+
+    switch (w->tag) {
+    case Window::UNIFIED: {
+        const Window_Unified* window = (const Window_Unified*)w;
+        const Buffer* buffer = window->buffer_handle->try_lock_reading();
+        if (!buffer) {
+            return false;
+        }
+        CZ_DEFER(window->buffer_handle->unlock());
+
+        hash_window(hasher, window, cursors_version(window));
+        hash_buffer(hasher, buffer);
+        return true;
+    }
+
+    case Window::VERTICAL_SPLIT:
+    case Window::HORIZONTAL_SPLIT: {
+        const Window_Split* window = (const Window_Split*)w;
+        hasher->value(window->split_ratio);
+        return hash_window_tree(hasher, client, window->first) &&
+               hash_window_tree(hasher, client, window->second);
+    }
+    }
+
+    return false;
+}
+
+uint64_t render_generation(const Editor* editor,
+                           const Client* client,
+                           size_t total_rows,
+                           size_t total_cols) {
+    ZoneScoped;
+
+    // Jobs can change arbitrary state so render every frame while they run.
+    if (editor->synchronous_jobs.len > 0 || editor->num_uncompleted_async_jobs.load() > 0) {
+        return 0;
+    }
+
+    Hasher hasher;
+    hasher.value(total_rows);
+    hasher.value(total_cols);
+    hash_shared(&hasher, editor, client);
+
+    // Messages expire after a timeout (see `draw_mini_buffer_buffer`).
+    hasher.value(client->_message.start);
+    hasher.value(client->_message.end);
+    hasher.value(client->_message.completion_engine);
+    bool message_expired =
+        std::chrono::system_clock::now() - client->_message_time > std::chrono::seconds(5);
+    hasher.value(message_expired);
+
+    const Completion_Cache& completion = client->mini_buffer_completion_cache;
+    hasher.value(completion.state);
+    hasher.value(completion.change_index);
+    hasher.value(completion.filter_context.results.len);
+    hasher.value(completion.filter_context.selected);
+
+    if (!hash_window_tree(&hasher, client, client->mini_buffer_window())) {
+        return 0;
+    }
+    {
+        const Buffer* messages = client->messages_buffer_handle->try_lock_reading();
+        if (!messages) {
+            return 0;
+        }
+        CZ_DEFER(client->messages_buffer_handle->unlock());
+        hash_buffer(&hasher, messages);
+    }
+    if (!hash_window_tree(&hasher, client, client->window)) {
+        return 0;
+    }
+
+    return hasher.finish();
+}
+
+}
+}
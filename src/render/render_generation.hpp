@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "core/buffer.hpp"
+#include "core/client.hpp"
+#include "core/editor.hpp"
+#include "core/window.hpp"
+
+namespace mag {
+namespace render {
+
+/// Hash the points and marks of the cursors of `window`.  Never returns `0`.
+uint64_t cursors_version(const Window_Unified* window);
+
+/// Hash the state that is observable when drawing `window` over `buffer`.  If the version
+/// doesn't change between frames then the window's cells from the previous frame can be reused.
+/// `cursors_version` is the `cursors_version` of `window`.
+uint64_t window_render_version(const Editor* editor,
+                               const Client* client,
+                               const Window_Unified* window,
+                               const Buffer* buffer,
+                               uint64_t cursors_version);
+
+/// Hash all the state observable by `render_to_cells`.  If the generation doesn't change between
+/// frames then the previous frame can be reused as is.  Returns `0` if the state can't be
+/// determined (jobs are running or a `Buffer` is locked), meaning a render is always required.
+uint64_t render_generation(const Editor* editor,
+                           const Client* client,
+                           size_t total_rows,
+                           size_t total_cols);
+
+}
+}
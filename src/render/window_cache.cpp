@@ -7,9 +7,15 @@
 namespace mag {
 namespace render {
 
+void Window_Unified_Cache::Region_Index::drop() {
+    starts.drop(cz::heap_allocator());
+    ends.drop(cz::heap_allocator());
+}
+
 void destroy_window_cache_children(Window_Cache* window_cache) {
     switch (window_cache->tag) {
     case Window::UNIFIED:
+        window_cache->v.unified.region_index.drop();
         break;
     case Window::VERTICAL_SPLIT:
     case Window::HORIZONTAL_SPLIT:
@@ -18,6 +18,28 @@ struct Window_Unified_Cache {
     size_t cursor_count;
     uint64_t selected_cursor_mark;
 
+    /// The `window_render_version` when the window was last drawn or `0` if it must be redrawn.
+    uint64_t render_version;
+    /// The selected cursor's position on the screen when the window was last drawn.
+    size_t cursor_pos_y, cursor_pos_x;
+
+    /// The `cursors_version` of the window at the start of the frame along with the state
+    /// it was computed in.  Drawing can move or kill cursors; then the version is stale.
+    uint64_t cursors_version;
+    size_t cursors_change_index;
+    size_t cursors_len;
+
+    /// The boundaries of the non-empty regions sorted by position so the regions
+    /// overlapping the visible region can be found via binary search.
+    struct Region_Index {
+        /// The `cursors_version` the index was built from or `0` if it must be rebuilt.
+        uint64_t cursors_version;
+        cz::Vector<uint64_t> starts;
+        cz::Vector<uint64_t> ends;
+
+        void drop();
+    } region_index;
+
     // Animate when the visible region shifts.
     struct Animated_Scrolling {
         std::chrono::system_clock::time_point start_time;
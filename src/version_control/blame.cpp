@@ -198,6 +198,7 @@ static Asynchronous_Job job_blame_append(cz::Arc_Weak<Buffer_Handle> handle,
     job.tick = job_blame_append_tick;
     job.kill = job_blame_append_kill;
     job.data = data;
+    job.buffer = job_buffer_key(handle);
     return job;
 }
 
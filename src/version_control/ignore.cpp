@@ -226,6 +226,31 @@ void find_ignore_rules(cz::Str root, Ignore_Rules* rules) {
     }
 }
 
+bool is_ignore_file(cz::Str name) {
+    return name == ".ignore" || name == ".agignore" || name == ".hgignore" ||
+           name == ".gitignore" || name == ".gitmodules";
+}
+
+bool get_global_ignore_files(cz::Allocator allocator, cz::Vector<cz::Str>* paths) {
+    cz::String home = {};
+    CZ_DEFER(home.drop(cz::heap_allocator()));
+    if (!cz::env::get_home(cz::heap_allocator(), &home)) {
+        return false;
+    }
+
+    cz::Str names[] = {"/.ignore", "/.agignore", "/.gitignore"};
+    paths->reserve(cz::heap_allocator(), sizeof(names) / sizeof(*names));
+    for (size_t i = 0; i < sizeof(names) / sizeof(*names); ++i) {
+        cz::String path = {};
+        path.reserve_exact(allocator, home.len + names[i].len + 1);
+        path.append(home);
+        path.append(names[i]);
+        path.null_terminate();
+        paths->push(path);
+    }
+    return true;
+}
+
 bool file_matches(const Ignore_Rules& rules, cz::Str path) {
     ZoneScoped;
 
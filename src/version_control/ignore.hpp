@@ -22,6 +22,13 @@ struct Ignore_Rules {
 /// Find ignore rules based of the ignore files present in the `root` directory.
 void find_ignore_rules(cz::Str root, Ignore_Rules* rules);
 
+/// Test if `name` is a file `find_ignore_rules` reads from the `root` directory.
+bool is_ignore_file(cz::Str name);
+
+/// Get the paths of the ignore files in the home directory `find_ignore_rules` reads.
+/// The paths are allocated with `allocator`.  Returns `false` if there is no home directory.
+bool get_global_ignore_files(cz::Allocator allocator, cz::Vector<cz::Str>* paths);
+
 /// Parse ignore rules from a ignore file's contents.
 void parse_ignore_rules(cz::Str contents, Ignore_Rules* rules);
 
@@ -1,6 +1,12 @@
 #include <czt/test_base.hpp>
 
+#include <stdlib.h>
+#include <string.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include <cz/util.hpp>
 #include "core/completion.hpp"
+#include "custom/config.hpp"
 #include "test_runner.hpp"
 
 using namespace mag;
@@ -96,3 +102,251 @@ TEST_CASE("spaces_are_wildcards_completion_filter commands") {
     CHECK(context.results[0] == "command_backward_line");
     CHECK(context.selected == 0);
 }
+
+/// Run the filter until it has checked every result.
+static void filter_all(Completion_Filter filter,
+                       Completion_Filter_Context* context,
+                       Completion_Engine_Context* engine_context,
+                       cz::Str selected_result,
+                       bool has_selected_result) {
+    do {
+        filter(/*editor=*/nullptr, context, engine_context, selected_result,
+               has_selected_result);
+    } while (context->incomplete);
+}
+
+TEST_CASE("completion filters narrow incrementally") {
+    // Check a single block of results per call so the filters have to resume.
+    uint64_t old_budget = custom::completion_filter_budget;
+    custom::completion_filter_budget = 0;
+    CZ_DEFER(custom::completion_filter_budget = old_budget);
+
+    Completion_Engine_Context engine_context = {};
+    engine_context.init();
+    CZ_DEFER(engine_context.drop());
+
+    const char* pieces[] = {"src/", "core/", "file", "Find", "_", ".cpp", ".hpp", "a"};
+    const size_t pieces_len = sizeof(pieces) / sizeof(*pieces);
+    cz::String strings = {};
+    CZ_DEFER(strings.drop(cz::heap_allocator()));
+    cz::Vector<size_t> ends = {};
+    CZ_DEFER(ends.drop(cz::heap_allocator()));
+    srand(7);
+    for (size_t i = 0; i < 5000; ++i) {
+        size_t count = 1 + rand() % 5;
+        for (size_t j = 0; j < count; ++j) {
+            cz::Str piece = pieces[rand() % pieces_len];
+            strings.reserve(cz::heap_allocator(), piece.len);
+            strings.append(piece);
+        }
+        ends.reserve(cz::heap_allocator(), 1);
+        ends.push(strings.len);
+    }
+    engine_context.results.reserve(ends.len);
+    for (size_t i = 0; i < ends.len; ++i) {
+        size_t start = i == 0 ? 0 : ends[i - 1];
+        engine_context.results.push(strings.slice(start, ends[i]));
+    }
+
+    Completion_Filter filters[] = {prefix_completion_filter, infix_completion_filter,
+                                   spaces_are_wildcards_completion_filter};
+    const char* queries[] = {"s",      "sr",    "src/",  "src/f", "src/fi$", "src/fil",
+                             "src/%f", "c",     "co f",  "co fi", "co fi.",  "",
+                             "^src",   "^src ", "^src a"};
+    for (size_t f = 0; f < sizeof(filters) / sizeof(*filters); ++f) {
+        Completion_Filter_Context context = {};
+        CZ_DEFER(context.drop());
+
+        for (size_t q = 0; q < sizeof(queries) / sizeof(*queries); ++q) {
+            engine_context.query.len = 0;
+            engine_context.query.reserve(cz::heap_allocator(), strlen(queries[q]));
+            engine_context.query.append(queries[q]);
+
+            // Change the query before the previous one finished.
+            filters[f](/*editor=*/nullptr, &context, &engine_context, {}, false);
+            if (q % 2 == 0) {
+                continue;
+            }
+            filter_all(filters[f], &context, &engine_context, {}, false);
+
+            Completion_Filter_Context fresh = {};
+            CZ_DEFER(fresh.drop());
+            filter_all(filters[f], &fresh, &engine_context, {}, false);
+            CHECK(context.results == fresh.results);
+        }
+    }
+
+    // The selected result is kept even if it is found in a later call.
+    Completion_Filter_Context context = {};
+    CZ_DEFER(context.drop());
+    engine_context.query.len = 0;
+    cz::Str selected = engine_context.results[engine_context.results.len - 1];
+    filter_all(spaces_are_wildcards_completion_filter, &context, &engine_context, selected,
+               true);
+    REQUIRE(context.selected < context.results.len);
+    CHECK(context.results[context.selected] == selected);
+}
+
+TEST_CASE("fuzzy_completion_filter ranks matches") {
+    Completion_Filter_Context context = {};
+    Completion_Engine_Context engine_context = {};
+    engine_context.init();
+    CZ_DEFER(context.drop());
+    CZ_DEFER(engine_context.drop());
+    engine_context.results.reserve(7);
+    engine_context.results.push("src/prose/alternate.cpp");
+    engine_context.results.push("src/core/command.cpp");
+    engine_context.results.push("tests/test_completion.cpp");
+    engine_context.results.push("src/core/completion.cpp");
+    engine_context.results.push("src/core/completion.hpp");
+    engine_context.results.push("src/custom/config.cpp");
+    engine_context.results.push("README.md");
+
+    // With no query the results are kept in order.
+    engine_context.query = cz::format("");
+    filter_all(fuzzy_completion_filter, &context, &engine_context,
+               /*selected_result=*/"src/core/command.cpp", /*has_selected_result=*/true);
+    CHECK(context.results == engine_context.results);
+    CHECK(context.selected == 1);
+
+    engine_context.query = cz::format("compcpp");
+    filter_all(fuzzy_completion_filter, &context, &engine_context, /*selected_result=*/{},
+               /*has_selected_result=*/false);
+    REQUIRE(context.results.len == 2);
+    CHECK(context.results[0] == "src/core/completion.cpp");
+    CHECK(context.results[1] == "tests/test_completion.cpp");
+
+    // Terms separated by spaces can match in any order.
+    engine_context.query = cz::format("hpp core");
+    filter_all(fuzzy_completion_filter, &context, &engine_context, /*selected_result=*/{},
+               /*has_selected_result=*/false);
+    REQUIRE(context.results.len == 1);
+    CHECK(context.results[0] == "src/core/completion.hpp");
+
+    // Uppercase characters only match uppercase characters.
+    engine_context.query = cz::format("RM");
+    filter_all(fuzzy_completion_filter, &context, &engine_context, /*selected_result=*/{},
+               /*has_selected_result=*/false);
+    REQUIRE(context.results.len == 1);
+    CHECK(context.results[0] == "README.md");
+
+    engine_context.query = cz::format("xyz");
+    filter_all(fuzzy_completion_filter, &context, &engine_context, /*selected_result=*/{},
+               /*has_selected_result=*/false);
+    CHECK(context.results.len == 0);
+}
+
+TEST_CASE("fuzzy_completion_filter narrows incrementally") {
+    uint64_t old_budget = custom::completion_filter_budget;
+    custom::completion_filter_budget = 0;
+    CZ_DEFER(custom::completion_filter_budget = old_budget);
+
+    Completion_Engine_Context engine_context = {};
+    engine_context.init();
+    CZ_DEFER(engine_context.drop());
+
+    const char* pieces[] = {"src/", "core/", "file", "_", "config", ".cpp", ".hpp", "Test"};
+    const size_t pieces_len = sizeof(pieces) / sizeof(*pieces);
+    cz::String strings = {};
+    CZ_DEFER(strings.drop(cz::heap_allocator()));
+    cz::Vector<size_t> ends = {};
+    CZ_DEFER(ends.drop(cz::heap_allocator()));
+    srand(11);
+    for (size_t i = 0; i < 5000; ++i) {
+        size_t count = 1 + rand() % 5;
+        for (size_t j = 0; j < count; ++j) {
+            cz::Str piece = pieces[rand() % pieces_len];
+            strings.reserve(cz::heap_allocator(), piece.len);
+            strings.append(piece);
+        }
+        ends.reserve(cz::heap_allocator(), 1);
+        ends.push(strings.len);
+    }
+    engine_context.results.reserve(ends.len);
+    for (size_t i = 0; i < ends.len; ++i) {
+        size_t start = i == 0 ? 0 : ends[i - 1];
+        engine_context.results.push(strings.slice(start, ends[i]));
+    }
+
+    const char* queries[] = {"c", "co", "cf", "cfg", "cfgh", "", "T", "Tc", "s c", "s cp"};
+    Completion_Filter_Context context = {};
+    CZ_DEFER(context.drop());
+    for (size_t q = 0; q < sizeof(queries) / sizeof(*queries); ++q) {
+        engine_context.query.len = 0;
+        engine_context.query.reserve(cz::heap_allocator(), strlen(queries[q]));
+        engine_context.query.append(queries[q]);
+
+        // Change the query before the previous one finished.
+        fuzzy_completion_filter(/*editor=*/nullptr, &context, &engine_context, {}, false);
+        if (q % 2 == 0) {
+            continue;
+        }
+        filter_all(fuzzy_completion_filter, &context, &engine_context, {}, false);
+
+        Completion_Filter_Context fresh = {};
+        CZ_DEFER(fresh.drop());
+        filter_all(fuzzy_completion_filter, &fresh, &engine_context, {}, false);
+        CHECK(context.results == fresh.results);
+    }
+}
+
+TEST_CASE("completion filters check appended results") {
+    uint64_t old_budget = custom::completion_filter_budget;
+    custom::completion_filter_budget = 0;
+    CZ_DEFER(custom::completion_filter_budget = old_budget);
+
+    const char* pieces[] = {"src/", "core/", "file", "_", "config", ".cpp", ".hpp"};
+    const size_t pieces_len = sizeof(pieces) / sizeof(*pieces);
+    cz::String strings = {};
+    CZ_DEFER(strings.drop(cz::heap_allocator()));
+    cz::Vector<size_t> ends = {};
+    CZ_DEFER(ends.drop(cz::heap_allocator()));
+    srand(13);
+    for (size_t i = 0; i < 5000; ++i) {
+        size_t count = 1 + rand() % 5;
+        for (size_t j = 0; j < count; ++j) {
+            cz::Str piece = pieces[rand() % pieces_len];
+            strings.reserve(cz::heap_allocator(), piece.len);
+            strings.append(piece);
+        }
+        ends.reserve(cz::heap_allocator(), 1);
+        ends.push(strings.len);
+    }
+
+    Completion_Filter filters[] = {prefix_completion_filter, infix_completion_filter,
+                                   spaces_are_wildcards_completion_filter,
+                                   fuzzy_completion_filter};
+    const char* queries[] = {"s", "sr", "c", "co", "cof", "f"};
+    for (size_t f = 0; f < sizeof(filters) / sizeof(*filters); ++f) {
+        Completion_Engine_Context engine_context = {};
+        engine_context.init();
+        CZ_DEFER(engine_context.drop());
+        Completion_Filter_Context context = {};
+        CZ_DEFER(context.drop());
+
+        // Stream the results in while the query changes.
+        size_t streamed = 0;
+        for (size_t q = 0; q < sizeof(queries) / sizeof(*queries); ++q) {
+            engine_context.query.len = 0;
+            engine_context.query.reserve(cz::heap_allocator(), strlen(queries[q]));
+            engine_context.query.append(queries[q]);
+
+            // Append results before the filter finished checking the old ones.
+            filters[f](/*editor=*/nullptr, &context, &engine_context, {}, false);
+
+            size_t end = cz::min(ends.len, streamed + 1000);
+            engine_context.results.reserve(end - streamed);
+            for (; streamed < end; ++streamed) {
+                size_t start = streamed == 0 ? 0 : ends[streamed - 1];
+                engine_context.results.push(strings.slice(start, ends[streamed]));
+            }
+
+            filter_all(filters[f], &context, &engine_context, {}, false);
+
+            Completion_Filter_Context fresh = {};
+            CZ_DEFER(fresh.drop());
+            filter_all(filters[f], &fresh, &engine_context, {}, false);
+            CHECK(context.results == fresh.results);
+        }
+    }
+}
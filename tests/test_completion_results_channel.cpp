@@ -0,0 +1,115 @@
+#include <czt/test_base.hpp>
+
+#include <thread>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "core/completion_results_channel.hpp"
+
+using namespace mag;
+
+static void push_chunk(Completion_Results_Channel* channel, cz::Slice<const cz::Str> results) {
+    cz::Vector<cz::Str> chunk = {};
+    CZ_DEFER(chunk.drop(cz::heap_allocator()));
+    chunk.reserve(cz::heap_allocator(), results.len);
+    chunk.append(results);
+    REQUIRE(channel->push(&chunk));
+    CHECK(chunk.len == 0);
+}
+
+TEST_CASE("Completion_Results_Channel keeps chunks in order") {
+    Completion_Results_Channel channel;
+    channel.init();
+    CZ_DEFER(channel.drop());
+
+    cz::Heap_Vector<cz::Str> results = {};
+    CZ_DEFER(results.drop());
+    CHECK_FALSE(channel.pop_all(&results));
+
+    cz::Str first[] = {"a", "b"};
+    cz::Str second[] = {"c"};
+    push_chunk(&channel, {first, 2});
+    push_chunk(&channel, {second, 1});
+    CHECK(channel.pop_all(&results));
+    REQUIRE(results.len == 3);
+    CHECK(results[0] == "a");
+    CHECK(results[1] == "b");
+    CHECK(results[2] == "c");
+
+    CHECK_FALSE(channel.finished());
+    channel.close();
+    CHECK(channel.finished());
+}
+
+TEST_CASE("Completion_Results_Channel full") {
+    Completion_Results_Channel channel;
+    channel.init();
+    CZ_DEFER(channel.drop());
+
+    cz::Str result = "x";
+    for (size_t i = 0; i < Completion_Results_Channel::CAPACITY; ++i) {
+        push_chunk(&channel, {&result, 1});
+    }
+
+    // The chunk is kept so it can be pushed once there is room.
+    cz::Vector<cz::Str> chunk = {};
+    CZ_DEFER(chunk.drop(cz::heap_allocator()));
+    chunk.reserve(cz::heap_allocator(), 1);
+    chunk.push(result);
+    CHECK_FALSE(channel.push(&chunk));
+    CHECK(chunk.len == 1);
+
+    // The channel isn't finished until every chunk is taken.
+    channel.close();
+    CHECK_FALSE(channel.finished());
+
+    cz::Heap_Vector<cz::Str> results = {};
+    CZ_DEFER(results.drop());
+    CHECK(channel.pop_all(&results));
+    CHECK(results.len == Completion_Results_Channel::CAPACITY);
+    CHECK(channel.finished());
+}
+
+TEST_CASE("Completion_Results_Channel streams between threads") {
+    Completion_Results_Channel channel;
+    channel.init();
+    CZ_DEFER(channel.drop());
+
+    const char* strings[] = {"0", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
+    const size_t count = 100000;
+
+    std::thread producer([&]() {
+        cz::Vector<cz::Str> chunk = {};
+        CZ_DEFER(chunk.drop(cz::heap_allocator()));
+        for (size_t i = 0; i < count; ++i) {
+            chunk.reserve(cz::heap_allocator(), 1);
+            chunk.push(strings[i % 10]);
+            if (chunk.len >= 100) {
+                while (!channel.push(&chunk)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+        while (chunk.len > 0 && !channel.push(&chunk)) {
+            std::this_thread::yield();
+        }
+        channel.close();
+    });
+
+    cz::Heap_Vector<cz::Str> results = {};
+    CZ_DEFER(results.drop());
+    while (1) {
+        channel.pop_all(&results);
+        if (channel.finished()) {
+            break;
+        }
+        std::this_thread::yield();
+    }
+    producer.join();
+
+    REQUIRE(results.len == count);
+    for (size_t i = 0; i < count; ++i) {
+        if (results[i].buffer != strings[i % 10]) {
+            FAIL("Results are out of order");
+        }
+    }
+}
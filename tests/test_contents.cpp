@@ -0,0 +1,164 @@
+#include <czt/test_base.hpp>
+
+#include <stdlib.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "core/contents.hpp"
+#include "core/movement.hpp"
+
+using namespace mag;
+
+/// Check that the indexed lookups agree with walking the buckets.
+static void check_index(const Contents& contents) {
+    uint64_t position = 0;
+    uint64_t line = 1;
+    for (size_t bucket = 0; bucket < contents.buckets.len; ++bucket) {
+        for (size_t index = 0; index < contents.buckets[bucket].len; index += 97) {
+            Contents_Iterator it = contents.iterator_at(position + index);
+            REQUIRE(it.bucket == bucket);
+            REQUIRE(it.index == index);
+        }
+
+        uint64_t lines = 0;
+        for (size_t index = 0; index < contents.buckets[bucket].len; ++index) {
+            if (contents.buckets[bucket][index] == '\n') {
+                ++lines;
+                Contents_Iterator start = start_of_line_position(contents, line + lines);
+                REQUIRE(start.position == position + index + 1);
+            }
+        }
+        REQUIRE(contents.bucket_line_feeds(bucket) == lines);
+        REQUIRE(contents.get_line_number(position) == line);
+
+        position += contents.buckets[bucket].len;
+        line += lines;
+    }
+
+    REQUIRE(position == contents.len);
+    Contents_Iterator end = contents.iterator_at(contents.len);
+    CHECK(end.bucket == contents.buckets.len);
+    CHECK(end.index == 0);
+    CHECK(contents.get_line_number(contents.len) == line);
+}
+
+TEST_CASE("Contents index stays consistent") {
+    Contents contents = {};
+    CZ_DEFER(contents.drop());
+
+    cz::String string = {};
+    CZ_DEFER(string.drop(cz::heap_allocator()));
+    string.reserve_exact(cz::heap_allocator(), 64 * 1024);
+    for (size_t i = 0; i < 64 * 1024; ++i) {
+        string.push(i % 37 == 0 ? '\n' : (char)('a' + i % 26));
+    }
+
+    SECTION("append") {
+        for (size_t i = 0; i < 8; ++i) {
+            contents.append(string);
+            check_index(contents);
+        }
+    }
+
+    SECTION("insert and remove") {
+        srand(1234);
+        contents.append(string);
+        for (size_t i = 0; i < 100; ++i) {
+            uint64_t position = rand() % (contents.len + 1);
+            size_t len = rand() % (i % 5 == 0 ? string.len : 100);
+            contents.insert(position, {string.buffer, len});
+            check_index(contents);
+
+            position = rand() % (contents.len + 1);
+            len = rand() % (contents.len - position + 1);
+            contents.remove(position, len);
+            check_index(contents);
+        }
+    }
+
+    SECTION("splice") {
+        srand(5678);
+        contents.append(string);
+
+        Contents expected = {};
+        CZ_DEFER(expected.drop());
+        expected.append(string);
+
+        cz::Vector<Contents_Splice> splices = {};
+        CZ_DEFER(splices.drop(cz::heap_allocator()));
+        for (size_t i = 0; i < 50; ++i) {
+            splices.len = 0;
+            uint64_t position = 0;
+            while (1) {
+                position += rand() % (i % 5 == 0 ? 20000 : 500);
+                if (position > contents.len) {
+                    break;
+                }
+
+                Contents_Splice splice = {};
+                splice.position = position;
+                if (rand() % 2 == 0) {
+                    splice.remove = cz::min((uint64_t)(rand() % 6000), contents.len - position);
+                }
+                if (rand() % 2 == 0) {
+                    size_t len = rand() % (i % 7 == 0 ? 10000 : 50);
+                    splice.insert = {string.buffer + rand() % (string.len - len), len};
+                }
+                position += splice.remove;
+
+                splices.reserve(cz::heap_allocator(), 1);
+                splices.push(splice);
+            }
+
+            contents.splice(splices);
+            check_index(contents);
+
+            // Apply from the back so the positions stay valid.
+            for (size_t s = splices.len; s-- > 0;) {
+                expected.remove(splices[s].position, splices[s].remove);
+                expected.insert(splices[s].position, splices[s].insert);
+            }
+
+            cz::String actual_string = contents.stringify(cz::heap_allocator());
+            CZ_DEFER(actual_string.drop(cz::heap_allocator()));
+            cz::String expected_string = expected.stringify(cz::heap_allocator());
+            CZ_DEFER(expected_string.drop(cz::heap_allocator()));
+            REQUIRE(actual_string == expected_string);
+        }
+    }
+}
+
+TEST_CASE("Contents insert keeps the text after the insertion point") {
+    cz::String string = {};
+    CZ_DEFER(string.drop(cz::heap_allocator()));
+    string.reserve_exact(cz::heap_allocator(), 16 * 1024);
+    for (size_t i = 0; i < 16 * 1024; ++i) {
+        string.push(i % 37 == 0 ? '\n' : (char)('a' + i % 26));
+    }
+
+    const size_t offsets[] = {0, 649, 2000, 4095};
+    const size_t lengths[] = {1, 100, 2328, 3000, 5000, 8000};
+    for (size_t o = 0; o < sizeof(offsets) / sizeof(*offsets); ++o) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(*lengths); ++l) {
+            INFO("offset: " << offsets[o] << ", length: " << lengths[l]);
+
+            // Insert into the middle of a full bucket.
+            Contents contents = {};
+            CZ_DEFER(contents.drop());
+            contents.append({string.buffer, 8192});
+            cz::Str insertion = {string.buffer + 8192, lengths[l]};
+            contents.insert(offsets[o], insertion);
+            check_index(contents);
+
+            cz::String expected = {};
+            CZ_DEFER(expected.drop(cz::heap_allocator()));
+            expected.reserve_exact(cz::heap_allocator(), 8192 + insertion.len);
+            expected.append({string.buffer, offsets[o]});
+            expected.append(insertion);
+            expected.append({string.buffer + offsets[o], 8192 - offsets[o]});
+
+            cz::String actual = contents.stringify(cz::heap_allocator());
+            CZ_DEFER(actual.drop(cz::heap_allocator()));
+            REQUIRE(actual == expected);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#include <czt/test_base.hpp>
+
+#ifndef _WIN32
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cz/defer.hpp>
+#include <cz/file.hpp>
+#include <cz/heap.hpp>
+#include "core/diff.hpp"
+#include "core/file.hpp"
+#include "test_runner.hpp"
+
+using namespace mag;
+
+/// Create a temporary file containing `contents`.  Returns the file descriptor or `-1`.
+static int create_temp_file(char* path, cz::Str contents) {
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        return -1;
+    }
+    if (write(fd, contents.buffer, contents.len) != (ssize_t)contents.len) {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+TEST_CASE("reload_file replaces a mapped buffer rewritten in place") {
+    Test_Runner tr;
+
+    char path[] = "/tmp/mag_test_XXXXXX";
+    int fd = create_temp_file(path, "old line\nold line\nold line\n");
+    REQUIRE(fd >= 0);
+    CZ_DEFER({
+        close(fd);
+        unlink(path);
+    });
+
+    WITH_SELECTED_BUFFER(&tr.client);
+    buffer->type = Buffer::FILE;
+    buffer->directory.len = 0;
+    buffer->directory.reserve(cz::heap_allocator(), 5);
+    buffer->directory.append("/tmp/");
+    buffer->name.len = 0;
+    buffer->name.reserve(cz::heap_allocator(), strlen(path) - 5);
+    buffer->name.append(path + 5);
+
+    {
+        cz::Input_File file;
+        REQUIRE(file.open(path));
+        CZ_DEFER(file.close());
+        cz::Slice<char> mapping;
+        REQUIRE(map_file(file, 1, &mapping));
+        buffer->contents.set_mapping(mapping);
+        buffer->contents.append_mapped({mapping.elems, mapping.len});
+    }
+
+    // Rewrite the start of the file in place and cut off the end.
+    REQUIRE(pwrite(fd, "new", 3, 0) == 3);
+    REQUIRE(ftruncate(fd, 18) == 0);
+
+    CHECK(reload_file(buffer) == nullptr);
+    CHECK(buffer->contents.mapping.len == 0);
+
+    cz::String contents = buffer->contents.stringify(cz::heap_allocator());
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    CHECK(contents == "new line\nold line\n");
+}
+
+#endif
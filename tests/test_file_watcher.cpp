@@ -0,0 +1,274 @@
+#include <czt/test_base.hpp>
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <cz/defer.hpp>
+#include <cz/file.hpp>
+#include <cz/format.hpp>
+#include <cz/heap.hpp>
+#include "core/file.hpp"
+#include "core/file_watcher.hpp"
+#include "custom/config.hpp"
+#include "test_runner.hpp"
+
+using namespace mag;
+
+static bool write_file(const char* path, cz::Str contents) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    CZ_DEFER(close(fd));
+    return write(fd, contents.buffer, contents.len) == (ssize_t)contents.len;
+}
+
+/// Open a buffer for the file `name` in `directory` containing `contents`.
+static cz::Arc<Buffer_Handle> open_buffer(Editor* editor,
+                                          cz::Str directory,
+                                          cz::Str name,
+                                          cz::Str contents) {
+    Buffer new_buffer = {};
+    new_buffer.type = Buffer::FILE;
+    new_buffer.directory = directory.clone_null_terminate(cz::heap_allocator());
+    new_buffer.name = name.clone(cz::heap_allocator());
+    new_buffer.contents.append(contents);
+    cz::Arc<Buffer_Handle> handle = editor->create_buffer(new_buffer);
+
+    // Make the file always look newer than the buffer.
+    WITH_BUFFER_HANDLE(handle);
+    buffer->has_file_time = true;
+    buffer->file_time = {};
+    return handle;
+}
+
+/// Run jobs until there are no more or a few seconds pass.
+static void run_jobs(Test_Runner* tr) {
+    for (int i = 0; i < 500; ++i) {
+        bool has_jobs = tr->server.slurp_jobs();
+        has_jobs |= tr->server.run_synchronous_jobs(&tr->client);
+        if (!has_jobs && tr->server.editor.synchronous_jobs.len == 0) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+/// Poll the watcher until a reload is queued or a few seconds pass.
+static void poll_until_reload_queued(Editor* editor) {
+    for (int i = 0; i < 500 && editor->pending_jobs.len == 0; ++i) {
+        editor->file_watcher.poll(editor);
+        if (editor->pending_jobs.len == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+}
+
+static cz::String stringify(const cz::Arc<Buffer_Handle>& handle) {
+    WITH_CONST_BUFFER_HANDLE(handle);
+    return buffer->contents.stringify(cz::heap_allocator());
+}
+
+/// Check the line counts of the buckets and the indexes over them against the text.
+static void check_line_counts(const Contents& contents) {
+    uint64_t lines = 0;
+    for (size_t i = 0; i < contents.buckets.len; ++i) {
+        INFO("bucket: " << i);
+        cz::Str bucket = {contents.buckets[i].elems, contents.buckets[i].len};
+        CHECK(contents.bucket_line_feeds(i) == bucket.count('\n'));
+        lines += bucket.count('\n');
+    }
+    CHECK(contents.get_line_number(contents.len) == lines + 1);
+}
+
+TEST_CASE("File_Watcher tracks buffers by directory") {
+    Test_Runner tr;
+    Editor* editor = &tr.server.editor;
+    File_Watcher* watcher = &editor->file_watcher;
+
+    // The test buffer is temporary so it isn't watched.
+    CHECK(watcher->directories.len == 0);
+
+    cz::Arc<Buffer_Handle> a = open_buffer(editor, "/tmp/mag_test_a/", "x.txt", "");
+    cz::Arc<Buffer_Handle> b = open_buffer(editor, "/tmp/mag_test_b/", "y.txt", "");
+    cz::Arc<Buffer_Handle> c = open_buffer(editor, "/tmp/mag_test_a/", "w.txt", "");
+    REQUIRE(watcher->directories.len == 2);
+    CHECK(watcher->directories[0].path == "/tmp/mag_test_a/");
+    CHECK(watcher->directories[1].path == "/tmp/mag_test_b/");
+    REQUIRE(watcher->directories[0].files.len == 2);
+    CHECK(watcher->directories[0].files[0].name == "w.txt");
+    CHECK(watcher->directories[0].files[1].name == "x.txt");
+
+    {
+        WITH_BUFFER_HANDLE(c);
+        buffer->directory.len = 0;
+        buffer->directory.reserve(cz::heap_allocator(), 17);
+        buffer->directory.append("/tmp/mag_test_b/");
+        buffer->directory.null_terminate();
+        watcher->rename_buffer(buffer, c);
+    }
+    REQUIRE(watcher->directories.len == 2);
+    CHECK(watcher->directories[0].files.len == 1);
+    CHECK(watcher->directories[1].files.len == 2);
+
+    // Directories are no longer watched once all their buffers are killed.
+    editor->kill(a.get());
+    REQUIRE(watcher->directories.len == 1);
+    CHECK(watcher->directories[0].path == "/tmp/mag_test_b/");
+    editor->kill(b.get());
+    editor->kill(c.get());
+    CHECK(watcher->directories.len == 0);
+}
+
+TEST_CASE("File_Watcher reloads buffers changed on disk") {
+    Test_Runner tr;
+    Editor* editor = &tr.server.editor;
+
+    char temp[] = "/tmp/mag_test_XXXXXX";
+    REQUIRE(mkdtemp(temp));
+    CZ_DEFER(rmdir(temp));
+    cz::Heap_String directory = cz::format(temp, "/");
+    CZ_DEFER(directory.drop());
+    cz::Heap_String path = cz::format(directory, "file.txt");
+    CZ_DEFER(path.drop());
+    REQUIRE(write_file(path.buffer, "a\nb\nc\n"));
+    CZ_DEFER(unlink(path.buffer));
+
+    cz::Arc<Buffer_Handle> handle = open_buffer(editor, directory, "file.txt", "a\nb\nc\n");
+    run_jobs(&tr);
+    REQUIRE(editor->pending_jobs.len == 0);
+
+    REQUIRE(write_file(path.buffer, "a\nB\nc\nd\n"));
+    poll_until_reload_queued(editor);
+    REQUIRE(editor->pending_jobs.len == 1);
+    run_jobs(&tr);
+
+    cz::String contents = stringify(handle);
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    CHECK(contents == "a\nB\nc\nd\n");
+}
+
+TEST_CASE("File_Watcher unmaps buffers whose files are rewritten in place") {
+    Test_Runner tr;
+    Editor* editor = &tr.server.editor;
+
+    char temp[] = "/tmp/mag_test_XXXXXX";
+    REQUIRE(mkdtemp(temp));
+    CZ_DEFER(rmdir(temp));
+    cz::Heap_String directory = cz::format(temp, "/");
+    CZ_DEFER(directory.drop());
+    cz::Heap_String path = cz::format(directory, "file.txt");
+    CZ_DEFER(path.drop());
+    REQUIRE(write_file(path.buffer, "aaaaaaaa\nbbbbbbbb\n"));
+    CZ_DEFER(unlink(path.buffer));
+
+    Buffer new_buffer = {};
+    new_buffer.type = Buffer::FILE;
+    new_buffer.directory = directory.clone_null_terminate(cz::heap_allocator());
+    new_buffer.name = cz::Str("file.txt").clone(cz::heap_allocator());
+    {
+        cz::Input_File file;
+        REQUIRE(file.open(path.buffer));
+        CZ_DEFER(file.close());
+        cz::Slice<char> mapping;
+        REQUIRE(map_file(file, 1, &mapping));
+        new_buffer.contents.set_mapping(mapping);
+        new_buffer.contents.append_mapped({mapping.elems, mapping.len});
+    }
+    cz::Arc<Buffer_Handle> handle = editor->create_buffer(new_buffer);
+    {
+        // Make the file always look newer than the buffer.
+        WITH_BUFFER_HANDLE(handle);
+        buffer->has_file_time = true;
+        buffer->file_time = {};
+    }
+    run_jobs(&tr);
+
+    // Rewrite the file without replacing it so the mapping sees the new bytes.
+    int fd = open(path.buffer, O_WRONLY);
+    REQUIRE(fd >= 0);
+    CZ_DEFER(close(fd));
+    REQUIRE(pwrite(fd, "a\nb\nc\nd\n", 8, 0) == 8);
+    REQUIRE(ftruncate(fd, 8) == 0);
+
+    // The buffer is copied out of the mapping before the reload is queued.
+    for (int i = 0; i < 500; ++i) {
+        editor->file_watcher.poll(editor);
+        WITH_CONST_BUFFER_HANDLE(handle);
+        if (buffer->contents.mapping.len == 0) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    {
+        WITH_CONST_BUFFER_HANDLE(handle);
+        REQUIRE(buffer->contents.mapping.len == 0);
+        CHECK(buffer->contents.len == 18);
+        CHECK(buffer->token_cache.check_points.len == 0);
+        check_line_counts(buffer->contents);
+    }
+
+    poll_until_reload_queued(editor);
+    run_jobs(&tr);
+
+    cz::String contents = stringify(handle);
+    CZ_DEFER(contents.drop(cz::heap_allocator()));
+    CHECK(contents == "a\nb\nc\nd\n");
+    WITH_CONST_BUFFER_HANDLE(handle);
+    check_line_counts(buffer->contents);
+}
+
+TEST_CASE("File_Watcher coalesces changes until files stop changing") {
+    Test_Runner tr;
+    Editor* editor = &tr.server.editor;
+
+    uint64_t old_delay = custom::file_watcher_delay;
+    custom::file_watcher_delay = 300;
+    CZ_DEFER(custom::file_watcher_delay = old_delay);
+
+    char temp[] = "/tmp/mag_test_XXXXXX";
+    REQUIRE(mkdtemp(temp));
+    CZ_DEFER(rmdir(temp));
+    cz::Heap_String directory = cz::format(temp, "/");
+    CZ_DEFER(directory.drop());
+    cz::Heap_String path1 = cz::format(directory, "one.txt");
+    CZ_DEFER(path1.drop());
+    cz::Heap_String path2 = cz::format(directory, "two.txt");
+    CZ_DEFER(path2.drop());
+    REQUIRE(write_file(path1.buffer, "1\n"));
+    CZ_DEFER(unlink(path1.buffer));
+    REQUIRE(write_file(path2.buffer, "2\n"));
+    CZ_DEFER(unlink(path2.buffer));
+
+    cz::Arc<Buffer_Handle> one = open_buffer(editor, directory, "one.txt", "1\n");
+    cz::Arc<Buffer_Handle> two = open_buffer(editor, directory, "two.txt", "2\n");
+    run_jobs(&tr);
+    REQUIRE(editor->pending_jobs.len == 0);
+
+    // A burst of changes including the same file changing repeatedly.
+    REQUIRE(write_file(path1.buffer, "1\n1\n"));
+    REQUIRE(write_file(path2.buffer, "2\n2\n"));
+    REQUIRE(write_file(path1.buffer, "1\n1\n1\n"));
+
+    // Nothing is reloaded until the burst ends.
+    editor->file_watcher.poll(editor);
+    CHECK(editor->pending_jobs.len == 0);
+
+    // Then each buffer is reloaded once.
+    poll_until_reload_queued(editor);
+    CHECK(editor->pending_jobs.len == 2);
+    run_jobs(&tr);
+
+    cz::String contents1 = stringify(one);
+    CZ_DEFER(contents1.drop(cz::heap_allocator()));
+    CHECK(contents1 == "1\n1\n1\n");
+    cz::String contents2 = stringify(two);
+    CZ_DEFER(contents2.drop(cz::heap_allocator()));
+    CHECK(contents2 == "2\n2\n");
+}
+
+#endif
@@ -0,0 +1,148 @@
+#include <czt/test_base.hpp>
+
+#include <stdlib.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "core/contents.hpp"
+#include "core/line_diff.hpp"
+
+using namespace mag;
+
+/// Apply `hunks` to `before` the same way `reload_file` does.
+static void apply_hunks(const Contents& before,
+                        cz::Slice<const Line_Diff_Hunk> hunks,
+                        cz::String* result) {
+    cz::String copy = {};
+    CZ_DEFER(copy.drop(cz::heap_allocator()));
+    before.stringify_into(cz::heap_allocator(), &copy);
+
+    uint64_t position = 0;
+    for (size_t i = 0; i < hunks.len; ++i) {
+        REQUIRE(hunks[i].position >= position);
+        result->reserve(cz::heap_allocator(), hunks[i].position - position + hunks[i].insert.len);
+        result->append(copy.slice(position, hunks[i].position));
+        result->append(hunks[i].insert);
+        position = hunks[i].position + hunks[i].remove_len;
+    }
+    result->reserve(cz::heap_allocator(), copy.len - position);
+    result->append(copy.slice_start(position));
+}
+
+static void check_diff(cz::Str before_string, cz::Str after, size_t expected_hunks) {
+    Contents before = {};
+    CZ_DEFER(before.drop());
+    before.append(before_string);
+
+    cz::Vector<Line_Diff_Hunk> hunks = {};
+    CZ_DEFER(hunks.drop(cz::heap_allocator()));
+    diff_lines(before, after, &hunks);
+    CHECK(hunks.len == expected_hunks);
+
+    cz::String result = {};
+    CZ_DEFER(result.drop(cz::heap_allocator()));
+    apply_hunks(before, hunks, &result);
+    CHECK(result == after);
+}
+
+TEST_CASE("diff_lines identical") {
+    check_diff("", "", 0);
+    check_diff("abc\ndef\n", "abc\ndef\n", 0);
+}
+
+TEST_CASE("diff_lines single changes") {
+    check_diff("a\nb\nc\n", "a\nc\n", 1);
+    check_diff("a\nc\n", "a\nb\nc\n", 1);
+    check_diff("a\nb\nc\n", "a\nB\nc\n", 1);
+    check_diff("a\nb\nc", "a\nb\nc\n", 1);
+    check_diff("", "a\nb\n", 1);
+    check_diff("a\nb\n", "", 1);
+}
+
+TEST_CASE("diff_lines hunk positions") {
+    Contents before = {};
+    CZ_DEFER(before.drop());
+    before.append("one\ntwo\nthree\nfour\nfive\n");
+
+    cz::Vector<Line_Diff_Hunk> hunks = {};
+    CZ_DEFER(hunks.drop(cz::heap_allocator()));
+    diff_lines(before, "one\n2\nthree\nfour\nfive\nsix\n", &hunks);
+
+    REQUIRE(hunks.len == 2);
+    CHECK(hunks[0].position == 4);
+    CHECK(hunks[0].remove_len == 4);
+    CHECK(hunks[0].insert == "2\n");
+    CHECK(hunks[1].position == 24);
+    CHECK(hunks[1].remove_len == 0);
+    CHECK(hunks[1].insert == "six\n");
+}
+
+TEST_CASE("diff_lines moved line") {
+    // Moving a line is one insertion and one removal.
+    check_diff("{\n}\n{\nint unique;\n}\n", "{\nint unique;\n}\n{\n}\n", 2);
+}
+
+TEST_CASE("diff_lines random edits across buckets") {
+    const char* lines[] = {"a\n", "b\n", "}\n", "\n", "int x = 0;\n", "no newline"};
+    const size_t lines_len = sizeof(lines) / sizeof(*lines);
+
+    srand(1);
+    for (int iteration = 0; iteration < 200; ++iteration) {
+        cz::String before_string = {};
+        cz::String after = {};
+        CZ_DEFER(before_string.drop(cz::heap_allocator()));
+        CZ_DEFER(after.drop(cz::heap_allocator()));
+
+        // Make the lines long enough to cross bucket boundaries.
+        size_t count = rand() % 2000;
+        for (size_t i = 0; i < count; ++i) {
+            cz::Str before_line = lines[rand() % (lines_len - 1)];
+            cz::Str after_line = before_line;
+            if (rand() % 50 == 0) {
+                after_line = lines[rand() % lines_len];
+            } else if (rand() % 100 == 0) {
+                after_line = "";
+            }
+            before_string.reserve(cz::heap_allocator(), before_line.len);
+            before_string.append(before_line);
+            after.reserve(cz::heap_allocator(), after_line.len);
+            after.append(after_line);
+        }
+
+        Contents before = {};
+        CZ_DEFER(before.drop());
+        before.append(before_string);
+
+        cz::Vector<Line_Diff_Hunk> hunks = {};
+        CZ_DEFER(hunks.drop(cz::heap_allocator()));
+        diff_lines(before, after, &hunks);
+
+        cz::String result = {};
+        CZ_DEFER(result.drop(cz::heap_allocator()));
+        apply_hunks(before, hunks, &result);
+        REQUIRE(result == after);
+    }
+}
+
+TEST_CASE("diff_lines only common lines that occur too often") {
+    // Every line in common occurs more than 64 times so none can be split on.
+    cz::String before = {};
+    cz::String after = {};
+    CZ_DEFER(before.drop(cz::heap_allocator()));
+    CZ_DEFER(after.drop(cz::heap_allocator()));
+    before.reserve(cz::heap_allocator(), 2 + 200 * 2 + 2);
+    after.reserve(cz::heap_allocator(), 2 + 200 * 2 + 2 + 2);
+    before.append("a\n");
+    after.append("c\n");
+    for (size_t i = 0; i < 200; ++i) {
+        before.append("}\n");
+        after.append("}\n");
+        if (i == 100) {
+            after.append("y\n");
+        }
+    }
+    before.append("b\n");
+    after.append("d\n");
+
+    // Changing the first and last lines and inserting one in the middle.
+    check_diff(before, after, 3);
+}
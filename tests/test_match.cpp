@@ -0,0 +1,124 @@
+#include <czt/test_base.hpp>
+
+#include <stdlib.h>
+#include <cz/char_type.hpp>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "core/contents.hpp"
+#include "core/match.hpp"
+
+using namespace mag;
+
+static bool naive_char_match(char test, char query, Case_Handling case_handling) {
+    if (case_handling == Case_Handling::CASE_SENSITIVE ||
+        (case_handling == Case_Handling::UPPERCASE_STICKY && cz::is_upper(query))) {
+        return test == query;
+    }
+    return cz::to_lower(test) == cz::to_lower(query);
+}
+
+static bool naive_matches(cz::Str string,
+                          uint64_t start,
+                          cz::Str query,
+                          Case_Handling case_handling) {
+    if (start + query.len > string.len) {
+        return false;
+    }
+    for (size_t i = 0; i < query.len; ++i) {
+        if (!naive_char_match(string[start + i], query[i], case_handling)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Returns `string.len` if there is no match.
+static uint64_t naive_find(cz::Str string,
+                           uint64_t start,
+                           cz::Str query,
+                           Case_Handling case_handling) {
+    for (uint64_t position = start; position < string.len; ++position) {
+        if (naive_matches(string, position, query, case_handling)) {
+            return position;
+        }
+    }
+    return string.len;
+}
+
+/// Returns `0` if there is no match.
+static uint64_t naive_rfind(cz::Str string,
+                            uint64_t end,
+                            cz::Str query,
+                            Case_Handling case_handling) {
+    for (uint64_t position = end; position-- > 0;) {
+        if (naive_matches(string, position, query, case_handling)) {
+            return position;
+        }
+    }
+    return 0;
+}
+
+TEST_CASE("find and rfind handle matches straddling buckets") {
+    srand(4321);
+
+    // Build the contents out of many small inserts so the buckets have a variety of sizes.
+    Contents contents = {};
+    CZ_DEFER(contents.drop());
+    const char alphabet[] = "abAB_\n";
+    for (size_t i = 0; i < 400; ++i) {
+        char piece[100];
+        size_t len = rand() % sizeof(piece);
+        for (size_t j = 0; j < len; ++j) {
+            piece[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        contents.insert(rand() % (contents.len + 1), {piece, len});
+    }
+    REQUIRE(contents.buckets.len > 2);
+
+    cz::String string = contents.stringify(cz::heap_allocator());
+    CZ_DEFER(string.drop(cz::heap_allocator()));
+
+    const Case_Handling case_handlings[] = {
+        Case_Handling::CASE_SENSITIVE,
+        Case_Handling::CASE_INSENSITIVE,
+        Case_Handling::UPPERCASE_STICKY,
+    };
+
+    for (size_t i = 0; i < 2000; ++i) {
+        char query_buffer[40];
+        size_t query_len = 1 + rand() % (i % 10 == 0 ? sizeof(query_buffer) : 5);
+        for (size_t j = 0; j < query_len; ++j) {
+            query_buffer[j] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        cz::Str query = {query_buffer, query_len};
+        Case_Handling case_handling = case_handlings[i % 3];
+        uint64_t start = rand() % (contents.len + 1);
+        INFO("i: " << i);
+        INFO("start: " << start);
+
+        Contents_Iterator it = contents.iterator_at(start);
+        bool found = find_cased(&it, query, case_handling);
+        uint64_t expected = naive_find(string, start, query, case_handling);
+        CHECK(found == (expected < string.len));
+        CHECK(it.position == expected);
+
+        // `rfind` only considers matches that fit in the buffer.
+        it = contents.iterator_at(start);
+        found = rfind_cased(&it, query, case_handling);
+        expected = naive_rfind(string, start, query, case_handling);
+        CHECK(found == naive_matches(string, expected, query, case_handling));
+        CHECK(it.position == expected);
+
+        it = contents.iterator_at(start);
+        found = find_cased(&it, query[0], case_handling);
+        expected = naive_find(string, start, query.slice_end(1), case_handling);
+        CHECK(found == (expected < string.len));
+        CHECK(it.position == expected);
+
+        it = contents.iterator_at(start);
+        found = rfind_cased(&it, query[0], case_handling);
+        expected = naive_rfind(string, start, query.slice_end(1), case_handling);
+        CHECK(found == naive_matches(string, expected, query.slice_end(1), case_handling));
+        CHECK(it.position == expected);
+    }
+}
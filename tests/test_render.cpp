@@ -0,0 +1,134 @@
+#include <czt/test_base.hpp>
+
+#include <cz/heap.hpp>
+#include "render/render.hpp"
+#include "test_runner.hpp"
+
+using namespace mag;
+
+TEST_CASE("render nested regions reaching before the visible region") {
+    const size_t rows = 8;
+    const size_t cols = 20;
+
+    Test_Runner tr;
+    tr.client.window->total_rows = rows;
+    tr.client.window->total_cols = cols;
+
+    const Face region_face = {{}, 5, 0};
+    tr.server.editor.theme.special_faces[Face_Type::OTHER_REGION] = region_face;
+
+    {
+        WITH_SELECTED_BUFFER(&tr.client);
+        for (size_t i = 0; i < 100; ++i) {
+            tr.append(window, buffer, "abcdefghi\n");
+        }
+
+        // The first region contains every other cursor.  The second region ends before the
+        // visible region and the third is nested on screen.  The selected cursor is on line 50.
+        window->cursors.reserve(cz::heap_allocator(), 4);
+        window->cursors.len = 0;
+        Cursor cursor = {};
+        cursor.point = 0;
+        cursor.mark = 800;
+        window->cursors.push(cursor);
+        cursor.point = 20;
+        cursor.mark = 10;
+        window->cursors.push(cursor);
+        cursor.point = 480;
+        cursor.mark = 470;
+        window->cursors.push(cursor);
+        cursor.point = 505;
+        cursor.mark = 505;
+        window->cursors.push(cursor);
+        window->selected_cursor = 3;
+        window->show_marks = true;
+    }
+
+    render::Cell* cells = cz::heap_allocator().alloc<render::Cell>(rows * cols);
+    CZ_DEFER(cz::heap_allocator().dealloc(cells, rows * cols));
+
+    render::Window_Cache* window_cache = nullptr;
+    CZ_DEFER(render::destroy_window_cache(window_cache));
+    render::Window_Cache* mini_buffer_window_cache = nullptr;
+    CZ_DEFER(render::destroy_window_cache(mini_buffer_window_cache));
+
+    bool any_animated_scrolling = true;
+    for (int frame = 0; frame < 100 && any_animated_scrolling; ++frame) {
+        any_animated_scrolling = false;
+        render::render_to_cells(cells, /*previous_cells=*/nullptr, &window_cache,
+                                &mini_buffer_window_cache, rows, cols, &tr.server.editor,
+                                &tr.client, &any_animated_scrolling);
+    }
+
+    {
+        WITH_CONST_SELECTED_BUFFER(&tr.client);
+        REQUIRE(window->start_position > 20);
+        REQUIRE(window->start_position <= 500);
+    }
+
+    // Every line on screen is inside the first region.  The last two
+    // rows are the mode line and the mini buffer.
+    for (size_t y = 0; y + 2 < rows; ++y) {
+        INFO("y: " << y);
+        CHECK(cells[y * cols].face.background == region_face.background);
+        CHECK(cells[y * cols + 8].face.background == region_face.background);
+    }
+}
+
+TEST_CASE("render stops drawing regions after their marks move") {
+    const size_t rows = 8;
+    const size_t cols = 20;
+
+    Test_Runner tr;
+    tr.client.window->total_rows = rows;
+    tr.client.window->total_cols = cols;
+
+    const Face region_face = {{}, 5, 0};
+    tr.server.editor.theme.special_faces[Face_Type::OTHER_REGION] = region_face;
+
+    {
+        WITH_SELECTED_BUFFER(&tr.client);
+        for (size_t i = 0; i < 10; ++i) {
+            tr.append(window, buffer, "abcdefghi\n");
+        }
+
+        window->cursors.reserve(cz::heap_allocator(), 2);
+        window->cursors.len = 0;
+        Cursor cursor = {};
+        cursor.point = 0;
+        cursor.mark = 100;
+        window->cursors.push(cursor);
+        cursor.point = 5;
+        cursor.mark = 5;
+        window->cursors.push(cursor);
+        window->selected_cursor = 1;
+        window->show_marks = true;
+    }
+
+    render::Cell* cells = cz::heap_allocator().alloc<render::Cell>(rows * cols);
+    CZ_DEFER(cz::heap_allocator().dealloc(cells, rows * cols));
+
+    render::Window_Cache* window_cache = nullptr;
+    CZ_DEFER(render::destroy_window_cache(window_cache));
+    render::Window_Cache* mini_buffer_window_cache = nullptr;
+    CZ_DEFER(render::destroy_window_cache(mini_buffer_window_cache));
+
+    bool any_animated_scrolling = false;
+    render::render_to_cells(cells, /*previous_cells=*/nullptr, &window_cache,
+                            &mini_buffer_window_cache, rows, cols, &tr.server.editor, &tr.client,
+                            &any_animated_scrolling);
+    CHECK(cells[2 * cols].face.background == region_face.background);
+
+    // Moving a mark keeps the number of cursors and doesn't edit the buffer.
+    {
+        WITH_SELECTED_BUFFER(&tr.client);
+        window->cursors[0].mark = 0;
+    }
+    render::render_to_cells(cells, /*previous_cells=*/nullptr, &window_cache,
+                            &mini_buffer_window_cache, rows, cols, &tr.server.editor, &tr.client,
+                            &any_animated_scrolling);
+    for (size_t y = 0; y + 2 < rows; ++y) {
+        INFO("y: " << y);
+        CHECK(cells[y * cols].face.background != region_face.background);
+    }
+}
@@ -0,0 +1,54 @@
+#include <czt/test_base.hpp>
+
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "prose/search_engine.hpp"
+
+using namespace mag;
+using namespace mag::prose;
+
+TEST_CASE("search_text reports each matching line once") {
+    cz::String output = {};
+    CZ_DEFER(output.drop(cz::heap_allocator()));
+
+    search_text("dir/file.txt", "abc\nxx abc abc\n\nnone\nabc", "abc", false, &output);
+    CHECK(output ==
+          "dir/file.txt:1:1:abc\n"
+          "dir/file.txt:2:4:xx abc abc\n"
+          "dir/file.txt:5:1:abc\n");
+}
+
+TEST_CASE("search_text no matches") {
+    cz::String output = {};
+    CZ_DEFER(output.drop(cz::heap_allocator()));
+
+    search_text("file", "abc\ndef\n", "abd", false, &output);
+    CHECK(output == "");
+}
+
+TEST_CASE("search_text query_word requires word boundaries") {
+    cz::String output = {};
+    CZ_DEFER(output.drop(cz::heap_allocator()));
+
+    search_text("file", "xabc\nabc_\nx abc\nabc", "abc", true, &output);
+    CHECK(output ==
+          "file:3:3:x abc\n"
+          "file:4:1:abc\n");
+}
+
+TEST_CASE("search_text query_word skips earlier non word matches on the same line") {
+    cz::String output = {};
+    CZ_DEFER(output.drop(cz::heap_allocator()));
+
+    search_text("file", "abcd abc", "abc", true, &output);
+    CHECK(output == "file:1:6:abcd abc\n");
+}
+
+TEST_CASE("search_text query_word with punctuation at the edges") {
+    cz::String output = {};
+    CZ_DEFER(output.drop(cz::heap_allocator()));
+
+    // Like `\b(x` the character before `(` must be a word character.
+    search_text("file", " (x\na(x", "(x", true, &output);
+    CHECK(output == "file:2:2:a(x\n");
+}
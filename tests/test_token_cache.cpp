@@ -1,4 +1,7 @@
+#include <stdlib.h>
 #include "core/token_iterator.hpp"
+#include "core/transaction.hpp"
+#include "custom/config.hpp"
 #include "syntax/tokenize_cplusplus.hpp"
 #include "test_runner.hpp"
 
@@ -27,3 +30,144 @@ TEST_CASE("Token_Cache find_check_point") {
         CHECK(token_cache.find_check_point(i).position == last_position);
     }
 }
+
+/// Every character is a token and the state tracks whether we are in a string.
+/// There is no look ahead so check points must be exactly reproducible.
+static bool quote_next_token(Contents_Iterator* iterator, Token* token, uint64_t* state) {
+    if (iterator->at_eob()) {
+        return false;
+    }
+    token->start = iterator->position;
+    if (iterator->get() == '"') {
+        *state = !*state;
+    }
+    token->type = (*state ? Token_Type::STRING : Token_Type::DEFAULT);
+    iterator->advance();
+    token->end = iterator->position;
+    return true;
+}
+
+/// Check that re-tokenizing between check points reproduces them.
+static void check_check_points(const Buffer* buffer) {
+    const Token_Cache& token_cache = buffer->token_cache;
+    REQUIRE(token_cache.change_index == buffer->changes.len);
+
+    Contents_Iterator iterator = buffer->contents.start();
+    uint64_t state = 0;
+    for (size_t i = 0; i < token_cache.check_points.len; ++i) {
+        INFO(i);
+        Token token;
+        while (iterator.position < token_cache.check_points[i].position) {
+            REQUIRE(buffer->mode.next_token(&iterator, &token, &state));
+        }
+        CHECK(iterator.position == token_cache.check_points[i].position);
+        CHECK(state == token_cache.check_points[i].state);
+    }
+}
+
+TEST_CASE("Token_Cache update with multi cursor edits") {
+    Test_Runner tr;
+    tr.set_tokenizer(quote_next_token);
+
+    cz::Heap_String body = {};
+    CZ_DEFER(body.drop());
+    for (size_t i = 0; i < 64 * 1024; ++i) {
+        body.reserve(1);
+        body.push(i % 97 == 0 ? '"' : (char)('a' + i % 26));
+    }
+    tr.setup(body);
+
+    WITH_SELECTED_BUFFER(&tr.client);
+    buffer->token_cache.generate_check_points_until(buffer, buffer->contents.len);
+    check_check_points(buffer);
+
+    srand(4321);
+    for (size_t round = 0; round < 50; ++round) {
+        Transaction transaction;
+        transaction.init(buffer);
+        CZ_DEFER(transaction.drop());
+
+        // Positions are relative to the contents after the previous edits in the commit.
+        uint64_t position = 0;
+        uint64_t offset = 0;
+        while (1) {
+            position += rand() % 4096;
+            if (position >= buffer->contents.len) {
+                break;
+            }
+
+            Edit edit;
+            edit.position = position + offset;
+            if (rand() % 2 == 0) {
+                edit.value = SSOStr::from_constant(rand() % 3 == 0 ? "\"" : "xy");
+                edit.flags = (rand() % 2 == 0 ? Edit::INSERT : Edit::INSERT_AFTER_POSITION);
+                offset += edit.value.len();
+            } else {
+                uint64_t end = cz::min(position + 1 + rand() % 2048, buffer->contents.len);
+                edit.value = buffer->contents.slice(transaction.value_allocator(),
+                                                    buffer->contents.iterator_at(position), end);
+                edit.flags = Edit::REMOVE;
+                offset -= end - position;
+                position = end;
+            }
+            transaction.push(edit);
+        }
+
+        REQUIRE(transaction.commit(&tr.client));
+        check_check_points(buffer);
+
+        if (round % 5 == 4) {
+            buffer->undo();
+            buffer->token_cache.update(buffer);
+            check_check_points(buffer);
+        }
+
+        // Update drops check points it can't cheaply fix so fill them back in.
+        buffer->token_cache.generate_check_points_until(buffer, buffer->contents.len);
+        check_check_points(buffer);
+    }
+}
+
+TEST_CASE("Token_Cache next_check_points_parallel matches sequential tokenization") {
+    size_t old_threads = custom::syntax_highlight_threads;
+    custom::syntax_highlight_threads = 4;
+    CZ_DEFER(custom::syntax_highlight_threads = old_threads);
+
+    Test_Runner tr;
+    tr.set_tokenizer(quote_next_token);
+
+    // Chunks start after blank lines.  Strings span blank lines so
+    // some chunks guess the wrong state and never converge.
+    cz::Heap_String body = {};
+    CZ_DEFER(body.drop());
+    for (size_t i = 0; i < 1536 * 1024; ++i) {
+        char c = (char)('a' + i % 26);
+        if (i % 4099 == 0) {
+            c = '"';
+        } else if (i % 997 < 2) {
+            c = '\n';
+        }
+        body.reserve(1);
+        body.push(c);
+    }
+    tr.setup(body);
+
+    WITH_SELECTED_BUFFER(&tr.client);
+
+    Token_Cache sequential = {};
+    CZ_DEFER(sequential.drop());
+    sequential.reset(buffer);
+    sequential.generate_check_points_until(buffer, buffer->contents.len);
+
+    buffer->token_cache.reset(buffer);
+    Contents_Iterator iterator = buffer->contents.start();
+    uint64_t state = 0;
+    while (buffer->token_cache.next_check_points_parallel(buffer, &iterator, &state)) {
+    }
+
+    // Every check point must be reproduced by tokenizing from the start.
+    check_check_points(buffer);
+    CHECK(buffer->token_cache.ran_to_end == sequential.ran_to_end);
+    CHECK(buffer->token_cache.is_covered(buffer->contents.len));
+    CHECK(sequential.is_covered(buffer->contents.len));
+}
@@ -0,0 +1,82 @@
+#include <czt/test_base.hpp>
+
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "core/token_iterator.hpp"
+#include "syntax/tokenize_cplusplus.hpp"
+#include "test_runner.hpp"
+
+using namespace mag;
+
+/// Check that iterating the tokens matches running the tokenizer from the start.
+static void check_tokens_match(const Buffer* buffer) {
+    Contents_Iterator iterator = buffer->contents.start();
+    uint64_t state = 0;
+    Forward_Token_Iterator forward;
+    forward.init_at_or_after(buffer, 0);
+
+    size_t count = 0;
+    Token token;
+    while (buffer->mode.next_token(&iterator, &token, &state)) {
+        INFO(count);
+        REQUIRE(forward.has_token());
+        CHECK(forward.token().start == token.start);
+        CHECK(forward.token().end == token.end);
+        CHECK(forward.token().type == token.type);
+        CHECK(forward.tokenization_iterator.position == iterator.position);
+        forward.next();
+        ++count;
+    }
+    CHECK_FALSE(forward.has_token());
+
+    Backward_Token_Iterator backward = {};
+    CZ_DEFER(backward.drop(cz::heap_allocator()));
+    REQUIRE(backward.init_at_or_before(cz::heap_allocator(), buffer, buffer->contents.len));
+    size_t backward_count = 1;
+    while (backward.previous(cz::heap_allocator())) {
+        ++backward_count;
+    }
+    CHECK(backward_count == count);
+}
+
+TEST_CASE("Token_Index matches the tokenizer") {
+    Test_Runner tr;
+    tr.set_tokenizer(syntax::cpp_next_token);
+
+    cz::Heap_String body = {};
+    CZ_DEFER(body.drop());
+    for (size_t i = 0; i < 500; ++i) {
+        cz::append(&body, "int f", i, "(int x) {\n    return x * ", i, "; /* comment */\n}\n");
+        if (i % 50 == 0) {
+            cz::append(&body, "const char* s = \"string ", i, "\";\n");
+        }
+    }
+    tr.setup(body);
+
+    WITH_SELECTED_BUFFER(&tr.client);
+    buffer->token_cache.generate_check_points_until(buffer, buffer->contents.len);
+    REQUIRE(buffer->token_cache.ran_to_end);
+
+    SECTION("partially indexed") {
+        uint64_t middle = buffer->contents.len / 2;
+        CHECK_FALSE(buffer->token_index.is_indexed(buffer, middle, middle + 2048));
+        buffer->token_index.index_region(buffer, middle, middle + 2048);
+        CHECK(buffer->token_index.is_indexed(buffer, middle, middle + 2048));
+        CHECK(buffer->token_index.blocks.len > 0);
+        check_tokens_match(buffer);
+    }
+
+    SECTION("fully indexed") {
+        buffer->token_index.index_region(buffer, 0, buffer->contents.len);
+        CHECK(buffer->token_index.is_indexed(buffer, 0, buffer->contents.len));
+        check_tokens_match(buffer);
+    }
+
+    SECTION("dropped after edits") {
+        buffer->token_index.index_region(buffer, 0, buffer->contents.len);
+        tr.append(window, buffer, "/*");
+        CHECK_FALSE(buffer->token_index.is_valid(buffer));
+        CHECK(buffer->token_index.find(buffer, 0) == nullptr);
+        check_tokens_match(buffer);
+    }
+}
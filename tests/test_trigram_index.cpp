@@ -0,0 +1,157 @@
+#include <czt/test_base.hpp>
+
+#include <string.h>
+#include <cz/defer.hpp>
+#include <cz/heap.hpp>
+#include "prose/trigram_index.hpp"
+
+using namespace mag;
+using namespace mag::prose;
+
+static cz::File_Time file_time_from(uint8_t value) {
+    cz::File_Time file_time;
+    memset(&file_time, value, sizeof(file_time));
+    return file_time;
+}
+
+static void candidate_paths(const Trigram_Index& index, cz::Str query, cz::String* paths) {
+    cz::Vector<uint32_t> ids = {};
+    CZ_DEFER(ids.drop(cz::heap_allocator()));
+    REQUIRE(index.find_candidates(query, &ids));
+
+    paths->len = 0;
+    for (size_t i = 0; i < ids.len; ++i) {
+        paths->reserve(cz::heap_allocator(), index.files[ids[i]].path.len + 1);
+        paths->append(index.files[ids[i]].path);
+        paths->push(' ');
+    }
+}
+
+TEST_CASE("Trigram_Index finds files containing every trigram") {
+    Trigram_Index_Builder builder;
+    builder.init(nullptr);
+    CZ_DEFER(builder.drop());
+    builder.add_file("c.txt", file_time_from(1), "hello world");
+    builder.add_file("a.txt", file_time_from(1), "say hello");
+    builder.add_file("b.txt", file_time_from(1), "abcd bcde");
+
+    Trigram_Index index;
+    index.init();
+    CZ_DEFER(index.drop());
+    builder.finish(&index);
+
+    REQUIRE(index.files.len == 3);
+    CHECK(index.files[0].path == "a.txt");
+    CHECK(index.files[2].path == "c.txt");
+
+    cz::String paths = {};
+    CZ_DEFER(paths.drop(cz::heap_allocator()));
+
+    candidate_paths(index, "hello", &paths);
+    CHECK(paths == "a.txt c.txt ");
+
+    // `b.txt` has every trigram of the query but not the query itself.
+    candidate_paths(index, "abcde", &paths);
+    CHECK(paths == "b.txt ");
+
+    candidate_paths(index, "xyz", &paths);
+    CHECK(paths == "");
+
+    cz::Vector<uint32_t> ids = {};
+    CZ_DEFER(ids.drop(cz::heap_allocator()));
+    CHECK_FALSE(index.find_candidates("he", &ids));
+}
+
+TEST_CASE("Trigram_Index_Builder reuses unchanged files") {
+    Trigram_Index old;
+    old.init();
+    CZ_DEFER(old.drop());
+    {
+        Trigram_Index_Builder builder;
+        builder.init(nullptr);
+        CZ_DEFER(builder.drop());
+        builder.add_file("kept", file_time_from(1), "alpha beta");
+        builder.add_file("changed", file_time_from(1), "alpha gamma");
+        builder.add_file("deleted", file_time_from(1), "alpha delta");
+        builder.finish(&old);
+    }
+
+    Trigram_Index index;
+    index.init();
+    CZ_DEFER(index.drop());
+    {
+        Trigram_Index_Builder builder;
+        builder.init(&old);
+        CZ_DEFER(builder.drop());
+
+        size_t id;
+        REQUIRE(old.find_file("kept", &id));
+        builder.add_unchanged_file(id);
+        builder.add_file("changed", file_time_from(2), "beta epsilon");
+        builder.add_file("added", file_time_from(2), "alpha");
+        builder.finish(&index);
+    }
+
+    size_t id;
+    CHECK_FALSE(index.find_file("deleted", &id));
+    REQUIRE(index.find_file("changed", &id));
+    cz::File_Time changed_time = file_time_from(2);
+    CHECK(memcmp(&index.files[id].file_time, &changed_time, sizeof(cz::File_Time)) == 0);
+
+    cz::String paths = {};
+    CZ_DEFER(paths.drop(cz::heap_allocator()));
+
+    candidate_paths(index, "alpha", &paths);
+    CHECK(paths == "added kept ");
+
+    candidate_paths(index, "beta", &paths);
+    CHECK(paths == "changed kept ");
+
+    candidate_paths(index, "gamma", &paths);
+    CHECK(paths == "");
+
+    candidate_paths(index, "delta", &paths);
+    CHECK(paths == "");
+}
+
+TEST_CASE("Trigram_Index serialize and deserialize") {
+    Trigram_Index index;
+    index.init();
+    CZ_DEFER(index.drop());
+    {
+        Trigram_Index_Builder builder;
+        builder.init(nullptr);
+        CZ_DEFER(builder.drop());
+        builder.add_file("src/main.cpp", file_time_from(3), "int main() {}");
+        builder.add_file("README", file_time_from(4), "main readme");
+        builder.finish(&index);
+    }
+
+    cz::String data = {};
+    CZ_DEFER(data.drop(cz::heap_allocator()));
+    index.serialize(&data);
+
+    Trigram_Index loaded;
+    loaded.init();
+    CZ_DEFER(loaded.drop());
+    REQUIRE(loaded.deserialize(data));
+
+    REQUIRE(loaded.files.len == index.files.len);
+    for (size_t i = 0; i < index.files.len; ++i) {
+        CHECK(loaded.files[i].path == index.files[i].path);
+    }
+    CHECK(loaded.trigrams.len == index.trigrams.len);
+    CHECK(loaded.postings.len == index.postings.len);
+
+    cz::String paths = {};
+    CZ_DEFER(paths.drop(cz::heap_allocator()));
+    candidate_paths(loaded, "main", &paths);
+    CHECK(paths == "README src/main.cpp ");
+
+    // Truncated files are rejected.
+    Trigram_Index truncated;
+    truncated.init();
+    CZ_DEFER(truncated.drop());
+    CHECK_FALSE(truncated.deserialize(data.slice_end(data.len - 1)));
+    CHECK(truncated.files.len == 0);
+}
@@ -100,3 +100,11 @@ TEST_CASE("version_control_ignore: /* !/foo /foo/* !/foo/bar") {
     CHECK_FALSE(file_matches(rules, "/foo/bar"));
     CHECK_FALSE(file_matches(rules, "/foo/bar/abc"));
 }
+
+TEST_CASE("version_control_ignore: is_ignore_file") {
+    CHECK(is_ignore_file(".gitignore"));
+    CHECK(is_ignore_file(".ignore"));
+    CHECK(is_ignore_file(".gitmodules"));
+    CHECK_FALSE(is_ignore_file("gitignore"));
+    CHECK_FALSE(is_ignore_file(".gitignore.orig"));
+}